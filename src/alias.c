@@ -0,0 +1,816 @@
+#include "alias.h"
+#include "vars.h"
+#include "dag.h"
+
+/* Body replaced while its function was running, freed by alias_free() */
+typedef struct alias_retired {
+	COMMAND *body;
+	SCRIPT *script;
+	struct alias_retired *next;
+} ALIAS_RETIRED;
+
+/* Hash table of ALIAS pointers */
+static ALIAS **slots = NULL;
+static unsigned int nslots = 0, used = 0;
+
+/* Aliases defined, none means nothing to expand */
+static int naliases = 0;
+
+/* Function calls running */
+static int depth = 0;
+
+/* Changes of aliases and functions */
+static unsigned int generation = 0;
+
+static ALIAS_RETIRED *retired = NULL;
+
+
+/* Function: alias_hash (internal)
+   FNV-1a of the len first bytes of name
+*/
+static unsigned int alias_hash(const char *name, int len)
+{
+	unsigned int h = 2166136261u;
+	int i;
+
+	for (i = 0; i < len; i++)
+	{
+		h = (h ^ (unsigned char) name[i]) * 16777619u;
+	}
+
+	return h;
+}
+
+
+/* Function: alias_grow (internal)
+   Double the table and reinsert the entries
+   Returns 0, -1 on allocation failure
+*/
+static int alias_grow()
+{
+	ALIAS **old = slots;
+	unsigned int oldsize = nslots, i, j;
+
+	nslots = (oldsize == 0) ? ALIAS_SLOTS : 2 * oldsize;
+	slots = calloc(nslots, sizeof (ALIAS*));
+	if (slots == NULL)
+	{
+		slots = old;
+		nslots = oldsize;
+		return -1;
+	}
+	for (i = 0; i < oldsize; i++)
+	{
+		if (old[i] != NULL)
+		{
+			for (j = old[i]->hash & (nslots - 1); slots[j] != NULL; j = (j + 1) & (nslots - 1))
+			{
+			}
+			slots[j] = old[i];
+		}
+	}
+	free(old);
+
+	return 0;
+}
+
+
+/* Function: alias_lookup (internal)
+   Find the entry of name (len bytes), create it if create is TRUE
+   Returns NULL if there is none or on allocation failure
+*/
+static ALIAS *alias_lookup(const char *name, int len, int create)
+{
+	unsigned int h = alias_hash(name, len), i;
+	ALIAS *entry;
+
+	if (nslots != 0)
+	{
+		for (i = h & (nslots - 1); slots[i] != NULL; i = (i + 1) & (nslots - 1))
+		{
+			entry = slots[i];
+			if (entry->hash == h && strncmp(entry->name, name, len) == 0 && entry->name[len] == '\0')
+			{
+				return entry;
+			}
+		}
+	}
+	if (create == FALSE)
+	{
+		return NULL;
+	}
+
+	// keep the load below 70%
+	if ((used + 1) * 10 > nslots * 7)
+	{
+		if (-1 == alias_grow())
+		{
+			return NULL;
+		}
+	}
+	entry = calloc(1, sizeof (ALIAS));
+	if (entry == NULL || (entry->name = strndup(name, len)) == NULL)
+	{
+		free(entry);
+		return NULL;
+	}
+	entry->hash = h;
+	for (i = h & (nslots - 1); slots[i] != NULL; i = (i + 1) & (nslots - 1))
+	{
+	}
+	slots[i] = entry;
+	used++;
+
+	return entry;
+}
+
+
+/* Function: alias_name (internal)
+   Length of the valid alias or function name at the start of s
+*/
+static int alias_name(const char *s)
+{
+	int i = 0;
+
+	while (isalnum(s[i]) || s[i] == '_' || s[i] == '-' || s[i] == '.')
+	{
+		i++;
+	}
+
+	return i;
+}
+
+
+/* Function: alias_set
+   An alias and a function of the same name can coexist
+*/
+int alias_set(const char *name, const char *value)
+{
+	int len = strlen(name);
+	ALIAS *entry;
+	char *copy;
+
+	if (len == 0 || alias_name(name) != len)
+	{
+		return -1;
+	}
+	entry = alias_lookup(name, len, TRUE);
+	if (entry == NULL || (copy = strdup(value)) == NULL)
+	{
+		return -1;
+	}
+	naliases += (entry->value == NULL);
+	free(entry->value);
+	entry->value = copy;
+	generation++;
+
+	return 0;
+}
+
+
+/* Function: alias_get
+   Hash lookup
+*/
+const char *alias_get(const char *name)
+{
+	ALIAS *entry = alias_lookup(name, strlen(name), FALSE);
+
+	return (entry != NULL) ? entry->value : NULL;
+}
+
+
+/* Function: alias_unset
+   The entries stay in the table
+*/
+void alias_unset(const char *name)
+{
+	ALIAS *entry;
+	unsigned int i;
+
+	for (i = 0; i < nslots; i++)
+	{
+		entry = slots[i];
+		if (entry != NULL && entry->value != NULL && (name == NULL || strcmp(entry->name, name) == 0))
+		{
+			free(entry->value);
+			entry->value = NULL;
+			naliases--;
+			generation++;
+		}
+	}
+}
+
+
+/* Function: alias_command
+   alias, alias name ..., alias name=value ...
+*/
+int alias_command(char **argv)
+{
+	char *word, *out;
+	const char *value;
+	int i, ret = 0;
+	unsigned int k;
+
+	if (argv[1] == NULL)
+	{
+		for (k = 0; k < nslots; k++)
+		{
+			if (slots[k] != NULL && slots[k]->value != NULL)
+			{
+				printf("alias %s='%s'\n", slots[k]->name, slots[k]->value);
+			}
+		}
+		return 0;
+	}
+
+	// each word is whole, the parser removed its quotes
+	for (i = 1; argv[i] != NULL; i++)
+	{
+		word = strdup(argv[i]);
+		if (word == NULL)
+		{
+			return 1;
+		}
+		if (word[0] == '\0')
+		{
+			free(word);
+			continue;
+		}
+
+		if ((out = strchr(word, '=')) != NULL)
+		{
+			*out = '\0';
+			if (-1 == alias_set(word, out + 1))
+			{
+#ifdef WARNING
+	printf("-mysh: alias: `%s': invalid alias name\n", word);
+#endif
+				ret = 1;
+			}
+		}
+		else if ((value = alias_get(word)) != NULL)
+		{
+			printf("alias %s='%s'\n", word, value);
+		}
+		else
+		{
+#ifdef WARNING
+	printf("-mysh: alias: %s: not found\n", word);
+#endif
+			ret = 1;
+		}
+		free(word);
+	}
+
+	return ret;
+}
+
+
+/* Function: alias_append (internal)
+   Append len bytes of s to the growing buffer *buf
+   Returns 0, -1 on allocation failure
+*/
+static int alias_append(char **buf, int *len, int *size, const char *s, int n)
+{
+	char *grow;
+
+	if (*len + n + 1 > *size)
+	{
+		*size = 2 * (*len + n + 1);
+		grow = realloc(*buf, *size);
+		if (grow == NULL)
+		{
+			return -1;
+		}
+		*buf = grow;
+	}
+	memcpy(*buf + *len, s, n);
+	*len += n;
+	(*buf)[*len] = '\0';
+
+	return 0;
+}
+
+
+/* Function: alias_word (internal)
+   Append the expansion of the command word (len bytes), the first word of
+   an alias value is expanded in turn
+   Returns TRUE if an alias applied
+*/
+static int alias_word(char **buf, int *len, int *size, const char *word, int n, int nest)
+{
+	ALIAS *entry = alias_lookup(word, n, FALSE);
+	const char *v;
+	int blank, first;
+
+	if (entry == NULL || entry->value == NULL || entry->expanding == TRUE || nest >= ALIAS_NEST)
+	{
+		alias_append(buf, len, size, word, n);
+		return FALSE;
+	}
+
+	entry->expanding = TRUE;
+	v = entry->value;
+	blank = strspn(v, " \t");
+	first = strcspn(v + blank, " \t\n;&|<>()'\"");
+	alias_append(buf, len, size, v, blank);
+	if (first > 0 && v[blank + first] != '\'' && v[blank + first] != '"')
+	{
+		alias_word(buf, len, size, v + blank, first, nest + 1);
+	}
+	else
+	{
+		alias_append(buf, len, size, v + blank, first);
+	}
+	alias_append(buf, len, size, v + blank + first, strlen(v + blank + first));
+	entry->expanding = FALSE;
+
+	return TRUE;
+}
+
+
+/* Function: alias_expand
+   Command words are found outside quotes, after the start of the line or
+   an operator
+*/
+char *alias_expand(const char *line)
+{
+	char *buf = NULL, quote = '\0';
+	int i, n, len = 0, size = 0, command = TRUE, changed = FALSE;
+
+	if (naliases == 0)
+	{
+		return NULL;
+	}
+
+	for (i = 0; line[i] != '\0'; )
+	{
+		if (quote != '\0')
+		{
+			quote = (line[i] == quote) ? '\0' : quote;
+		}
+		else if (command == TRUE && !isspace(line[i]))
+		{
+			command = FALSE;
+			n = strcspn(line + i, " \t\n;&|<>()'\"");
+			if (n > 0 && line[i + n] != '\'' && line[i + n] != '"')
+			{
+				changed |= alias_word(&buf, &len, &size, line + i, n, 0);
+				i += n;
+				continue;
+			}
+		}
+		if (quote == '\0' && (line[i] == '\'' || line[i] == '"'))
+		{
+			quote = line[i];
+		}
+		// 2>&1 and >&file are not list operators
+		else if (quote == '\0' && strchr(";&|(\n", line[i]) != NULL
+			&& !(line[i] == '&' && i > 0 && strchr("<>", line[i-1]) != NULL))
+		{
+			command = TRUE;
+		}
+		alias_append(&buf, &len, &size, line + i, 1);
+		i++;
+	}
+
+	if (changed == FALSE)
+	{
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+
+/* Function: alias_body (internal)
+   Normalize the body (len bytes) of a function: one line, commands
+   separated by "; "
+   Returns a new string
+*/
+static char *alias_body(const char *body, int len)
+{
+	char *out = malloc(2 * len + 1), last = ';';
+	const char *p, *end = body + len, *eol;
+	int n, k = 0;
+
+	if (out == NULL)
+	{
+		return NULL;
+	}
+	for (p = body; p < end; p = eol + 1)
+	{
+		eol = memchr(p, '\n', end - p);
+		if (eol == NULL)
+		{
+			eol = end;
+		}
+		while (p < eol && isspace(*p))
+		{
+			p++;
+		}
+		for (n = eol - p; n > 0 && isspace(p[n-1]); n--)
+		{
+		}
+		if (n == 0)
+		{
+			continue;
+		}
+		// lines of a list are joined by "; " unless an operator joins them
+		if (k > 0)
+		{
+			k += sprintf(out + k, "%s", (strchr(";&|", last) != NULL) ? " " : "; ");
+		}
+		memcpy(out + k, p, n);
+		k += n;
+		last = p[n-1];
+	}
+	// no trailing separator, it would leave an empty command
+	while (k > 0 && (out[k-1] == ';' || isspace(out[k-1])))
+	{
+		k--;
+	}
+	out[k] = '\0';
+
+	return out;
+}
+
+
+/* Function: alias_parse (internal)
+   Parse the source of fn, an empty body leaves no COMMAND. A body with
+   control flow is compiled instead
+*/
+static void alias_parse(ALIAS *fn)
+{
+	COMMAND *cmd = NULL;
+
+	fn->parsed = TRUE;
+	if (script_control(fn->source) == TRUE)
+	{
+		if (script_compile(fn->source, &fn->script) == SCRIPT_MORE)
+		{
+#ifdef WARNING
+	printf("-mysh: %s: syntax error: unexpected end of function body\n", fn->name);
+#endif
+		}
+		return;
+	}
+	cmd = command_parse(fn->source);
+	if (cmd != NULL && cmd->token < 2 && cmd->next == NULL)
+	{
+		command_free(cmd);
+		cmd = NULL;
+	}
+	fn->body = cmd;
+}
+
+
+/* Function: alias_install (internal)
+   Replace the function of entry by source (NULL removes it), parsed now
+   if parse is TRUE. A function redefining itself keeps running its old
+   body
+*/
+static void alias_install(ALIAS *entry, char *source, int parse)
+{
+	ALIAS_RETIRED *old;
+
+	if ((entry->body != NULL || entry->script != NULL) && entry->calls > 0
+		&& (old = malloc(sizeof (ALIAS_RETIRED))) != NULL)
+	{
+		old->body = entry->body;
+		old->script = entry->script;
+		old->next = retired;
+		retired = old;
+	}
+	else
+	{
+		if (entry->body != NULL)
+		{
+			command_free(entry->body);
+		}
+		script_free(entry->script);
+	}
+	free(entry->source);
+	entry->source = source;
+	entry->body = NULL;
+	entry->script = NULL;
+	entry->parsed = FALSE;
+	generation++;
+	if (source != NULL && parse == TRUE)
+	{
+		alias_parse(entry);
+	}
+}
+
+
+/* Function: alias_define (internal)
+   Set the body of the function name (len bytes)
+   Returns the function, NULL on allocation failure
+*/
+static ALIAS *alias_define(const char *name, int len, const char *body, int blen)
+{
+	ALIAS *entry = alias_lookup(name, len, TRUE);
+	char *source, *expanded;
+
+	if (entry == NULL || (source = alias_body(body, blen)) == NULL)
+	{
+		return NULL;
+	}
+	// aliases apply when the function is defined
+	expanded = alias_expand(source);
+	if (expanded != NULL)
+	{
+		free(source);
+		source = expanded;
+	}
+	alias_install(entry, source, TRUE);
+
+	return entry;
+}
+
+
+/* Function: alias_define_source
+   Parsed by the first alias_enter()
+*/
+int alias_define_source(const char *name, const char *source)
+{
+	ALIAS *entry;
+	char *copy;
+
+	if (alias_name(name) != (int) strlen(name) || (entry = alias_lookup(name, strlen(name), TRUE)) == NULL
+		|| (copy = strdup(source)) == NULL)
+	{
+		return -1;
+	}
+	alias_install(entry, copy, FALSE);
+
+	return 0;
+}
+
+
+/* Function: alias_funcdef
+   name() { list; }, name () {, function name {, function name() {
+*/
+int alias_funcdef(const char *line, ALIAS **fn)
+{
+	const char *p = line, *name, *body;
+	ALIAS *entry;
+	char quote = '\0';
+	int n, keyword = FALSE, nest = 1;
+
+	while (*p == ' ' || *p == '\t')
+	{
+		p++;
+	}
+	if (strncmp(p, "function", 8) == 0 && (p[8] == ' ' || p[8] == '\t'))
+	{
+		keyword = TRUE;
+		for (p += 8; *p == ' ' || *p == '\t'; p++)
+		{
+		}
+	}
+	name = p;
+	n = alias_name(p);
+	if (n == 0 || isdigit(*p))
+	{
+		return 0;
+	}
+	for (p += n; *p == ' ' || *p == '\t'; p++)
+	{
+	}
+	if (*p == '(')
+	{
+		for (p++; *p == ' ' || *p == '\t'; p++)
+		{
+		}
+		if (*p != ')')
+		{
+			return 0;
+		}
+		p++;
+	}
+	else if (keyword == FALSE)
+	{
+		return 0;
+	}
+
+	// the body may start on a later line
+	while (isspace(*p))
+	{
+		p++;
+	}
+	if (*p == '\0')
+	{
+		return -1;
+	}
+	if (*p != '{')
+	{
+		return 0;
+	}
+
+	for (body = ++p; *p != '\0'; p++)
+	{
+		if (quote != '\0')
+		{
+			quote = (*p == quote) ? '\0' : quote;
+		}
+		else if (*p == '\'' || *p == '"')
+		{
+			quote = *p;
+		}
+		else if (*p == '{')
+		{
+			nest++;
+		}
+		else if (*p == '}' && --nest == 0)
+		{
+			break;
+		}
+	}
+	if (*p == '\0')
+	{
+		return -1;
+	}
+	if (fn != NULL)
+	{
+		*fn = NULL;
+	}
+	if ((entry = alias_define(name, n, body, p - body)) == NULL)
+	{
+#ifdef WARNING
+	printf("-mysh: %.*s: could not define function\n", n, name);
+#endif
+	}
+
+	if (fn != NULL)
+	{
+		*fn = entry;
+	}
+
+	return p + 1 - line;
+}
+
+
+/* Function: alias_function
+   Hash lookup
+*/
+ALIAS *alias_function(const char *name)
+{
+	ALIAS *entry;
+
+	if (name == NULL || used == 0)
+	{
+		return NULL;
+	}
+	entry = alias_lookup(name, strlen(name), FALSE);
+
+	return (entry != NULL && entry->source != NULL) ? entry : NULL;
+}
+
+
+/* Function: alias_unset_function
+   Its body is kept while it is running
+*/
+void alias_unset_function(const char *name)
+{
+	ALIAS *entry = alias_function(name);
+
+	if (entry != NULL)
+	{
+		alias_install(entry, NULL, FALSE);
+	}
+}
+
+
+/* Function: alias_enter
+   The depth is inherited by the children running a function, a body
+   not parsed yet is parsed now
+*/
+int alias_enter(ALIAS *fn)
+{
+	if (depth >= ALIAS_NEST)
+	{
+#ifdef WARNING
+	printf("-mysh: %s: maximum function nesting level exceeded (%d)\n", fn->name, ALIAS_NEST);
+#endif
+		return -1;
+	}
+	if (fn->parsed == FALSE)
+	{
+		alias_parse(fn);
+	}
+	depth++;
+	fn->calls++;
+
+	return 0;
+}
+
+
+/* Function: alias_leave
+   Counterpart of alias_enter()
+*/
+void alias_leave(ALIAS *fn)
+{
+	depth--;
+	fn->calls--;
+}
+
+
+/* Function: alias_exec
+   The body is run as a list by dag_exec(), like $(cmd), a compiled one
+   hands its lists to dag_list()
+*/
+void alias_exec(ALIAS *fn, char **argv)
+{
+	static const SCRIPT_HOOKS hooks = {dag_list, NULL, NULL, NULL};
+	sigset_t none;
+	int status = 0;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGTTOU, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+	sigemptyset(&none);
+	sigprocmask(SIG_SETMASK, &none, NULL);
+	if (-1 == alias_enter(fn))
+	{
+		fflush(stdout);
+		_exit(1);
+	}
+	vars_positional(&argv[1]);
+	if (fn->script != NULL)
+	{
+		script_run(fn->script, &hooks, &status);
+		fflush(stdout);
+		_exit(status);
+	}
+	dag_exec(fn->source);
+}
+
+
+/* Function: alias_print_functions
+   One line each, as they were normalized
+*/
+void alias_print_functions()
+{
+	unsigned int i;
+
+	for (i = 0; i < nslots; i++)
+	{
+		if (slots[i] != NULL && slots[i]->source != NULL)
+		{
+			printf("%s() { %s; }\n", slots[i]->name, slots[i]->source);
+		}
+	}
+}
+
+
+/* Function: alias_generation
+*/
+unsigned int alias_generation()
+{
+	return generation;
+}
+
+
+/* Function: alias_free
+   Entries, table and retired bodies
+*/
+void alias_free()
+{
+	ALIAS_RETIRED *old;
+	unsigned int i;
+
+	for (i = 0; i < nslots; i++)
+	{
+		if (slots[i] != NULL)
+		{
+			if (slots[i]->body != NULL)
+			{
+				command_free(slots[i]->body);
+			}
+			script_free(slots[i]->script);
+			free(slots[i]->name);
+			free(slots[i]->value);
+			free(slots[i]->source);
+			free(slots[i]);
+		}
+	}
+	free(slots);
+	while (retired != NULL)
+	{
+		old = retired->next;
+		if (retired->body != NULL)
+		{
+			command_free(retired->body);
+		}
+		script_free(retired->script);
+		free(retired);
+		retired = old;
+	}
+	slots = NULL;
+	nslots = used = 0;
+	naliases = 0;
+}
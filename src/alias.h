@@ -0,0 +1,158 @@
+/*
+	ALIAS holds the aliases and shell functions, the names looked up before
+	builtins and $PATH. Both live in one open addressing hash table
+	(linear probing, power of two size) keyed by name; entries are never
+	removed, unalias and unset -f only drop the definition.
+
+	Aliases are expanded in the text of a command line before it is
+	parsed: the first word of each command (at the start of the line,
+	after ; & | && || and inside $( ) or <( )) is replaced by its value,
+	whose own first word is expanded in turn unless it names an alias
+	already being expanded ("alias ls='ls -F'").
+
+	A function is defined by "name() { list; }" (or "function name
+	{ list; }"), over several lines if the body is not closed on the first
+	one. Its body is parsed once, when it is defined (or on its first call
+	for a function restored from the rc cache), and kept as a COMMAND
+	list, or compiled by script.h if it holds if, while, for ...; the
+	shell runs it in process, its arguments as $1 ... (see
+	vars.h). In a pipeline or a background job the function runs in the
+	job's process. Calls nest ALIAS_NEST deep at most.
+*/
+
+#ifndef _ALIAS_H_
+#define _ALIAS_H_
+
+#include "include.h"
+#include "parser.h"
+#include "script.h"
+
+/* Initial table size, a power of two */
+#define ALIAS_SLOTS 64
+
+/* Nesting limit of function calls and of alias expansion */
+#define ALIAS_NEST 100
+
+
+/* Typedef: ALIAS
+   One name. value is the alias (NULL if none), source the normalized
+   body of the function and body its parsed form (NULL if none or not
+   parsed yet), script instead when the body has control flow. calls
+   counts the invocations of the function running
+*/
+typedef struct alias {
+	char *name;
+	unsigned int hash;
+	char *value;
+	char *source;
+	COMMAND *body;
+	SCRIPT *script;
+	int parsed;
+	int calls;
+	int expanding;
+} ALIAS;
+
+
+/* Function: alias_set
+   Define the alias name as value
+   Returns 0, -1 if name is not a valid alias name or on allocation failure
+*/
+int alias_set(const char *name, const char *value);
+
+
+/* Function: alias_get
+   Returns the value of the alias name, NULL if there is none
+*/
+const char *alias_get(const char *name);
+
+
+/* Function: alias_unset
+   Remove the alias name, all aliases if name is NULL
+*/
+void alias_unset(const char *name);
+
+
+/* Function: alias_command
+   Builtin alias: print the aliases of argv (all without argument), define
+   the NAME=value words. A quoted value is a single word, its quotes
+   removed by the parser
+   Returns 0, 1 if a name has no alias
+*/
+int alias_command(char **argv);
+
+
+/* Function: alias_expand
+   Expand the aliases of line
+   Returns a new line, NULL if no alias applies
+*/
+char *alias_expand(const char *line);
+
+
+/* Function: alias_funcdef
+   Define the function line starts with, if any, *fn (if fn is not NULL)
+   receives it
+   Returns the length of the definition, 0 if line does not start with
+   one, -1 if the body is not closed yet (more lines are needed)
+*/
+int alias_funcdef(const char *line, ALIAS **fn);
+
+
+/* Function: alias_define_source
+   Define the function name with a body already normalized, parsed when
+   it is first called
+   Returns 0, -1 if name is not valid or on allocation failure
+*/
+int alias_define_source(const char *name, const char *source);
+
+
+/* Function: alias_function
+   Returns the function name, NULL if there is none
+*/
+ALIAS *alias_function(const char *name);
+
+
+/* Function: alias_unset_function
+   Remove the function name
+*/
+void alias_unset_function(const char *name);
+
+
+/* Function: alias_enter
+   Start a call of fn
+   Returns 0, -1 if calls already nest ALIAS_NEST deep
+*/
+int alias_enter(ALIAS *fn);
+
+
+/* Function: alias_leave
+   End a call of fn started by alias_enter()
+*/
+void alias_leave(ALIAS *fn);
+
+
+/* Function: alias_exec
+   In a child: run fn with the arguments argv (argv[0] is the name) and
+   exit with its status
+*/
+void alias_exec(ALIAS *fn, char **argv);
+
+
+/* Function: alias_print_functions
+   Print the definitions of the functions
+*/
+void alias_print_functions();
+
+
+/* Function: alias_generation
+   Returns a number that changes whenever an alias or a function is
+   defined or removed
+*/
+unsigned int alias_generation();
+
+
+/* Function: alias_free
+   Deallocate aliases and functions
+*/
+void alias_free();
+
+#endif /* _ALIAS_H_ */
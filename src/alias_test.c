@@ -0,0 +1,318 @@
+#include "alias.h"
+#include "vars.h"
+
+extern char **environ;
+
+/* prototypes */
+void test_alias();
+void test_expand();
+void test_funcdef();
+void test_positional();
+void test_nest();
+void test_exec();
+void test_bench(int count);
+
+
+/* Function: expand (helper)
+   alias_expand() of line compared to expected, NULL when unchanged
+*/
+void expand(const char *line, const char *expected)
+{
+	char *out = alias_expand(line);
+
+	if (expected == NULL)
+	{
+		assert(out == NULL);
+		return;
+	}
+	assert(out != NULL && strcmp(out, expected) == 0);
+	free(out);
+}
+
+
+/* Function: test_alias
+   Define, query and remove aliases, alias builtin words
+*/
+void test_alias()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS set and builtin\n");
+#endif
+
+	char *define[] = {"alias", "ll=ls -l", "la=ls -a", NULL};
+	char *bad[] = {"alias", "a/b=x", NULL};
+	char *missing[] = {"alias", "nothing", NULL};
+
+	assert(alias_get("ll") == NULL);
+	assert(alias_set("g", "git") == 0);
+	assert(strcmp(alias_get("g"), "git") == 0);
+	assert(alias_set("g", "git status") == 0);
+	assert(strcmp(alias_get("g"), "git status") == 0);
+	assert(alias_set("", "x") == -1);
+	assert(alias_set("a b", "x") == -1);
+
+	assert(alias_command(define) == 0);
+	assert(strcmp(alias_get("ll"), "ls -l") == 0);
+	assert(strcmp(alias_get("la"), "ls -a") == 0);
+	assert(alias_command(bad) == 1);
+	assert(alias_command(missing) == 1);
+
+	alias_unset("g");
+	assert(alias_get("g") == NULL);
+	assert(alias_get("ll") != NULL);
+	alias_unset(NULL);
+	assert(alias_get("ll") == NULL && alias_get("la") == NULL);
+	expand("ll", NULL);
+}
+
+
+/* Function: test_expand
+   Command words only, chains of aliases, self reference
+*/
+void test_expand()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS expand\n");
+#endif
+
+	assert(alias_set("ll", "ls -l") == 0);
+	assert(alias_set("ls", "ls --color") == 0);
+	assert(alias_set("l", "ll") == 0);
+	assert(alias_set("loop1", "loop2 a") == 0);
+	assert(alias_set("loop2", "loop1 b") == 0);
+
+	expand("echo ll", NULL);
+	expand("ls", "ls --color");
+	expand("  ll /tmp", "  ls --color -l /tmp");
+	expand("l", "ls --color -l");
+	expand("loop1", "loop1 b a");
+	expand("echo a; ll|ll && ll || ll &", "echo a; ls --color -l|ls --color -l && ls --color -l || ls --color -l &");
+	expand("echo $(ll) <(ll)", "echo $(ls --color -l) <(ls --color -l)");
+	expand("echo 'a; ll' \"; ll\"", NULL);
+	expand("'ll' x", NULL);
+	expand("cmd >&ll", NULL);
+
+	alias_unset(NULL);
+}
+
+
+/* Function: test_funcdef
+   Definition forms, bodies over several lines, redefinition
+*/
+void test_funcdef()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS function definitions\n");
+#endif
+
+	const char *line = "greet() { echo hi $1; echo bye; }; greet x";
+	ALIAS *fn;
+
+	assert(alias_function("greet") == NULL);
+	assert(alias_funcdef(line, NULL) == (int) strlen("greet() { echo hi $1; echo bye; }"));
+	fn = alias_function("greet");
+	assert(fn != NULL && strcmp(fn->source, "echo hi $1; echo bye") == 0);
+	assert(fn->body != NULL && strcmp(fn->body->argv[0], "echo") == 0);
+	assert(fn->body->next != NULL && strcmp(fn->body->next->argv[0], "echo") == 0);
+
+	assert(alias_funcdef("multi ()\n", NULL) == -1);
+	assert(alias_funcdef("multi ()\n{\n  ls |\n  wc -l\n  true && false\n\n  echo ${HOME}\n}\n", NULL) > 0);
+	assert(strcmp(alias_function("multi")->source, "ls | wc -l; true && false; echo ${HOME}") == 0);
+	assert(alias_funcdef("function kw { true; }", NULL) > 0);
+	assert(alias_function("kw") != NULL);
+	assert(alias_funcdef("function kw2() { echo '}'; }", NULL) > 0);
+	assert(strcmp(alias_function("kw2")->source, "echo '}'") == 0);
+	assert(alias_funcdef("empty() { }", NULL) > 0);
+	assert(alias_function("empty") != NULL && alias_function("empty")->body == NULL);
+
+	assert(alias_funcdef("echo (x)", NULL) == 0);
+	assert(alias_funcdef("ls -l", NULL) == 0);
+	assert(alias_funcdef("f() echo", NULL) == 0);
+	assert(alias_funcdef("function", NULL) == 0);
+
+	// aliases apply to the body when it is defined
+	assert(alias_set("ll", "ls -l") == 0);
+	assert(alias_funcdef("greet() { ll; }", NULL) > 0);
+	assert(strcmp(alias_function("greet")->source, "ls -l") == 0);
+	alias_unset(NULL);
+
+	alias_unset_function("multi");
+	assert(alias_function("multi") == NULL);
+
+	// restored from a source, parsed on the first call
+	assert(alias_define_source("lazy", "echo a; echo b") == 0);
+	fn = alias_function("lazy");
+	assert(fn != NULL && fn->body == NULL && fn->parsed == FALSE);
+	assert(alias_enter(fn) == 0);
+	assert(fn->body != NULL && fn->body->next != NULL);
+	alias_leave(fn);
+	assert(alias_define_source("bad name", "true") == -1);
+}
+
+
+/* Function: test_positional
+   $1, ${10}, $# and $@ while a function runs
+*/
+void test_positional()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS positional parameters\n");
+#endif
+
+	char *args[] = {"a", "b c", "3", "4", "5", "6", "7", "8", "9", "ten", NULL};
+	char *words[] = {"$1", "${10}", "$#", "x$4y", "$11", "$@", NULL};
+	const char *expected[] = {"a", "ten", "10", "x4y", "a1", "a", "b", "c", "3", NULL};
+	char **saved, **out;
+	int i;
+
+	saved = vars_positional(args);
+	out = vars_expand(words, 0);
+	for (i = 0; expected[i] != NULL; i++)
+	{
+		assert(out[i] != NULL && strcmp(out[i], expected[i]) == 0);
+	}
+	vars_expand_free(out, words);
+	assert(vars_positional(saved) == args);
+
+	// a function called without arguments
+	saved = vars_positional(&args[10]);
+	out = vars_expand(words, 0);
+	assert(strcmp(out[0], "") == 0 && strcmp(out[2], "0") == 0 && out[5] == NULL);
+	vars_expand_free(out, words);
+	vars_positional(saved);
+
+	// outside functions the words stay
+	out = vars_expand(words, 0);
+	assert(strcmp(out[0], "$1") == 0 && strcmp(out[2], "$#") == 0 && strcmp(out[5], "$@") == 0);
+	vars_expand_free(out, words);
+}
+
+
+/* Function: test_nest
+   Calls nest ALIAS_NEST deep at most
+*/
+void test_nest()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS nesting limit\n");
+#endif
+
+	ALIAS *fn = alias_function("greet");
+	int i;
+
+	for (i = 0; i < ALIAS_NEST; i++)
+	{
+		assert(alias_enter(fn) == 0);
+	}
+	assert(fn->calls == ALIAS_NEST);
+	assert(alias_enter(fn) == -1);
+
+	// redefined while running, the running body stays valid
+	COMMAND *body = fn->body;
+	assert(alias_funcdef("greet() { echo new; }", NULL) > 0);
+	assert(strcmp(body->argv[0], "ls") == 0);
+	for (i = 0; i < ALIAS_NEST; i++)
+	{
+		alias_leave(fn);
+	}
+	assert(fn->calls == 0);
+}
+
+
+/* Function: test_exec
+   A function run in a child, arguments and exit status
+*/
+void test_exec()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS run in a child\n");
+#endif
+
+	char *argv[] = {"show", "one", "two", NULL}, buf[256];
+	int fd[2], pid, status;
+	long n, len = 0;
+
+	assert(alias_funcdef("show() { echo $# $2; false || echo $1 | tr o 0; false; }", NULL) > 0);
+	assert(pipe(fd) == 0);
+	fflush(stdout);
+	pid = fork();
+	assert(pid != -1);
+	if (pid == 0)
+	{
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[0]);
+		close(fd[1]);
+		alias_exec(alias_function("show"), argv);
+	}
+	close(fd[1]);
+	while ((n = read(fd[0], buf + len, sizeof buf - len - 1)) > 0)
+	{
+		len += n;
+	}
+	buf[len] = '\0';
+	close(fd[0]);
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(strcmp(buf, "2 two\n0ne\n") == 0);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+}
+
+
+/* Function: test_bench
+   Lookups of command names with many aliases and functions defined
+*/
+void test_bench(int count)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS %d lookups\n", count);
+#endif
+
+	struct timespec start, end;
+	char name[32], def[64];
+	long ns;
+	int i, found = 0;
+
+	for (i = 0; i < 500; i++)
+	{
+		snprintf(name, sizeof name, "a%d", i);
+		assert(alias_set(name, "true") == 0);
+		snprintf(def, sizeof def, "f%d() { true; }", i);
+		assert(alias_funcdef(def, NULL) > 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++)
+	{
+		found += (alias_function((i & 1) ? "f250" : "ls") != NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	assert(found == count / 2);
+
+#ifdef DEBUG_TEST
+	printf("TEST: ALIAS %ld ns per lookup\n", ns / count);
+#endif
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: ALIAS Module\n");
+#endif
+
+	assert(vars_init(environ) == 0);
+	test_alias();
+	test_expand();
+	test_funcdef();
+	test_positional();
+	test_nest();
+	test_exec();
+	test_bench(1000000);
+	alias_free();
+	vars_free();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: ALIAS Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,671 @@
+#include "capture.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+/* Rings, a slot keeps its memfd once created */
+static CAPTURE_RING slots[CAPTURE_JOBS];
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Slot reserved by capture_pipe() until capture_attach()/capture_close() */
+static CAPTURE_RING *pending = NULL;
+
+/* Pump thread: epoll set of the pipes, wake stops it, notify is written
+   after every read so capture_follow() can wait for new output */
+static pthread_t pump_thread;
+static int pump_started = FALSE;
+static int epfd = -1, wake = -1, notify = -1;
+
+static int enabled = FALSE;
+static unsigned long ticks = 0;
+
+
+/* Function: capture_enable
+   Switch capturing of new background jobs
+*/
+int capture_enable(const char *arg)
+{
+	if (arg == NULL)
+	{
+		printf("capture %s\n", (enabled == TRUE) ? "on" : "off");
+	}
+	else if (strcmp(arg, "on") == 0)
+	{
+		enabled = TRUE;
+	}
+	else if (strcmp(arg, "off") == 0)
+	{
+		enabled = FALSE;
+	}
+	else
+	{
+#ifdef WARNING
+	printf("-mysh: capture: usage: capture [on|off]\n");
+#endif
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Function: capture_store (internal)
+   Append len bytes to the ring, keeping the last CAPTURE_SIZE bytes
+   Precondition: ring_lock is held
+*/
+static void capture_store(CAPTURE_RING *ring, const char *buf, size_t len)
+{
+	size_t off, first;
+
+	if (len > CAPTURE_SIZE)
+	{
+		ring->head += len - CAPTURE_SIZE;
+		buf += len - CAPTURE_SIZE;
+		len = CAPTURE_SIZE;
+	}
+	off = ring->head & (CAPTURE_SIZE - 1);
+	first = (len < CAPTURE_SIZE - off) ? len : CAPTURE_SIZE - off;
+	memcpy(ring->data + off, buf, first);
+	memcpy(ring->data, buf + first, len - first);
+	ring->head += len;
+}
+
+
+/* Function: capture_copy (internal)
+   Copy the bytes of the ring from from (a position <= head) to head into buf
+   Returns the number of bytes, bytes no longer in the ring are skipped
+   Precondition: ring_lock is held, buf holds CAPTURE_SIZE bytes
+*/
+static size_t capture_copy(CAPTURE_RING *ring, uint64_t from, char *buf)
+{
+	size_t off, len, first;
+
+	if (ring->head - from > CAPTURE_SIZE)
+	{
+		from = ring->head - CAPTURE_SIZE;
+	}
+	len = ring->head - from;
+	off = from & (CAPTURE_SIZE - 1);
+	first = (len < CAPTURE_SIZE - off) ? len : CAPTURE_SIZE - off;
+	memcpy(buf, ring->data + off, first);
+	memcpy(buf + first, ring->data, len - first);
+
+	return len;
+}
+
+
+/* Function: capture_pump (internal)
+   Worker thread, copy every pipe that is readable into its ring
+*/
+static void *capture_pump(void *arg)
+{
+	struct epoll_event ev[16];
+	CAPTURE_RING *ring;
+	char buf[CAPTURE_READ];
+	uint64_t one = 1;
+	ssize_t len;
+	int i, n, pass;
+
+	for (;;)
+	{
+		n = epoll_wait(epfd, ev, 16, -1);
+		if (n == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		for (i = 0; i < n; i++)
+		{
+			ring = (CAPTURE_RING*) ev[i].data.ptr;
+			if (ring == NULL)
+			{
+				return NULL;
+			}
+			len = read(ring->fd, buf, sizeof buf);
+			if (len > 0)
+			{
+				pthread_mutex_lock(&ring_lock);
+				capture_store(ring, buf, len);
+				pass = ring->passthrough;
+				if (pass == TRUE)
+				{
+					ring->shown = ring->head;
+				}
+				pthread_mutex_unlock(&ring_lock);
+				if (pass == TRUE && write(STDOUT_FILENO, buf, len) == -1)
+				{
+					perror("write");
+				}
+			}
+			else if (len == 0 || errno != EINTR)
+			{
+				epoll_ctl(epfd, EPOLL_CTL_DEL, ring->fd, NULL);
+				pthread_mutex_lock(&ring_lock);
+				close(ring->fd);
+				ring->fd = -1;
+				pthread_mutex_unlock(&ring_lock);
+			}
+			if (write(notify, &one, sizeof one) == -1)
+			{
+				// counter full, a reader is already due
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Function: capture_start (internal)
+   Start the pump on first use, with all signals blocked: SIGCHLD and job
+   control signals are handled by the main thread
+*/
+static int capture_start()
+{
+	struct epoll_event ev;
+	sigset_t all, old;
+	int ret;
+
+	if (pump_started == TRUE)
+	{
+		return 0;
+	}
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	wake = eventfd(0, EFD_CLOEXEC);
+	notify = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (epfd == -1 || wake == -1 || notify == -1)
+	{
+		perror("capture");
+		goto capture_start_fail;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, wake, &ev))
+	{
+		perror("capture");
+		goto capture_start_fail;
+	}
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&pump_thread, NULL, capture_pump, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret != 0)
+	{
+		perror("capture");
+		goto capture_start_fail;
+	}
+	pump_started = TRUE;
+
+	return 0;
+
+capture_start_fail:
+	close(epfd);
+	close(wake);
+	close(notify);
+	epfd = wake = notify = -1;
+	return -1;
+}
+
+
+/* Function: capture_reserve (internal)
+   Pick a free slot, or the least recently started finished job
+*/
+static CAPTURE_RING *capture_reserve()
+{
+	CAPTURE_RING *ring = NULL;
+	int i;
+
+	pthread_mutex_lock(&ring_lock);
+	for (i = 0; i < CAPTURE_JOBS; i++)
+	{
+		if (slots[i].fd == -1 && &slots[i] != pending &&
+			(ring == NULL || slots[i].used < ring->used))
+		{
+			ring = &slots[i];
+		}
+	}
+	if (ring != NULL)
+	{
+		ring->pgid = 0;
+		ring->head = 0;
+		ring->shown = 0;
+		ring->passthrough = FALSE;
+	}
+	pthread_mutex_unlock(&ring_lock);
+	if (ring == NULL || ring->data != NULL)
+	{
+		return ring;
+	}
+
+	ring->memfd = memfd_create("mysh-job", MFD_CLOEXEC);
+	if (ring->memfd == -1 || -1 == ftruncate(ring->memfd, CAPTURE_SIZE))
+	{
+		perror("memfd_create");
+		goto capture_reserve_fail;
+	}
+	ring->data = mmap(NULL, CAPTURE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ring->memfd, 0);
+	if (ring->data == MAP_FAILED)
+	{
+		perror("mmap");
+		goto capture_reserve_fail;
+	}
+
+	return ring;
+
+capture_reserve_fail:
+	if (ring->memfd != -1)
+	{
+		close(ring->memfd);
+	}
+	ring->memfd = -1;
+	ring->data = NULL;
+	return NULL;
+}
+
+
+/* Function: capture_pipe
+   Reserve a ring and open the pipe of the next job
+*/
+int capture_pipe(int fds[2])
+{
+	static int initialized = FALSE;
+	int i;
+
+	fds[0] = fds[1] = -1;
+	if (enabled == FALSE)
+	{
+		return -1;
+	}
+	if (initialized == FALSE)
+	{
+		for (i = 0; i < CAPTURE_JOBS; i++)
+		{
+			slots[i].fd = -1;
+			slots[i].memfd = -1;
+		}
+		initialized = TRUE;
+	}
+	if (-1 == capture_start())
+	{
+		return -1;
+	}
+	pending = capture_reserve();
+	if (pending == NULL)
+	{
+#ifdef WARNING
+	printf("-mysh: capture: too many captured jobs, output not captured\n");
+#endif
+		return -1;
+	}
+	if (-1 == pipe2(fds, O_CLOEXEC))
+	{
+		perror("pipe");
+		fds[0] = fds[1] = -1;
+		pending = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Function: capture_child
+   Redirect to the capture pipe
+*/
+void capture_child(int fds[2], int out)
+{
+	if (fds[1] == -1)
+	{
+		return;
+	}
+	if (-1 == dup2(fds[1], STDERR_FILENO) || (out == TRUE && -1 == dup2(fds[1], STDOUT_FILENO)))
+	{
+		perror("dup2");
+	}
+	close(fds[0]);
+	close(fds[1]);
+}
+
+
+/* Function: capture_attach
+   Register the read end with the pump
+*/
+int capture_attach(int fds[2], int pgid, int label)
+{
+	struct epoll_event ev;
+	CAPTURE_RING *ring = pending;
+
+	if (fds[0] == -1 || ring == NULL)
+	{
+		return -1;
+	}
+	close(fds[1]);
+	fds[1] = -1;
+	pending = NULL;
+
+	pthread_mutex_lock(&ring_lock);
+	ring->pgid = pgid;
+	ring->label = label;
+	ring->fd = fds[0];
+	ring->used = ++ticks;
+	pthread_mutex_unlock(&ring_lock);
+	fds[0] = -1;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = ring;
+	if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, ring->fd, &ev))
+	{
+		perror("epoll_ctl");
+		pthread_mutex_lock(&ring_lock);
+		close(ring->fd);
+		ring->fd = -1;
+		pthread_mutex_unlock(&ring_lock);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Function: capture_close
+   Release the reserved ring and the pipe
+*/
+void capture_close(int fds[2])
+{
+	if (fds[0] == -1)
+	{
+		return;
+	}
+	close(fds[0]);
+	if (fds[1] != -1)
+	{
+		close(fds[1]);
+	}
+	fds[0] = fds[1] = -1;
+	pending = NULL;
+}
+
+
+/* Function: capture_find (internal)
+   Newest ring of process group pgid
+   Precondition: ring_lock is held
+*/
+static CAPTURE_RING *capture_find(int pgid)
+{
+	CAPTURE_RING *ring = NULL;
+	int i;
+
+	for (i = 0; i < CAPTURE_JOBS && pump_started == TRUE; i++)
+	{
+		if (slots[i].pgid == pgid && pgid != 0 && (ring == NULL || slots[i].used > ring->used))
+		{
+			ring = &slots[i];
+		}
+	}
+
+	return ring;
+}
+
+
+/* Function: capture_dump
+   Copy the ring out under the lock, write it without
+*/
+long capture_dump(int pgid, int fd)
+{
+	CAPTURE_RING *ring;
+	char *buf;
+	size_t len;
+
+	buf = (char*) malloc(CAPTURE_SIZE);
+	if (buf == NULL)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&ring_lock);
+	ring = capture_find(pgid);
+	if (ring == NULL)
+	{
+		pthread_mutex_unlock(&ring_lock);
+		free(buf);
+		return -1;
+	}
+	len = capture_copy(ring, 0, buf);
+	ring->shown = ring->head;
+	pthread_mutex_unlock(&ring_lock);
+
+	if (len > 0 && write(fd, buf, len) == -1)
+	{
+		perror("write");
+	}
+	free(buf);
+
+	return len;
+}
+
+
+/* Function: capture_last
+   Most recently started captured job
+*/
+int capture_last()
+{
+	int i, pgid = 0;
+	unsigned long used = 0;
+
+	pthread_mutex_lock(&ring_lock);
+	for (i = 0; i < CAPTURE_JOBS && pump_started == TRUE; i++)
+	{
+		if (slots[i].pgid != 0 && slots[i].used > used)
+		{
+			used = slots[i].used;
+			pgid = slots[i].pgid;
+		}
+	}
+	pthread_mutex_unlock(&ring_lock);
+
+	return pgid;
+}
+
+
+/* Function: capture_lines (internal)
+   Print buf with the job label at the start of every line
+   midline tells whether the previous output of the job ended inside a line
+*/
+static void capture_lines(int label, const char *buf, size_t len, int *midline)
+{
+	const char *end = buf + len, *nl;
+
+	while (buf < end)
+	{
+		if (*midline == FALSE)
+		{
+			printf("[%d] ", label);
+		}
+		nl = memchr(buf, '\n', end - buf);
+		nl = (nl != NULL) ? nl + 1 : end;
+		fwrite(buf, 1, nl - buf, stdout);
+		*midline = (nl[-1] != '\n');
+		buf = nl;
+	}
+}
+
+
+/* Function: capture_follow
+   Multiplex new output of the given jobs
+*/
+int capture_follow(const int *pgids, int n)
+{
+	struct pollfd pfd[2] = {{notify, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+	CAPTURE_RING *ring[n];
+	int midline[n];
+	uint64_t count, dropped;
+	char *buf, drain[256];
+	size_t len;
+	int i, j, found = 0, open, label;
+
+	pthread_mutex_lock(&ring_lock);
+	for (i = 0; i < n; i++)
+	{
+		ring[i] = capture_find(pgids[i]);
+		found += (ring[i] != NULL);
+		midline[i] = FALSE;
+	}
+	pthread_mutex_unlock(&ring_lock);
+	if (found == 0)
+	{
+		return -1;
+	}
+	buf = (char*) malloc(CAPTURE_SIZE);
+	if (buf == NULL)
+	{
+		return -1;
+	}
+
+	// rings are only reused by capture_attach(), which cannot run meanwhile
+	for (;;)
+	{
+		open = 0;
+		for (i = 0; i < n; i++)
+		{
+			if (ring[i] == NULL)
+			{
+				continue;
+			}
+			pthread_mutex_lock(&ring_lock);
+			dropped = (ring[i]->head - ring[i]->shown > CAPTURE_SIZE) ?
+				ring[i]->head - ring[i]->shown - CAPTURE_SIZE : 0;
+			len = capture_copy(ring[i], ring[i]->shown, buf);
+			ring[i]->shown = ring[i]->head;
+			open += (ring[i]->fd != -1);
+			label = ring[i]->label;
+			pthread_mutex_unlock(&ring_lock);
+
+			if (dropped > 0)
+			{
+				printf("%s[%d] ... %lu bytes not shown\n", (midline[i] == TRUE) ? "\n" : "",
+					label, (unsigned long) dropped);
+				midline[i] = FALSE;
+			}
+			// a line left open by another job is ended first
+			for (j = 0; j < n && len > 0; j++)
+			{
+				if (j != i && midline[j] == TRUE)
+				{
+					printf("\n");
+					midline[j] = FALSE;
+				}
+			}
+			capture_lines(label, buf, len, &midline[i]);
+		}
+		fflush(stdout);
+		if (open == 0)
+		{
+			break;
+		}
+
+		if (poll(pfd, isatty(STDIN_FILENO) ? 2 : 1, -1) > 0)
+		{
+			if (pfd[1].revents & POLLIN)
+			{
+				if (read(STDIN_FILENO, drain, sizeof drain) < 0)
+				{
+					perror("read");
+				}
+				break;
+			}
+			if (read(notify, &count, sizeof count) < 0)
+			{
+				// already drained
+			}
+		}
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (midline[i] == TRUE)
+		{
+			printf("\n");
+			break;
+		}
+	}
+	free(buf);
+
+	return 0;
+}
+
+
+/* Function: capture_foreground
+   Switch the job between terminal and ring
+*/
+void capture_foreground(int pgid, int on)
+{
+	CAPTURE_RING *ring;
+	char *buf;
+	size_t len = 0;
+
+	buf = (char*) malloc(CAPTURE_SIZE);
+	if (buf == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&ring_lock);
+	ring = capture_find(pgid);
+	if (ring != NULL)
+	{
+		// the flush is written under the lock, before anything the pump passes through
+		if (on == TRUE)
+		{
+			len = capture_copy(ring, ring->shown, buf);
+			ring->shown = ring->head;
+			fflush(stdout);
+			if (len > 0 && write(STDOUT_FILENO, buf, len) == -1)
+			{
+				perror("write");
+			}
+		}
+		ring->passthrough = on;
+	}
+	pthread_mutex_unlock(&ring_lock);
+	free(buf);
+}
+
+
+/* Function: capture_free
+   Stop the pump and release everything
+*/
+void capture_free()
+{
+	uint64_t one = 1;
+	int i;
+
+	if (pump_started == FALSE)
+	{
+		return;
+	}
+	if (write(wake, &one, sizeof one) == -1)
+	{
+		perror("write");
+	}
+	pthread_join(pump_thread, NULL);
+	pump_started = FALSE;
+
+	for (i = 0; i < CAPTURE_JOBS; i++)
+	{
+		if (slots[i].fd != -1)
+		{
+			close(slots[i].fd);
+			slots[i].fd = -1;
+		}
+		if (slots[i].data != NULL)
+		{
+			munmap(slots[i].data, CAPTURE_SIZE);
+			close(slots[i].memfd);
+			slots[i].data = NULL;
+			slots[i].memfd = -1;
+		}
+		slots[i].pgid = 0;
+		slots[i].used = 0;
+	}
+	close(epfd);
+	close(wake);
+	close(notify);
+	epfd = wake = notify = -1;
+}
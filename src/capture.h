@@ -0,0 +1,129 @@
+/*
+	CAPTURE keeps the output of background jobs away from the terminal.
+	When capturing is on ("capture on"), a job started with '&' gets a pipe
+	as stderr (and as stdout of its last command, unless redirected). The
+	read end is handed to a pump thread that waits on all capture pipes with
+	epoll and copies whatever arrives into the job's ring: a fixed size
+	buffer in a memfd mapped into the shell, head counting the bytes ever
+	written so only the last CAPTURE_SIZE bytes are kept.
+
+	"jobs -o %n" prints what the ring of job n holds, "jobs --follow %n ..."
+	prints new output of the given jobs as it arrives, each line prefixed
+	with its job number. When a job is brought to the foreground with fg the
+	output not shown yet is flushed to the terminal and the pump writes the
+	job's output through until the job stops or finishes.
+
+	Rings of finished jobs are kept until their slot is needed by a new job;
+	with all CAPTURE_JOBS slots held by running jobs a new job is not
+	captured.
+*/
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "include.h"
+#include <stdint.h>
+#include <pthread.h>
+
+/* Ring size per job, a power of two */
+#define CAPTURE_SIZE (64 * 1024)
+
+/* Rings kept, captured jobs running at the same time */
+#define CAPTURE_JOBS 64
+
+/* Read size of the pump */
+#define CAPTURE_READ 16384
+
+
+/* Typedef: CAPTURE_RING
+   Output of one job. fd is the read end of its pipe (-1 after EOF),
+   data the mapping of memfd, head the number of bytes ever written,
+   shown the bytes already written to the terminal, label the job number
+   used as line prefix, passthrough set while the job is in the foreground
+*/
+typedef struct capture_ring {
+	int pgid;
+	int label;
+	int fd;
+	int memfd;
+	char *data;
+	uint64_t head;
+	uint64_t shown;
+	int passthrough;
+	unsigned long used;
+} CAPTURE_RING;
+
+
+/* Function: capture_enable
+   Builtin capture [on|off], without argument print the current state
+*/
+int capture_enable(const char *arg);
+
+
+/* Function: capture_pipe
+   Create the pipe of a background job about to be started
+   fds[0] and fds[1] are -1 when capturing is off or on error
+   Returns 0 if the job is captured, -1 otherwise
+*/
+int capture_pipe(int fds[2]);
+
+
+/* Function: capture_child
+   In the child: connect stderr, and stdout when out is TRUE, to the
+   capture pipe, then close it. Does nothing when fds[1] is -1
+*/
+void capture_child(int fds[2], int out);
+
+
+/* Function: capture_attach
+   In the shell after the job was started: close the write end and hand the
+   read end of the pipe to the pump as the ring of process group pgid,
+   label is the job number. On failure the pipe is closed. fds is reset
+   to -1 so a later capture_close() does nothing
+   Returns 0 on success, -1 on error
+*/
+int capture_attach(int fds[2], int pgid, int label);
+
+
+/* Function: capture_close
+   Close the pipe of a job that could not be started, fds may be -1
+*/
+void capture_close(int fds[2]);
+
+
+/* Function: capture_dump
+   Write the contents of the ring of pgid to fd
+   Returns the number of bytes written, -1 if the job is not captured
+*/
+long capture_dump(int pgid, int fd);
+
+
+/* Function: capture_last
+   Returns the process group of the most recently started captured job,
+   0 if there is none
+*/
+int capture_last();
+
+
+/* Function: capture_follow
+   Print new output of the n process groups in pgids as it arrives, line
+   by line with their job number as prefix, until every pipe is closed or
+   Enter is pressed on the terminal
+   Returns 0, -1 if none of the groups is captured
+*/
+int capture_follow(const int *pgids, int n);
+
+
+/* Function: capture_foreground
+   Flush the output of pgid not shown yet to the terminal and write the
+   rest of its output through (on is TRUE), or capture it again (FALSE)
+*/
+void capture_foreground(int pgid, int on);
+
+
+/* Function: capture_free
+   Stop the pump, close all pipes and rings
+*/
+void capture_free();
+
+#endif /* _CAPTURE_H_ */
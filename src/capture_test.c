@@ -0,0 +1,193 @@
+#include "capture.h"
+
+#define TFILE "/tmp/mysh_capture_test"
+
+/* prototypes */
+void test_setup();
+void test_destroy();
+void test_capture();
+void test_wrap();
+void test_disabled();
+
+
+/* Function: job (helper)
+   start a child writing size bytes of pattern c to stdout and "err\n" to
+   stderr through the capture pipe, wait for it to exit
+*/
+int job(char c, int size)
+{
+	int fds[2], pid, i;
+	char line[80];
+
+	assert(capture_pipe(fds) == 0);
+	pid = fork();
+	assert(pid != -1);
+	if (pid == 0)
+	{
+		capture_child(fds, TRUE);
+		memset(line, c, sizeof line);
+		line[sizeof line - 1] = '\n';
+		for (i = 0; i < size; i += sizeof line)
+		{
+			assert(write(STDOUT_FILENO, line, sizeof line) == sizeof line);
+		}
+		assert(write(STDERR_FILENO, "err\n", 4) == 4);
+		_exit(0);
+	}
+	assert(capture_attach(fds, pid, 1) == 0);
+	assert(fds[0] == -1 && fds[1] == -1);
+	waitpid(pid, NULL, 0);
+
+	return pid;
+}
+
+
+/* Function: dump (helper)
+   capture_dump() of pid into TFILE, returns the size, content in buf
+*/
+long dump(int pid, char *buf, long size)
+{
+	long len;
+	int fd;
+
+	fd = open(TFILE, O_CREAT | O_TRUNC | O_RDWR, 0600);
+	assert(fd != -1);
+	len = capture_dump(pid, fd);
+	if (len > 0)
+	{
+		assert(pread(fd, buf, size, 0) == len);
+	}
+	close(fd);
+
+	return len;
+}
+
+
+/* Function: settle (helper)
+   dump until the pump has stored len bytes, at most one second
+*/
+long settle(int pid, char *buf, long size, long len)
+{
+	long got = 0;
+	int i;
+
+	for (i = 0; i < 1000 && (got = dump(pid, buf, size)) != len; i++)
+	{
+		usleep(1000);
+	}
+
+	return got;
+}
+
+
+/* Function: test_setup
+   Turn capturing on
+*/
+void test_setup()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CAPTURE Initialized\n");
+#endif
+
+	assert(capture_enable("bogus") == -1);
+	assert(capture_enable("on") == 0);
+	assert(capture_last() == 0);
+}
+
+
+/* Function: test_destroy
+   Stop the pump
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CAPTURE Closed\n");
+#endif
+
+	capture_free();
+	unlink(TFILE);
+}
+
+
+/* Function: test_capture
+   stdout and stderr end up in the ring
+*/
+void test_capture()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CAPTURE small job\n");
+#endif
+
+	static char buf[CAPTURE_SIZE];
+	int pid;
+
+	pid = job('a', 160);
+	assert(capture_last() == pid);
+	assert(settle(pid, buf, sizeof buf, 164) == 164);
+	assert(buf[0] == 'a' && buf[79] == '\n');
+	assert(strncmp(buf + 160, "err\n", 4) == 0);
+	assert(dump(pid + 100000, buf, sizeof buf) == -1);
+}
+
+
+/* Function: test_wrap
+   Only the last CAPTURE_SIZE bytes are kept
+*/
+void test_wrap()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CAPTURE ring wrap\n");
+#endif
+
+	static char buf[CAPTURE_SIZE];
+	int pid, i;
+
+	// full long before the pipe is drained, wait for the last write
+	pid = job('b', 4 * CAPTURE_SIZE);
+	for (i = 0; i < 1000 && strncmp(buf + CAPTURE_SIZE - 4, "err\n", 4) != 0; i++)
+	{
+		assert(settle(pid, buf, sizeof buf, CAPTURE_SIZE) == CAPTURE_SIZE);
+		usleep(1000);
+	}
+	assert(strncmp(buf + CAPTURE_SIZE - 4, "err\n", 4) == 0);
+	assert(buf[CAPTURE_SIZE - 5] == '\n' && buf[CAPTURE_SIZE - 6] == 'b');
+	assert(capture_last() == pid);
+}
+
+
+/* Function: test_disabled
+   No pipe when capturing is off
+*/
+void test_disabled()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CAPTURE disabled\n");
+#endif
+
+	int fds[2];
+
+	assert(capture_enable("off") == 0);
+	assert(capture_pipe(fds) == -1);
+	assert(fds[0] == -1 && fds[1] == -1);
+	capture_close(fds);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: CAPTURE Module\n");
+#endif
+
+	test_setup();
+	test_capture();
+	test_wrap();
+	test_disabled();
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: CAPTURE Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,226 @@
+#include "cmdsub.h"
+#include "vars.h"
+#include "wildcard.h"
+#include "dag.h"
+#include <sys/mman.h>
+
+/* Substitutions run by a child */
+static long forks = 0;
+
+
+/* Function: cmdsub_length
+   Parentheses nest, quoted ones do not count
+*/
+int cmdsub_length(const char *s)
+{
+	char quote = '\0';
+	int i, depth = 0;
+
+	for (i = 1; s[i] != '\0'; i++)
+	{
+		if (quote != '\0')
+		{
+			if (s[i] == quote)
+			{
+				quote = '\0';
+			}
+		}
+		else if (s[i] == '\'' || s[i] == '"')
+		{
+			quote = s[i];
+		}
+		else if (s[i] == '(')
+		{
+			depth++;
+		}
+		else if (s[i] == ')' && --depth == 0)
+		{
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Function: cmdsub_builtin (internal)
+   Evaluate cmdline in this process if it is a single echo, pwd, true,
+   false or ':' without redirection, *out receives its output
+   Returns TRUE if it was evaluated
+*/
+static int cmdsub_builtin(const char *cmdline, int status, char **out)
+{
+	COMMAND *cmd = command_parse(cmdline);
+	WILDCARD wc;
+	char **vars, **argv, cwd[PATH_MAX];
+	const char *name;
+	int i, len = 0, size = 0, done = FALSE;
+
+	*out = NULL;
+	if (cmd == NULL || cmd->next != NULL || cmd->argv[0] == NULL || cmd->pipe == TRUE
+		|| cmd->background == TRUE || cmd->infile != NULL || cmd->outfile != NULL
+		|| cmd->procsub != NULL || cmd->heredoc != NULL || cmd->heredoc_tag != NULL)
+	{
+		command_free(cmd);
+		return FALSE;
+	}
+
+	name = cmd->argv[0];
+	if (strcmp(name, "true") == 0 || strcmp(name, "false") == 0 || strcmp(name, ":") == 0)
+	{
+		*out = strdup("");
+		done = TRUE;
+	}
+	else if (strcmp(name, "pwd") == 0)
+	{
+		*out = strdup((getcwd(cwd, sizeof cwd) != NULL) ? cwd : "");
+		done = TRUE;
+	}
+	else if (strcmp(name, "echo") == 0)
+	{
+		vars = vars_expand(cmd->argv, status);
+		argv = wildcard_expand(vars, &wc);
+		i = (argv[1] != NULL && strcmp(argv[1], "-n") == 0) ? 2 : 1;
+		for (; argv[i] != NULL; i++)
+		{
+			len += strlen(argv[i]) + 1;
+		}
+		*out = malloc(len + 1);
+		if (*out != NULL)
+		{
+			**out = '\0';
+			i = (argv[1] != NULL && strcmp(argv[1], "-n") == 0) ? 2 : 1;
+			for (; argv[i] != NULL; i++)
+			{
+				size += sprintf(*out + size, "%s%s", (size > 0) ? " " : "", argv[i]);
+			}
+		}
+		wildcard_expand_free(argv, vars, &wc);
+		vars_expand_free(vars, cmd->argv);
+		done = TRUE;
+	}
+	command_free(cmd);
+
+	return done;
+}
+
+
+/* Function: cmdsub_fork (internal)
+   Run cmdline in a child with stdout on a memfd, read it back once the
+   child exited
+*/
+static char *cmdsub_fork(const char *cmdline)
+{
+	struct stat st;
+	sigset_t none;
+	char *buf;
+	long n, done = 0;
+	int fd, pid, status;
+
+	fd = memfd_create("cmdsub", MFD_CLOEXEC);
+	if (fd == -1)
+	{
+		perror("memfd_create");
+		return NULL;
+	}
+	fflush(stdout);
+	forks++;
+	pid = fork();
+	if (pid == -1)
+	{
+		perror("fork");
+		close(fd);
+		return NULL;
+	}
+	if (pid == 0)
+	{
+		signal(SIGINT, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		signal(SIGTTOU, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, NULL);
+		if (-1 == dup2(fd, STDOUT_FILENO))
+		{
+			perror("dup2");
+			_exit(1);
+		}
+		dag_exec(cmdline);
+	}
+
+	while (-1 == waitpid(pid, &status, 0))
+	{
+		if (errno != EINTR)
+		{
+			perror("waitpid");
+			break;
+		}
+	}
+	if (-1 == fstat(fd, &st))
+	{
+		perror("fstat");
+		close(fd);
+		return NULL;
+	}
+	buf = malloc(st.st_size + 1);
+	while (buf != NULL && done < st.st_size)
+	{
+		n = pread(fd, buf + done, st.st_size - done, done);
+		if (n == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			break;
+		}
+		done += n;
+	}
+	if (buf != NULL)
+	{
+		buf[done] = '\0';
+	}
+	close(fd);
+
+	return buf;
+}
+
+
+/* Function: cmdsub_run
+   In process when possible, else in a child
+*/
+char *cmdsub_run(const char *cmdline, int len, int status)
+{
+	char *line = strndup(cmdline, len), *out;
+	int n;
+
+	if (line == NULL)
+	{
+		return NULL;
+	}
+	if (cmdsub_builtin(line, status, &out) == FALSE)
+	{
+		out = cmdsub_fork(line);
+	}
+	free(line);
+
+	if (out != NULL)
+	{
+		for (n = strlen(out); n > 0 && out[n-1] == '\n'; n--)
+		{
+			out[n-1] = '\0';
+		}
+	}
+
+	return out;
+}
+
+
+/* Function: cmdsub_forks
+   Counter of cmdsub_fork()
+*/
+long cmdsub_forks()
+{
+	return forks;
+}
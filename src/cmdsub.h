@@ -0,0 +1,46 @@
+/*
+	CMDSUB runs command substitutions: "$(cmd)" in a word is replaced with
+	the output of cmd, trailing newlines removed. Outside of an assignment
+	the result is split into words at blanks (see vars_expand()).
+
+	When cmd is a single command the shell can answer itself (echo, pwd,
+	true, false and ':', with variables and patterns in their arguments
+	expanded and quoted words kept whole by the parser) it is evaluated
+	in the calling process without a fork; a script doing x=$(echo $y)
+	or dir=$(pwd) in a loop starts no process.
+
+	Anything else runs in a child through dag_exec(), which handles pipes,
+	redirections and lists, with its stdout on a memfd. The output is read
+	with a single pread() once the child exited: nothing has to drain a
+	pipe while the command runs and a large output costs no more round
+	trips than a small one.
+*/
+
+#ifndef _CMDSUB_H_
+#define _CMDSUB_H_
+
+#include "include.h"
+#include "parser.h"
+
+
+/* Function: cmdsub_length
+   s points at "$(", returns the length of the substitution up to and
+   including its closing ')', 0 if it is not closed
+*/
+int cmdsub_length(const char *s);
+
+
+/* Function: cmdsub_run
+   Run the command line cmdline (len bytes) and collect its output,
+   status is the value of $? in it
+   Returns a new string without trailing newlines, NULL on failure
+*/
+char *cmdsub_run(const char *cmdline, int len, int status);
+
+
+/* Function: cmdsub_forks
+   Returns the number of substitutions that needed a child process
+*/
+long cmdsub_forks();
+
+#endif /* _CMDSUB_H_ */
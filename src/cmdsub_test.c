@@ -0,0 +1,195 @@
+#include "cmdsub.h"
+#include "vars.h"
+
+extern char **environ;
+
+/* prototypes */
+void test_length();
+void test_builtin();
+void test_fork();
+void test_expand();
+void test_bench(int count);
+
+
+/* Function: run (helper)
+   cmdsub_run() of a whole string
+*/
+char *run(const char *cmdline)
+{
+	return cmdsub_run(cmdline, strlen(cmdline), 0);
+}
+
+
+/* Function: test_length
+   Nested and quoted parentheses, unclosed substitutions
+*/
+void test_length()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CMDSUB length\n");
+#endif
+
+	assert(cmdsub_length("$(pwd)") == 6);
+	assert(cmdsub_length("$(pwd)/x") == 6);
+	assert(cmdsub_length("$(echo $(pwd))") == 14);
+	assert(cmdsub_length("$(echo ')')") == 11);
+	assert(cmdsub_length("$(echo") == 0);
+}
+
+
+/* Function: test_builtin
+   echo, pwd and true run without a child
+*/
+void test_builtin()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CMDSUB in process\n");
+#endif
+
+	char *out, cwd[PATH_MAX];
+	long forks = cmdsub_forks();
+
+	assert(vars_set("NAME", "world", FALSE) == 0);
+	out = run("echo hello $NAME");
+	assert(strcmp(out, "hello world") == 0);
+	free(out);
+	out = run("echo -n a  b");
+	assert(strcmp(out, "a b") == 0);
+	free(out);
+	out = run("pwd");
+	assert(strcmp(out, getcwd(cwd, sizeof cwd)) == 0);
+	free(out);
+	out = run("true");
+	assert(strcmp(out, "") == 0);
+	free(out);
+	out = cmdsub_run("echo $?)", 7, 3);
+	assert(strcmp(out, "3") == 0);
+	free(out);
+
+	// quoted words stay whole, quotes removed, '$' in single quotes kept
+	out = run("echo \"in ; semi\" 'a|b'");
+	assert(strcmp(out, "in ; semi a|b") == 0);
+	free(out);
+	out = run("echo \"$NAME  x\" '$NAME'");
+	assert(strcmp(out, "world  x $NAME") == 0);
+	free(out);
+	assert(cmdsub_forks() == forks);
+}
+
+
+/* Function: test_fork
+   External commands, pipelines, lists, trailing newlines, large output
+*/
+void test_fork()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CMDSUB child\n");
+#endif
+
+	char *out;
+	long forks = cmdsub_forks();
+
+	out = run("printf a\\nb\\n\\n\\n");
+	assert(strcmp(out, "a\nb") == 0);
+	free(out);
+	out = run("echo abc | tr b x");
+	assert(strcmp(out, "axc") == 0);
+	free(out);
+	out = run("false || echo $?");
+	assert(strcmp(out, "1") == 0);
+	free(out);
+	out = run("echo out > /dev/null; echo x");
+	assert(strcmp(out, "x") == 0);
+	free(out);
+	out = run("seq 1 100000");
+	assert(strlen(out) == 588894);
+	assert(strncmp(out + strlen(out) - 7, "\n100000", 7) == 0);
+	free(out);
+	assert(cmdsub_forks() == forks + 5);
+}
+
+
+/* Function: test_expand
+   Substitutions in words: nesting, splitting, assignments
+*/
+void test_expand()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CMDSUB expand\n");
+#endif
+
+	char *words[] = {"cmd", "$(echo a b)", "x$(echo $(echo in))y", "$(true)", "V=$(echo 1 2)", NULL};
+	const char *expected[] = {"cmd", "a", "b", "xiny", "V=1 2", NULL};
+	char **out;
+	int i;
+
+	out = vars_expand(words, 0);
+	for (i = 0; expected[i] != NULL; i++)
+	{
+		assert(out[i] != NULL && strcmp(out[i], expected[i]) == 0);
+	}
+	assert(out[i] == NULL);
+	assert(out[0] == words[0]);
+	vars_expand_free(out, words);
+}
+
+
+/* Function: test_bench
+   count substitutions answered in process against the same in a child
+*/
+void test_bench(int count)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: CMDSUB %d substitutions\n", count);
+#endif
+
+	struct timespec start, end;
+	long inproc_us, fork_us;
+	char *out;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++)
+	{
+		out = run("echo $NAME");
+		free(out);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	inproc_us = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++)
+	{
+		out = run("/bin/echo $NAME");
+		assert(strcmp(out, "world") == 0);
+		free(out);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fork_us = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+
+#ifdef DEBUG_TEST
+	printf("TEST: CMDSUB in process %ld us, child %ld us\n", inproc_us, fork_us);
+#endif
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: CMDSUB Module\n");
+#endif
+
+	assert(vars_init(environ) == 0);
+	test_length();
+	test_builtin();
+	test_fork();
+	test_expand();
+	test_bench(200);
+	vars_free();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: CMDSUB Module\n");
+#endif
+
+	return 0;
+}
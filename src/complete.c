@@ -0,0 +1,667 @@
+#include "complete.h"
+#include <sys/syscall.h>
+
+
+/* Directory entry returned by getdents64() */
+struct dirent64_raw {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+#ifndef DT_UNKNOWN
+#define DT_UNKNOWN 0
+#define DT_DIR 4
+#define DT_REG 8
+#define DT_LNK 10
+#endif
+
+
+/* Completion sources */
+static const char **builtin_names = NULL;
+static PIDTABLE *job_table = NULL;
+
+/* Executable index, replaced by the index thread under index_lock */
+static PATHINDEX *path_index = NULL;
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t index_thread;
+static int index_started = FALSE;
+static volatile int index_building = FALSE;
+
+
+/* Function: pathindex_add (internal)
+   Append name (len bytes) to the pool
+*/
+static int pathindex_add(PATHINDEX *idx, const char *name, int len)
+{
+	char *pool;
+	uint32_t *names;
+
+	if (idx->pool_len + len + 1 > idx->pool_size)
+	{
+		pool = realloc(idx->pool, 2 * idx->pool_size + len + 1);
+		if (pool == NULL)
+		{
+			return -1;
+		}
+		idx->pool = pool;
+		idx->pool_size = 2 * idx->pool_size + len + 1;
+	}
+	if (idx->count == idx->capacity)
+	{
+		names = realloc(idx->name, (2 * idx->capacity + 64) * sizeof (uint32_t));
+		if (names == NULL)
+		{
+			return -1;
+		}
+		idx->name = names;
+		idx->capacity = 2 * idx->capacity + 64;
+	}
+
+	idx->name[idx->count++] = idx->pool_len;
+	memcpy(idx->pool + idx->pool_len, name, len + 1);
+	idx->pool_len += len + 1;
+
+	return 0;
+}
+
+
+/* Function: pathindex_cmp (internal)
+   qsort_r() comparator for name offsets
+*/
+static int pathindex_cmp(const void *a, const void *b, void *pool)
+{
+	return strcmp((char*) pool + *(const uint32_t*) a, (char*) pool + *(const uint32_t*) b);
+}
+
+
+/* Function: pathindex_scan (internal)
+   Add the executables of one directory
+*/
+static void pathindex_scan(PATHINDEX *idx, const char *dir)
+{
+	char buf[COMPLETE_DENTS];
+	struct dirent64_raw *d;
+	struct stat st;
+	long n, off;
+	int fd;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return;
+	}
+
+	while ((n = syscall(SYS_getdents64, fd, buf, sizeof buf)) > 0)
+	{
+		for (off = 0; off < n; off += d->d_reclen)
+		{
+			d = (struct dirent64_raw*) (buf + off);
+			if (d->d_name[0] == '.' || d->d_type == DT_DIR)
+			{
+				continue;
+			}
+			// follows symlinks: only regular files with an execute bit
+			if (-1 == fstatat(fd, d->d_name, &st, 0) || !S_ISREG(st.st_mode) ||
+				(st.st_mode & 0111) == 0)
+			{
+				continue;
+			}
+			pathindex_add(idx, d->d_name, strlen(d->d_name));
+		}
+	}
+	close(fd);
+}
+
+
+/* Function: pathindex_dirs (internal)
+   Call fn for each directory in path, at most COMPLETE_DIRS
+   Returns number of directories
+*/
+static int pathindex_dirs(const char *path, void (*fn)(void*, const char*, int), void *arg)
+{
+	char dir[PATH_MAX];
+	const char *p = path, *end;
+	int n = 0, len;
+
+	while (*p != '\0' && n < COMPLETE_DIRS)
+	{
+		end = strchr(p, ':');
+		len = (end == NULL) ? strlen(p) : end - p;
+		if (len == 0)
+		{
+			// empty entry is the current directory, not indexed
+			p += (end == NULL) ? 0 : 1;
+			continue;
+		}
+		if (len < PATH_MAX)
+		{
+			memcpy(dir, p, len);
+			dir[len] = '\0';
+			fn(arg, dir, n++);
+		}
+		p += len + ((end == NULL) ? 0 : 1);
+	}
+
+	return n;
+}
+
+
+/* Function: pathindex_visit (internal)
+   pathindex_dirs() callback of pathindex_build()
+*/
+static void pathindex_visit(void *arg, const char *dir, int n)
+{
+	PATHINDEX *idx = (PATHINDEX*) arg;
+	struct stat st;
+
+	// record mtime before scanning so a concurrent change marks it stale
+	if (0 == stat(dir, &st))
+	{
+		idx->mtime[n] = st.st_mtim;
+	}
+	pathindex_scan(idx, dir);
+}
+
+
+/* Function: pathindex_build
+   Scan all directories, sort and drop duplicates
+*/
+PATHINDEX *pathindex_build(const char *path)
+{
+	PATHINDEX *idx;
+	int i, j;
+
+	idx = calloc(1, sizeof (PATHINDEX));
+	if (idx == NULL)
+	{
+		return NULL;
+	}
+	idx->path = strdup(path);
+	if (idx->path == NULL)
+	{
+		free(idx);
+		return NULL;
+	}
+
+	idx->ndirs = pathindex_dirs(path, pathindex_visit, idx);
+	if (idx->count == 0)
+	{
+		return idx;
+	}
+
+	qsort_r(idx->name, idx->count, sizeof (uint32_t), pathindex_cmp, idx->pool);
+	for (i = 1, j = 1; i < idx->count; i++)
+	{
+		if (strcmp(idx->pool + idx->name[i], idx->pool + idx->name[j-1]) != 0)
+		{
+			idx->name[j++] = idx->name[i];
+		}
+	}
+	idx->count = j;
+
+	return idx;
+}
+
+
+/* Function: pathindex_lower (internal)
+   First name not below prefix (compared on the first plen bytes)
+*/
+static int pathindex_lower(PATHINDEX *idx, const char *prefix, int plen, int upper)
+{
+	int lo = 0, hi = idx->count, mid, cmp;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		cmp = strncmp(idx->pool + idx->name[mid], prefix, plen);
+		if (cmp < 0 || (upper && cmp == 0))
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+
+/* Function: pathindex_find
+   Two binary searches for the prefix range
+*/
+int pathindex_find(PATHINDEX *idx, const char *prefix, int plen, int *first)
+{
+	int lo, hi;
+
+	if (idx == NULL)
+	{
+		*first = 0;
+		return 0;
+	}
+	lo = pathindex_lower(idx, prefix, plen, FALSE);
+	hi = pathindex_lower(idx, prefix, plen, TRUE);
+	*first = lo;
+
+	return hi - lo;
+}
+
+
+/* Function: pathindex_get
+   nth name
+*/
+const char *pathindex_get(PATHINDEX *idx, int n)
+{
+	return idx->pool + idx->name[n];
+}
+
+
+/* Function: pathindex_check (internal)
+   pathindex_dirs() callback of pathindex_stale()
+*/
+static void pathindex_check(void *arg, const char *dir, int n)
+{
+	PATHINDEX *idx = ((void**) arg)[0];
+	int *stale = ((void**) arg)[1];
+	struct stat st;
+
+	if (*stale == FALSE && 0 == stat(dir, &st) &&
+		(st.st_mtim.tv_sec != idx->mtime[n].tv_sec || st.st_mtim.tv_nsec != idx->mtime[n].tv_nsec))
+	{
+		*stale = TRUE;
+	}
+}
+
+
+/* Function: pathindex_stale
+   Compare $PATH and directory mtimes
+*/
+int pathindex_stale(PATHINDEX *idx, const char *path)
+{
+	int stale = FALSE;
+	void *arg[2] = {idx, &stale};
+
+	if (idx == NULL || strcmp(idx->path, path) != 0)
+	{
+		return TRUE;
+	}
+	pathindex_dirs(path, pathindex_check, arg);
+
+	return stale;
+}
+
+
+/* Function: pathindex_free
+   Deallocate
+*/
+void pathindex_free(PATHINDEX *idx)
+{
+	if (idx == NULL)
+	{
+		return;
+	}
+	free(idx->pool);
+	free(idx->name);
+	free(idx->path);
+	free(idx);
+}
+
+
+/* Function: complete_worker (internal)
+   Index thread: build the index of path (owned) and publish it
+*/
+static void *complete_worker(void *arg)
+{
+	PATHINDEX *idx, *old;
+
+	idx = pathindex_build((char*) arg);
+	free(arg);
+	if (idx != NULL)
+	{
+		pthread_mutex_lock(&index_lock);
+		old = path_index;
+		path_index = idx;
+		pthread_mutex_unlock(&index_lock);
+		pathindex_free(old);
+	}
+	index_building = FALSE;
+
+	return NULL;
+}
+
+
+/* Function: complete_refresh (internal)
+   Start a rebuild if the index is missing or stale and none is running.
+   The thread starts with all signals blocked, the main thread handles them
+*/
+static void complete_refresh()
+{
+	const char *path = getenv("PATH");
+	sigset_t all, old;
+	char *copy;
+	int stale, ret;
+
+	if (path == NULL || index_building == TRUE)
+	{
+		return;
+	}
+	pthread_mutex_lock(&index_lock);
+	stale = pathindex_stale(path_index, path);
+	pthread_mutex_unlock(&index_lock);
+	if (stale == FALSE)
+	{
+		return;
+	}
+
+	if (index_started == TRUE)
+	{
+		// previous build is done, reap it
+		pthread_join(index_thread, NULL);
+		index_started = FALSE;
+	}
+	copy = strdup(path);
+	if (copy == NULL)
+	{
+		return;
+	}
+	index_building = TRUE;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&index_thread, NULL, complete_worker, copy);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret != 0)
+	{
+#ifdef WARNING
+		printf("-mysh: complete: could not start index thread\n");
+#endif
+		free(copy);
+		index_building = FALSE;
+		return;
+	}
+	index_started = TRUE;
+}
+
+
+/* Function: complete_init
+   Remember sources, start first build
+*/
+void complete_init(const char **builtins, PIDTABLE *table)
+{
+	builtin_names = builtins;
+	job_table = table;
+	complete_refresh();
+}
+
+
+/* Function: complete_free
+   Join and deallocate
+*/
+void complete_free()
+{
+	if (index_started == TRUE)
+	{
+		pthread_join(index_thread, NULL);
+		index_started = FALSE;
+	}
+	pathindex_free(path_index);
+	path_index = NULL;
+}
+
+
+/* Function: complete_add (internal)
+   Add a candidate made of prefix (plen bytes), name and suffix
+*/
+static int complete_add(COMPLETION *c, const char *prefix, int plen, const char *name, const char *suffix)
+{
+	char **match, *s;
+	int nlen = strlen(name), slen = strlen(suffix);
+
+	if (c->count == c->capacity)
+	{
+		match = realloc(c->match, (2 * c->capacity + 16) * sizeof (char*));
+		if (match == NULL)
+		{
+			return -1;
+		}
+		c->match = match;
+		c->capacity = 2 * c->capacity + 16;
+	}
+	s = malloc(plen + nlen + slen + 1);
+	if (s == NULL)
+	{
+		return -1;
+	}
+	memcpy(s, prefix, plen);
+	memcpy(s + plen, name, nlen);
+	memcpy(s + plen + nlen, suffix, slen + 1);
+	c->match[c->count++] = s;
+
+	return 0;
+}
+
+
+/* Function: complete_strcmp (internal)
+   qsort() comparator for candidates
+*/
+static int complete_strcmp(const void *a, const void *b)
+{
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+
+/* Function: complete_commands (internal)
+   Builtins and executables starting with word
+*/
+static void complete_commands(COMPLETION *c, const char *word, int wlen)
+{
+	int i, n, first;
+
+	for (i = 0; builtin_names != NULL && builtin_names[i] != NULL; i++)
+	{
+		if (strncmp(builtin_names[i], word, wlen) == 0)
+		{
+			complete_add(c, "", 0, builtin_names[i], "");
+		}
+	}
+
+	complete_refresh();
+	pthread_mutex_lock(&index_lock);
+	if (path_index == NULL && index_started == TRUE)
+	{
+		// first query before the initial build finished
+		pthread_mutex_unlock(&index_lock);
+		pthread_join(index_thread, NULL);
+		index_started = FALSE;
+		pthread_mutex_lock(&index_lock);
+	}
+	n = pathindex_find(path_index, word, wlen, &first);
+	for (i = 0; i < n; i++)
+	{
+		complete_add(c, "", 0, pathindex_get(path_index, first + i), "");
+	}
+	pthread_mutex_unlock(&index_lock);
+}
+
+
+/* Function: complete_jobs (internal)
+   Job specs "%n" starting with word
+*/
+static void complete_jobs(COMPLETION *c, const char *word, int wlen)
+{
+	sigset_t all, old;
+	char spec[16];
+	int i, capacity;
+
+	if (job_table == NULL)
+	{
+		return;
+	}
+	// the table is updated by the SIGCHLD handler
+	sigfillset(&all);
+	sigprocmask(SIG_SETMASK, &all, &old);
+	capacity = pidtable_getcapacity(job_table);
+	for (i = 1; i <= capacity; i++)
+	{
+		if (pidtable_getindex(job_table, i) == NULL)
+		{
+			continue;
+		}
+		snprintf(spec, sizeof spec, "%%%d", i);
+		if (strncmp(spec, word, wlen) == 0)
+		{
+			complete_add(c, "", 0, spec, "");
+		}
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+
+/* Function: complete_files (internal)
+   Entries of the directory part of word starting with the rest of it
+*/
+static void complete_files(COMPLETION *c, const char *word, int wlen)
+{
+	char buf[COMPLETE_DENTS], dir[PATH_MAX];
+	const char *base, *slash;
+	struct dirent64_raw *d;
+	struct stat st;
+	long n, off;
+	int fd, dlen, blen, isdir;
+
+	slash = memrchr(word, '/', wlen);
+	dlen = (slash == NULL) ? 0 : slash - word + 1;
+	base = word + dlen;
+	blen = wlen - dlen;
+	if (dlen >= PATH_MAX)
+	{
+		return;
+	}
+	if (dlen == 0)
+	{
+		strcpy(dir, ".");
+	}
+	else
+	{
+		memcpy(dir, word, dlen);
+		dir[dlen] = '\0';
+	}
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return;
+	}
+	while ((n = syscall(SYS_getdents64, fd, buf, sizeof buf)) > 0)
+	{
+		for (off = 0; off < n; off += d->d_reclen)
+		{
+			d = (struct dirent64_raw*) (buf + off);
+			if (strncmp(d->d_name, base, blen) != 0 ||
+				strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+			{
+				continue;
+			}
+			// hidden files only when asked for
+			if (d->d_name[0] == '.' && blen == 0)
+			{
+				continue;
+			}
+			isdir = (d->d_type == DT_DIR);
+			if (d->d_type == DT_LNK || d->d_type == DT_UNKNOWN)
+			{
+				isdir = (0 == fstatat(fd, d->d_name, &st, 0) && S_ISDIR(st.st_mode));
+			}
+			complete_add(c, word, dlen, d->d_name, isdir ? "/" : "");
+		}
+	}
+	close(fd);
+}
+
+
+/* Function: complete_word
+   Find the word, pick the source, sort and drop duplicates
+*/
+int complete_word(const char *line, int pos, COMPLETION *c)
+{
+	const char *sep = " \t;|&<>()";
+	int start, prev, i, j;
+
+	c->match = NULL;
+	c->count = c->capacity = 0;
+
+	for (start = pos; start > 0 && strchr(sep, line[start-1]) == NULL; start--);
+	c->start = start;
+	for (prev = start; prev > 0 && (line[prev-1] == ' ' || line[prev-1] == '\t'); prev--);
+
+	if (line[start] == '%')
+	{
+		complete_jobs(c, line + start, pos - start);
+	}
+	else if ((prev == 0 || strchr(";|&(", line[prev-1]) != NULL) &&
+		memchr(line + start, '/', pos - start) == NULL)
+	{
+		complete_commands(c, line + start, pos - start);
+	}
+	else
+	{
+		complete_files(c, line + start, pos - start);
+	}
+
+	if (c->count > 1)
+	{
+		qsort(c->match, c->count, sizeof (char*), complete_strcmp);
+		for (i = 1, j = 1; i < c->count; i++)
+		{
+			if (strcmp(c->match[i], c->match[j-1]) == 0)
+			{
+				free(c->match[i]);
+			}
+			else
+			{
+				c->match[j++] = c->match[i];
+			}
+		}
+		c->count = j;
+	}
+
+	return c->count;
+}
+
+
+/* Function: complete_common
+   Longest shared prefix
+*/
+int complete_common(COMPLETION *c)
+{
+	int len;
+
+	if (c->count == 0)
+	{
+		return 0;
+	}
+	// sorted: the first and last candidates differ the most
+	for (len = 0; c->match[0][len] != '\0' && c->match[0][len] == c->match[c->count-1][len]; len++);
+
+	return len;
+}
+
+
+/* Function: complete_release
+   Free candidates
+*/
+void complete_release(COMPLETION *c)
+{
+	int i;
+
+	for (i = 0; i < c->count; i++)
+	{
+		free(c->match[i]);
+	}
+	free(c->match);
+	c->match = NULL;
+	c->count = c->capacity = 0;
+}
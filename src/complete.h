@@ -0,0 +1,125 @@
+/*
+	Tab completion
+	The word under the cursor is completed from one of three sources:
+		command position: builtin names and executables found in $PATH
+		"%" prefix: job specs of the entries in the PIDTABLE
+		anywhere else: file names in the directory part of the word
+
+	Executables are kept in a PATHINDEX, a sorted array of offsets into a
+	string pool, so a prefix query is two binary searches. The index is built
+	by a background thread at startup; every query stats the $PATH
+	directories and, when $PATH or a directory mtime changed, starts a rebuild
+	while queries keep using the previous index. Directories are read with
+	batched getdents64() calls rather than one readdir() per entry.
+*/
+
+#ifndef _COMPLETE_H_
+#define _COMPLETE_H_
+
+#include "include.h"
+#include "pidtable.h"
+#include <stdint.h>
+#include <pthread.h>
+
+/* Buffer size for getdents64() batches */
+#define COMPLETE_DENTS (32 * 1024)
+
+/* Max number of $PATH directories watched for changes */
+#define COMPLETE_DIRS 64
+
+
+/* Typedef: PATHINDEX
+   Sorted, duplicate free executable names of all $PATH directories
+   pool holds the names, name[] their offsets sorted by name
+   path and mtime[] record the $PATH value and directory mtimes it was built from
+*/
+typedef struct pathindex {
+	char *pool;
+	size_t pool_len;
+	size_t pool_size;
+	uint32_t *name;
+	int count;
+	int capacity;
+	char *path;
+	int ndirs;
+	struct timespec mtime[COMPLETE_DIRS];
+} PATHINDEX;
+
+
+/* Typedef: COMPLETION
+   List of candidates for the word starting at start, sorted and unique
+   Directory candidates end with '/'
+*/
+typedef struct completion {
+	char **match;
+	int count;
+	int capacity;
+	int start;
+} COMPLETION;
+
+
+/* Function: complete_init
+   Set the builtin names (NULL terminated) and job table used for completion
+   and start building the executable index in the background
+*/
+void complete_init(const char **builtins, PIDTABLE *table);
+
+
+/* Function: complete_free
+   Wait for the index thread and deallocate the executable index
+*/
+void complete_free();
+
+
+/* Function: complete_word
+   Collect candidates for the word ending at pos in line
+   Returns number of candidates; c must be released with complete_release()
+*/
+int complete_word(const char *line, int pos, COMPLETION *c);
+
+
+/* Function: complete_common
+   Returns length of the longest prefix shared by all candidates
+*/
+int complete_common(COMPLETION *c);
+
+
+/* Function: complete_release
+   Deallocate the candidates in c
+*/
+void complete_release(COMPLETION *c);
+
+
+/* Function: pathindex_build
+   Build the executable index of the colon separated directory list path
+   Returns dynamically allocated PATHINDEX, NULL on allocation failure
+*/
+PATHINDEX *pathindex_build(const char *path);
+
+
+/* Function: pathindex_find
+   Find the range of names starting with prefix (plen bytes)
+   Returns number of matches and stores the index of the first in *first
+*/
+int pathindex_find(PATHINDEX *idx, const char *prefix, int plen, int *first);
+
+
+/* Function: pathindex_get
+   Returns the nth name in sorted order
+*/
+const char *pathindex_get(PATHINDEX *idx, int n);
+
+
+/* Function: pathindex_stale
+   Returns TRUE if path differs from the one idx was built from or one of the
+   directories was modified since
+*/
+int pathindex_stale(PATHINDEX *idx, const char *path);
+
+
+/* Function: pathindex_free
+   Deallocate the index
+*/
+void pathindex_free(PATHINDEX *idx);
+
+#endif /* _COMPLETE_H_ */
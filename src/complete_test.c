@@ -0,0 +1,238 @@
+#include "complete.h"
+#include <ftw.h>
+
+#define TDIR "/tmp/mysh_complete_test"
+
+/* prototypes */
+void test_setup();
+void test_destroy();
+void test_index();
+void test_stale();
+void test_words();
+void test_large(int size);
+
+PATHINDEX *idx;
+const char *builtins[] = {"cd", "jobs", "kill", NULL};
+
+
+/* Function: touch (helper)
+   create file dir/name with mode
+*/
+void touch(const char *dir, const char *name, int mode)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, PATH_MAX, "%s/%s", dir, name);
+	fd = open(path, O_CREAT | O_WRONLY, mode);
+	assert(fd != -1);
+	fchmod(fd, mode);
+	close(fd);
+}
+
+
+/* Function: remove_entry (helper)
+   nftw() callback of remove_dir
+*/
+int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+
+/* Function: remove_dir (helper)
+   delete the files of dir and dir itself
+*/
+void remove_dir(const char *dir)
+{
+	nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+/* Function: test_setup
+   Two PATH directories with overlapping names
+*/
+void test_setup()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: COMPLETE Initialized\n");
+#endif
+
+	remove_dir(TDIR);
+	assert(mkdir(TDIR, 0755) == 0);
+	assert(mkdir(TDIR "/a", 0755) == 0);
+	assert(mkdir(TDIR "/b", 0755) == 0);
+	assert(mkdir(TDIR "/a/subdir", 0755) == 0);
+	touch(TDIR "/a", "gcc", 0755);
+	touch(TDIR "/a", "git", 0755);
+	touch(TDIR "/a", "readme", 0644);
+	touch(TDIR "/b", "git", 0755);
+	touch(TDIR "/b", "gzip", 0755);
+	touch(TDIR "/b", "ls", 0755);
+	touch(TDIR "/b", ".hidden", 0755);
+}
+
+
+/* Function: test_destroy
+   Remove test directories
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: COMPLETE Closed\n");
+#endif
+
+	pathindex_free(idx);
+	remove_dir(TDIR);
+}
+
+
+/* Function: test_index
+   Sorted, unique executables only
+*/
+void test_index()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: COMPLETE executable index\n");
+#endif
+
+	int first, n;
+
+	idx = pathindex_build(TDIR "/a:" TDIR "/b::/nonexistent");
+	assert(idx != NULL);
+	assert(idx->count == 4);
+	assert(idx->ndirs == 3);
+
+	n = pathindex_find(idx, "g", 1, &first);
+	assert(n == 3);
+	assert(strcmp(pathindex_get(idx, first), "gcc") == 0);
+	assert(strcmp(pathindex_get(idx, first + 1), "git") == 0);
+	assert(strcmp(pathindex_get(idx, first + 2), "gzip") == 0);
+
+	n = pathindex_find(idx, "git", 3, &first);
+	assert(n == 1);
+	assert(pathindex_find(idx, "gitk", 4, &first) == 0);
+	assert(pathindex_find(idx, "readme", 6, &first) == 0);
+	assert(pathindex_find(idx, "", 0, &first) == 4);
+}
+
+
+/* Function: test_stale
+   Changes to PATH or a directory are detected
+*/
+void test_stale()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: COMPLETE stale detection\n");
+#endif
+
+	struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+
+	assert(pathindex_stale(idx, TDIR "/a:" TDIR "/b::/nonexistent") == FALSE);
+	assert(pathindex_stale(idx, TDIR "/a") == TRUE);
+
+	touch(TDIR "/b", "grep", 0755);
+	assert(utimensat(AT_FDCWD, TDIR "/b", times, 0) == 0);
+	assert(pathindex_stale(idx, TDIR "/a:" TDIR "/b::/nonexistent") == TRUE);
+
+	pathindex_free(idx);
+	idx = pathindex_build(TDIR "/a:" TDIR "/b");
+	assert(idx->count == 5);
+}
+
+
+/* Function: test_words
+   Source selection by position of the word
+*/
+void test_words()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: COMPLETE words\n");
+#endif
+
+	COMPLETION c;
+
+	setenv("PATH", TDIR "/a:" TDIR "/b", 1);
+	complete_init(builtins, NULL);
+
+	// command position: builtins and executables
+	assert(complete_word("g", 1, &c) == 4);
+	assert(c.start == 0);
+	assert(strcmp(c.match[0], "gcc") == 0);
+	assert(complete_common(&c) == 1);
+	complete_release(&c);
+
+	assert(complete_word("echo x | ki", 11, &c) == 1);
+	assert(c.start == 9);
+	assert(strcmp(c.match[0], "kill") == 0);
+	complete_release(&c);
+
+	// argument position: files
+	assert(complete_word("cat " TDIR "/a/s", strlen("cat " TDIR "/a/s"), &c) == 1);
+	assert(strcmp(c.match[0], TDIR "/a/subdir/") == 0);
+	complete_release(&c);
+
+	assert(complete_word("ls " TDIR "/b/", strlen("ls " TDIR "/b/"), &c) == 4);
+	complete_release(&c);
+	assert(complete_word("ls " TDIR "/b/.", strlen("ls " TDIR "/b/."), &c) == 1);
+	complete_release(&c);
+
+	complete_free();
+}
+
+
+/* Function: test_large
+   Prefix queries over size executables
+*/
+void test_large(int size)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: COMPLETE %d executables\n", size);
+#endif
+
+	struct timespec start, end;
+	char name[32];
+	int i, n, first;
+
+	assert(mkdir(TDIR "/large", 0755) == 0);
+	for (i = 0; i < size; i++)
+	{
+		snprintf(name, sizeof name, "cmd%05d", i);
+		touch(TDIR "/large", name, 0755);
+	}
+	pathindex_free(idx);
+	idx = pathindex_build(TDIR "/large:" TDIR "/a");
+	assert(idx->count == size + 2);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < 1000; i++)
+	{
+		n = pathindex_find(idx, "cmd1234", 7, &first);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	assert(n == 10);
+	assert(strcmp(pathindex_get(idx, first), "cmd12340") == 0);
+	// 1000 queries well under a millisecond each
+	assert((end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec < 100000000L);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: COMPLETE Module\n");
+#endif
+
+	test_setup();
+	test_index();
+	test_stale();
+	test_words();
+	test_large(20000);
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: COMPLETE Module\n");
+#endif
+
+	return 0;
+}
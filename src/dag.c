@@ -0,0 +1,791 @@
+#include "dag.h"
+#include "vars.h"
+#include "wildcard.h"
+#include "alias.h"
+#include <poll.h>
+#include <sys/syscall.h>
+
+
+/* Function: dag_trim (internal)
+   Skip leading blanks, cut trailing blanks and newline in place
+*/
+static char *dag_trim(char *s)
+{
+	char *end;
+
+	while (isspace(*s))
+	{
+		s++;
+	}
+	end = s + strlen(s);
+	while (end > s && isspace(end[-1]))
+	{
+		*--end = '\0';
+	}
+
+	return s;
+}
+
+
+/* Function: dag_compare (internal)
+   qsort/bsearch order of task indexes by name, dag_sorted is the graph
+*/
+static const DAG *dag_sorted;
+
+static int dag_compare(const void *a, const void *b)
+{
+	return strcmp(dag_sorted->task[*(const int*) a].name, dag_sorted->task[*(const int*) b].name);
+}
+
+
+/* Function: dag_find (internal)
+   Index of task name using the sorted index order, -1 if there is none
+*/
+static int dag_find(const DAG *dag, const int *order, const char *name)
+{
+	int lo = 0, hi = dag->count - 1, mid, cmp;
+
+	while (lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		cmp = strcmp(name, dag->task[order[mid]].name);
+		if (cmp == 0)
+		{
+			return order[mid];
+		}
+		if (cmp < 0)
+		{
+			hi = mid - 1;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+
+	return -1;
+}
+
+
+/* Function: dag_resolve (internal)
+   Turn the dependency names of every task into indexes, fill the users
+   lists and check for cycles (Kahn's algorithm)
+   deps[i] is the dependency list of task i as written in the file
+   Returns 0, -1 on error
+*/
+static int dag_resolve(DAG *dag, char **deps)
+{
+	int *order, *queue, i, j, k, head = 0, tail = 0, ret = -1;
+	char *word, *save;
+
+	order = malloc(dag->count * sizeof (int));
+	queue = malloc(dag->count * sizeof (int));
+	dag->users = calloc(dag->count, sizeof (int*));
+	dag->nusers = calloc(dag->count, sizeof (int));
+	if (order == NULL || queue == NULL || dag->users == NULL || dag->nusers == NULL)
+	{
+		perror("malloc");
+		goto resolve_exit;
+	}
+	for (i = 0; i < dag->count; i++)
+	{
+		order[i] = i;
+	}
+	dag_sorted = dag;
+	qsort(order, dag->count, sizeof (int), dag_compare);
+	for (i = 1; i < dag->count; i++)
+	{
+		if (strcmp(dag->task[order[i]].name, dag->task[order[i-1]].name) == 0)
+		{
+#ifdef WARNING
+	printf("-mysh: dag: %s: task defined twice\n", dag->task[order[i]].name);
+#endif
+			goto resolve_exit;
+		}
+	}
+
+	for (i = 0; i < dag->count; i++)
+	{
+		for (word = strtok_r(deps[i], " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save))
+		{
+			j = dag_find(dag, order, word);
+			if (j == -1 || dag->task[i].ndeps == DAG_DEPS)
+			{
+#ifdef WARNING
+	printf("-mysh: dag: %s: %s %s\n", dag->task[i].name,
+		(j == -1) ? "unknown task" : "too many dependencies at", word);
+#endif
+				goto resolve_exit;
+			}
+			dag->task[i].deps[dag->task[i].ndeps++] = j;
+			dag->nusers[j]++;
+		}
+	}
+	for (i = 0; i < dag->count; i++)
+	{
+		dag->users[i] = malloc((dag->nusers[i] + 1) * sizeof (int));
+		dag->nusers[i] = 0;
+	}
+	for (i = 0; i < dag->count; i++)
+	{
+		for (k = 0; k < dag->task[i].ndeps; k++)
+		{
+			j = dag->task[i].deps[k];
+			dag->users[j][dag->nusers[j]++] = i;
+		}
+		dag->task[i].pending = dag->task[i].ndeps;
+		if (dag->task[i].pending == 0)
+		{
+			queue[tail++] = i;
+		}
+	}
+
+	// tasks never freed of their pending dependencies are on a cycle
+	while (head < tail)
+	{
+		i = queue[head++];
+		for (k = 0; k < dag->nusers[i]; k++)
+		{
+			if (--dag->task[dag->users[i][k]].pending == 0)
+			{
+				queue[tail++] = dag->users[i][k];
+			}
+		}
+	}
+	for (i = 0; i < dag->count; i++)
+	{
+		if (dag->task[i].pending != 0)
+		{
+#ifdef WARNING
+	printf("-mysh: dag: %s: dependency cycle\n", dag->task[i].name);
+#endif
+			goto resolve_exit;
+		}
+	}
+	ret = 0;
+
+resolve_exit:
+	free(order);
+	free(queue);
+	return ret;
+}
+
+
+/* Function: dag_load
+   One task per line, dependencies resolved once the whole file is read
+*/
+DAG *dag_load(const char *path)
+{
+	FILE *fp;
+	DAG *dag;
+	DAG_TASK *task;
+	char *line = NULL, *name, *deps, *cmdline, **depv = NULL, **grow;
+	size_t size = 0;
+	int lineno = 0, capacity = 0, i, ok = TRUE;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+#ifdef WARNING
+	printf("-mysh: dag: %s: %s\n", path, strerror(errno));
+#endif
+		return NULL;
+	}
+	dag = calloc(1, sizeof (DAG));
+
+	while (ok && getline(&line, &size, fp) != -1)
+	{
+		lineno++;
+		name = dag_trim(line);
+		if (*name == '\0' || *name == '#')
+		{
+			continue;
+		}
+		deps = strchr(name, ':');
+		cmdline = (deps != NULL) ? strchr(deps + 1, ':') : NULL;
+		if (cmdline == NULL)
+		{
+#ifdef WARNING
+	printf("-mysh: dag: %s:%d: expected name: deps: command\n", path, lineno);
+#endif
+			ok = FALSE;
+			break;
+		}
+		*deps++ = '\0';
+		*cmdline++ = '\0';
+		name = dag_trim(name);
+		cmdline = dag_trim(cmdline);
+		if (*name == '\0' || strlen(name) >= DAG_NAME || strpbrk(name, " \t") != NULL || *cmdline == '\0')
+		{
+#ifdef WARNING
+	printf("-mysh: dag: %s:%d: invalid task name or empty command\n", path, lineno);
+#endif
+			ok = FALSE;
+			break;
+		}
+
+		if (dag->count == capacity)
+		{
+			capacity = (capacity == 0) ? 16 : 2 * capacity;
+			task = realloc(dag->task, capacity * sizeof (DAG_TASK));
+			grow = realloc(depv, capacity * sizeof (char*));
+			if (task != NULL)
+			{
+				dag->task = task;
+			}
+			if (grow != NULL)
+			{
+				depv = grow;
+			}
+			if (task == NULL || grow == NULL)
+			{
+				perror("realloc");
+				ok = FALSE;
+				break;
+			}
+		}
+		task = &dag->task[dag->count];
+		memset(task, 0, sizeof (DAG_TASK));
+		strcpy(task->name, name);
+		task->cmdline = strdup(cmdline);
+		task->pid = task->pidfd = -1;
+		depv[dag->count++] = strdup(deps);
+	}
+	free(line);
+	fclose(fp);
+
+	if (ok && -1 == dag_resolve(dag, depv))
+	{
+		ok = FALSE;
+	}
+	for (i = 0; i < dag->count; i++)
+	{
+		free(depv[i]);
+	}
+	free(depv);
+	if (ok == FALSE)
+	{
+		dag_free(dag);
+		return NULL;
+	}
+
+	return dag;
+}
+
+
+/* Function: dag_redirect (internal)
+   In a pipeline member: open the input and output files of cmd, their
+   names expanded with status prev
+*/
+static void dag_redirect(const COMMAND *cmd, int prev)
+{
+	char *names[3] = {cmd->infile, cmd->outfile, NULL}, **path;
+	int fd;
+
+	path = vars_expand((cmd->infile != NULL) ? names : &names[1], prev);
+	for (fd = 0; path[fd] != NULL; fd++)
+	{
+		command_unmark(path[fd]);
+	}
+	if (cmd->infile != NULL)
+	{
+		fd = open(*path, O_RDONLY);
+		if (fd == -1 || -1 == dup2(fd, STDIN_FILENO))
+		{
+			perror(*path);
+			_exit(1);
+		}
+		close(fd);
+		path++;
+	}
+	if (cmd->outfile != NULL)
+	{
+		fd = open(*path, cmd->fdmode | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (fd == -1 || -1 == dup2(fd, STDOUT_FILENO))
+		{
+			perror(*path);
+			_exit(1);
+		}
+		close(fd);
+	}
+}
+
+
+/* Function: dag_stage (internal)
+   In the process of one command of a pipeline: redirections,
+   assignments and patterns, then its function or executable. Never
+   returns
+*/
+static void dag_stage(COMMAND *cmd, int prev)
+{
+	WILDCARD wc;
+	char **argv;
+	int n;
+
+	dag_redirect(cmd, prev);
+	argv = vars_expand(cmd->argv, prev);
+	for (n = 0; argv[n] != NULL && vars_assignment(argv[n]) > 0; n++)
+	{
+	}
+	vars_assign(argv, n, TRUE);
+	if (argv[n] == NULL)
+	{
+		_exit(0);
+	}
+	argv = wildcard_expand(&argv[n], &wc);
+	if (alias_function(argv[0]) != NULL)
+	{
+		alias_exec(alias_function(argv[0]), argv);
+	}
+	execvp(argv[0], argv);
+#ifdef WARNING
+	printf("-mysh: %s: command not found\n", argv[0]);
+#endif
+	_exit(127);
+}
+
+
+/* Function: dag_pipeline (internal)
+   Run the pipeline starting at *cmdp and wait for it, *cmdp is left on
+   its last command. prev is the value of $?
+   Returns the exit status of the last command
+*/
+static int dag_pipeline(COMMAND **cmdp, int prev)
+{
+	COMMAND *cmd = *cmdp;
+	int in = -1, fd[2] = {-1, -1}, pid, last = -1, more, status, ret = 1;
+
+	for (;;)
+	{
+		more = (cmd->pipe == TRUE && cmd->next != NULL);
+		if (more && -1 == pipe(fd))
+		{
+			perror("pipe");
+			more = FALSE;
+		}
+		pid = fork();
+		if (pid == -1)
+		{
+			perror("fork");
+		}
+		else if (pid == 0)
+		{
+			if (in != -1)
+			{
+				dup2(in, STDIN_FILENO);
+				close(in);
+			}
+			if (more)
+			{
+				dup2(fd[1], STDOUT_FILENO);
+				close(fd[0]);
+				close(fd[1]);
+			}
+			dag_stage(cmd, prev);
+		}
+		last = pid;
+		if (in != -1)
+		{
+			close(in);
+			in = -1;
+		}
+		if (more == FALSE)
+		{
+			break;
+		}
+		close(fd[1]);
+		in = fd[0];
+		cmd = cmd->next;
+	}
+	*cmdp = cmd;
+
+	while ((pid = wait(&status)) != -1 || errno == EINTR)
+	{
+		if (pid == last && pid != -1)
+		{
+			ret = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		}
+	}
+
+	return ret;
+}
+
+
+/* Function: dag_list
+   Pipelines of the list run one after the other, && and || decide which
+*/
+int dag_list(COMMAND *cmd, int *status)
+{
+	COMMAND *c;
+
+	for (c = cmd; c != NULL && c->token > 1; c = command_next(c, *status))
+	{
+		*status = dag_pipeline(&c, *status);
+	}
+
+	return 0;
+}
+
+
+/* Function: dag_spawn
+   The processes join the group of the first one. Each resets the
+   signals of the shell as a task does
+*/
+int dag_spawn(COMMAND *cmd, int prev, int *last, int *count)
+{
+	COMMAND *c;
+	sigset_t none;
+	int pgid = 0, in = -1, fd[2] = {-1, -1}, null, pid, more, list;
+
+	for (c = cmd; c->pipe == TRUE && c->next != NULL; c = c->next)
+	{
+	}
+	list = (c->next != NULL);
+	*last = -1;
+	*count = 0;
+	fflush(stdout);
+	null = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	for (c = cmd; ; c = c->next)
+	{
+		more = (list == FALSE && c->pipe == TRUE && c->next != NULL);
+		if (more && -1 == pipe(fd))
+		{
+			perror("pipe");
+			more = FALSE;
+		}
+		pid = fork();
+		if (pid == -1)
+		{
+			perror("fork");
+			if (more)
+			{
+				close(fd[0]);
+				close(fd[1]);
+			}
+			break;
+		}
+		if (pid == 0)
+		{
+			setpgid(0, pgid);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGQUIT, SIG_DFL);
+			signal(SIGTSTP, SIG_DFL);
+			signal(SIGTTOU, SIG_DFL);
+			signal(SIGCHLD, SIG_DFL);
+			sigemptyset(&none);
+			sigprocmask(SIG_SETMASK, &none, NULL);
+			if (in != -1 || null != -1)
+			{
+				dup2((in != -1) ? in : null, STDIN_FILENO);
+			}
+			if (in != -1)
+			{
+				close(in);
+			}
+			if (more)
+			{
+				dup2(fd[1], STDOUT_FILENO);
+				close(fd[0]);
+				close(fd[1]);
+			}
+			if (list)
+			{
+				dag_list(cmd, &prev);
+				fflush(stdout);
+				_exit(prev);
+			}
+			dag_stage(c, prev);
+		}
+		pgid = (pgid == 0) ? pid : pgid;
+		setpgid(pid, pgid);
+		*last = pid;
+		(*count)++;
+		if (in != -1)
+		{
+			close(in);
+			in = -1;
+		}
+		if (more == FALSE)
+		{
+			break;
+		}
+		close(fd[1]);
+		in = fd[0];
+	}
+	if (in != -1)
+	{
+		close(in);
+	}
+	if (null != -1)
+	{
+		close(null);
+	}
+
+	return (pgid == 0) ? -1 : pgid;
+}
+
+
+/* Function: dag_exec
+   The list is parsed and run by dag_list()
+*/
+void dag_exec(const char *cmdline)
+{
+	COMMAND *cmd;
+	int status = 0;
+
+	cmd = command_parse(cmdline);
+	dag_list(cmd, &status);
+	command_free(cmd);
+	fflush(stdout);
+
+	_exit(status);
+}
+
+
+/* Function: dag_elapsed (internal)
+   Seconds since start
+*/
+static double dag_elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+/* Function: dag_start (internal)
+   Fork task i in a process group of its own and open its pidfd
+   Returns 0, -1 if the task could not be started
+*/
+static int dag_start(DAG *dag, int i)
+{
+	DAG_TASK *task = &dag->task[i];
+	sigset_t none;
+	int fd;
+
+	printf("[dag] start %s\n", task->name);
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &task->start);
+	task->pid = fork();
+	if (task->pid == -1)
+	{
+		perror("fork");
+		return -1;
+	}
+	if (task->pid == 0)
+	{
+		setpgid(0, 0);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		signal(SIGTTOU, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, NULL);
+		fd = open("/dev/null", O_RDONLY);
+		if (fd != -1)
+		{
+			dup2(fd, STDIN_FILENO);
+			close(fd);
+		}
+		dag_exec(task->cmdline);
+	}
+	setpgid(task->pid, task->pid);
+	task->state = DAG_RUN;
+	task->pidfd = syscall(SYS_pidfd_open, task->pid, 0);
+
+	return 0;
+}
+
+
+/* Function: dag_skip (internal)
+   Mark the tasks depending on task i as skipped, recursively
+   Returns the number of tasks skipped
+*/
+static int dag_skip(DAG *dag, int i)
+{
+	int k, u, count = 0;
+
+	for (k = 0; k < dag->nusers[i]; k++)
+	{
+		u = dag->users[i][k];
+		if (dag->task[u].state == DAG_WAIT)
+		{
+			dag->task[u].state = DAG_SKIP;
+			printf("[dag] skipped %s (needs %s)\n", dag->task[u].name, dag->task[i].name);
+			count += 1 + dag_skip(dag, u);
+		}
+	}
+
+	return count;
+}
+
+
+/* Function: dag_finish (internal)
+   Record the exit status of task i, queue its users that became ready or
+   skip them if it failed
+   Returns the number of tasks failed or skipped
+*/
+static int dag_finish(DAG *dag, int i, int status, int *ready, int *tail)
+{
+	DAG_TASK *task = &dag->task[i];
+	int k, u;
+
+	task->status = status;
+	if (task->pidfd != -1)
+	{
+		close(task->pidfd);
+		task->pidfd = -1;
+	}
+	if (status != 0)
+	{
+		task->state = DAG_FAIL;
+		printf("[dag] failed %s (exit %d, %.2fs)\n", task->name, status, dag_elapsed(&task->start));
+		return 1 + dag_skip(dag, i);
+	}
+
+	task->state = DAG_OK;
+	printf("[dag] done %s (%.2fs)\n", task->name, dag_elapsed(&task->start));
+	for (k = 0; k < dag->nusers[i]; k++)
+	{
+		u = dag->users[i][k];
+		if (--dag->task[u].pending == 0 && dag->task[u].state == DAG_WAIT)
+		{
+			ready[(*tail)++] = u;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Function: dag_reap (internal)
+   Wait for the task process, returns its exit status
+*/
+static int dag_reap(DAG_TASK *task)
+{
+	int status;
+
+	while (-1 == waitpid(task->pid, &status, 0))
+	{
+		if (errno != EINTR)
+		{
+			perror("waitpid");
+			return 1;
+		}
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+
+/* Function: dag_run
+   Ready tasks are queued in order, the running ones are polled by pidfd
+*/
+int dag_run(DAG *dag, int jobs)
+{
+	struct pollfd *pfd;
+	int *ready, *slot, i, k, head = 0, tail = 0, running = 0, failed = 0;
+
+	if (jobs < 1)
+	{
+		jobs = 1;
+	}
+	ready = malloc(dag->count * sizeof (int));
+	pfd = malloc(jobs * sizeof (struct pollfd));
+	slot = malloc(jobs * sizeof (int));
+	if (ready == NULL || pfd == NULL || slot == NULL)
+	{
+		perror("malloc");
+		free(ready);
+		free(pfd);
+		free(slot);
+		return dag->count;
+	}
+	for (i = 0; i < dag->count; i++)
+	{
+		dag->task[i].state = DAG_WAIT;
+		dag->task[i].pending = dag->task[i].ndeps;
+		if (dag->task[i].pending == 0)
+		{
+			ready[tail++] = i;
+		}
+	}
+
+	while (head < tail || running > 0)
+	{
+		while (running < jobs && head < tail)
+		{
+			i = ready[head++];
+			if (-1 == dag_start(dag, i))
+			{
+				failed += dag_finish(dag, i, 1, ready, &tail);
+			}
+			else if (dag->task[i].pidfd == -1)
+			{
+				// no pidfd, wait for this task alone
+				failed += dag_finish(dag, i, dag_reap(&dag->task[i]), ready, &tail);
+			}
+			else
+			{
+				pfd[running].fd = dag->task[i].pidfd;
+				pfd[running].events = POLLIN;
+				slot[running++] = i;
+			}
+		}
+		if (running == 0)
+		{
+			continue;
+		}
+		if (-1 == poll(pfd, running, -1))
+		{
+			// interrupted by SIGCHLD of the tasks or of other jobs
+			continue;
+		}
+		for (k = running - 1; k >= 0; k--)
+		{
+			if (pfd[k].revents == 0)
+			{
+				continue;
+			}
+			i = slot[k];
+			failed += dag_finish(dag, i, dag_reap(&dag->task[i]), ready, &tail);
+			pfd[k] = pfd[--running];
+			slot[k] = slot[running];
+		}
+		fflush(stdout);
+	}
+
+	free(ready);
+	free(pfd);
+	free(slot);
+	return failed;
+}
+
+
+/* Function: dag_free
+   Free the tasks and the users lists
+*/
+void dag_free(DAG *dag)
+{
+	int i;
+
+	if (dag == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < dag->count; i++)
+	{
+		free(dag->task[i].cmdline);
+		if (dag->users != NULL)
+		{
+			free(dag->users[i]);
+		}
+	}
+	free(dag->task);
+	free(dag->users);
+	free(dag->nusers);
+	free(dag);
+}
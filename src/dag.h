@@ -0,0 +1,123 @@
+/*
+	DAG runs a set of dependent tasks read from a file, like make -j
+	without make. Each line of the file is
+
+		name: dep1 dep2 ...: command line
+
+	blank lines and lines starting with '#' are skipped. A task starts once
+	all its dependencies succeeded; up to jobs tasks run at the same time,
+	each in a process group of its own with stdin from /dev/null. The shell
+	waits for them with one poll() on their pidfds. When a task fails (non
+	zero exit status) the tasks depending on it, directly or not, are not
+	started and reported as skipped; independent tasks still run.
+
+	The command line of a task is parsed by the shell parser and may hold
+	pipes, redirections, ';', && and ||, variables, patterns and $(cmd).
+	Dependencies are resolved and checked for cycles when the file is
+	loaded, before anything runs.
+*/
+
+#ifndef _DAG_H_
+#define _DAG_H_
+
+#include "include.h"
+#include "parser.h"
+
+/* Max length of a task name */
+#define DAG_NAME 64
+
+/* Max number of dependencies of a task */
+#define DAG_DEPS 32
+
+/* Parallel tasks unless given with -j */
+#define DAG_JOBS 4
+
+/* Task states */
+#define DAG_WAIT	0
+#define DAG_RUN		1
+#define DAG_OK		2
+#define DAG_FAIL	3
+#define DAG_SKIP	4
+
+
+/* Typedef: DAG_TASK
+   One task. deps are indexes in the task array, pending the number of
+   dependencies not finished yet, status the exit status once finished
+*/
+typedef struct dag_task {
+	char name[DAG_NAME];
+	char *cmdline;
+	int deps[DAG_DEPS];
+	int ndeps;
+	int pending;
+	int state;
+	int pid;
+	int pidfd;
+	int status;
+	struct timespec start;
+} DAG_TASK;
+
+
+/* Typedef: DAG
+   Tasks in file order, users[i] lists the tasks depending on task i
+   (nusers[i] of them)
+*/
+typedef struct dag {
+	DAG_TASK *task;
+	int count;
+	int **users;
+	int *nusers;
+} DAG;
+
+
+/* Function: dag_load
+   Read the task file at path
+   Returns the graph, NULL on a syntax error, unknown dependency or cycle
+   (a message tells which line or task)
+*/
+DAG *dag_load(const char *path);
+
+
+/* Function: dag_run
+   Run every task, at most jobs at the same time, and report each task
+   started, finished, failed or skipped on stdout
+   Returns the number of tasks that failed or were skipped
+   Precondition: dag is a valid pointer returned by dag_load()
+*/
+int dag_run(DAG *dag, int jobs);
+
+
+/* Function: dag_list
+   In a task process: run the command list cmd, *status holds $? and
+   receives the status of its last pipeline
+   Returns 0
+*/
+int dag_list(COMMAND *cmd, int *status);
+
+
+/* Function: dag_spawn
+   Start the command list cmd in a process group of its own with stdin
+   from /dev/null, without waiting for it. prev is the value of $?. A
+   single pipeline runs one process per command, each executing its
+   command itself; a list with && or || runs in one process through
+   dag_list()
+   Returns the process group, -1 if nothing was started. *last receives
+   the process whose exit status is the one of cmd, *count the number of
+   processes started
+*/
+int dag_spawn(COMMAND *cmd, int prev, int *last, int *count);
+
+
+/* Function: dag_exec
+   In a task process: run the command list cmdline and exit with the
+   status of its last pipeline
+*/
+void dag_exec(const char *cmdline);
+
+
+/* Function: dag_free
+   Deallocate the graph, dag may be NULL
+*/
+void dag_free(DAG *dag);
+
+#endif /* _DAG_H_ */
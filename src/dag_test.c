@@ -0,0 +1,168 @@
+#include "dag.h"
+
+#define DAG_TEST_FILE "/tmp/mysh_dag_test.dag"
+#define DAG_TEST_OUT "/tmp/mysh_dag_test.out"
+
+/* prototypes */
+void test_load();
+void test_errors();
+void test_run();
+void test_parallel();
+
+
+/* Function: write_file (helper)
+   Replace the test file with text
+*/
+void write_file(const char *text)
+{
+	FILE *fp = fopen(DAG_TEST_FILE, "w");
+	assert(fp != NULL);
+	fputs(text, fp);
+	fclose(fp);
+}
+
+
+/* Function: test_load
+   Names, dependencies and users
+*/
+void test_load()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: DAG load\n");
+#endif
+
+	DAG *dag;
+
+	write_file("# comment\n\nlink: cc1 cc2: echo link\ncc1:: echo one\n  cc2 : : echo two: three\n");
+	dag = dag_load(DAG_TEST_FILE);
+	assert(dag != NULL);
+	assert(dag->count == 3);
+	assert(strcmp(dag->task[0].name, "link") == 0);
+	assert(dag->task[0].ndeps == 2);
+	assert(dag->task[0].deps[0] == 1 && dag->task[0].deps[1] == 2);
+	assert(strcmp(dag->task[2].name, "cc2") == 0);
+	assert(strcmp(dag->task[2].cmdline, "echo two: three") == 0);
+	assert(dag->nusers[1] == 1 && dag->users[1][0] == 0);
+	assert(dag->nusers[0] == 0);
+	dag_free(dag);
+}
+
+
+/* Function: test_errors
+   Syntax errors, unknown tasks, duplicates and cycles are rejected
+*/
+void test_errors()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: DAG errors\n");
+#endif
+
+	write_file("a: b: true\n");
+	assert(dag_load(DAG_TEST_FILE) == NULL);
+	write_file("a:: true\na:: false\n");
+	assert(dag_load(DAG_TEST_FILE) == NULL);
+	write_file("a: c: true\nb: a: true\nc: b: true\nd:: true\n");
+	assert(dag_load(DAG_TEST_FILE) == NULL);
+	write_file("a: a: true\n");
+	assert(dag_load(DAG_TEST_FILE) == NULL);
+	write_file("a: true\n");
+	assert(dag_load(DAG_TEST_FILE) == NULL);
+	write_file("a::\n");
+	assert(dag_load(DAG_TEST_FILE) == NULL);
+	assert(dag_load("/nonexistent/mysh.dag") == NULL);
+}
+
+
+/* Function: test_run
+   Failures skip the dependents only, lists and pipes run in a task
+*/
+void test_run()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: DAG run\n");
+#endif
+
+	DAG *dag;
+	FILE *fp;
+	char line[64];
+
+	unlink(DAG_TEST_OUT);
+	write_file("a:: true\n"
+		"b: a: echo hello | tr a-z A-Z >> " DAG_TEST_OUT "\n"
+		"c:: false\n"
+		"d: c: true\n"
+		"e: d b: true\n"
+		"f:: false || true\n"
+		"g:: true && false && true\n"
+		"h: b f: echo done >> " DAG_TEST_OUT "\n");
+	dag = dag_load(DAG_TEST_FILE);
+	assert(dag != NULL);
+	assert(dag_run(dag, 2) == 4);
+	assert(dag->task[0].state == DAG_OK);
+	assert(dag->task[1].state == DAG_OK);
+	assert(dag->task[2].state == DAG_FAIL && dag->task[2].status == 1);
+	assert(dag->task[3].state == DAG_SKIP);
+	assert(dag->task[4].state == DAG_SKIP);
+	assert(dag->task[5].state == DAG_OK);
+	assert(dag->task[6].state == DAG_FAIL);
+	assert(dag->task[7].state == DAG_OK);
+	dag_free(dag);
+
+	fp = fopen(DAG_TEST_OUT, "r");
+	assert(fp != NULL);
+	assert(fgets(line, sizeof line, fp) != NULL && strcmp(line, "HELLO\n") == 0);
+	assert(fgets(line, sizeof line, fp) != NULL && strcmp(line, "done\n") == 0);
+	fclose(fp);
+	unlink(DAG_TEST_OUT);
+}
+
+
+/* Function: test_parallel
+   Independent tasks overlap up to the job limit
+*/
+void test_parallel()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: DAG parallel\n");
+#endif
+
+	struct timespec start, end;
+	long ms;
+	DAG *dag;
+
+	write_file("a:: sleep 0.3\nb:: sleep 0.3\nc:: sleep 0.3\nd: a b c: true\n");
+	dag = dag_load(DAG_TEST_FILE);
+	assert(dag != NULL);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert(dag_run(dag, 3) == 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+	assert(ms >= 300 && ms < 800);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert(dag_run(dag, 1) == 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+	assert(ms >= 900);
+	dag_free(dag);
+	unlink(DAG_TEST_FILE);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: DAG Module\n");
+#endif
+
+	test_load();
+	test_errors();
+	test_run();
+	test_parallel();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: DAG Module\n");
+#endif
+
+	return 0;
+}
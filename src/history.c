@@ -0,0 +1,576 @@
+#include "history.h"
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+
+
+/* Function: history_remap (internal)
+   Remap the log if it changed size, size only covers complete entries
+   Precondition: lock is held
+*/
+static void history_remap(HISTORY *h)
+{
+	struct stat st;
+	char *end;
+
+	if (-1 == fstat(h->fd, &st))
+	{
+		return;
+	}
+	if (h->map != NULL && (size_t) st.st_size == h->mapped)
+	{
+		return;
+	}
+	if (h->map != NULL)
+	{
+		munmap(h->map, h->mapped);
+	}
+	h->map = NULL;
+	h->mapped = h->size = 0;
+	if (st.st_size == 0)
+	{
+		return;
+	}
+
+	h->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, h->fd, 0);
+	if (h->map == MAP_FAILED)
+	{
+		h->map = NULL;
+		return;
+	}
+	h->mapped = st.st_size;
+
+	// ignore a partial entry at the end (being appended by another shell)
+	end = memrchr(h->map, '\n', h->mapped);
+	h->size = (end == NULL) ? 0 : end + 1 - h->map;
+}
+
+
+/* Function: history_cmp (internal)
+   Order entries by text, newline terminates, ties by offset
+*/
+static int history_cmp(const void *a, const void *b, void *arg)
+{
+	const char *map = (const char*) arg;
+	uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+	const unsigned char *p = (const unsigned char*) map + x, *q = (const unsigned char*) map + y;
+
+	while (*p == *q && *p != '\n')
+	{
+		p++;
+		q++;
+	}
+	if (*p != *q)
+	{
+		if (*p == '\n')
+		{
+			return -1;
+		}
+		if (*q == '\n')
+		{
+			return 1;
+		}
+		return *p - *q;
+	}
+
+	return (x < y) ? -1 : (x > y);
+}
+
+
+/* Function: history_pcmp (internal)
+   Compare entry text against prefix: < 0, 0 if it starts with prefix, > 0
+*/
+static int history_pcmp(const char *map, uint32_t off, const char *prefix, int plen)
+{
+	const unsigned char *p = (const unsigned char*) map + off, *q = (const unsigned char*) prefix;
+	int k;
+
+	for (k = 0; k < plen; k++)
+	{
+		if (p[k] == '\n')
+		{
+			return -1;
+		}
+		if (p[k] != q[k])
+		{
+			return p[k] - q[k];
+		}
+	}
+
+	return 0;
+}
+
+
+/* Function: history_bound (internal)
+   First index whose prefix compare is >= 0 (upper == FALSE) or > 0 (upper == TRUE)
+*/
+static int history_bound(HISTORY *h, const char *prefix, int plen, int upper)
+{
+	int lo = 0, hi = h->count, mid, c;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		c = history_pcmp(h->map, h->index[mid], prefix, plen);
+		if (c < 0 || (upper == TRUE && c == 0))
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+
+/* Function: history_catchup (internal)
+   Insert entries appended since the index was built
+   Precondition: lock is held and index is ready
+*/
+static void history_catchup(HISTORY *h)
+{
+	char *nl;
+	uint32_t off;
+	int lo, hi, mid;
+
+	while (h->indexed < h->size)
+	{
+		off = h->indexed;
+		nl = memchr(h->map + off, '\n', h->size - off);
+		h->indexed = nl + 1 - h->map;
+
+		if (h->count == h->capacity)
+		{
+			uint32_t *index = realloc(h->index, sizeof (uint32_t) * (h->capacity * 2 + 64));
+			if (index == NULL)
+			{
+				continue;
+			}
+			h->index = index;
+			h->capacity = h->capacity * 2 + 64;
+		}
+		for (lo = 0, hi = h->count; lo < hi; )
+		{
+			mid = lo + (hi - lo) / 2;
+			if (history_cmp(&h->index[mid], &off, h->map) < 0)
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		memmove(&h->index[lo + 1], &h->index[lo], sizeof (uint32_t) * (h->count - lo));
+		h->index[lo] = off;
+		h->count++;
+	}
+}
+
+
+/* Function: history_index_build
+   Sort entry offsets of a private snapshot of the log
+*/
+void history_index_build(HISTORY *h)
+{
+	struct stat st;
+	char *map, *p, *end;
+	uint32_t *index;
+	size_t size;
+	int count = 0;
+
+	if (-1 == fstat(h->fd, &st) || st.st_size == 0)
+	{
+		size = 0;
+		map = NULL;
+		index = NULL;
+	}
+	else
+	{
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, h->fd, 0);
+		if (map == MAP_FAILED)
+		{
+			return;
+		}
+		end = memrchr(map, '\n', st.st_size);
+		size = (end == NULL) ? 0 : end + 1 - map;
+
+		for (p = map; p < map + size; p = memchr(p, '\n', map + size - p) + 1)
+		{
+			count++;
+		}
+		index = malloc(sizeof (uint32_t) * (count + 64));
+		if (index == NULL)
+		{
+			munmap(map, st.st_size);
+			return;
+		}
+		count = 0;
+		for (p = map; p < map + size; p = memchr(p, '\n', map + size - p) + 1)
+		{
+			index[count++] = p - map;
+		}
+		qsort_r(index, count, sizeof (uint32_t), history_cmp, map);
+		munmap(map, st.st_size);
+	}
+
+	pthread_mutex_lock(&h->lock);
+	h->index = index;
+	h->count = count;
+	h->capacity = (index == NULL) ? 0 : count + 64;
+	h->indexed = size;
+	h->ready = TRUE;
+	pthread_mutex_unlock(&h->lock);
+}
+
+
+/* Function: history_worker (internal)
+   Background index builder
+*/
+static void *history_worker(void *arg)
+{
+	history_index_build((HISTORY*) arg);
+
+	return NULL;
+}
+
+
+/* Function: history_open
+   Open log, build index in the background. The builder starts with all
+   signals blocked, they are handled by the main thread only
+*/
+HISTORY *history_open(const char *path)
+{
+	sigset_t all, old;
+	HISTORY *h;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+	{
+		return NULL;
+	}
+
+	h = (HISTORY*) malloc(sizeof (HISTORY));
+	if (h == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+	h->fd = fd;
+	h->map = NULL;
+	h->mapped = 0;
+	h->size = 0;
+	h->index = NULL;
+	h->count = 0;
+	h->capacity = 0;
+	h->indexed = 0;
+	h->ready = FALSE;
+	pthread_mutex_init(&h->lock, NULL);
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	h->building = (0 == pthread_create(&h->thread, NULL, history_worker, h));
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return h;
+}
+
+
+/* Function: history_close
+   Release history
+*/
+void history_close(HISTORY *h)
+{
+	if (h == NULL)
+	{
+		return;
+	}
+	if (h->building == TRUE)
+	{
+		pthread_join(h->thread, NULL);
+	}
+	if (h->map != NULL)
+	{
+		munmap(h->map, h->mapped);
+	}
+	free(h->index);
+	close(h->fd);
+	pthread_mutex_destroy(&h->lock);
+	free(h);
+}
+
+
+/* Function: history_add
+   Append entry with a single write under flock
+*/
+int history_add(HISTORY *h, const char *line)
+{
+	struct iovec iov[2];
+	const char *last;
+	int len, ret, i, last_len = 0;
+
+	if (h == NULL)
+	{
+		return -1;
+	}
+	len = strcspn(line, "\n");
+	for (i = 0; i < len && isspace(line[i]); i++);
+	if (i == len)
+	{
+		return 0;
+	}
+
+	// skip repeat of the newest entry
+	last = history_line(h, history_prefix(h, "", 0, -1), &last_len);
+	if (last != NULL && last_len == len && memcmp(last, line, len) == 0)
+	{
+		return 0;
+	}
+
+	iov[0].iov_base = (void*) line;
+	iov[0].iov_len = len;
+	iov[1].iov_base = "\n";
+	iov[1].iov_len = 1;
+
+	if (-1 == flock(h->fd, LOCK_EX))
+	{
+		return -1;
+	}
+	ret = writev(h->fd, iov, 2);
+	flock(h->fd, LOCK_UN);
+
+	return (ret == len + 1) ? 0 : -1;
+}
+
+
+/* Function: history_start (internal)
+   Start offset of the entry that ends right before pos
+*/
+static long history_start(HISTORY *h, long pos)
+{
+	char *nl;
+
+	if (pos <= 0)
+	{
+		return -1;
+	}
+	nl = (pos >= 2) ? memrchr(h->map, '\n', pos - 1) : NULL;
+
+	return (nl == NULL) ? 0 : nl + 1 - h->map;
+}
+
+
+/* Function: history_prefix
+   Newest entry with prefix below before
+*/
+long history_prefix(HISTORY *h, const char *prefix, int plen, long before)
+{
+	long off, best = -1;
+	int lo, hi, i;
+
+	pthread_mutex_lock(&h->lock);
+	history_remap(h);
+	if (before < 0 || before > h->size)
+	{
+		before = h->size;
+	}
+
+	if (h->ready == TRUE && plen > 0)
+	{
+		history_catchup(h);
+		lo = history_bound(h, prefix, plen, FALSE);
+		hi = history_bound(h, prefix, plen, TRUE);
+		if (hi - lo <= HISTORY_SCAN)
+		{
+			for (i = lo; i < hi; i++)
+			{
+				if (h->index[i] < before && (long) h->index[i] > best)
+				{
+					best = h->index[i];
+				}
+			}
+			pthread_mutex_unlock(&h->lock);
+			return best;
+		}
+	}
+
+	// dense matches or no index: walk the log backwards
+	for (off = history_start(h, before); off >= 0; off = history_start(h, off))
+	{
+		if (history_pcmp(h->map, off, prefix, plen) == 0)
+		{
+			best = off;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&h->lock);
+
+	return best;
+}
+
+
+/* Function: history_next
+   Oldest entry with prefix after the entry at after
+*/
+long history_next(HISTORY *h, const char *prefix, int plen, long after)
+{
+	long off, best = -1;
+	char *nl;
+	int lo, hi, i;
+
+	pthread_mutex_lock(&h->lock);
+	history_remap(h);
+	if (after < 0 || after >= h->size)
+	{
+		pthread_mutex_unlock(&h->lock);
+		return -1;
+	}
+
+	if (h->ready == TRUE && plen > 0)
+	{
+		history_catchup(h);
+		lo = history_bound(h, prefix, plen, FALSE);
+		hi = history_bound(h, prefix, plen, TRUE);
+		if (hi - lo <= HISTORY_SCAN)
+		{
+			for (i = lo; i < hi; i++)
+			{
+				if (h->index[i] > after && (best == -1 || h->index[i] < best))
+				{
+					best = h->index[i];
+				}
+			}
+			pthread_mutex_unlock(&h->lock);
+			return best;
+		}
+	}
+
+	for (off = after; off < h->size; )
+	{
+		nl = memchr(h->map + off, '\n', h->size - off);
+		off = nl + 1 - h->map;
+		if (off < h->size && history_pcmp(h->map, off, prefix, plen) == 0)
+		{
+			best = off;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&h->lock);
+
+	return best;
+}
+
+
+/* Function: history_search
+   Backward chunked substring search
+*/
+long history_search(HISTORY *h, const char *text, int tlen, long before)
+{
+	long start, end, limit, p;
+	char *q, *last;
+
+	pthread_mutex_lock(&h->lock);
+	history_remap(h);
+	if (before < 0 || before > h->size)
+	{
+		before = h->size;
+	}
+	else if (before > 0)
+	{
+		// matches may extend to the end of the entry starting below before
+		q = memchr(h->map + before - 1, '\n', h->size - before + 1);
+		before = (q == NULL) ? h->size : q - h->map + 1;
+	}
+	if (tlen <= 0)
+	{
+		pthread_mutex_unlock(&h->lock);
+		return history_prefix(h, "", 0, before);
+	}
+
+	for (end = before; end > 0; end = start)
+	{
+		start = (end > HISTORY_CHUNK) ? end - HISTORY_CHUNK : 0;
+		// matches may start in the chunk and end after it
+		limit = (end + tlen - 1 < before) ? end + tlen - 1 : before;
+		last = NULL;
+		for (p = start; p < end; p = q - h->map + 1)
+		{
+			q = memmem(h->map + p, limit - p, text, tlen);
+			if (q == NULL || q - h->map >= end)
+			{
+				break;
+			}
+			last = q;
+		}
+		if (last != NULL)
+		{
+			start = history_start(h, last - h->map + 1);
+			pthread_mutex_unlock(&h->lock);
+			return start;
+		}
+	}
+	pthread_mutex_unlock(&h->lock);
+
+	return -1;
+}
+
+
+/* Function: history_line
+   Pointer into the mapping for entry at off
+*/
+const char *history_line(HISTORY *h, long off, int *len)
+{
+	char *nl;
+
+	if (off < 0 || h->map == NULL || off >= h->size)
+	{
+		*len = 0;
+		return NULL;
+	}
+	nl = memchr(h->map + off, '\n', h->size - off);
+	*len = nl - (h->map + off);
+
+	return h->map + off;
+}
+
+
+/* Function: history_print
+   List the newest n entries with their numbers
+*/
+void history_print(HISTORY *h, int n)
+{
+	long off, first;
+	const char *line;
+	int num = 1, len, i;
+	char *p;
+
+	if (h == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&h->lock);
+	history_remap(h);
+	first = 0;
+	if (n > 0)
+	{
+		for (i = 0, off = h->size; i < n && (off = history_start(h, off)) >= 0; i++)
+		{
+			first = off;
+		}
+		for (p = h->map; p != NULL && p < h->map + first; p = memchr(p, '\n', h->map + first - p) + 1)
+		{
+			num++;
+		}
+	}
+	for (off = first; off < h->size; off += len + 1)
+	{
+		line = h->map + off;
+		len = (char*) memchr(line, '\n', h->size - off) - line;
+		printf("%5d  %.*s\n", num++, len, line);
+	}
+	pthread_mutex_unlock(&h->lock);
+}
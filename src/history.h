@@ -0,0 +1,122 @@
+/*
+	HISTORY is the persistent command history.
+	The history file is an append-only log of newline terminated entries,
+	shared by every running shell: each entry is appended with a single
+	write() under an exclusive flock(), and readers map the file with mmap()
+	and pick up entries appended by other sessions by remapping when the file
+	grew. Nothing is parsed at startup.
+
+	Up-arrow prefix search uses an index of entry offsets sorted by entry text
+	(then by offset), built by a background thread from its own mapping the
+	first time the history is opened and kept up to date incrementally. A
+	prefix query is a binary search for the range of matching entries; for
+	sparse matches the range is scanned for the newest entry, for dense
+	matches (large range) the log is scanned backwards, which reaches a match
+	within a few entries. Until the index is ready every query scans the log.
+
+	Ctrl-R substring search scans the mapping backwards in chunks with
+	memmem(), proportional to the distance to the match.
+*/
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include "include.h"
+#include <stdint.h>
+#include <pthread.h>
+
+/* History file name, relative to $HOME */
+#define HISTORY_FILE ".mysh_history"
+
+/* Largest index range scanned directly, larger ranges scan the log */
+#define HISTORY_SCAN 4096
+
+/* Chunk size for backward substring search */
+#define HISTORY_CHUNK (64 * 1024)
+
+
+/* Typedef: HISTORY
+   Mapping of the history log and its prefix index
+   map/mapped is the current read-only mapping of the file, size is the length
+   of the complete entries in it
+   index holds entry offsets sorted by text, covering entries below indexed
+*/
+typedef struct history {
+	int fd;
+	char *map;
+	size_t mapped;
+	size_t size;
+	uint32_t *index;
+	int count;
+	int capacity;
+	size_t indexed;
+	int ready;
+	int building;
+	pthread_t thread;
+	pthread_mutex_t lock;
+} HISTORY;
+
+
+/* Function: history_open
+   Open (create) the history file at path and start building the index in the
+   background. Returns NULL if the file cannot be opened.
+*/
+HISTORY *history_open(const char *path);
+
+
+/* Function: history_close
+   Unmap and close history, free index
+   Precondition: h is a valid pointer returned by history_open()
+*/
+void history_close(HISTORY *h);
+
+
+/* Function: history_add
+   Append line (up to the first newline) to the log
+   Empty lines and a repeat of the newest entry are not stored
+   Returns 0 on success, -1 on error
+*/
+int history_add(HISTORY *h, const char *line);
+
+
+/* Function: history_index_build
+   Build the prefix index synchronously (used by the background thread and tests)
+*/
+void history_index_build(HISTORY *h);
+
+
+/* Function: history_prefix
+   Find the newest entry starting at an offset below before whose text starts
+   with prefix (plen bytes). Use before = -1 to search from the end.
+   Returns entry offset, or -1 if there is none
+*/
+long history_prefix(HISTORY *h, const char *prefix, int plen, long before);
+
+
+/* Function: history_next
+   Find the oldest entry after the entry at offset after that starts with prefix
+   Returns entry offset, or -1 if there is none
+*/
+long history_next(HISTORY *h, const char *prefix, int plen, long after);
+
+
+/* Function: history_search
+   Find the newest entry starting below before that contains text (tlen bytes)
+   Returns entry offset, or -1 if there is none
+*/
+long history_search(HISTORY *h, const char *text, int tlen, long before);
+
+
+/* Function: history_line
+   Returns pointer to the text of the entry at offset off and stores its length
+   The pointer is valid until the next history call
+*/
+const char *history_line(HISTORY *h, long off, int *len);
+
+
+/* Function: history_print
+   Print the last n entries (all if n <= 0)
+*/
+void history_print(HISTORY *h, int n);
+
+#endif /* _HISTORY_H_ */
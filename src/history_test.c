@@ -0,0 +1,212 @@
+#include "history.h"
+
+#define HFILE "/tmp/mysh_history_test"
+
+/* prototypes */
+void test_setup();
+void test_destroy();
+void test_add();
+void test_prefix();
+void test_search();
+void test_shared();
+void test_large(int size);
+
+HISTORY *hist;
+
+
+/* Function: expect (helper)
+   check that entry at off has text s
+*/
+void expect(long off, const char *s)
+{
+	int len;
+	const char *line = history_line(hist, off, &len);
+	assert(line != NULL);
+	assert(len == strlen(s));
+	assert(strncmp(line, s, len) == 0);
+}
+
+
+/* Function: test_setup
+   Create empty history, wait for the index
+*/
+void test_setup()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTORY Initialized\n");
+#endif
+
+	unlink(HFILE);
+	hist = history_open(HFILE);
+	assert(hist != NULL);
+	pthread_join(hist->thread, NULL);
+	hist->building = FALSE;
+	assert(hist->ready == TRUE);
+	assert(history_prefix(hist, "", 0, -1) == -1);
+}
+
+
+/* Function: test_destroy
+   Close history
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTORY Closed\n");
+#endif
+
+	history_close(hist);
+	unlink(HFILE);
+}
+
+
+/* Function: test_add
+   Empty lines and repeats of the last entry are skipped
+*/
+void test_add()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTORY add\n");
+#endif
+
+	assert(history_add(hist, "git status\n") == 0);
+	assert(history_add(hist, "make\n") == 0);
+	assert(history_add(hist, "git commit -a\n") == 0);
+	assert(history_add(hist, "   \n") == 0);
+	assert(history_add(hist, "git status\n") == 0);
+	assert(history_add(hist, "git status") == 0);
+
+	long off = history_prefix(hist, "", 0, -1);
+	expect(off, "git status");
+	off = history_prefix(hist, "", 0, off);
+	expect(off, "git commit -a");
+	off = history_prefix(hist, "", 0, off);
+	expect(off, "make");
+	off = history_prefix(hist, "", 0, off);
+	expect(off, "git status");
+	assert(history_prefix(hist, "", 0, off) == -1);
+}
+
+
+/* Function: test_prefix
+   Prefix search backwards and forwards
+*/
+void test_prefix()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTORY prefix search\n");
+#endif
+
+	long off = history_prefix(hist, "git", 3, -1);
+	expect(off, "git status");
+	long older = history_prefix(hist, "git", 3, off);
+	expect(older, "git commit -a");
+	long oldest = history_prefix(hist, "git", 3, older);
+	expect(oldest, "git status");
+	assert(history_prefix(hist, "git", 3, oldest) == -1);
+
+	assert(history_next(hist, "git", 3, oldest) == older);
+	assert(history_next(hist, "git", 3, older) == off);
+	assert(history_next(hist, "git", 3, off) == -1);
+
+	expect(history_prefix(hist, "ma", 2, -1), "make");
+	assert(history_prefix(hist, "makefile", 8, -1) == -1);
+	assert(history_prefix(hist, "x", 1, -1) == -1);
+}
+
+
+/* Function: test_search
+   Substring search
+*/
+void test_search()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTORY substring search\n");
+#endif
+
+	long off = history_search(hist, "comm", 4, -1);
+	expect(off, "git commit -a");
+	assert(history_search(hist, "comm", 4, off) == -1);
+	// a longer query still matches the entry starting below before
+	expect(history_search(hist, "commit -a", 9, off + 1), "git commit -a");
+	off = history_search(hist, "status", 6, -1);
+	expect(off, "git status");
+	off = history_search(hist, "status", 6, off);
+	expect(off, "git status");
+	assert(history_search(hist, "status", 6, off) == -1);
+	assert(history_search(hist, "nothing", 7, -1) == -1);
+}
+
+
+/* Function: test_shared
+   Entries appended by another session are visible
+*/
+void test_shared()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTORY shared between sessions\n");
+#endif
+
+	HISTORY *other = history_open(HFILE);
+	assert(other != NULL);
+	assert(history_add(other, "echo from other\n") == 0);
+	history_close(other);
+
+	expect(history_prefix(hist, "echo", 4, -1), "echo from other");
+	expect(history_search(hist, "other", 5, -1), "echo from other");
+}
+
+
+/* Function: test_large
+   Index and scan paths agree on a larger log
+*/
+void test_large(int size)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTORY %d entries\n", size);
+#endif
+
+	char line[64];
+	int i;
+	for (i = 0; i < size; i++)
+	{
+		snprintf(line, sizeof line, "cmd %d", i);
+		assert(history_add(hist, line) == 0);
+		if (i % 1000 == 0)
+		{
+			snprintf(line, sizeof line, "rare %d", i);
+			assert(history_add(hist, line) == 0);
+		}
+	}
+
+	// sparse prefix uses the index range, dense prefix walks the log
+	snprintf(line, sizeof line, "rare %d", ((size - 1) / 1000) * 1000);
+	expect(history_prefix(hist, "rare", 4, -1), line);
+	snprintf(line, sizeof line, "cmd %d", size - 1);
+	expect(history_prefix(hist, "cmd", 3, -1), line);
+	expect(history_prefix(hist, "cmd 1", 5, history_prefix(hist, "cmd 1", 5, -1)), "cmd 19998");
+	expect(history_search(hist, "are 0", 5, -1), "rare 0");
+}
+
+
+/* Run tests */
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: HISTORY Module\n");
+#endif
+
+	test_setup();
+	test_add();
+	test_prefix();
+	test_search();
+	test_shared();
+	test_large(20000);
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: HISTORY Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,429 @@
+#include "histstat.h"
+#include <sys/mman.h>
+#include <sys/file.h>
+
+/* Number of commands listed by histstat without arguments */
+#define HISTSTAT_TOP 20
+
+
+/* Function: histstat_layout (internal)
+   Size of a stats file
+*/
+static size_t histstat_layout()
+{
+	return sizeof (HISTSTAT_HEADER) + HISTSTAT_NAMES * sizeof (HISTSTAT_SLOT) +
+		HISTSTAT_RING * sizeof (HISTSTAT_REC);
+}
+
+
+/* Function: histstat_open
+   Create the file at its full size on first use, map it shared
+*/
+HISTSTAT *histstat_open(const char *path)
+{
+	HISTSTAT *h;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd == -1)
+	{
+		return NULL;
+	}
+	if (-1 == flock(fd, LOCK_EX) || -1 == fstat(fd, &st))
+	{
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size == 0 && -1 == ftruncate(fd, histstat_layout()))
+	{
+		goto histstat_fail;
+	}
+	if (st.st_size != 0 && (size_t) st.st_size != histstat_layout())
+	{
+#ifdef WARNING
+	printf("-mysh: histstat: %s has a different layout, not recording\n", path);
+#endif
+		goto histstat_fail;
+	}
+
+	map = mmap(NULL, histstat_layout(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		goto histstat_fail;
+	}
+	h = (HISTSTAT*) malloc(sizeof (HISTSTAT));
+	if (h == NULL)
+	{
+		munmap(map, histstat_layout());
+		goto histstat_fail;
+	}
+	h->fd = fd;
+	h->size = histstat_layout();
+	h->header = (HISTSTAT_HEADER*) map;
+	h->slot = (HISTSTAT_SLOT*) (h->header + 1);
+	h->rec = (HISTSTAT_REC*) (h->slot + HISTSTAT_NAMES);
+
+	// new file, the rest of it reads as zeros
+	if (st.st_size == 0)
+	{
+		h->header->magic = HISTSTAT_MAGIC;
+		h->header->version = HISTSTAT_VERSION;
+		h->header->ring = HISTSTAT_RING;
+		h->header->names = HISTSTAT_NAMES;
+		h->header->next = 0;
+	}
+	if (h->header->magic != HISTSTAT_MAGIC || h->header->version != HISTSTAT_VERSION ||
+		h->header->ring != HISTSTAT_RING || h->header->names != HISTSTAT_NAMES)
+	{
+		munmap(map, h->size);
+		free(h);
+		goto histstat_fail;
+	}
+	flock(fd, LOCK_UN);
+
+	return h;
+
+histstat_fail:
+	flock(fd, LOCK_UN);
+	close(fd);
+	return NULL;
+}
+
+
+/* Function: histstat_close
+   Unmap and close
+*/
+void histstat_close(HISTSTAT *h)
+{
+	if (h == NULL)
+	{
+		return;
+	}
+	munmap(h->header, h->size);
+	close(h->fd);
+	free(h);
+}
+
+
+/* Function: histstat_bucket
+   Exact below 8us, then HISTSTAT_SUB buckets per power of two
+*/
+int histstat_bucket(uint64_t us)
+{
+	int bit;
+
+	if (us < 8)
+	{
+		return us;
+	}
+	bit = 63 - __builtin_clzll(us);
+	if (bit >= HISTSTAT_MAXBIT)
+	{
+		return HISTSTAT_BUCKETS - 1;
+	}
+
+	return 8 + (bit - 3) * HISTSTAT_SUB + ((us >> (bit - 2)) & (HISTSTAT_SUB - 1));
+}
+
+
+/* Function: histstat_upper (internal)
+   Largest duration falling in bucket b
+*/
+static long histstat_upper(int b)
+{
+	int bit, sub;
+
+	if (b < 8)
+	{
+		return b;
+	}
+	bit = 3 + (b - 8) / HISTSTAT_SUB;
+	sub = (b - 8) % HISTSTAT_SUB;
+
+	return ((long) (HISTSTAT_SUB + sub + 1) << (bit - 2)) - 1;
+}
+
+
+/* Function: histstat_slot (internal)
+   Probe the hash table for name, claiming a free slot if create is TRUE
+   Precondition: the file lock is held when create is TRUE
+*/
+static HISTSTAT_SLOT *histstat_slot(HISTSTAT *h, const char *name, int create)
+{
+	uint32_t hash = 2166136261u;
+	const unsigned char *p;
+	HISTSTAT_SLOT *slot;
+	int i;
+
+	for (p = (const unsigned char*) name; *p != '\0'; p++)
+	{
+		hash = (hash ^ *p) * 16777619u;
+	}
+
+	for (i = 0; i < HISTSTAT_NAMES; i++)
+	{
+		slot = &h->slot[(hash + i) & (HISTSTAT_NAMES - 1)];
+		if (slot->name[0] == '\0')
+		{
+			if (create == FALSE)
+			{
+				return NULL;
+			}
+			strncpy(slot->name, name, HISTSTAT_NAME - 1);
+			return slot;
+		}
+		if (strncmp(slot->name, name, HISTSTAT_NAME) == 0)
+		{
+			return slot;
+		}
+	}
+
+	// table full, the record is kept in the ring only
+	return NULL;
+}
+
+
+/* Function: histstat_find
+   Lookup without creating
+*/
+HISTSTAT_SLOT *histstat_find(HISTSTAT *h, const char *name)
+{
+	if (h == NULL || *name == '\0')
+	{
+		return NULL;
+	}
+
+	return histstat_slot(h, name, FALSE);
+}
+
+
+/* Function: histstat_add
+   Evict the oldest record from its histogram, store rec, count it
+*/
+int histstat_add(HISTSTAT *h, const HISTSTAT_REC *rec)
+{
+	HISTSTAT_REC *old;
+	HISTSTAT_SLOT *slot;
+	int b;
+
+	if (h == NULL || rec->name[0] == '\0')
+	{
+		return -1;
+	}
+	if (-1 == flock(h->fd, LOCK_EX))
+	{
+		return -1;
+	}
+
+	old = &h->rec[h->header->next % HISTSTAT_RING];
+	if (h->header->next >= HISTSTAT_RING && (slot = histstat_slot(h, old->name, FALSE)) != NULL)
+	{
+		b = histstat_bucket(old->wall);
+		if (slot->count > 0 && slot->bucket[b] > 0)
+		{
+			slot->count--;
+			slot->bucket[b]--;
+		}
+	}
+
+	*old = *rec;
+	old->name[HISTSTAT_NAME-1] = '\0';
+	old->line[HISTSTAT_LINE-1] = '\0';
+	slot = histstat_slot(h, old->name, TRUE);
+	if (slot != NULL)
+	{
+		slot->count++;
+		slot->bucket[histstat_bucket(rec->wall)]++;
+	}
+	h->header->next++;
+
+	flock(h->fd, LOCK_UN);
+
+	return 0;
+}
+
+
+/* Function: histstat_record
+   Normalize the command line (single spaces, no leading/trailing blanks),
+   the name is the base name of the first word
+*/
+int histstat_record(HISTSTAT_REC *rec, PROCGROUP *pg)
+{
+	const char *p, *word;
+	int n = 0, i;
+
+	if (pg->group_pid == 0)
+	{
+		return -1;
+	}
+	memset(rec, 0, sizeof *rec);
+
+	for (p = pg->cmdline; *p != '\0' && p < pg->cmdline + PROCGROUP_BUF && n < HISTSTAT_LINE - 1; p++)
+	{
+		if (isspace(*p))
+		{
+			if (n > 0 && rec->line[n-1] != ' ')
+			{
+				rec->line[n++] = ' ';
+			}
+			continue;
+		}
+		rec->line[n++] = *p;
+	}
+	if (n > 0 && rec->line[n-1] == ' ')
+	{
+		n--;
+	}
+	rec->line[n] = '\0';
+
+	for (i = 0; i < n && rec->line[i] != ' '; i++);
+	for (word = rec->line + i; word > rec->line && word[-1] != '/'; word--);
+	n = rec->line + i - word;
+	n = (n < HISTSTAT_NAME - 1) ? n : HISTSTAT_NAME - 1;
+	memcpy(rec->name, word, n);
+	rec->name[n] = '\0';
+
+	rec->start = pg->started;
+	rec->wall = procgroup_wall(pg);
+	rec->user = pg->utime.tv_sec * 1000000LL + pg->utime.tv_usec;
+	rec->sys = pg->stime.tv_sec * 1000000LL + pg->stime.tv_usec;
+	rec->status = pg->exit_status;
+
+	return 0;
+}
+
+
+/* Function: histstat_job
+*/
+int histstat_job(HISTSTAT *h, PROCGROUP *pg)
+{
+	HISTSTAT_REC rec;
+
+	if (h == NULL || histstat_record(&rec, pg) == -1)
+	{
+		return -1;
+	}
+
+	return histstat_add(h, &rec);
+}
+
+
+/* Function: histstat_percentile
+   Walk the histogram to the bucket holding the pct-th run
+*/
+long histstat_percentile(HISTSTAT_SLOT *slot, int pct)
+{
+	uint64_t target, seen = 0;
+	int b;
+
+	if (slot == NULL || slot->count == 0)
+	{
+		return -1;
+	}
+	target = ((uint64_t) slot->count * pct + 99) / 100;
+	target = (target == 0) ? 1 : target;
+	for (b = 0; b < HISTSTAT_BUCKETS; b++)
+	{
+		seen += slot->bucket[b];
+		if (seen >= target)
+		{
+			return histstat_upper(b);
+		}
+	}
+
+	return histstat_upper(HISTSTAT_BUCKETS - 1);
+}
+
+
+/* Function: histstat_format (internal)
+   Human readable duration
+*/
+static char *histstat_format(char *buf, long us)
+{
+	if (us < 0)
+	{
+		strcpy(buf, "-");
+	}
+	else if (us < 1000)
+	{
+		sprintf(buf, "%ldus", us);
+	}
+	else if (us < 1000000)
+	{
+		sprintf(buf, "%.1fms", us / 1000.0);
+	}
+	else
+	{
+		sprintf(buf, "%.2fs", us / 1000000.0);
+	}
+
+	return buf;
+}
+
+
+/* Function: histstat_line (internal)
+   Print one command
+*/
+static void histstat_line(const char *name, HISTSTAT_SLOT *slot)
+{
+	char p50[16], p95[16], p99[16];
+
+	printf("%-20s %8u %10s %10s %10s\n", name, (slot == NULL) ? 0 : slot->count,
+		histstat_format(p50, histstat_percentile(slot, 50)),
+		histstat_format(p95, histstat_percentile(slot, 95)),
+		histstat_format(p99, histstat_percentile(slot, 99)));
+}
+
+
+/* Function: histstat_cmp (internal)
+   Order slots by run count, most frequent first
+*/
+static int histstat_cmp(const void *a, const void *b)
+{
+	uint32_t x = (*(HISTSTAT_SLOT* const*) a)->count, y = (*(HISTSTAT_SLOT* const*) b)->count;
+
+	return (x < y) - (x > y);
+}
+
+
+/* Function: histstat_print
+   Report percentiles from the index
+*/
+int histstat_print(HISTSTAT *h, char **names)
+{
+	HISTSTAT_SLOT *top[HISTSTAT_NAMES];
+	int i, n = 0;
+
+	if (h == NULL)
+	{
+		printf("-mysh: histstat: no statistics file\n");
+		return -1;
+	}
+
+	printf("%-20s %8s %10s %10s %10s\n", "command", "runs", "p50", "p95", "p99");
+	if (names[0] != NULL)
+	{
+		for (i = 0; names[i] != NULL; i++)
+		{
+			histstat_line(names[i], histstat_find(h, names[i]));
+		}
+		return 0;
+	}
+
+	for (i = 0; i < HISTSTAT_NAMES; i++)
+	{
+		if (h->slot[i].count > 0)
+		{
+			top[n++] = &h->slot[i];
+		}
+	}
+	qsort(top, n, sizeof (HISTSTAT_SLOT*), histstat_cmp);
+	for (i = 0; i < n && i < HISTSTAT_TOP; i++)
+	{
+		histstat_line(top[i]->name, top[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+	HISTSTAT is the persistent per-command latency history.
+	Every job the shell runs is stored as a fixed size record (normalized
+	command line, start time, wall/user/sys time, exit status) in a ring in
+	a binary file shared by all sessions and mapped with mmap(). When the
+	ring is full the oldest record is overwritten.
+
+	Next to the ring the file holds an index: an open addressing hash table
+	keyed by command name, each slot holding a log scale histogram of the
+	wall clock durations of the records in the ring. Adding a record bumps
+	its bucket, overwriting one decrements the bucket of the evicted record,
+	so percentiles for a command are read from its histogram (a hash lookup
+	and a walk over HISTSTAT_BUCKETS counters) without scanning the ring.
+
+	Updates take an exclusive flock() on the file; a shell that finds a file
+	of a different layout leaves it alone and records nothing.
+*/
+
+#ifndef _HISTSTAT_H_
+#define _HISTSTAT_H_
+
+#include "include.h"
+#include "procgroup.h"
+#include <stdint.h>
+
+/* Stats file name, relative to $HOME */
+#define HISTSTAT_FILE ".mysh_histstat"
+
+/* File layout */
+#define HISTSTAT_MAGIC 0x4d595354
+#define HISTSTAT_VERSION 1
+
+/* Number of records kept */
+#define HISTSTAT_RING 16384
+
+/* Hash table slots, a power of two */
+#define HISTSTAT_NAMES 512
+
+/* Max length of a command name and of the normalized command line */
+#define HISTSTAT_NAME 24
+#define HISTSTAT_LINE 48
+
+/* Histogram: values below 8us exact, then 4 buckets per power of two up
+   to 2^36us (19 hours), longer runs fall in the last bucket */
+#define HISTSTAT_SUB 4
+#define HISTSTAT_MAXBIT 36
+#define HISTSTAT_BUCKETS (8 + (HISTSTAT_MAXBIT - 3) * HISTSTAT_SUB)
+
+
+/* Typedef: HISTSTAT_REC
+   One finished job, times in microseconds, start in seconds since the epoch
+   status is the exit status, 128 + signal number if killed
+*/
+typedef struct histstat_rec {
+	int64_t start;
+	uint64_t wall;
+	uint64_t user;
+	uint64_t sys;
+	int32_t status;
+	char name[HISTSTAT_NAME];
+	char line[HISTSTAT_LINE];
+} HISTSTAT_REC;
+
+
+/* Typedef: HISTSTAT_SLOT
+   Index entry: histogram of the records of one command name in the ring
+   A slot stays assigned to its name once used (count may drop to zero)
+*/
+typedef struct histstat_slot {
+	char name[HISTSTAT_NAME];
+	uint32_t count;
+	uint32_t bucket[HISTSTAT_BUCKETS];
+} HISTSTAT_SLOT;
+
+
+/* Typedef: HISTSTAT_HEADER
+   Start of the file, next is the number of records ever added
+*/
+typedef struct histstat_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ring;
+	uint32_t names;
+	uint64_t next;
+} HISTSTAT_HEADER;
+
+
+/* Typedef: HISTSTAT
+   Mapping of the stats file
+*/
+typedef struct histstat {
+	int fd;
+	size_t size;
+	HISTSTAT_HEADER *header;
+	HISTSTAT_SLOT *slot;
+	HISTSTAT_REC *rec;
+} HISTSTAT;
+
+
+/* Function: histstat_open
+   Open or create the stats file at path and map it
+   Returns dynamically allocated HISTSTAT, NULL on error or layout mismatch
+*/
+HISTSTAT *histstat_open(const char *path);
+
+
+/* Function: histstat_close
+   Unmap and close, h may be NULL
+*/
+void histstat_close(HISTSTAT *h);
+
+
+/* Function: histstat_add
+   Append a record, overwriting the oldest one when the ring is full
+   Returns 0 on success, -1 on error
+*/
+int histstat_add(HISTSTAT *h, const HISTSTAT_REC *rec);
+
+
+/* Function: histstat_record
+   Build the record of a finished PROCGROUP, no lock, no I/O, so it may be
+   called from a signal handler
+   Returns 0, -1 if pg was never started
+*/
+int histstat_record(HISTSTAT_REC *rec, PROCGROUP *pg);
+
+
+/* Function: histstat_job
+   Build a record from a finished PROCGROUP and add it
+   Not async-signal-safe: the SIGCHLD handler queues histstat_record()s instead
+*/
+int histstat_job(HISTSTAT *h, PROCGROUP *pg);
+
+
+/* Function: histstat_find
+   Returns the index slot of command name, NULL if it was never recorded
+*/
+HISTSTAT_SLOT *histstat_find(HISTSTAT *h, const char *name);
+
+
+/* Function: histstat_percentile
+   Returns the duration (us) below which pct percent of the runs in slot fall
+   The value is the upper bound of the histogram bucket, -1 if slot is empty
+*/
+long histstat_percentile(HISTSTAT_SLOT *slot, int pct);
+
+
+/* Function: histstat_bucket
+   Returns the histogram bucket of a duration in microseconds
+*/
+int histstat_bucket(uint64_t us);
+
+
+/* Function: histstat_print
+   Builtin command histstat [name ...]
+   Print run count and p50/p95/p99 for the given names, or for the most
+   frequent commands when none is given
+*/
+int histstat_print(HISTSTAT *h, char **names);
+
+#endif /* _HISTSTAT_H_ */
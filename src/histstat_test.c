@@ -0,0 +1,220 @@
+#include "histstat.h"
+
+#define HFILE "/tmp/mysh_histstat_test"
+
+/* prototypes */
+void test_setup();
+void test_destroy();
+void test_bucket();
+void test_percentile();
+void test_ring();
+void test_job();
+void test_layout();
+
+HISTSTAT *stats;
+
+
+/* Function: add (helper)
+   add a record of name taking wall us
+*/
+void add(const char *name, uint64_t wall)
+{
+	HISTSTAT_REC rec;
+
+	memset(&rec, 0, sizeof rec);
+	strncpy(rec.name, name, HISTSTAT_NAME - 1);
+	strncpy(rec.line, name, HISTSTAT_LINE - 1);
+	rec.wall = wall;
+	assert(histstat_add(stats, &rec) == 0);
+}
+
+
+/* Function: test_setup
+   Create an empty stats file
+*/
+void test_setup()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTSTAT Initialized\n");
+#endif
+
+	unlink(HFILE);
+	stats = histstat_open(HFILE);
+	assert(stats != NULL);
+	assert(stats->header->next == 0);
+	assert(histstat_find(stats, "ls") == NULL);
+}
+
+
+/* Function: test_destroy
+   Close and remove the stats file
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTSTAT Closed\n");
+#endif
+
+	histstat_close(stats);
+	unlink(HFILE);
+}
+
+
+/* Function: test_bucket
+   Buckets are monotonic and cover every duration
+*/
+void test_bucket()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTSTAT buckets\n");
+#endif
+
+	uint64_t us;
+	int b, prev = 0;
+
+	assert(histstat_bucket(0) == 0);
+	assert(histstat_bucket(7) == 7);
+	assert(histstat_bucket(8) == 8);
+	assert(histstat_bucket(~0ULL) == HISTSTAT_BUCKETS - 1);
+	for (us = 1; us < (1ULL << 40); us = us * 9 / 8 + 1)
+	{
+		b = histstat_bucket(us);
+		assert(b >= prev && b < HISTSTAT_BUCKETS);
+		prev = b;
+	}
+}
+
+
+/* Function: test_percentile
+   Percentiles land in the bucket of the expected run
+*/
+void test_percentile()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTSTAT percentiles\n");
+#endif
+
+	HISTSTAT_SLOT *slot;
+	long p;
+	int i;
+
+	// 90 runs of 1ms, 9 of 100ms, one of 5s
+	for (i = 0; i < 90; i++)
+	{
+		add("make", 1000);
+	}
+	for (i = 0; i < 9; i++)
+	{
+		add("make", 100000);
+	}
+	add("make", 5000000);
+
+	slot = histstat_find(stats, "make");
+	assert(slot != NULL && slot->count == 100);
+	p = histstat_percentile(slot, 50);
+	assert(p >= 1000 && p < 1250);
+	p = histstat_percentile(slot, 95);
+	assert(p >= 100000 && p < 125000);
+	p = histstat_percentile(slot, 100);
+	assert(p >= 5000000 && p < 6250000);
+	assert(histstat_percentile(histstat_find(stats, "nope"), 50) == -1);
+}
+
+
+/* Function: test_ring
+   Overwritten records leave the histograms
+*/
+void test_ring()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTSTAT ring wrap\n");
+#endif
+
+	int i;
+
+	for (i = 0; i < HISTSTAT_RING; i++)
+	{
+		add((i % 2) ? "ls" : "cat", 10);
+	}
+	assert(stats->header->next == HISTSTAT_RING + 100);
+	assert(histstat_find(stats, "make")->count == 0);
+	assert(histstat_find(stats, "ls")->count == HISTSTAT_RING / 2);
+	assert(histstat_find(stats, "cat")->count == HISTSTAT_RING / 2);
+	assert(histstat_percentile(histstat_find(stats, "ls"), 99) == 11);
+}
+
+
+/* Function: test_job
+   Records built from a PROCGROUP are normalized
+*/
+void test_job()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTSTAT job records\n");
+#endif
+
+	PROCGROUP *pg = procgroup_init();
+	HISTSTAT_REC *rec;
+
+	procgroup_load(pg, 1234, RUNNING, "  /usr/bin/grep   -r\tfoo  . ");
+	procgroup_reap(pg, 1 << 8, NULL);
+	assert(histstat_job(stats, pg) == 0);
+	rec = &stats->rec[(stats->header->next - 1) % HISTSTAT_RING];
+	assert(strcmp(rec->name, "grep") == 0);
+	assert(strcmp(rec->line, "/usr/bin/grep -r foo .") == 0);
+	assert(rec->status == 1);
+	assert(histstat_find(stats, "grep")->count == 1);
+
+	// the foreground placeholder is not a job
+	procgroup_clear(pg);
+	assert(histstat_job(stats, pg) == -1);
+	procgroup_free(pg);
+}
+
+
+/* Function: test_layout
+   A second mapping sees the same data, a foreign file is left alone
+*/
+void test_layout()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: HISTSTAT file layout\n");
+#endif
+
+	HISTSTAT *other;
+	int fd;
+
+	other = histstat_open(HFILE);
+	assert(other != NULL);
+	assert(histstat_find(other, "ls")->count == HISTSTAT_RING / 2);
+	histstat_close(other);
+
+	fd = open(HFILE ".bad", O_CREAT | O_TRUNC | O_WRONLY, 0600);
+	assert(fd != -1);
+	assert(write(fd, "garbage", 7) == 7);
+	close(fd);
+	assert(histstat_open(HFILE ".bad") == NULL);
+	unlink(HFILE ".bad");
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: HISTSTAT Module\n");
+#endif
+
+	test_setup();
+	test_bucket();
+	test_percentile();
+	test_ring();
+	test_job();
+	test_layout();
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: HISTSTAT Module\n");
+#endif
+
+	return 0;
+}
@@ -1,6 +1,11 @@
 #ifndef _INCLUDE_H_
 #define _INCLUDE_H_
 
+/* Linux extensions: pipe2, memfd_create, close_range, ... */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "debug.h"
 
 /* C Standard library */
@@ -11,6 +16,7 @@
 #include <assert.h>
 #include <time.h>
 #include <stdarg.h>
+#include <limits.h>
 
 /* System library */
 #include <unistd.h>
@@ -49,6 +55,10 @@
 /* output of warning/error messages */
 #define WARNING
 
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
 #ifndef TRUE
 #define TRUE 1
 #define FALSE 0
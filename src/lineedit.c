@@ -0,0 +1,1081 @@
+#include "lineedit.h"
+#include "prompt.h"
+#include "complete.h"
+#include <poll.h>
+#include <sys/ioctl.h>
+
+
+/* Typedef: LINESTATE
+   State of the line being edited
+   The line is a gap buffer: buf[0, pos) is the text before the cursor, the
+   len - pos bytes after the cursor are stored at the end of buf, the gap
+   between them always has room for at least two bytes.
+   hpos is the history entry shown (-1 while editing a new line), saved is
+   the new line kept while browsing history and used as the search prefix.
+   Display: cur is the terminal cell of the cursor counted from the start of
+   the prompt, drawn/cells the bytes and cells currently on screen. Bytes
+   from dirty on changed since the last redraw, full forces a prompt redraw.
+   wk/wv caches the width of the first wk bytes.
+*/
+typedef struct linestate {
+	char *buf;
+	int size;
+	int len;
+	int pos;
+	char prompt[LINEEDIT_PROMPT];
+	int plen;
+	int pwidth;
+	PROMPT_FUNC render;
+	HISTORY *history;
+	long hpos;
+	char *saved;
+	int saved_len;
+	int cols;
+	int cur;
+	int drawn;
+	int cells;
+	int dirty;
+	int full;
+	int wk;
+	int wv;
+} LINESTATE;
+
+
+/* terminal settings restored after each line */
+static struct termios saved_tio;
+
+/* output scratch buffer, one write() per redraw */
+static char *out = NULL;
+static int out_size = 0;
+
+/* input read ahead, a paste is consumed in blocks */
+static unsigned char in[LINEEDIT_READ];
+static int in_pos = 0;
+static int in_len = 0;
+
+
+/* Function: lineedit_width
+   Width of a string without escape sequences
+*/
+int lineedit_width(const char *s)
+{
+	int width = 0;
+
+	while (*s != '\0')
+	{
+		if (*s == '\033' && s[1] == '[')
+		{
+			for (s += 2; *s != '\0' && !isalpha(*s); s++);
+			if (*s != '\0')
+			{
+				s++;
+			}
+			continue;
+		}
+		if ((*s & 0xc0) != 0x80)
+		{
+			width++;
+		}
+		s++;
+	}
+
+	return width;
+}
+
+
+/* Function: lineedit_write (internal)
+   write() all of buf
+*/
+static void lineedit_write(const char *buf, int len)
+{
+	int ret;
+
+	while (len > 0)
+	{
+		ret = write(STDOUT_FILENO, buf, len);
+		if (ret == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ret <= 0)
+		{
+			return;
+		}
+		buf += ret;
+		len -= ret;
+	}
+}
+
+
+/* Function: lineedit_output (internal)
+   Make room for n bytes in the scratch buffer
+*/
+static int lineedit_output(int n)
+{
+	char *p;
+
+	if (n > out_size)
+	{
+		p = realloc(out, n);
+		if (p == NULL)
+		{
+			return -1;
+		}
+		out = p;
+		out_size = n;
+	}
+
+	return 0;
+}
+
+
+/* Function: lineedit_tail (internal)
+   Start of the text after the cursor
+*/
+static char *lineedit_tail(LINESTATE *ls)
+{
+	return ls->buf + ls->size - (ls->len - ls->pos);
+}
+
+
+/* Function: lineedit_at (internal)
+   Byte at logical offset k
+*/
+static char lineedit_at(LINESTATE *ls, int k)
+{
+	return (k < ls->pos) ? ls->buf[k] : ls->buf[k + ls->size - ls->len];
+}
+
+
+/* Function: lineedit_copy (internal)
+   Copy logical bytes [from, to) to dst
+*/
+static void lineedit_copy(LINESTATE *ls, char *dst, int from, int to)
+{
+	int n;
+
+	if (from < ls->pos)
+	{
+		n = ((to < ls->pos) ? to : ls->pos) - from;
+		memcpy(dst, ls->buf + from, n);
+		dst += n;
+		from += n;
+	}
+	if (from < to)
+	{
+		memcpy(dst, ls->buf + from + ls->size - ls->len, to - from);
+	}
+}
+
+
+/* Function: lineedit_span (internal)
+   Display width of logical bytes [from, to)
+*/
+static int lineedit_span(LINESTATE *ls, int from, int to)
+{
+	int width = 0;
+
+	for (; from < to; from++)
+	{
+		if ((lineedit_at(ls, from) & 0xc0) != 0x80)
+		{
+			width++;
+		}
+	}
+
+	return width;
+}
+
+
+/* Function: lineedit_cells (internal)
+   Display width of the first k bytes of the line, continuing from the cache
+*/
+static int lineedit_cells(LINESTATE *ls, int k)
+{
+	int width;
+
+	if (k >= ls->wk)
+	{
+		width = ls->wv + lineedit_span(ls, ls->wk, k);
+	}
+	else
+	{
+		width = lineedit_span(ls, 0, k);
+	}
+	ls->wk = k;
+	ls->wv = width;
+
+	return width;
+}
+
+
+/* Function: lineedit_touch (internal)
+   Record that the text changed from logical offset k on
+*/
+static void lineedit_touch(LINESTATE *ls, int k)
+{
+	if (k < ls->dirty)
+	{
+		ls->dirty = k;
+	}
+	if (k < ls->wk)
+	{
+		ls->wk = ls->wv = 0;
+	}
+}
+
+
+/* Function: lineedit_gap (internal)
+   Make room for n more bytes, keeping two spare bytes in the gap
+*/
+static int lineedit_gap(LINESTATE *ls, int n)
+{
+	int size, after = ls->len - ls->pos;
+	char *buf;
+
+	if (ls->size - ls->len >= n + 2)
+	{
+		return 0;
+	}
+	size = 2 * ls->size;
+	if (size < ls->len + n + 2)
+	{
+		size = ls->len + n + 2;
+	}
+	if (size < LINEEDIT_READ)
+	{
+		size = LINEEDIT_READ;
+	}
+	buf = realloc(ls->buf, size);
+	if (buf == NULL)
+	{
+		return -1;
+	}
+	memmove(buf + size - after, buf + ls->size - after, after);
+	ls->buf = buf;
+	ls->size = size;
+
+	return 0;
+}
+
+
+/* Function: lineedit_move (internal)
+   Move the cursor (and gap) to logical offset k
+*/
+static void lineedit_move(LINESTATE *ls, int k)
+{
+	char *tail = lineedit_tail(ls);
+
+	if (k < ls->pos)
+	{
+		memmove(tail - (ls->pos - k), ls->buf + k, ls->pos - k);
+	}
+	else if (k > ls->pos)
+	{
+		memmove(ls->buf + ls->pos, tail, k - ls->pos);
+	}
+	ls->pos = k;
+}
+
+
+/* Function: lineedit_insert (internal)
+   Insert n bytes at the cursor
+*/
+static void lineedit_insert(LINESTATE *ls, const char *s, int n)
+{
+	if (-1 == lineedit_gap(ls, n))
+	{
+		return;
+	}
+	memcpy(ls->buf + ls->pos, s, n);
+	lineedit_touch(ls, ls->pos);
+	ls->pos += n;
+	ls->len += n;
+}
+
+
+/* Function: lineedit_delete (internal)
+   Delete bytes [from, to), the cursor keeps its place in the text
+*/
+static void lineedit_delete(LINESTATE *ls, int from, int to)
+{
+	int pos = ls->pos;
+
+	if (from < 0 || to > ls->len || from >= to)
+	{
+		return;
+	}
+	lineedit_move(ls, to);
+	ls->pos = from;
+	ls->len -= to - from;
+	lineedit_touch(ls, from);
+
+	if (pos > to)
+	{
+		lineedit_move(ls, pos - (to - from));
+	}
+	else if (pos < from)
+	{
+		lineedit_move(ls, pos);
+	}
+}
+
+
+/* Function: lineedit_set (internal)
+   Replace the line with text
+*/
+static void lineedit_set(LINESTATE *ls, const char *text, int len)
+{
+	ls->len = ls->pos = 0;
+	lineedit_touch(ls, 0);
+	lineedit_insert(ls, text, len);
+}
+
+
+/* Function: lineedit_prev (internal)
+   Byte offset of the character before pos
+*/
+static int lineedit_prev(LINESTATE *ls, int pos)
+{
+	if (pos > 0)
+	{
+		pos--;
+	}
+	while (pos > 0 && (lineedit_at(ls, pos) & 0xc0) == 0x80)
+	{
+		pos--;
+	}
+
+	return pos;
+}
+
+
+/* Function: lineedit_next (internal)
+   Byte offset of the character after pos
+*/
+static int lineedit_next(LINESTATE *ls, int pos)
+{
+	if (pos < ls->len)
+	{
+		pos++;
+	}
+	while (pos < ls->len && (lineedit_at(ls, pos) & 0xc0) == 0x80)
+	{
+		pos++;
+	}
+
+	return pos;
+}
+
+
+/* Function: lineedit_goto (internal)
+   Append the escapes moving the terminal cursor from cell a to cell b
+*/
+static int lineedit_goto(LINESTATE *ls, char *dst, int a, int b)
+{
+	int n = 0, ra = a / ls->cols, rb = b / ls->cols;
+
+	if (rb < ra)
+	{
+		n += sprintf(dst + n, "\033[%dA", ra - rb);
+	}
+	else if (rb > ra)
+	{
+		n += sprintf(dst + n, "\033[%dB", rb - ra);
+	}
+	dst[n++] = '\r';
+	if (b % ls->cols > 0)
+	{
+		n += sprintf(dst + n, "\033[%dC", b % ls->cols);
+	}
+
+	return n;
+}
+
+
+/* Function: lineedit_refresh (internal)
+   Repaint the cells that changed since the last refresh with a single write:
+   the prompt only when full is set, the line from the first changed byte on
+*/
+static void lineedit_refresh(LINESTATE *ls)
+{
+	struct winsize ws;
+	int n = 0, from, start, end, cols = 80;
+
+	if (0 == ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) && ws.ws_col > 0)
+	{
+		cols = ws.ws_col;
+	}
+	if (cols != ls->cols)
+	{
+		// rewrapped by the terminal, start over on the cursor row
+		lineedit_write("\r", 1);
+		ls->cols = cols;
+		ls->cur = 0;
+		ls->full = TRUE;
+	}
+
+	from = (ls->full == TRUE) ? 0 : ((ls->dirty < ls->drawn) ? ls->dirty : ls->drawn);
+	if (-1 == lineedit_output(ls->plen + ls->len - from + 128))
+	{
+		return;
+	}
+
+	start = (ls->full == TRUE) ? 0 : ls->pwidth + lineedit_cells(ls, from);
+	n += lineedit_goto(ls, out + n, ls->cur, start);
+	if (ls->full == TRUE)
+	{
+		memcpy(out + n, ls->prompt, ls->plen);
+		n += ls->plen;
+	}
+	lineedit_copy(ls, out + n, from, ls->len);
+	n += ls->len - from;
+
+	end = ls->pwidth + lineedit_cells(ls, ls->len);
+	if ((ls->full == TRUE || from < ls->len) && end > 0 && end % cols == 0)
+	{
+		// leave the pending wrap state so the cursor is on the next row
+		n += sprintf(out + n, "\r\n");
+	}
+	if (ls->full == TRUE || end < ls->cells)
+	{
+		n += sprintf(out + n, "\033[J");
+	}
+
+	ls->cur = ls->pwidth + lineedit_cells(ls, ls->pos);
+	n += lineedit_goto(ls, out + n, end, ls->cur);
+	lineedit_write(out, n);
+
+	ls->drawn = ls->dirty = ls->len;
+	ls->cells = end;
+	ls->full = FALSE;
+}
+
+
+/* Function: lineedit_clear (internal)
+   Erase prompt and line, the next refresh starts from scratch
+*/
+static void lineedit_clear(LINESTATE *ls)
+{
+	char seq[64];
+	int n;
+
+	n = lineedit_goto(ls, seq, ls->cur, 0);
+	n += sprintf(seq + n, "\033[J");
+	lineedit_write(seq, n);
+	ls->cur = ls->cells = 0;
+	ls->full = TRUE;
+}
+
+
+/* Function: lineedit_newline (internal)
+   Move below the line, the next refresh starts on a fresh row
+*/
+static void lineedit_newline(LINESTATE *ls, const char *text)
+{
+	char seq[64];
+	int n;
+
+	n = lineedit_goto(ls, seq, ls->cur, ls->cells);
+	n += sprintf(seq + n, "%s\r\n", text);
+	lineedit_write(seq, n);
+	ls->cur = ls->cells = 0;
+	ls->full = TRUE;
+}
+
+
+/* Function: lineedit_prompt (internal)
+   Render the prompt into the line state
+*/
+static void lineedit_prompt(LINESTATE *ls)
+{
+	ls->plen = ls->render(ls->prompt, LINEEDIT_PROMPT);
+	ls->pwidth = lineedit_width(ls->prompt);
+	ls->full = TRUE;
+}
+
+
+/* Function: lineedit_pending (internal)
+   Returns TRUE if input is waiting, the refresh is deferred until it is consumed
+*/
+static int lineedit_pending()
+{
+	struct pollfd pfd;
+
+	if (in_pos < in_len)
+	{
+		return TRUE;
+	}
+	pfd.fd = STDIN_FILENO;
+	pfd.events = POLLIN;
+
+	return (poll(&pfd, 1, 0) == 1);
+}
+
+
+/* Function: lineedit_key (internal)
+   Next input byte, reading in blocks and redrawing on prompt updates and
+   interrupted reads
+   Returns byte read, or -1 on end of input
+*/
+static int lineedit_key(LINESTATE *ls)
+{
+	struct pollfd pfd[2];
+	int ret, nfd;
+
+	if (in_pos < in_len)
+	{
+		return in[in_pos++];
+	}
+
+	pfd[0].fd = STDIN_FILENO;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = prompt_notify_fd();
+	pfd[1].events = POLLIN;
+	nfd = (pfd[1].fd == -1) ? 1 : 2;
+
+	while (TRUE)
+	{
+		ret = poll(pfd, nfd, -1);
+		if (ret == -1)
+		{
+			if (errno != EINTR)
+			{
+				return -1;
+			}
+			// a job notification may have been printed over the line
+			ls->full = TRUE;
+			lineedit_refresh(ls);
+			continue;
+		}
+		if (nfd == 2 && pfd[1].revents != 0 && prompt_changed() == TRUE)
+		{
+			lineedit_prompt(ls);
+			lineedit_refresh(ls);
+		}
+		if (pfd[0].revents != 0)
+		{
+			ret = read(STDIN_FILENO, in, LINEEDIT_READ);
+			if (ret > 0)
+			{
+				in_pos = 1;
+				in_len = ret;
+				return in[0];
+			}
+			if (ret == 0 || errno != EINTR)
+			{
+				return -1;
+			}
+		}
+	}
+}
+
+
+/* Function: lineedit_equal (internal)
+   Returns TRUE if the line is text (len bytes)
+*/
+static int lineedit_equal(LINESTATE *ls, const char *text, int len)
+{
+	return len == ls->len && memcmp(text, ls->buf, ls->pos) == 0 &&
+		memcmp(text + ls->pos, lineedit_tail(ls), len - ls->pos) == 0;
+}
+
+
+/* Function: lineedit_history (internal)
+   Move through history entries starting with the saved line
+   dir < 0 older, dir > 0 newer
+*/
+static void lineedit_history(LINESTATE *ls, int dir)
+{
+	const char *line;
+	long off;
+	int len;
+
+	if (ls->history == NULL || (dir > 0 && ls->hpos == -1))
+	{
+		return;
+	}
+	if (ls->hpos == -1)
+	{
+		free(ls->saved);
+		ls->saved = malloc(ls->len + 1);
+		if (ls->saved == NULL)
+		{
+			return;
+		}
+		lineedit_copy(ls, ls->saved, 0, ls->len);
+		ls->saved_len = ls->len;
+	}
+
+	off = ls->hpos;
+	while (TRUE)
+	{
+		if (dir < 0)
+		{
+			off = history_prefix(ls->history, ls->saved, ls->saved_len, off);
+		}
+		else
+		{
+			off = history_next(ls->history, ls->saved, ls->saved_len, off);
+		}
+		if (off == -1)
+		{
+			break;
+		}
+		// skip entries identical to the one shown
+		line = history_line(ls->history, off, &len);
+		if (lineedit_equal(ls, line, len) == FALSE)
+		{
+			break;
+		}
+	}
+
+	if (off == -1)
+	{
+		if (dir > 0)
+		{
+			lineedit_set(ls, ls->saved, ls->saved_len);
+			ls->hpos = -1;
+		}
+		return;
+	}
+	ls->hpos = off;
+	line = history_line(ls->history, off, &len);
+	lineedit_set(ls, line, len);
+}
+
+
+/* Function: lineedit_search (internal)
+   Ctrl-R incremental reverse search, drawn on one row in place of the line
+   Returns the key that ended the search (0 if it was consumed)
+*/
+static int lineedit_search(LINESTATE *ls)
+{
+	char query[LINEEDIT_QUERY];
+	const char *line = NULL;
+	long match = -1, found;
+	int qlen = 0, len = 0, c, n, shown, failed = FALSE;
+
+	if (ls->history == NULL)
+	{
+		return 0;
+	}
+	lineedit_clear(ls);
+
+	while (TRUE)
+	{
+		// draw "(reverse-i-search)`query': match", cut at the screen width
+		line = (match == -1) ? NULL : history_line(ls->history, match, &len);
+		if (line == NULL)
+		{
+			len = 0;
+		}
+		n = qlen + 32;
+		shown = (ls->cols > n + 1) ? ls->cols - n - 1 : 0;
+		shown = (len < shown) ? len : shown;
+		if (-1 == lineedit_output(shown + qlen + 64))
+		{
+			return 0;
+		}
+		n = sprintf(out, "\r%s(reverse-i-search)`", failed ? "failed " : "");
+		memcpy(&out[n], query, qlen);
+		n += qlen;
+		n += sprintf(&out[n], "': ");
+		memcpy(&out[n], line, shown);
+		n += shown;
+		n += sprintf(&out[n], "\033[K");
+		lineedit_write(out, n);
+
+		c = lineedit_key(ls);
+		switch (c)
+		{
+			case KEY_CTRL('R'):
+				found = (match == -1) ? -1 : history_search(ls->history, query, qlen, match);
+				failed = (found == -1);
+				match = (found == -1) ? match : found;
+				continue;
+
+			case KEY_BACKSPACE:
+			case KEY_CTRL('H'):
+				if (qlen > 0)
+				{
+					qlen--;
+				}
+				match = (qlen > 0) ? history_search(ls->history, query, qlen, -1) : -1;
+				failed = FALSE;
+				continue;
+
+			case KEY_CTRL('G'):
+			case KEY_CTRL('C'):
+				lineedit_write("\r\033[K", 4);
+				return 0;
+
+			case -1:
+				return -1;
+		}
+
+		if (c >= ' ' && qlen < LINEEDIT_QUERY)
+		{
+			query[qlen++] = c;
+			// the current match may still contain the longer text
+			found = history_search(ls->history, query, qlen, match == -1 ? -1 : match + 1);
+			failed = (found == -1);
+			match = (found == -1) ? match : found;
+			continue;
+		}
+
+		// any other key accepts the match and is handled by the editor
+		if (line != NULL)
+		{
+			lineedit_set(ls, line, len);
+			ls->hpos = match;
+		}
+		lineedit_write("\r\033[K", 4);
+		return c;
+	}
+}
+
+
+/* Function: lineedit_list (internal)
+   Print candidates in columns below the line
+*/
+static void lineedit_list(LINESTATE *ls, COMPLETION *c)
+{
+	int i, n, width = 0, cols, len;
+
+	lineedit_newline(ls, "");
+	if (c->count > LINEEDIT_LIST && 0 == lineedit_output(64))
+	{
+		n = sprintf(out, "Display all %d possibilities? (y or n)", c->count);
+		lineedit_write(out, n);
+		i = lineedit_key(ls);
+		lineedit_write("\r\n", 2);
+		if (i != 'y')
+		{
+			return;
+		}
+	}
+
+	for (i = 0; i < c->count; i++)
+	{
+		len = lineedit_width(c->match[i]);
+		width = (len > width) ? len : width;
+	}
+	width += 2;
+	cols = (ls->cols / width > 0) ? ls->cols / width : 1;
+
+	// one write per row
+	for (i = 0; i < c->count; i++)
+	{
+		if (-1 == lineedit_output(width + 3))
+		{
+			return;
+		}
+		len = strlen(c->match[i]);
+		memcpy(out, c->match[i], len);
+		n = len;
+		if ((i + 1) % cols == 0 || i == c->count - 1)
+		{
+			out[n++] = '\r';
+			out[n++] = '\n';
+		}
+		else
+		{
+			for (len = lineedit_width(c->match[i]); len < width; len++)
+			{
+				out[n++] = ' ';
+			}
+		}
+		lineedit_write(out, n);
+	}
+}
+
+
+/* Function: lineedit_complete (internal)
+   Tab: insert the common prefix of the candidates, list them on a repeated Tab
+*/
+static void lineedit_complete(LINESTATE *ls, int repeated)
+{
+	COMPLETION c;
+	int common, wlen;
+
+	// the word is before the cursor, terminate it in the gap
+	ls->buf[ls->pos] = '\0';
+	if (complete_word(ls->buf, ls->pos, &c) == 0)
+	{
+		complete_release(&c);
+		return;
+	}
+
+	common = complete_common(&c);
+	wlen = ls->pos - c.start;
+	if (common > wlen || (c.count == 1 && common == wlen))
+	{
+		lineedit_delete(ls, c.start, ls->pos);
+		lineedit_insert(ls, c.match[0], common);
+		// a unique file or command is finished, a directory is not
+		if (c.count == 1 && c.match[0][common-1] != '/')
+		{
+			lineedit_insert(ls, " ", 1);
+		}
+	}
+	else if (repeated && c.count > 1)
+	{
+		lineedit_list(ls, &c);
+	}
+	complete_release(&c);
+}
+
+
+/* Function: lineedit_raw (internal)
+   Put terminal in raw mode, keeping output processing
+*/
+static int lineedit_raw()
+{
+	struct termios raw;
+
+	if (-1 == tcgetattr(STDIN_FILENO, &saved_tio))
+	{
+		return -1;
+	}
+	raw = saved_tio;
+	raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+	raw.c_cflag |= CS8;
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+
+	return tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+}
+
+
+/* Function: lineedit_escape (internal)
+   Handle the rest of an escape sequence (arrows, Home, End, Delete)
+*/
+static void lineedit_escape(LINESTATE *ls)
+{
+	int seq[3] = {0, 0, 0};
+
+	seq[0] = lineedit_key(ls);
+	seq[1] = lineedit_key(ls);
+	if (seq[0] != '[' && seq[0] != 'O')
+	{
+		return;
+	}
+	if (seq[1] >= '0' && seq[1] <= '9')
+	{
+		seq[2] = lineedit_key(ls);
+		if (seq[2] != '~')
+		{
+			return;
+		}
+		switch (seq[1])
+		{
+			case '1':
+			case '7':
+				lineedit_move(ls, 0);
+				break;
+			case '4':
+			case '8':
+				lineedit_move(ls, ls->len);
+				break;
+			case '3':
+				lineedit_delete(ls, ls->pos, lineedit_next(ls, ls->pos));
+				break;
+		}
+		return;
+	}
+	switch (seq[1])
+	{
+		case 'A':
+			lineedit_history(ls, -1);
+			break;
+		case 'B':
+			lineedit_history(ls, 1);
+			break;
+		case 'C':
+			lineedit_move(ls, lineedit_next(ls, ls->pos));
+			break;
+		case 'D':
+			lineedit_move(ls, lineedit_prev(ls, ls->pos));
+			break;
+		case 'H':
+			lineedit_move(ls, 0);
+			break;
+		case 'F':
+			lineedit_move(ls, ls->len);
+			break;
+	}
+}
+
+
+/* Function: lineedit_read
+   Main editing loop
+*/
+int lineedit_read(char **line, size_t *size, HISTORY *h, PROMPT_FUNC prompt)
+{
+	LINESTATE ls;
+	int c, from, result = -1, done = FALSE, tab = FALSE;
+	char ch;
+
+	memset(&ls, 0, sizeof ls);
+	ls.buf = *line;
+	ls.size = (*line == NULL) ? 0 : *size;
+	ls.render = prompt;
+	ls.history = h;
+	ls.hpos = -1;
+
+	fflush(stdout);
+	lineedit_prompt(&ls);
+	if (-1 == lineedit_raw())
+	{
+		// not a terminal after all
+		lineedit_write(ls.prompt, ls.plen);
+		return getline(line, size, stdin);
+	}
+	if (-1 == lineedit_gap(&ls, 0))
+	{
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &saved_tio);
+		return -1;
+	}
+	lineedit_refresh(&ls);
+
+	while (done == FALSE)
+	{
+		c = lineedit_key(&ls);
+		if (c == KEY_CTRL('R'))
+		{
+			c = lineedit_search(&ls);
+		}
+
+		switch (c)
+		{
+			case 0:
+				break;
+
+			case -1:
+				done = TRUE;
+				break;
+
+			case '\t':
+				lineedit_complete(&ls, tab);
+				break;
+
+			case '\r':
+			case '\n':
+				result = ls.len;
+				done = TRUE;
+				break;
+
+			case KEY_CTRL('D'):
+				if (ls.len == 0)
+				{
+					done = TRUE;
+					break;
+				}
+				lineedit_delete(&ls, ls.pos, lineedit_next(&ls, ls.pos));
+				break;
+
+			case KEY_CTRL('C'):
+				lineedit_newline(&ls, "^C");
+				lineedit_set(&ls, "", 0);
+				ls.hpos = -1;
+				lineedit_prompt(&ls);
+				break;
+
+			case KEY_BACKSPACE:
+			case KEY_CTRL('H'):
+				lineedit_delete(&ls, lineedit_prev(&ls, ls.pos), ls.pos);
+				break;
+
+			case KEY_CTRL('A'):
+				lineedit_move(&ls, 0);
+				break;
+
+			case KEY_CTRL('E'):
+				lineedit_move(&ls, ls.len);
+				break;
+
+			case KEY_CTRL('B'):
+				lineedit_move(&ls, lineedit_prev(&ls, ls.pos));
+				break;
+
+			case KEY_CTRL('F'):
+				lineedit_move(&ls, lineedit_next(&ls, ls.pos));
+				break;
+
+			case KEY_CTRL('K'):
+				lineedit_delete(&ls, ls.pos, ls.len);
+				break;
+
+			case KEY_CTRL('U'):
+				lineedit_delete(&ls, 0, ls.pos);
+				break;
+
+			case KEY_CTRL('W'):
+				from = ls.pos;
+				while (from > 0 && isspace(lineedit_at(&ls, from - 1)))
+				{
+					from--;
+				}
+				while (from > 0 && !isspace(lineedit_at(&ls, from - 1)))
+				{
+					from--;
+				}
+				lineedit_delete(&ls, from, ls.pos);
+				break;
+
+			case KEY_CTRL('L'):
+				lineedit_write("\033[H\033[2J", 7);
+				ls.cur = ls.cells = 0;
+				ls.full = TRUE;
+				break;
+
+			case KEY_CTRL('P'):
+				lineedit_history(&ls, -1);
+				break;
+
+			case KEY_CTRL('N'):
+				lineedit_history(&ls, 1);
+				break;
+
+			case KEY_ESC:
+				lineedit_escape(&ls);
+				break;
+
+			default:
+				if (c >= ' ' && c != KEY_BACKSPACE)
+				{
+					ch = c;
+					lineedit_insert(&ls, &ch, 1);
+					ls.hpos = -1;
+				}
+				break;
+		}
+
+		tab = (c == '\t');
+		// a paste is drawn once it is consumed
+		if (done == FALSE && (ls.full == TRUE || lineedit_pending() == FALSE))
+		{
+			lineedit_refresh(&ls);
+		}
+	}
+
+	// leave the cursor after the line
+	lineedit_move(&ls, ls.len);
+	lineedit_refresh(&ls);
+	lineedit_newline(&ls, "");
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &saved_tio);
+	free(ls.saved);
+
+	// the gap is at the end: the text is contiguous and has room for "\n\0"
+	if (result >= 0)
+	{
+		ls.buf[result++] = '\n';
+		ls.buf[result] = '\0';
+	}
+	*line = ls.buf;
+	*size = ls.size;
+
+	return result;
+}
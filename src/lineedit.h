@@ -0,0 +1,58 @@
+/*
+	Interactive line editor
+	Reads one command line from the terminal in raw mode with emacs style
+	editing keys, prefix history search on up/down, Ctrl-R incremental
+	search and Tab completion (see complete.h). The prompt is redrawn when
+	an asynchronous prompt segment changes while the user is typing.
+
+	The line is held in a gap buffer that grows as needed, so inserting or
+	deleting at the cursor does not move the rest of the line. Redraws are
+	incremental: only the cells from the first changed byte on are written,
+	and input arriving in a burst (a paste) is drawn once it is consumed.
+*/
+
+#ifndef _LINEEDIT_H_
+#define _LINEEDIT_H_
+
+#include "include.h"
+#include "history.h"
+
+/* Max size of the rendered prompt */
+#define LINEEDIT_PROMPT (PATH_MAX + 256)
+
+/* Max length of the Ctrl-R search text */
+#define LINEEDIT_QUERY 256
+
+/* Input is read in blocks of this size, also the initial line buffer size */
+#define LINEEDIT_READ 4096
+
+/* Completion candidates listed without asking */
+#define LINEEDIT_LIST 100
+
+/* Control keys */
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+
+
+/* Typedef: PROMPT_FUNC
+   Renders the prompt into buf (at most size bytes), returns its length
+*/
+typedef int (*PROMPT_FUNC)(char *buf, int size);
+
+
+/* Function: lineedit_read
+   Read one line from the terminal on STDIN into *line, which is allocated or
+   grown as needed and its size stored in *size, like getline(). The line is
+   newline terminated. History may be NULL.
+   Returns length of the line, or -1 on end of input (Ctrl-D on an empty line)
+*/
+int lineedit_read(char **line, size_t *size, HISTORY *h, PROMPT_FUNC prompt);
+
+
+/* Function: lineedit_width
+   Returns the display width of s, skipping terminal escape sequences
+*/
+int lineedit_width(const char *s);
+
+#endif /* _LINEEDIT_H_ */
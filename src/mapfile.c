@@ -0,0 +1,142 @@
+#include "mapfile.h"
+
+
+/* Function: mapfile_advise (internal)
+   Ask for the window after the one being read, give back the windows
+   before it
+*/
+static void mapfile_advise(MAPFILE *mf)
+{
+	size_t window = mf->pos - mf->pos % MAPFILE_WINDOW, len;
+
+	if (mf->data == NULL)
+	{
+		return;
+	}
+	while (mf->ahead < mf->size && mf->ahead < window + 2 * MAPFILE_WINDOW)
+	{
+		len = (mf->size - mf->ahead < MAPFILE_WINDOW) ? mf->size - mf->ahead : MAPFILE_WINDOW;
+		madvise(mf->data + mf->ahead, len, MADV_WILLNEED);
+		mf->ahead += MAPFILE_WINDOW;
+	}
+	if (window > mf->released)
+	{
+		madvise(mf->data + mf->released, window - mf->released, MADV_DONTNEED);
+		mf->released = window;
+	}
+}
+
+
+/* Function: mapfile_open
+   An empty file has no mapping
+*/
+MAPFILE *mapfile_open(const char *path)
+{
+	MAPFILE *mf;
+	struct stat st;
+	int fd, err;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return NULL;
+	}
+	err = (-1 == fstat(fd, &st)) ? errno : (S_ISDIR(st.st_mode) ? EISDIR : 0);
+	if (err != 0)
+	{
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	mf = calloc(1, sizeof (MAPFILE));
+	if (mf == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+	mf->size = st.st_size;
+	if (mf->size > 0)
+	{
+		mf->data = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mf->data == MAP_FAILED)
+		{
+			err = errno;
+			close(fd);
+			free(mf);
+			errno = err;
+			return NULL;
+		}
+		madvise(mf->data, mf->size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	mapfile_advise(mf);
+
+	return mf;
+}
+
+
+/* Function: mapfile_getline
+   Physical lines are copied until one does not end with a backslash
+*/
+long mapfile_getline(MAPFILE *mf, char **line, size_t *size)
+{
+	const char *p, *end;
+	size_t len = 0, n, need;
+	char *grow;
+
+	if (mf->pos >= mf->size)
+	{
+		return -1;
+	}
+	while (TRUE)
+	{
+		p = mf->data + mf->pos;
+		end = memchr(p, '\n', mf->size - mf->pos);
+		n = (end != NULL) ? (size_t) (end - p) + 1 : mf->size - mf->pos;
+		need = len + n + 1;
+		if (need > *size || *line == NULL)
+		{
+			need = (need < 2 * *size) ? 2 * *size : ((need < 128) ? 128 : need);
+			grow = realloc(*line, need);
+			if (grow == NULL)
+			{
+				perror("realloc");
+				return -1;
+			}
+			*line = grow;
+			*size = need;
+		}
+		memcpy(*line + len, p, n);
+		len += n;
+		mf->pos += n;
+		mf->lineno++;
+
+		// a backslash before the newline joins the next line
+		if (len >= 2 && (*line)[len-1] == '\n' && (*line)[len-2] == '\\' && mf->pos < mf->size)
+		{
+			len -= 2;
+			continue;
+		}
+		break;
+	}
+	(*line)[len] = '\0';
+	mapfile_advise(mf);
+
+	return len;
+}
+
+
+/* Function: mapfile_close
+*/
+void mapfile_close(MAPFILE *mf)
+{
+	if (mf == NULL)
+	{
+		return;
+	}
+	if (mf->data != NULL)
+	{
+		munmap(mf->data, mf->size);
+	}
+	free(mf);
+}
@@ -0,0 +1,61 @@
+/*
+	MAPFILE reads a script file (mysh FILE, source FILE) one line at a
+	time from a read-only mapping instead of reading it whole. The
+	mapping is advised MADV_SEQUENTIAL; the window of MAPFILE_WINDOW bytes
+	after the one being read is asked for with MADV_WILLNEED so the
+	kernel reads it while the commands before it run, and the windows
+	already read are given back with MADV_DONTNEED. Memory stays at a few
+	windows and the longest line whatever the size of the file, and the
+	first command runs as soon as its line is mapped.
+
+	A line ending with a backslash goes on with the next one, the
+	backslash and newline are removed. Definitions and constructs over
+	several lines are put together by the shell, which asks for the
+	lines it needs.
+*/
+
+#ifndef _MAPFILE_H_
+#define _MAPFILE_H_
+
+#include "include.h"
+#include <sys/mman.h>
+
+/* Read ahead and released in windows of this size, a multiple of the page size */
+#define MAPFILE_WINDOW (4 * 1024 * 1024)
+
+
+/* Typedef: MAPFILE
+   Mapping of size bytes, position of the next line, start of the bytes
+   not released yet, end of the window read ahead, number of lines read
+*/
+typedef struct mapfile {
+	char *data;
+	size_t size;
+	size_t pos;
+	size_t released;
+	size_t ahead;
+	int lineno;
+} MAPFILE;
+
+
+/* Function: mapfile_open
+   Map the file at path
+   Returns the MAPFILE, NULL on error (errno tells which)
+*/
+MAPFILE *mapfile_open(const char *path);
+
+
+/* Function: mapfile_getline
+   Copy the next line, with its newline and continuation lines, into
+   *line (*size bytes, grown as getline() does)
+   Returns its length, -1 at the end of the file
+*/
+long mapfile_getline(MAPFILE *mf, char **line, size_t *size);
+
+
+/* Function: mapfile_close
+   Unmap the file and deallocate mf, it may be NULL
+*/
+void mapfile_close(MAPFILE *mf);
+
+#endif /* _MAPFILE_H_ */
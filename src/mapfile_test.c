@@ -0,0 +1,193 @@
+#include "mapfile.h"
+#include <sys/resource.h>
+
+/* prototypes */
+void test_lines(const char *dir);
+void test_errors(const char *dir);
+void test_large(const char *dir, long mb);
+
+
+/* Function: write_file (helper)
+   Write text to path
+*/
+void write_file(const char *path, const char *text)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	assert(fd != -1);
+	assert(write(fd, text, strlen(text)) == (ssize_t) strlen(text));
+	close(fd);
+}
+
+
+/* Function: maxrss (helper)
+   Peak resident set size in KB
+*/
+long maxrss()
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_maxrss;
+}
+
+
+/* Function: elapsed (helper)
+   Microseconds from start to end
+*/
+long elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000 + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+
+/* Function: test_lines
+   Lines keep their newline, continuations are joined
+*/
+void test_lines(const char *dir)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: MAPFILE lines\n");
+#endif
+
+	char path[PATH_MAX], *line = NULL;
+	size_t size = 0;
+	MAPFILE *mf;
+
+	snprintf(path, sizeof path, "%s/lines", dir);
+	write_file(path, "echo a\nfor i in 1 2; do\n  echo $i\ndone\necho b \\\nc \\\nd\n\necho \\\\\nlast");
+	mf = mapfile_open(path);
+	assert(mf != NULL);
+	assert(mapfile_getline(mf, &line, &size) == 7 && strcmp(line, "echo a\n") == 0);
+	assert(mapfile_getline(mf, &line, &size) == 17 && strcmp(line, "for i in 1 2; do\n") == 0);
+	assert(mapfile_getline(mf, &line, &size) == 10 && strcmp(line, "  echo $i\n") == 0);
+	assert(mapfile_getline(mf, &line, &size) == 5 && strcmp(line, "done\n") == 0);
+	assert(mapfile_getline(mf, &line, &size) == 11 && strcmp(line, "echo b c d\n") == 0);
+	assert(mf->lineno == 7);
+	assert(mapfile_getline(mf, &line, &size) == 1 && strcmp(line, "\n") == 0);
+
+	// the backslash before the newline of "echo \\" is the escaped one,
+	// it still joins: continuation is by the last character only
+	assert(mapfile_getline(mf, &line, &size) == 10 && strcmp(line, "echo \\last") == 0);
+	assert(mapfile_getline(mf, &line, &size) == -1);
+	assert(mapfile_getline(mf, &line, &size) == -1);
+	mapfile_close(mf);
+
+	// a backslash on the last line is kept
+	write_file(path, "echo x\\\n");
+	mf = mapfile_open(path);
+	assert(mapfile_getline(mf, &line, &size) == 8 && strcmp(line, "echo x\\\n") == 0);
+	assert(mapfile_getline(mf, &line, &size) == -1);
+	mapfile_close(mf);
+
+	// empty file
+	write_file(path, "");
+	mf = mapfile_open(path);
+	assert(mf != NULL && mf->data == NULL);
+	assert(mapfile_getline(mf, &line, &size) == -1);
+	mapfile_close(mf);
+	mapfile_close(NULL);
+
+	free(line);
+	unlink(path);
+}
+
+
+/* Function: test_errors
+   Missing files and directories are not opened
+*/
+void test_errors(const char *dir)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: MAPFILE errors\n");
+#endif
+
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof path, "%s/missing", dir);
+	errno = 0;
+	assert(mapfile_open(path) == NULL && errno == ENOENT);
+	errno = 0;
+	assert(mapfile_open(dir) == NULL && errno == EISDIR);
+}
+
+
+/* Function: test_large
+   A file of mb MB: every line is read, memory grows by a few windows
+   only, the first line comes long before the whole file would be read
+*/
+void test_large(const char *dir, long mb)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: MAPFILE %ld MB file\n", mb);
+#endif
+
+	struct timespec start, first, end;
+	char path[PATH_MAX], chunk[65536], text[65], *line = NULL;
+	long lines = 0, rss, i;
+	size_t size = 0;
+	MAPFILE *mf;
+	int fd;
+
+	// 64 bytes per line
+	for (i = 0; i < (long) sizeof chunk; i += 64)
+	{
+		snprintf(text, sizeof text, "echo %058ld\n", i / 64);
+		memcpy(chunk + i, text, 64);
+	}
+	snprintf(path, sizeof path, "%s/large", dir);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	assert(fd != -1);
+	for (i = 0; i < mb * 16; i++)
+	{
+		assert(write(fd, chunk, sizeof chunk) == sizeof chunk);
+	}
+	fsync(fd);
+	close(fd);
+
+	rss = maxrss();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	mf = mapfile_open(path);
+	assert(mf != NULL);
+	assert(mapfile_getline(mf, &line, &size) == 64 && strncmp(line, "echo 0", 6) == 0);
+	clock_gettime(CLOCK_MONOTONIC, &first);
+	for (lines = 1; mapfile_getline(mf, &line, &size) != -1; lines++)
+	{
+		assert(line[63] == '\n');
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	mapfile_close(mf);
+	assert(lines == mb * 1024 * 16);
+	assert(maxrss() - rss < 4 * MAPFILE_WINDOW / 1024 + 1024);
+
+#ifdef DEBUG_TEST
+	printf("TEST: MAPFILE first line after %ld us, %ld lines in %ld us, %ld KB more resident\n",
+		elapsed(&start, &first), lines, elapsed(&start, &end), maxrss() - rss);
+#endif
+
+	free(line);
+	unlink(path);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: MAPFILE Module\n");
+#endif
+
+	char dir[] = "/tmp/mapfile_test.XXXXXX";
+
+	assert(mkdtemp(dir) != NULL);
+	test_lines(dir);
+	test_errors(dir);
+	test_large(dir, 64);
+	rmdir(dir);
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: MAPFILE Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,640 @@
+#include "memo.h"
+#include "vars.h"
+#include <dirent.h>
+#include <sys/sendfile.h>
+
+/* Cache directory, empty until memo_init() succeeded, short enough for
+   the path of an entry to fit in PATH_MAX */
+static char cache[PATH_MAX - MEMO_KEY - 32];
+static long limit = MEMO_LIMIT * 1024L * 1024L;
+
+/* Statistics of this session */
+static long hits = 0, misses = 0, stored = 0, replayed = 0;
+
+
+/* Typedef: MEMO_HASH (internal)
+   Two 64 bit hashes fed with the same bytes, 128 bits of key
+*/
+typedef struct memo_hash {
+	unsigned long long a;
+	unsigned long long b;
+} MEMO_HASH;
+
+
+/* Typedef: MEMO_ENTRY (internal)
+   One cache file, for eviction
+*/
+typedef struct memo_entry {
+	char name[MEMO_KEY + 1];
+	struct timespec mtime;
+	long size;
+} MEMO_ENTRY;
+
+
+/* Function: memo_init
+   Create the directory private to the user
+*/
+int memo_init(const char *dir)
+{
+	if (strlen(dir) >= sizeof cache || (-1 == mkdir(dir, 0700) && errno != EEXIST))
+	{
+		cache[0] = '\0';
+		return -1;
+	}
+	snprintf(cache, sizeof cache, "%s", dir);
+
+	return 0;
+}
+
+
+/* Function: memo_parse
+   Options come before the command, "--" ends the key files
+*/
+int memo_parse(char **argv, MEMO_OPTS *opts)
+{
+	char *end;
+	int i;
+
+	memset(opts, 0, sizeof (MEMO_OPTS));
+	for (i = 1; argv[i] != NULL && strncmp(argv[i], "--", 2) == 0; i++)
+	{
+		if (strcmp(argv[i], "--") == 0)
+		{
+			i++;
+			break;
+		}
+		else if (strcmp(argv[i], "--key-files") == 0)
+		{
+			opts->files = &argv[i+1];
+			while (opts->files[opts->nfiles] != NULL && strcmp(opts->files[opts->nfiles], "--") != 0)
+			{
+				opts->nfiles++;
+			}
+			i += opts->nfiles + 1;
+			if (argv[i] == NULL)
+			{
+				goto memo_usage;
+			}
+		}
+		else if (strcmp(argv[i], "--env") == 0 && argv[i+1] != NULL && opts->nenv < MEMO_ENV)
+		{
+			opts->env[opts->nenv++] = argv[++i];
+		}
+		else if (i == 1 && strcmp(argv[i], "--stats") == 0 && argv[i+1] == NULL)
+		{
+			opts->action = MEMO_STATS;
+			return 0;
+		}
+		else if (i == 1 && strcmp(argv[i], "--clear") == 0 && argv[i+1] == NULL)
+		{
+			opts->action = MEMO_CLEAR;
+			return 0;
+		}
+		else if (i == 1 && strcmp(argv[i], "--limit") == 0 && argv[i+1] != NULL && argv[i+2] == NULL)
+		{
+			opts->limit = strtol(argv[i+1], &end, 10);
+			if (*end != '\0' || opts->limit < 1)
+			{
+				goto memo_usage;
+			}
+			opts->action = MEMO_SIZE;
+			return 0;
+		}
+		else
+		{
+			goto memo_usage;
+		}
+	}
+	if (argv[i] == NULL)
+	{
+		goto memo_usage;
+	}
+
+	return i;
+
+memo_usage:
+#ifdef WARNING
+	printf("-mysh: memo: usage: memo [--key-files file ... --] [--env NAME] ... cmd ...\n");
+	printf("       memo --stats | --clear | --limit MB\n");
+#endif
+	return -1;
+}
+
+
+/* Function: memo_feed (internal)
+   FNV-1a for a, a multiply and xorshift mix for b
+*/
+static void memo_feed(MEMO_HASH *h, const void *data, long len)
+{
+	const unsigned char *p = data;
+	long i;
+
+	for (i = 0; i < len; i++)
+	{
+		h->a = (h->a ^ p[i]) * 0x100000001b3ULL;
+		h->b = (h->b + p[i]) * 0x9e3779b97f4a7c15ULL;
+		h->b ^= h->b >> 29;
+	}
+}
+
+
+/* Function: memo_file (internal)
+   Feed the name and contents of a file, a marker if it cannot be read
+*/
+static void memo_file(MEMO_HASH *h, const char *path)
+{
+	char buf[16384];
+	long n;
+	int fd;
+
+	memo_feed(h, path, strlen(path) + 1);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		memo_feed(h, "\0missing", 8);
+		return;
+	}
+	while ((n = read(fd, buf, sizeof buf)) > 0 || (n == -1 && errno == EINTR))
+	{
+		if (n > 0)
+		{
+			memo_feed(h, buf, n);
+		}
+	}
+	close(fd);
+	memo_feed(h, "", 1);
+}
+
+
+/* Function: memo_var (internal)
+   Feed the name and value of a variable
+*/
+static void memo_var(MEMO_HASH *h, const char *name)
+{
+	const char *value = vars_get(name);
+
+	memo_feed(h, name, strlen(name) + 1);
+	memo_feed(h, (value != NULL) ? value : "\0unset", (value != NULL) ? strlen(value) + 1 : 6);
+}
+
+
+/* Function: memo_key
+   Variables are found by their '$' in the command line
+*/
+void memo_key(const MEMO_OPTS *opts, const char *cmdline, const char *infile, char *key)
+{
+	MEMO_HASH h = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL};
+	char cwd[PATH_MAX], name[256];
+	const char *p;
+	int i, n, brace;
+
+	memo_feed(&h, cmdline, strlen(cmdline) + 1);
+	if (getcwd(cwd, sizeof cwd) != NULL)
+	{
+		memo_feed(&h, cwd, strlen(cwd) + 1);
+	}
+	for (p = strchr(cmdline, '$'); p != NULL; p = strchr(p + 1, '$'))
+	{
+		brace = (p[1] == '{');
+		for (n = 0; isalnum(p[1+brace+n]) || p[1+brace+n] == '_'; n++)
+		{
+		}
+		if (n > 0 && n < (int) sizeof name)
+		{
+			snprintf(name, sizeof name, "%.*s", n, p + 1 + brace);
+			memo_var(&h, name);
+		}
+	}
+	for (i = 0; i < opts->nenv; i++)
+	{
+		memo_var(&h, opts->env[i]);
+	}
+	if (infile != NULL)
+	{
+		memo_file(&h, infile);
+	}
+	for (i = 0; i < opts->nfiles; i++)
+	{
+		memo_file(&h, opts->files[i]);
+	}
+
+	snprintf(key, MEMO_KEY + 1, "%016llx%016llx", h.a, h.b);
+}
+
+
+/* Function: memo_copy (internal)
+   Copy len bytes of entry from offset off to fd: copy_file_range() when
+   fd is a regular file, sendfile() to anything else, read()/write() if
+   both refuse (fd opened with O_APPEND)
+   Returns the number of bytes copied
+*/
+static long memo_copy(int entry, off_t off, int fd, long len)
+{
+	char buf[16384];
+	long n, done = 0, w, k;
+	int mode = 0;
+
+	while (done < len)
+	{
+		if (mode == 0)
+		{
+			n = copy_file_range(entry, &off, fd, NULL, len - done, 0);
+		}
+		else if (mode == 1)
+		{
+			n = sendfile(fd, entry, &off, len - done);
+		}
+		else
+		{
+			n = pread(entry, buf, (len - done < (long) sizeof buf) ? len - done : (long) sizeof buf, off);
+			for (w = 0; n > 0 && w < n; )
+			{
+				k = write(fd, buf + w, n - w);
+				if (k == -1 && errno == EINTR)
+				{
+					continue;
+				}
+				if (k <= 0)
+				{
+					return done;
+				}
+				w += k;
+			}
+			off += (n > 0) ? n : 0;
+		}
+
+		if (n == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n == -1 && mode < 2 && done == 0)
+		{
+			mode++;
+			continue;
+		}
+		if (n <= 0)
+		{
+			break;
+		}
+		done += n;
+	}
+
+	return done;
+}
+
+
+/* Function: memo_replay
+   A hit makes the entry the most recently used one
+*/
+int memo_replay(const char *key, int fd)
+{
+	char path[PATH_MAX], header[MEMO_HEADER];
+	struct stat st;
+	int entry, status;
+
+	if (cache[0] == '\0')
+	{
+		return -1;
+	}
+	snprintf(path, sizeof path, "%s/%s", cache, key);
+	entry = open(path, O_RDONLY | O_CLOEXEC);
+	if (entry == -1)
+	{
+		misses++;
+		return -1;
+	}
+	if (-1 == fstat(entry, &st) || st.st_size < MEMO_HEADER
+		|| MEMO_HEADER != pread(entry, header, MEMO_HEADER, 0)
+		|| memcmp(header, MEMO_MAGIC, strlen(MEMO_MAGIC)) != 0)
+	{
+		close(entry);
+		misses++;
+		return -1;
+	}
+	memcpy(&status, header + strlen(MEMO_MAGIC), sizeof (int));
+
+	replayed += memo_copy(entry, MEMO_HEADER, fd, st.st_size - MEMO_HEADER);
+	futimens(entry, NULL);
+	close(entry);
+	hits++;
+
+	return status;
+}
+
+
+/* Function: memo_write (internal)
+   write() all of buf, -1 on error
+*/
+static int memo_write(int fd, const char *buf, long len)
+{
+	long n;
+
+	while (len > 0)
+	{
+		n = write(fd, buf, len);
+		if (n == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+
+/* Function: memo_release (internal)
+   Close everything, remove the temporary file unless it was stored
+*/
+static void memo_release(MEMO_TEE *tee)
+{
+	int *fds[] = {&tee->fd, &tee->in, &tee->out, &tee->tmp}, i;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (*fds[i] != -1)
+		{
+			close(*fds[i]);
+		}
+	}
+	if (tee->path[0] != '\0')
+	{
+		unlink(tee->path);
+	}
+	pthread_mutex_destroy(&tee->lock);
+	free(tee);
+}
+
+
+/* Function: memo_pump (internal)
+   Thread: pass the job's output on and into the temporary file until the
+   last writer closed the pipe
+*/
+static void *memo_pump(void *arg)
+{
+	MEMO_TEE *tee = arg;
+	char buf[16384];
+	long n;
+	int discard;
+
+	while ((n = read(tee->in, buf, sizeof buf)) != 0)
+	{
+		if (n == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		memo_write(tee->out, buf, n);
+		if (tee->tmp != -1 && -1 == memo_write(tee->tmp, buf, n))
+		{
+			close(tee->tmp);
+			tee->tmp = -1;
+		}
+		tee->bytes += n;
+	}
+
+	pthread_mutex_lock(&tee->lock);
+	tee->done = TRUE;
+	discard = tee->discard;
+	pthread_mutex_unlock(&tee->lock);
+	if (discard == TRUE)
+	{
+		memo_release(tee);
+	}
+
+	return NULL;
+}
+
+
+/* Function: memo_record
+   The entry is written under a unique temporary name (a discarded
+   recording of the same key may still be running), the pump runs with
+   all signals blocked
+*/
+MEMO_TEE *memo_record(const char *key, int out)
+{
+	char header[MEMO_HEADER] = {0};
+	sigset_t all, old;
+	MEMO_TEE *tee;
+	int pfd[2], ret;
+
+	if (cache[0] == '\0' || (tee = calloc(1, sizeof (MEMO_TEE))) == NULL)
+	{
+		return NULL;
+	}
+	tee->fd = tee->in = tee->out = tee->tmp = -1;
+	pthread_mutex_init(&tee->lock, NULL);
+	snprintf(tee->key, sizeof tee->key, "%s", key);
+	snprintf(tee->path, sizeof tee->path, "%s/.%s.XXXXXX", cache, key);
+
+	tee->tmp = mkostemp(tee->path, O_CLOEXEC);
+	if (tee->tmp == -1)
+	{
+		tee->path[0] = '\0';
+	}
+	if (tee->tmp == -1 || -1 == memo_write(tee->tmp, header, MEMO_HEADER)
+		|| -1 == pipe2(pfd, O_CLOEXEC))
+	{
+		memo_release(tee);
+		return NULL;
+	}
+	tee->in = pfd[0];
+	tee->fd = pfd[1];
+	tee->out = fcntl(out, F_DUPFD_CLOEXEC, 0);
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&tee->thread, NULL, memo_pump, tee);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret != 0 || tee->out == -1)
+	{
+		if (ret == 0)
+		{
+			close(tee->fd);
+			tee->fd = -1;
+			pthread_join(tee->thread, NULL);
+		}
+		memo_release(tee);
+		return NULL;
+	}
+
+	return tee;
+}
+
+
+/* Function: memo_finish
+   Stores under the key by renaming the temporary file
+*/
+void memo_finish(MEMO_TEE *tee, int status)
+{
+	char header[MEMO_HEADER] = {0}, path[PATH_MAX];
+
+	close(tee->fd);
+	tee->fd = -1;
+	if (status >= 128)
+	{
+		pthread_mutex_lock(&tee->lock);
+		if (tee->done == FALSE)
+		{
+			tee->discard = TRUE;
+			pthread_detach(tee->thread);
+			pthread_mutex_unlock(&tee->lock);
+			return;
+		}
+		pthread_mutex_unlock(&tee->lock);
+		pthread_join(tee->thread, NULL);
+		memo_release(tee);
+		return;
+	}
+
+	pthread_join(tee->thread, NULL);
+	memcpy(header, MEMO_MAGIC, strlen(MEMO_MAGIC));
+	memcpy(header + strlen(MEMO_MAGIC), &status, sizeof (int));
+	snprintf(path, sizeof path, "%s/%s", cache, tee->key);
+	if (tee->tmp != -1 && MEMO_HEADER == pwrite(tee->tmp, header, MEMO_HEADER, 0)
+		&& 0 == rename(tee->path, path))
+	{
+		tee->path[0] = '\0';
+		stored++;
+	}
+	memo_release(tee);
+	memo_evict();
+}
+
+
+/* Function: memo_scan (internal)
+   List the entries of the cache, *total receives their size
+   Returns the number of entries, -1 on error
+*/
+static long memo_scan(MEMO_ENTRY **list, long *total)
+{
+	MEMO_ENTRY *grow;
+	struct dirent *ent;
+	struct stat st;
+	long count = 0, size = 0;
+	DIR *dir;
+
+	*list = NULL;
+	*total = 0;
+	if (cache[0] == '\0' || (dir = opendir(cache)) == NULL)
+	{
+		return -1;
+	}
+	while ((ent = readdir(dir)) != NULL)
+	{
+		if (strlen(ent->d_name) != MEMO_KEY || ent->d_name[strspn(ent->d_name, "0123456789abcdef")] != '\0'
+			|| -1 == fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW))
+		{
+			continue;
+		}
+		if (count == size)
+		{
+			size = (size > 0) ? 2 * size : 64;
+			grow = realloc(*list, size * sizeof (MEMO_ENTRY));
+			if (grow == NULL)
+			{
+				break;
+			}
+			*list = grow;
+		}
+		strcpy((*list)[count].name, ent->d_name);
+		(*list)[count].mtime = st.st_mtim;
+		(*list)[count].size = st.st_size;
+		*total += st.st_size;
+		count++;
+	}
+	closedir(dir);
+
+	return count;
+}
+
+
+/* Function: memo_compare (internal)
+   qsort order of entries, least recently used first
+*/
+static int memo_compare(const void *a, const void *b)
+{
+	const struct timespec *x = &((const MEMO_ENTRY*) a)->mtime, *y = &((const MEMO_ENTRY*) b)->mtime;
+
+	if (x->tv_sec != y->tv_sec)
+	{
+		return (x->tv_sec > y->tv_sec) - (x->tv_sec < y->tv_sec);
+	}
+	return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+
+/* Function: memo_evict
+   Oldest mtime first
+*/
+int memo_evict()
+{
+	char path[PATH_MAX];
+	MEMO_ENTRY *list;
+	long count, total, i;
+	int removed = 0;
+
+	count = memo_scan(&list, &total);
+	if (count > 0 && total > limit)
+	{
+		qsort(list, count, sizeof (MEMO_ENTRY), memo_compare);
+		for (i = 0; i < count && total > limit; i++)
+		{
+			snprintf(path, sizeof path, "%s/%s", cache, list[i].name);
+			if (0 == unlink(path))
+			{
+				total -= list[i].size;
+				removed++;
+			}
+		}
+	}
+	free(list);
+
+	return removed;
+}
+
+
+/* Function: memo_action
+   --stats counts this session, the entries are read from the directory
+*/
+void memo_action(const MEMO_OPTS *opts)
+{
+	char path[PATH_MAX];
+	MEMO_ENTRY *list;
+	long count, total, i;
+
+	if (opts->action == MEMO_SIZE)
+	{
+		limit = opts->limit * 1024L * 1024L;
+		printf("memo: limit %ld MB, %d entries evicted\n", opts->limit, memo_evict());
+		return;
+	}
+
+	count = memo_scan(&list, &total);
+	if (opts->action == MEMO_CLEAR)
+	{
+		for (i = 0; i < count; i++)
+		{
+			snprintf(path, sizeof path, "%s/%s", cache, list[i].name);
+			unlink(path);
+		}
+		printf("memo: %ld entries removed\n", (count > 0) ? count : 0);
+	}
+	else
+	{
+		printf("memo: %ld hits, %ld misses (%.1f%% hit rate), %ld stored, %ld KB replayed\n",
+			hits, misses, (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0,
+			stored, replayed / 1024);
+		printf("memo: %ld entries, %ld KB of %ld MB in %s\n", (count > 0) ? count : 0,
+			total / 1024, limit / (1024L * 1024L), (cache[0] != '\0') ? cache : "(no cache)");
+	}
+	free(list);
+}
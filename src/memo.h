@@ -0,0 +1,143 @@
+/*
+	MEMO caches the output of deterministic commands. "memo cmd ..." hashes
+	everything the output is supposed to depend on: the command line of
+	the pipeline, the current directory, the values of the variables it
+	names, the contents of its "<" input file, of the files given with
+	--key-files and of the variables given with --env. The hash names an
+	entry of the cache directory (content addressed): a header holding the
+	exit status followed by the bytes the pipeline wrote to stdout.
+
+	On a hit the entry is replayed without running anything, with
+	copy_file_range() or sendfile() so the output does not go through a
+	user space buffer. On a miss the pipeline runs as any job, its stdout a
+	pipe read by a thread that passes the output on and writes it to a
+	temporary file; the file is renamed into place once the job exited
+	(killed or stopped jobs are not cached).
+
+	Entries are kept under a size limit: a hit touches the entry's mtime
+	and storing one evicts the least recently used entries until the cache
+	fits again.
+*/
+
+#ifndef _MEMO_H_
+#define _MEMO_H_
+
+#include "include.h"
+#include <pthread.h>
+
+/* Cache directory, relative to $HOME */
+#define MEMO_DIR ".mysh_memo"
+
+/* Header of an entry */
+#define MEMO_MAGIC "MYSHMEMO"
+#define MEMO_HEADER 16
+
+/* Default size limit of the cache, in MB */
+#define MEMO_LIMIT 256
+
+/* Length of a key in hex digits */
+#define MEMO_KEY 32
+
+/* --env variables at most */
+#define MEMO_ENV 16
+
+/* What memo was asked for */
+#define MEMO_RUN 0
+#define MEMO_STATS 1
+#define MEMO_CLEAR 2
+#define MEMO_SIZE 3
+
+
+/* Typedef: MEMO_OPTS
+   Options of one memo command: key files (nfiles words of argv), --env
+   names, action and, for --limit, the new limit in MB
+*/
+typedef struct memo_opts {
+	char **files;
+	int nfiles;
+	char *env[MEMO_ENV];
+	int nenv;
+	int action;
+	long limit;
+} MEMO_OPTS;
+
+
+/* Typedef: MEMO_TEE
+   Output of a job being recorded: fd is the write end of the pipe to give
+   the job as stdout, the thread copies the read end to out and tmp
+*/
+typedef struct memo_tee {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int fd;
+	int in;
+	int out;
+	int tmp;
+	int done;
+	int discard;
+	long bytes;
+	char key[MEMO_KEY + 1];
+	char path[PATH_MAX];
+} MEMO_TEE;
+
+
+/* Function: memo_init
+   Use dir as the cache directory, created if missing
+   Returns 0, -1 if it cannot be created
+*/
+int memo_init(const char *dir);
+
+
+/* Function: memo_parse
+   Parse memo [--key-files f ... --] [--env NAME] ... cmd,
+   memo --stats, memo --clear and memo --limit MB
+   Returns the index of the command in argv (0 for an action without
+   command), -1 on a usage error
+*/
+int memo_parse(char **argv, MEMO_OPTS *opts);
+
+
+/* Function: memo_key
+   Compute the key of cmdline (the pipeline, up to the end of the line) run
+   in the current directory with infile as input into key (MEMO_KEY + 1
+   bytes)
+*/
+void memo_key(const MEMO_OPTS *opts, const char *cmdline, const char *infile, char *key);
+
+
+/* Function: memo_replay
+   Write the output cached under key to fd
+   Returns the exit status recorded, -1 on a miss
+*/
+int memo_replay(const char *key, int fd);
+
+
+/* Function: memo_record
+   Start recording the output of a job for key, passed on to out
+   Returns NULL if the cache cannot take it
+*/
+MEMO_TEE *memo_record(const char *key, int out);
+
+
+/* Function: memo_finish
+   The job exited with status (stopped or killed: 128 or more). Close the
+   write end, store the entry unless status says otherwise and release
+   the tee; output still arriving from a stopped job is passed on by the
+   thread, which then cleans up by itself
+*/
+void memo_finish(MEMO_TEE *tee, int status);
+
+
+/* Function: memo_evict
+   Remove least recently used entries until the cache fits in its limit
+   Returns the number of entries removed
+*/
+int memo_evict();
+
+
+/* Function: memo_action
+   Run --stats, --clear or --limit, output on stdout
+*/
+void memo_action(const MEMO_OPTS *opts);
+
+#endif /* _MEMO_H_ */
@@ -0,0 +1,229 @@
+#include "memo.h"
+#include "vars.h"
+#include <sys/mman.h>
+
+extern char **environ;
+
+/* prototypes */
+void test_parse();
+void test_key(const char *dir);
+void test_record();
+void test_evict();
+
+
+/* Function: contents (helper)
+   Whole contents of a memfd
+*/
+char *contents(int fd, char *buf, int size)
+{
+	long n = pread(fd, buf, size - 1, 0);
+
+	buf[(n > 0) ? n : 0] = '\0';
+	return buf;
+}
+
+
+/* Function: store (helper)
+   Record output under key as a job would
+*/
+void store(const char *key, const char *output, int status)
+{
+	int sink = open("/dev/null", O_WRONLY);
+	MEMO_TEE *tee = memo_record(key, sink);
+
+	assert(tee != NULL);
+	assert(write(tee->fd, output, strlen(output)) == (long) strlen(output));
+	memo_finish(tee, status);
+	close(sink);
+}
+
+
+/* Function: test_parse
+   Key files, --env, actions and usage errors
+*/
+void test_parse()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: MEMO parse\n");
+#endif
+
+	char *run[] = {"memo", "--key-files", "a", "b", "--", "--env", "LANG", "ls", "-l", NULL};
+	char *plain[] = {"memo", "ls", NULL};
+	char *stats[] = {"memo", "--stats", NULL};
+	char *limit[] = {"memo", "--limit", "10", NULL};
+	char *bad_limit[] = {"memo", "--limit", "x", NULL};
+	char *no_cmd[] = {"memo", "--env", "A", NULL};
+	char *unclosed[] = {"memo", "--key-files", "a", NULL};
+	char *unknown[] = {"memo", "--what", "ls", NULL};
+	MEMO_OPTS opts;
+
+	assert(memo_parse(run, &opts) == 7);
+	assert(opts.nfiles == 2 && strcmp(opts.files[1], "b") == 0);
+	assert(opts.nenv == 1 && strcmp(opts.env[0], "LANG") == 0);
+	assert(opts.action == MEMO_RUN);
+	assert(memo_parse(plain, &opts) == 1 && opts.nfiles == 0 && opts.nenv == 0);
+	assert(memo_parse(stats, &opts) == 0 && opts.action == MEMO_STATS);
+	assert(memo_parse(limit, &opts) == 0 && opts.action == MEMO_SIZE && opts.limit == 10);
+	assert(memo_parse(bad_limit, &opts) == -1);
+	assert(memo_parse(no_cmd, &opts) == -1);
+	assert(memo_parse(unclosed, &opts) == -1);
+	assert(memo_parse(unknown, &opts) == -1);
+}
+
+
+/* Function: test_key
+   The key follows the command, key files, input file and variables
+*/
+void test_key(const char *dir)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: MEMO key\n");
+#endif
+
+	char file[PATH_MAX], *files[] = {file, NULL}, key[MEMO_KEY + 1], other[MEMO_KEY + 1];
+	MEMO_OPTS opts;
+	FILE *fp;
+
+	memset(&opts, 0, sizeof opts);
+	snprintf(file, sizeof file, "%s/../memo_key_file", dir);
+	fp = fopen(file, "w");
+	fputs("one", fp);
+	fclose(fp);
+
+	memo_key(&opts, "ls -l", NULL, key);
+	assert(strlen(key) == MEMO_KEY);
+	memo_key(&opts, "ls -l", NULL, other);
+	assert(strcmp(key, other) == 0);
+	memo_key(&opts, "ls -a", NULL, other);
+	assert(strcmp(key, other) != 0);
+	memo_key(&opts, "ls -l", file, other);
+	assert(strcmp(key, other) != 0);
+
+	opts.files = files;
+	opts.nfiles = 1;
+	memo_key(&opts, "ls -l", NULL, key);
+	fp = fopen(file, "w");
+	fputs("two", fp);
+	fclose(fp);
+	memo_key(&opts, "ls -l", NULL, other);
+	assert(strcmp(key, other) != 0);
+	unlink(file);
+
+	memset(&opts, 0, sizeof opts);
+	assert(vars_set("MEMO_A", "1", FALSE) == 0);
+	memo_key(&opts, "echo ${MEMO_A}", NULL, key);
+	assert(vars_set("MEMO_A", "2", FALSE) == 0);
+	memo_key(&opts, "echo ${MEMO_A}", NULL, other);
+	assert(strcmp(key, other) != 0);
+	opts.env[opts.nenv++] = "MEMO_B";
+	memo_key(&opts, "echo ${MEMO_A}", NULL, key);
+	assert(strcmp(key, other) != 0);
+}
+
+
+/* Function: test_record
+   A finished job is replayed with its status, a killed one is not stored
+*/
+void test_record()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: MEMO record and replay\n");
+#endif
+
+	char buf[256], *big;
+	int out = memfd_create("memo_test", 0), i;
+	const char *key = "0123456789abcdef0123456789abcdef";
+	const char *killed = "fedcba9876543210fedcba9876543210";
+
+	assert(memo_replay(key, out) == -1);
+	store(key, "hello\nworld\n", 3);
+	assert(memo_replay(key, out) == 3);
+	assert(strcmp(contents(out, buf, sizeof buf), "hello\nworld\n") == 0);
+
+	store(killed, "partial", 130);
+	assert(memo_replay(killed, out) == -1);
+
+	/* larger than a pipe buffer, replayed to a non regular file */
+	big = malloc(1 << 20);
+	for (i = 0; i < (1 << 20) - 1; i++)
+	{
+		big[i] = 'a' + i % 26;
+	}
+	big[i] = '\0';
+	store(killed, big, 0);
+	close(out);
+	out = open("/dev/null", O_WRONLY);
+	assert(memo_replay(killed, out) == 0);
+	close(out);
+	free(big);
+}
+
+
+/* Function: test_evict
+   Least recently used entries go first
+*/
+void test_evict()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: MEMO evict\n");
+#endif
+
+	char key[MEMO_KEY + 1], *big;
+	MEMO_OPTS opts;
+	int i, sink = open("/dev/null", O_WRONLY);
+
+	big = malloc(400 * 1024 + 1);
+	memset(big, 'x', 400 * 1024);
+	big[400 * 1024] = '\0';
+	for (i = 0; i < 4; i++)
+	{
+		snprintf(key, sizeof key, "%032x", i + 1);
+		store(key, big, 0);
+		usleep(10000);
+	}
+	/* touch the first entry, it becomes the most recently used */
+	assert(memo_replay("00000000000000000000000000000001", sink) == 0);
+
+	memset(&opts, 0, sizeof opts);
+	opts.action = MEMO_SIZE;
+	opts.limit = 1;
+	memo_action(&opts);
+	assert(memo_replay("00000000000000000000000000000001", sink) == 0);
+	assert(memo_replay("00000000000000000000000000000004", sink) == 0);
+	assert(memo_replay("00000000000000000000000000000002", sink) == -1);
+	assert(memo_replay("00000000000000000000000000000003", sink) == -1);
+
+	opts.action = MEMO_CLEAR;
+	memo_action(&opts);
+	assert(memo_replay("00000000000000000000000000000004", sink) == -1);
+	close(sink);
+	free(big);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: MEMO Module\n");
+#endif
+
+	char dir[] = "/tmp/memo_testXXXXXX", cache[PATH_MAX];
+
+	assert(vars_init(environ) == 0);
+	assert(mkdtemp(dir) != NULL);
+	snprintf(cache, sizeof cache, "%s/cache", dir);
+	assert(memo_init(cache) == 0);
+	test_parse();
+	test_key(cache);
+	test_record();
+	test_evict();
+	rmdir(cache);
+	rmdir(dir);
+	vars_free();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: MEMO Module\n");
+#endif
+
+	return 0;
+}
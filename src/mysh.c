@@ -1,9 +1,74 @@
 #include "mysh.h"
+#include <poll.h>
+#include <sys/mman.h>
 
 extern sigset_t fullset;
 extern PIDTABLE *ptable;
 extern PROCGROUP *foreground;
 extern int ttyd;
+extern HISTSTAT *jobstats;
+
+
+/* Cached working directory, validated against the device/inode of "." */
+static char cwd_cache[PATH_MAX];
+static dev_t cwd_dev;
+static ino_t cwd_ino;
+static int cwd_valid = FALSE;
+
+/* Persistent history, NULL when not interactive */
+static HISTORY *history = NULL;
+
+/* Created by the first jobs --stats/--top */
+static SAMPLER *sampler = NULL;
+
+/* Parse of the lines run last, NULL if unavailable */
+static PARSECACHE *parsecache = NULL;
+
+/* Set by exec_command() for "time cmd", reported once the job is reaped */
+static int time_pending = FALSE;
+
+/* Set by exec_command() for "timeout ... cmd", applied when the job is loaded */
+static int deadline_pending = FALSE, deadline_sig;
+static struct timespec deadline_after, deadline_grace;
+
+/* Exit status of the last pipeline, decides && and || */
+static int last_status = 0;
+
+/* Value of $? for the command being started, last_status is reset on the way */
+static int expand_status = 0;
+
+/* Set while repeat/watch runs a pipeline: do not go on with the list */
+static int run_once = FALSE;
+
+
+/* Function: shell_getcwd
+   return cached current directory, getcwd() only when "." changed
+*/
+const char *shell_getcwd()
+{
+	struct stat st;
+
+	if (-1 == stat(".", &st))
+	{
+		// directory removed under us, keep showing the last known path
+		return cwd_valid ? cwd_cache : NULL;
+	}
+	if (cwd_valid == TRUE && st.st_dev == cwd_dev && st.st_ino == cwd_ino)
+	{
+		return cwd_cache;
+	}
+
+	if (getcwd(cwd_cache, PATH_MAX) == NULL)
+	{
+		cwd_valid = FALSE;
+		return NULL;
+	}
+	cwd_dev = st.st_dev;
+	cwd_ino = st.st_ino;
+	cwd_valid = TRUE;
+
+	return cwd_cache;
+}
 
 
 /* Function: shell_pwd
@@ -11,29 +76,49 @@ extern int ttyd;
 */
 int shell_pwd()
 {
-	int size;
-	char *p = NULL;
+	const char *p = shell_getcwd();
 
-	for (size = INTERNAL_BUF; ; size += INTERNAL_BUF)
+	if (p == NULL)
 	{
-		char buf[size];
-		p = getcwd((char*)&buf, size);
-		if (p == NULL && errno == ERANGE)
-		{
-			continue;
-		}
-		else if (p == NULL)
-		{
-			perror("pwd");
-		}
-		printf("%s", p);
-		break;
+		perror("pwd");
+		return -1;
+	}
+	printf("%s", p);
+
+	return 0;
+}
+
+
+/* Function: shell_prompt
+   render the whole prompt into one buffer and emit it with a single write
+*/
+int shell_prompt()
+{
+	static char prompt[PATH_MAX + PROMPT_SEG * 4];
+	int len;
+
+	len = prompt_render(prompt, sizeof prompt, shell_getcwd(), ptable);
+
+	// keep ordering with anything still buffered by stdio
+	fflush(stdout);
+	if (-1 == write(STDOUT_FILENO, prompt, len))
+	{
+		return -1;
 	}
 
 	return 0;
 }
 
 
+/* Function: shell_prompt_render
+   render the prompt for the line editor
+*/
+int shell_prompt_render(char *buf, int size)
+{
+	return prompt_render(buf, size, shell_getcwd(), ptable);
+}
+
+
 /* Function: shell_cd
    change current working directory
 */
@@ -46,14 +131,130 @@ int shell_cd(const char *path)
 
 	if (chdir(path) == -1)
 	{
-		printf("-mysh: cd %s: ", path);
+		printf("-mysh: cd: %s: %s\n", path, strerror(errno));
 		fflush(stdout);
+		return -1;
+	}
+
+	// refresh the cache once here instead of on every prompt
+	cwd_valid = FALSE;
+	shell_getcwd();
+
+	return 0;
+}
+
+
+/* Function: shell_prefetch
+   prefetch [-s MB] [file ...]
+   Set the readahead window for "< file" redirects (0 disables) and/or start
+   reading files used by upcoming jobs into the page cache
+*/
+int shell_prefetch(char **argv)
+{
+	int i = 1;
+
+	if (argv[i] != NULL && strcmp(argv[i], "-s") == 0)
+	{
+		if (argv[i+1] == NULL || !isdigit(argv[i+1][0]))
+		{
+#ifdef WARNING
+	printf("-mysh: prefetch: usage: prefetch [-s MB] [file ...]\n");
+#endif
+			return -1;
+		}
+		redirect_prefetch = atoi(argv[i+1]);
+		i += 2;
 	}
+	else if (argv[i] == NULL)
+	{
+		if (redirect_prefetch > 0)
+		{
+			printf("prefetch: input redirects read ahead %d MB\n", redirect_prefetch);
+		}
+		else
+		{
+			printf("prefetch: input redirect prefetching is off\n");
+		}
+	}
+
+	for (; argv[i] != NULL; i++)
+	{
+		if (-1 == redirect_prefetch_file(argv[i]))
+		{
+#ifdef WARNING
+	printf("-mysh: prefetch: %s: %s\n", argv[i], strerror(errno));
+#endif
+		}
+	}
+
+	return 0;
+}
+
+
+/* Function: shell_dag
+   Builtin dag [-j N] file, the status is 1 if a task failed or was skipped
+*/
+int shell_dag(char **argv)
+{
+	int i = 1, jobs = DAG_JOBS;
+	DAG *dag;
+
+	if (argv[i] != NULL && strcmp(argv[i], "-j") == 0 && argv[i+1] != NULL)
+	{
+		jobs = atoi(argv[i+1]);
+		i += 2;
+	}
+	if (argv[i] == NULL || jobs < 1)
+	{
+#ifdef WARNING
+	printf("-mysh: dag: usage: dag [-j N] file\n");
+#endif
+		last_status = 2;
+		return -1;
+	}
+	dag = dag_load(argv[i]);
+	if (dag == NULL)
+	{
+		last_status = 2;
+		return -1;
+	}
+	last_status = (dag_run(dag, jobs) > 0) ? 1 : 0;
+	dag_free(dag);
 
 	return 0;
 }
 
 
+/* Function: shell_export
+   Builtin export [NAME[=value] ...], without argument list the exported
+   variables
+*/
+int shell_export(char **argv)
+{
+	int i, ret = 0;
+
+	if (argv[1] == NULL)
+	{
+		vars_print(FALSE);
+		return 0;
+	}
+	for (i = 1; argv[i] != NULL; i++)
+	{
+		if (vars_assignment(argv[i]) > 0)
+		{
+			vars_assign(&argv[i], 1, TRUE);
+		}
+		else if (-1 == vars_export(argv[i]))
+		{
+			ret = -1;
+		}
+	}
+	last_status = (ret == -1) ? 1 : 0;
+
+	return ret;
+}
+
+
 /* Function
 */
 int shell_atoi(const char *s)
@@ -69,140 +270,937 @@ int shell_atoi(const char *s)
 }
 
 
-/* Function: shell_run
-   Handles all shell built-ins
+/* Function: shell_jobs_pgid
+   Process group of job spec "%n", 0 if there is no such job
+*/
+int shell_jobs_pgid(const char *spec)
+{
+	PROCGROUP *pg;
+	int pgid = 0;
+
+	if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+	{
+		perror("sigprocmask");
+	}
+	pg = pidtable_getindex(ptable, shell_atoi(spec));
+	pgid = (pg != NULL) ? pg->group_pid : 0;
+	if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+	{
+		perror("sigprocmask");
+	}
+	if (pgid == 0)
+	{
+#ifdef WARNING
+	printf("-mysh: jobs: %s: no such job\n", spec);
+#endif
+	}
+
+	return pgid;
+}
+
+
+/* Function: shell_jobs
+   Builtin jobs [-l | -o [%n] | --follow %n ... | --stats | --top [n]]
+*/
+int shell_jobs(char **argv)
+{
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	const char *arg = argv[1];
+	char drain[256];
+	int pgids[MYSH_FOLLOW];
+	int i, n, top;
+
+	if (arg == NULL || strcmp(arg, "-l") == 0)
+	{
+		pidtable_print(ptable, (arg != NULL) ? TRUE : FALSE);
+		return 0;
+	}
+
+	// captured output, without a job spec the last captured job (it may be done)
+	if (strcmp(arg, "-o") == 0)
+	{
+		n = (argv[2] != NULL) ? shell_jobs_pgid(argv[2]) : capture_last();
+		if (n != 0 && capture_dump(n, STDOUT_FILENO) == -1)
+		{
+#ifdef WARNING
+	printf("-mysh: jobs: output of %s was not captured\n", (argv[2] != NULL) ? argv[2] : "the job");
+#endif
+		}
+		return 0;
+	}
+	if (strcmp(arg, "--follow") == 0)
+	{
+		for (n = 0; argv[n+2] != NULL && n < MYSH_FOLLOW; n++)
+		{
+			pgids[n] = shell_jobs_pgid(argv[n+2]);
+		}
+		if (n == 0 || capture_follow(pgids, n) == -1)
+		{
+#ifdef WARNING
+	printf("-mysh: jobs: --follow: no captured job given\n");
+#endif
+		}
+		return 0;
+	}
+
+	top = (strcmp(arg, "--top") == 0);
+	if (top == FALSE && strcmp(arg, "--stats") != 0)
+	{
+#ifdef WARNING
+	printf("-mysh: jobs: usage: jobs [-l | -o [%%n] | --follow %%n ... | --stats | --top [n]]\n");
+#endif
+		return -1;
+	}
+	if (sampler == NULL && (sampler = sampler_init()) == NULL)
+	{
+		return -1;
+	}
+
+	// --top refreshes n times, or until Enter is pressed or no job is left
+	n = (top == FALSE) ? 1 : ((argv[2] != NULL) ? atoi(argv[2]) : -1);
+	for (i = 0; i != n; i++)
+	{
+		if (i > 0)
+		{
+			if (isatty(STDIN_FILENO) && poll(&pfd, 1, SAMPLER_INTERVAL) > 0)
+			{
+				if (read(STDIN_FILENO, drain, sizeof drain) < 0)
+				{
+					perror("read");
+				}
+				break;
+			}
+			else if (!isatty(STDIN_FILENO))
+			{
+				poll(NULL, 0, SAMPLER_INTERVAL);
+			}
+		}
+		sampler_sample(sampler);
+		if (top == TRUE)
+		{
+			printf("\033[H\033[2J");
+		}
+		if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+		{
+			perror("sigprocmask");
+		}
+		sampler_print(sampler, ptable);
+		n = (top == TRUE && pidtable_getsize(ptable) == 0) ? i + 1 : n;
+		if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+		{
+			perror("sigprocmask");
+		}
+		fflush(stdout);
+	}
+
+	return 0;
+}
+
+
+/* Names handled by shell_run(), used for completion */
+static const char *shell_builtins[] = {
+	".", ":", "[", "alias", "bg", "capture", "cd", "dag", "exit", "export", "false", "fg", "histstat", "history", "jobs", "kill", "memo", "parsecache", "prefetch", "prompt", "pwd", "repeat", "set", "source", "test", "time", "timeout", "true", "unalias", "unset", "watch", NULL
+};
+
+
+/* Function: shell_run
+   Handles all shell built-ins
+*/
+int shell_run(char **argv)
+{
+	const char *cmd = argv[0], *arg = (cmd != NULL) ? argv[1] : NULL;
+	int table_id = shell_atoi(arg), i;
+	PROCGROUP *pgrp = NULL;
+
+	if (cmd == NULL)
+	{
+		// no command
+		return MYSH_NEXT;
+	}
+
+	else if (strcmp(cmd, "true") == 0 || strcmp(cmd, ":") == 0)
+	{
+		last_status = 0;
+	}
+
+	else if (strcmp(cmd, "false") == 0)
+	{
+		last_status = 1;
+	}
+
+	else if (strcmp(cmd, "test") == 0 || strcmp(cmd, "[") == 0)
+	{
+		last_status = script_test(argv);
+	}
+
+	else if (strncmp(cmd, "jobs", 4) == 0)
+	{
+		shell_jobs(argv);
+	}
+
+	else if (strncmp(cmd, "exit", 4) == 0)
+	{
+		// exit N is the status of mysh FILE
+		if (argv[1] != NULL)
+		{
+			last_status = atoi(argv[1]) & 0xff;
+		}
+		return MYSH_EXIT;
+	}
+
+	else if (strncmp(cmd, "kill", 4) == 0)
+	{
+		pgrp = (PROCGROUP*) pidtable_getindex(ptable, table_id);
+		if (pgrp == NULL || table_id == -1)
+		{
+#ifdef WARNING
+	printf("-mysh: kill: %s: no such job\n", arg);
+#endif
+		}
+		else
+		{
+			if (-1 == kill(pgrp->group_pid, SIGKILL))
+			{
+				perror("kill");
+			}
+		}
+	}
+
+	else if (strncmp(cmd, "pwd", 3) == 0)
+	{
+		shell_pwd();
+		printf("\n");
+	}
+
+	else if (strncmp(cmd, "cd", 2) == 0)
+	{
+		shell_cd(arg);
+	}
+
+	else if (strcmp(cmd, "export") == 0)
+	{
+		shell_export(argv);
+	}
+
+	else if (strcmp(cmd, "unset") == 0)
+	{
+		// unset -f removes functions
+		int function = (arg != NULL && strcmp(arg, "-f") == 0);
+		for (i = 1 + function; argv[i] != NULL; i++)
+		{
+			if (function)
+			{
+				alias_unset_function(argv[i]);
+			}
+			else
+			{
+				vars_unset(argv[i]);
+			}
+		}
+	}
+
+	else if (strcmp(cmd, "set") == 0)
+	{
+		vars_print(TRUE);
+		alias_print_functions();
+	}
+
+	else if (strcmp(cmd, "parsecache") == 0)
+	{
+		if (arg != NULL && strcmp(arg, "-c") == 0)
+		{
+			parsecache_clear(parsecache);
+		}
+		else if (arg != NULL || parsecache == NULL)
+		{
+#ifdef WARNING
+	printf("-mysh: parsecache: usage: parsecache [-c]\n");
+#endif
+			last_status = 2;
+		}
+		else
+		{
+			parsecache_print(parsecache);
+		}
+	}
+
+	else if (strcmp(cmd, "source") == 0 || strcmp(cmd, ".") == 0)
+	{
+		return shell_source(argv);
+	}
+
+	else if (strcmp(cmd, "alias") == 0)
+	{
+		last_status = alias_command(argv);
+	}
+
+	else if (strcmp(cmd, "unalias") == 0)
+	{
+		if (arg != NULL && strcmp(arg, "-a") == 0)
+		{
+			alias_unset(NULL);
+		}
+		for (i = 1; arg != NULL && argv[i] != NULL && strcmp(arg, "-a") != 0; i++)
+		{
+			if (alias_get(argv[i]) == NULL)
+			{
+#ifdef WARNING
+	printf("-mysh: unalias: %s: not found\n", argv[i]);
+#endif
+				last_status = 1;
+			}
+			alias_unset(argv[i]);
+		}
+	}
+
+	else if (strcmp(cmd, "dag") == 0)
+	{
+		shell_dag(argv);
+	}
+
+	else if (strcmp(cmd, "capture") == 0)
+	{
+		capture_enable(arg);
+	}
+
+	else if (strcmp(cmd, "prompt") == 0)
+	{
+		prompt_config(argv);
+	}
+
+	else if (strcmp(cmd, "prefetch") == 0)
+	{
+		shell_prefetch(argv);
+	}
+
+	else if (strcmp(cmd, "histstat") == 0)
+	{
+		histstat_print(jobstats, &argv[1]);
+	}
+
+	else if (strcmp(cmd, "history") == 0)
+	{
+		history_print(history, (arg != NULL) ? atoi(arg) : 0);
+	}
+
+	else if (strncmp(cmd, "bg", 2) == 0)
+	{
+		pgrp = (PROCGROUP*) pidtable_getindex(ptable, table_id);
+		if (pgrp == NULL || table_id == -1)
+		{
+#ifdef WARNING
+	printf("-mysh: bg: %s: no such job\n", arg);
+#endif
+		}
+		else
+		{
+			if (-1 == kill(pgrp->group_pid, SIGCONT))
+			{
+				perror("kill");
+			}
+		}
+	}
+
+	else if (strncmp(cmd, "fg", 2) == 0)
+	{
+		if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+		{
+			perror("sigprocmask");
+		}
+		procgroup_free(foreground);
+		foreground = (PROCGROUP*) pidtable_getindex(ptable, table_id);
+		if (foreground == NULL || table_id == -1)
+		{
+#ifdef WARNING
+	printf("-mysh: fg: %s: no such job\n", arg);
+#endif
+			foreground = procgroup_init();
+			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+		}
+		else
+		{
+			if (-1 == kill(foreground->group_pid, SIGTSTP))
+			{
+				perror("kill");
+			}
+			printf("%s\n", foreground->cmdline);
+			pidtable_delpid(ptable, foreground->group_pid, FALSE, FALSE);
+			pid_t gid = getpgid(foreground->group_pid);
+			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			if (gid == -1)
+			{
+				perror("getpgid");
+			}
+			if (-1 == tcsetpgrp(ttyd, gid))
+			{
+				perror("tcsetpgrp");
+			}
+			capture_foreground(foreground->group_pid, TRUE);
+			if (-1 == kill(foreground->group_pid, SIGCONT))
+			{
+				perror("kill");
+			}
+			int wait_id = -1, status = 0;
+			struct rusage ru;
+			while(wait_id == -1)
+			{
+				wait_id = wait4(-gid, &status, WUNTRACED, &ru);
+			}
+			capture_foreground(gid, FALSE);
+			if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			procgroup_reap(foreground, status, &ru);
+			if (!WIFSTOPPED(status))
+			{
+				timeout_reaped(foreground);
+				histstat_job(jobstats, foreground);
+			}
+			last_status = WIFSTOPPED(status) ? 128 + WSTOPSIG(status) : foreground->exit_status;
+			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			if (-1 == tcsetpgrp(ttyd, getpid()))
+			{
+				perror("tcsetpgrp");
+			}
+		}
+	}
+
+	else
+	{
+		// Not a built-in command
+		return MYSH_EXTC;
+	}
+
+	return MYSH_NEXT;
+}
+
+
+/* Function: shell_time
+   Print the usage of a job run with the time builtin to stderr
+   pg is NULL for a builtin, only the wall clock time is known then
+*/
+void shell_time(PROCGROUP *pg, long wall)
+{
+	if (time_pending == FALSE)
+	{
+		return;
+	}
+	time_pending = FALSE;
+	if (pg == NULL)
+	{
+		fprintf(stderr, "\nreal\t%ld.%06lds\nuser\t0.000000s\nsys\t0.000000s\n",
+			wall / 1000000, wall % 1000000);
+		return;
+	}
+	// stopped, the job was handed to the pidtable
+	if (pg->group_pid == 0)
+	{
+		return;
+	}
+
+	wall = procgroup_wall(pg);
+	fprintf(stderr, "\nreal\t%ld.%06lds\nuser\t%ld.%06lds\nsys\t%ld.%06lds\n"
+		"maxrss\t%ldK\ncsw\t%ld voluntary, %ld involuntary\n",
+		wall / 1000000, wall % 1000000,
+		(long) pg->utime.tv_sec, (long) pg->utime.tv_usec,
+		(long) pg->stime.tv_sec, (long) pg->stime.tv_usec,
+		pg->maxrss, pg->nvcsw, pg->nivcsw);
+}
+
+
+/* Function: shell_skip
+   Skip n words of a command line, NULL stays NULL
+*/
+char *shell_skip(char *line, int n)
+{
+	if (line == NULL)
+	{
+		return NULL;
+	}
+	while (n-- > 0)
+	{
+		while (isspace(*line))
+		{
+			line++;
+		}
+		while (*line != '\0' && !isspace(*line))
+		{
+			line++;
+		}
+	}
+	while (isspace(*line))
+	{
+		line++;
+	}
+
+	return line;
+}
+
+
+/* Function: shell_deadline
+   Give a job just loaded the deadline requested by the timeout builtin
+   Precondition: signals are blocked
+*/
+void shell_deadline(PROCGROUP *pg)
+{
+	if (deadline_pending == FALSE)
+	{
+		return;
+	}
+	deadline_pending = FALSE;
+	clock_gettime(CLOCK_MONOTONIC, &pg->deadline);
+	pg->deadline.tv_sec += deadline_after.tv_sec;
+	pg->deadline.tv_nsec += deadline_after.tv_nsec;
+	if (pg->deadline.tv_nsec >= 1000000000L)
+	{
+		pg->deadline.tv_sec++;
+		pg->deadline.tv_nsec -= 1000000000L;
+	}
+	if (-1 == timeout_add(pg->group_pid, &pg->deadline, deadline_sig, &deadline_grace))
+	{
+		memset(&pg->deadline, 0, sizeof pg->deadline);
+	}
+}
+
+
+/* Function: shell_builtin (internal)
+   Returns TRUE if name is in shell_builtins
+*/
+static int shell_builtin(const char *name)
+{
+	int i;
+
+	for (i = 0; name != NULL && shell_builtins[i] != NULL; i++)
+	{
+		if (strcmp(shell_builtins[i], name) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/* Function: shell_resolve (internal)
+   Look up the executable of each pipeline of cmd, not for builtins,
+   functions and assignments, which are not exec'd
+*/
+static void shell_resolve(COMMAND *cmd)
+{
+	const char *word;
+
+	for (; cmd != NULL; cmd = cmd->next)
+	{
+		word = cmd->argv[0];
+		if (word != NULL && vars_assignment(word) == 0 && shell_builtin(word) == FALSE && alias_function(word) == NULL)
+		{
+			command_resolve(cmd);
+		}
+		while (cmd->pipe == TRUE && cmd->next != NULL)
+		{
+			cmd = cmd->next;
+		}
+	}
+}
+
+
+/* Function: shell_exec
+   In a child: expand variables and patterns, run the function or exec
+   the executable resolved for cmp if there is one
+*/
+int shell_exec(const COMMAND *cmp)
+{
+	WILDCARD wc;
+	char **argv = vars_expand(cmp->argv, expand_status), **words;
+	int n = 0;
+
+	// VAR=x cmd, only this process gets VAR
+	while (argv[n] != NULL && vars_assignment(argv[n]) > 0)
+	{
+		n++;
+	}
+	vars_assign(argv, n, TRUE);
+	if (argv[n] == NULL)
+	{
+		_exit(0);
+	}
+	words = wildcard_expand(&argv[n], &wc);
+	if (alias_function(words[0]) != NULL)
+	{
+		alias_exec(alias_function(words[0]), words);
+	}
+	if (cmp->path != NULL && n == 0)
+	{
+		execv(cmp->path, words);
+	}
+
+	return execvp(words[0], words);
+}
+
+
+/* Function: shell_exec_failed (internal)
+   In a child whose exec failed: report it, exit 127 if the command was
+   not found, 126 otherwise
+*/
+static void shell_exec_failed(const COMMAND *cmp)
+{
+	int err = errno;
+
+#ifdef WARNING
+	switch(err)
+	{
+		case ENOENT:
+			printf("-mysh: %s: command not found\n", cmp->argv[0]);
+			break;
+		default:
+			perror("-mysh: ");
+	}
+#endif
+	fflush(stdout);
+	_exit((err == ENOENT) ? 127 : 126);
+}
+
+
+/* Function: shell_output (internal)
+   Read the whole memfd fd into a new buffer, *len receives its size
+*/
+static char *shell_output(int fd, long *len)
+{
+	struct stat st;
+	char *buf;
+	long n, done = 0;
+
+	*len = 0;
+	if (-1 == fstat(fd, &st) || (buf = malloc(st.st_size + 1)) == NULL)
+	{
+		return NULL;
+	}
+	while (done < st.st_size && (n = pread(fd, buf + done, st.st_size - done, done)) > 0)
+	{
+		done += n;
+	}
+	*len = done;
+
+	return buf;
+}
+
+
+/* Function: shell_repeat
+   Run the pipeline at cmp as many times as opts ask, watch sends its
+   output to a memfd between runs and shows it with the changes marked
+*/
+int shell_repeat(COMMAND *cmp, const REPEAT_OPTS *opts)
+{
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	struct timespec start, end;
+	REPEAT_STATS *st;
+	char summary[256], drain[256], *out, *prev = NULL;
+	long i, usec, wait, outlen, prevlen = 0;
+	int memfd = -1, saved = -1, once = run_once, resolved;
+
+	st = repeat_stats_init(opts->count);
+	if (st == NULL)
+	{
+		perror("malloc");
+		return -1;
+	}
+	if (opts->watch)
+	{
+		memfd = memfd_create("mysh-watch", MFD_CLOEXEC);
+		saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+		if (memfd == -1 || saved == -1)
+		{
+			perror("watch");
+			close(memfd);
+			close(saved);
+			repeat_stats_free(st);
+			return -1;
+		}
+	}
+	// cmp is the caller's copy shifted past repeat: the path looked up
+	// here is its own, released after the runs
+	resolved = (cmp->path == NULL);
+	command_resolve(cmp);
+
+	run_once = TRUE;
+	for (i = 0; i != opts->count; i++)
+	{
+		if (opts->watch)
+		{
+			fflush(stdout);
+			// the runs share the file offset of memfd, start over
+			if (-1 == ftruncate(memfd, 0) || -1 == lseek(memfd, 0, SEEK_SET) || -1 == dup2(memfd, STDOUT_FILENO))
+			{
+				perror("watch");
+				break;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		exec_command(cmp);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		usec = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+		repeat_stats_add(st, usec, last_status);
+		if (opts->verbose)
+		{
+			fprintf(stderr, "repeat: run %ld: %ld.%03ldms (exit %d)\n", i + 1, usec / 1000, usec % 1000, last_status);
+		}
+
+		if (opts->watch)
+		{
+			fflush(stdout);
+			dup2(saved, STDOUT_FILENO);
+			out = shell_output(memfd, &outlen);
+			if (isatty(STDOUT_FILENO))
+			{
+				printf("\033[H\033[2J");
+			}
+			printf("Every %ld.%01lds: %s\t[run %ld, %ld.%03ldms, exit %d]\n\n", opts->interval / 1000,
+				opts->interval % 1000 / 100, cmp->cmdline, i + 1, usec / 1000, usec % 1000, last_status);
+			fflush(stdout);
+			if (out != NULL)
+			{
+				repeat_diff(opts->diff ? prev : NULL, prevlen, out, outlen, STDOUT_FILENO);
+				free(prev);
+				prev = out;
+				prevlen = outlen;
+			}
+		}
+
+		// Ctrl-C on a run stops the loop
+		if (last_status == 128 + SIGINT)
+		{
+			break;
+		}
+		if (opts->watch && i + 1 != opts->count)
+		{
+			wait = opts->interval - usec / 1000;
+			wait = (wait > 0) ? wait : 0;
+			if (isatty(STDIN_FILENO) && poll(&pfd, 1, wait) > 0)
+			{
+				if (read(STDIN_FILENO, drain, sizeof drain) < 0)
+				{
+					perror("read");
+				}
+				break;
+			}
+			else if (!isatty(STDIN_FILENO))
+			{
+				poll(NULL, 0, wait);
+			}
+		}
+	}
+	run_once = once;
+
+	if (opts->watch == FALSE)
+	{
+		fprintf(stderr, "repeat: %s\n", repeat_stats_summary(st, summary, sizeof summary));
+	}
+	repeat_stats_free(st);
+	free(prev);
+	if (resolved)
+	{
+		free(cmp->path);
+		cmp->path = NULL;
+	}
+	if (opts->watch)
+	{
+		close(memfd);
+		close(saved);
+	}
+
+	return 0;
+}
+
+
+/* Function: shell_memo
+   The output of a miss reaches stdout through the pipe of the tee, a
+   job left in the background is run without caching
+*/
+int shell_memo(COMMAND *cmp, const MEMO_OPTS *opts)
+{
+	const COMMAND *last = cmp;
+	char key[MEMO_KEY + 1];
+	MEMO_TEE *tee = NULL;
+	int status, saved = -1, once = run_once;
+
+	while (last->pipe == TRUE && last->next != NULL)
+	{
+		last = last->next;
+	}
+	memo_key(opts, cmp->cmdline, cmp->infile, key);
+	fflush(stdout);
+	status = memo_replay(key, STDOUT_FILENO);
+	if (status != -1)
+	{
+		last_status = status;
+		return 0;
+	}
+
+	if (last->background == FALSE)
+	{
+		tee = memo_record(key, STDOUT_FILENO);
+		saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	}
+	if (tee != NULL && (saved == -1 || -1 == dup2(tee->fd, STDOUT_FILENO)))
+	{
+		perror("memo");
+		memo_finish(tee, 128);
+		tee = NULL;
+	}
+
+	run_once = TRUE;
+	exec_command(cmp);
+	run_once = once;
+
+	if (tee != NULL)
+	{
+		fflush(stdout);
+		if (-1 == dup2(saved, STDOUT_FILENO))
+		{
+			perror("dup2");
+		}
+		memo_finish(tee, last_status);
+	}
+	if (saved != -1)
+	{
+		close(saved);
+	}
+
+	return 0;
+}
+
+
+/* Function: shell_script_list
+   Script hook: a command list goes through exec_command()
+*/
+int shell_script_list(COMMAND *cmd, int *status)
+{
+	int ret = exec_command(cmd);
+
+	*status = last_status;
+	return (ret == MYSH_EXIT) ? -1 : 0;
+}
+
+
+/* Function: shell_script_builtin
+   Script hook: functions come first, time, timeout, repeat, watch and
+   memo need exec_command()
+*/
+int shell_script_builtin(const char *name)
+{
+	static const char *prefixes[] = {"time", "timeout", "repeat", "watch", "memo", NULL};
+	int i;
+
+	for (i = 0; prefixes[i] != NULL; i++)
+	{
+		if (strcmp(prefixes[i], name) == 0)
+		{
+			return FALSE;
+		}
+	}
+
+	return (shell_builtin(name) == TRUE && alias_function(name) == NULL);
+}
+
+
+/* Function: shell_script_run
+   Script hook: builtins succeed unless they say otherwise
+*/
+int shell_script_run(char **argv, int *status)
+{
+	int ret;
+
+	last_status = 0;
+	ret = shell_run(argv);
+	*status = last_status;
+
+	return (ret == MYSH_EXIT) ? -1 : 0;
+}
+
+
+/* Hooks of the scripts run by the shell */
+static const SCRIPT_HOOKS shell_hooks = {shell_script_list, shell_script_builtin, shell_script_run, &ptable};
+
+
+/* Function: shell_script
+   Compile text, a syntax error is status 2
 */
-int shell_run(const char *cmd, const char *arg)
+int shell_script(const char *text)
 {
-	int table_id = shell_atoi(arg);
-	PROCGROUP *pgrp = NULL;
+	SCRIPT *script;
+	int ret = script_compile(text, &script);
 
-	if (cmd == NULL)
+	if (ret != 0)
 	{
-		// no command
+#ifdef WARNING
+	if (ret == SCRIPT_MORE)
+	{
+		printf("-mysh: syntax error: unexpected end of file\n");
+	}
+#endif
+		last_status = 2;
 		return MYSH_NEXT;
 	}
-
-	else if (strncmp(cmd, "jobs", 4) == 0)
+	ret = MYSH_NEXT;
+	if (script_run(script, &shell_hooks, &last_status) == -1)
 	{
-		pidtable_print(ptable);
+		ret = MYSH_EXIT;
 	}
+	script_free(script);
 
-	else if (strncmp(cmd, "exit", 4) == 0)
-	{
-		return MYSH_EXIT;
-	}
+	return ret;
+}
 
-	else if (strncmp(cmd, "kill", 4) == 0)
-	{
-		pgrp = (PROCGROUP*) pidtable_getindex(ptable, table_id);
-		if (pgrp == NULL || table_id == -1)
-		{
-#ifdef WARNING
-	printf("-mysh: kill: %s: no such job\n", arg);
-#endif
-		}
-		else
-		{
-			if (-1 == kill(pgrp->group_pid, SIGKILL))
-			{
-				perror("kill");
-			}
-		}
-	}
 
-	else if (strncmp(cmd, "pwd", 3) == 0)
-	{
-		shell_pwd();
-		printf("\n");
-	}
+/* Function: shell_function
+   The body runs as a whole list even under repeat or memo, time reports
+   the call as one builtin
+*/
+int shell_function(ALIAS *fn, char **argv)
+{
+	char **saved;
+	int once = run_once, timing = time_pending, ret = MYSH_NEXT;
 
-	else if (strncmp(cmd, "cd", 2) == 0)
+	if (-1 == alias_enter(fn))
 	{
-		shell_cd(arg);
+		last_status = 1;
+		return MYSH_NEXT;
 	}
-
-	else if (strncmp(cmd, "bg", 2) == 0)
+	saved = vars_positional(&argv[1]);
+	if (fn->script != NULL)
 	{
-		pgrp = (PROCGROUP*) pidtable_getindex(ptable, table_id);
-		if (pgrp == NULL || table_id == -1)
-		{
-#ifdef WARNING
-	printf("-mysh: bg: %s: no such job\n", arg);
-#endif
-		}
-		else
+		run_once = FALSE;
+		if (script_run(fn->script, &shell_hooks, &last_status) == -1)
 		{
-			if (-1 == kill(pgrp->group_pid, SIGCONT))
-			{
-				perror("kill");
-			}
+			ret = MYSH_EXIT;
 		}
+		run_once = once;
 	}
-
-	else if (strncmp(cmd, "fg", 2) == 0)
+	else if (fn->body != NULL)
 	{
-		if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
-		{
-			perror("sigprocmask");
-		}
-		procgroup_free(foreground);
-		foreground = (PROCGROUP*) pidtable_getindex(ptable, table_id);
-		if (foreground == NULL || table_id == -1)
-		{
-#ifdef WARNING
-	printf("-mysh: fg: %s: no such job\n", arg);
-#endif
-			foreground = procgroup_init();
-			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
-			{
-				perror("sigprocmask");
-			}
-		}
-		else
+		run_once = FALSE;
+		if (exec_command(fn->body) == MYSH_EXIT)
 		{
-			if (-1 == kill(foreground->group_pid, SIGTSTP))
-			{
-				perror("kill");
-			}
-			printf("%s\n", foreground->cmdline);
-			pidtable_delpid(ptable, foreground->group_pid, FALSE, FALSE);
-			pid_t gid = getpgid(foreground->group_pid);
-			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
-			{
-				perror("sigprocmask");
-			}
-			if (gid == -1)
-			{
-				perror("getpgid");
-			}
-			if (-1 == tcsetpgrp(ttyd, gid))
-			{
-				perror("tcsetpgrp");
-			}
-			if (-1 == kill(foreground->group_pid, SIGCONT))
-			{
-				perror("kill");
-			}
-			int wait_id = -1;
-			while(wait_id == -1)
-			{
-				wait_id = waitpid(-gid, NULL, WUNTRACED);
-			}
-			if (-1 == tcsetpgrp(ttyd, getpid()))
-			{
-				perror("tcsetpgrp");
-			}
+			ret = MYSH_EXIT;
 		}
+		run_once = once;
 	}
+	vars_positional(saved);
+	alias_leave(fn);
+	time_pending = timing;
 
-	else
-	{
-		// Not a built-in command
-		return MYSH_EXTC;
-	}
-
-	return MYSH_NEXT;
+	return ret;
 }
 
 
@@ -214,9 +1212,14 @@ int pipe_command(const COMMAND *cmp)
 	print_debug("DEBUG: Begin piping");
 
 	int pipefd[2] = {STDIN_FILENO,STDOUT_FILENO}, pipefd_old[2] = {STDIN_FILENO,STDOUT_FILENO};
-	int pidn, fd, ret = 0, location = 0, wait_id = -1;
+	int pidn, fd, ret = 0, location = 0, wait_id = -1, infd;
 	int gpid = 0;
 	int count = 1;
+	int capfd[2] = {-1, -1}, table_id = 0;
+	COMMAND *next;
+
+	// a background pipeline succeeds once started
+	last_status = 0;
 
 pipe_loop:
 	if (cmp->next == NULL)
@@ -232,16 +1235,43 @@ pipe_loop:
 		perror("pipe");
 #endif
 		ret = -1;
-		goto pipe_terminate;
+		goto pipe_stop;
+	}
+
+	if (-1 == procsub_open(cmp->procsub))
+	{
+		ret = -1;
+		goto pipe_abort;
+	}
+	infd = redirect_input(cmp);
+	if (infd == REDIRECT_ERR)
+	{
+		procsub_close(cmp->procsub);
+		if (location == 0)
+		{
+			// nothing started yet, skip the whole pipeline
+			ret = -1;
+			goto pipe_abort;
+		}
+		infd = -1;
 	}
 
 	count ++;
+	if (location == 0 && cmp->background == TRUE)
+	{
+		capture_pipe(capfd);
+	}
 	pidn = fork();
 	if (pidn == -1)
 	{
 		perror("fork");
+		procsub_close(cmp->procsub);
+		if (infd != -1)
+		{
+			close(infd);
+		}
 		ret = -1;
-		goto pipe_terminate;
+		goto pipe_abort;
 	}
 
 	// Child
@@ -266,9 +1296,17 @@ pipe_loop:
 #ifdef DEBUG
 	printf("CHILD: New child %d in group %d\n", getpid(), gpid);
 #endif
+		procsub_child(cmp->procsub);
 
 		// Input redirect
-		if (cmp->infile != NULL)
+		if (infd != -1)
+		{
+			if (-1 == dup2(infd, STDIN_FILENO))
+			{
+				perror("dup2");
+			}
+		}
+		else if (cmp->infile != NULL)
 		{
 			print_debug("DEBUG: Setting input file");
 			fd = open(cmp->infile, cmp->fdmode);
@@ -315,9 +1353,10 @@ pipe_loop:
 			perror("close");
 		}
 
-		if (execvp(cmp->argv[0], cmp->argv) == -1)
+		capture_child(capfd, FALSE);
+		if (shell_exec(cmp) == -1)
 		{
-			_exit(0);
+			shell_exec_failed(cmp);
 		}
 	}
 	// Parent, close old pipes
@@ -341,6 +1380,12 @@ pipe_loop:
 #ifdef DEBUG
 	printf("PARENT: New child %d in group %d\n", pidn, gpid);
 #endif
+		count += procsub_spawn(cmp->procsub, gpid);
+		procsub_close(cmp->procsub);
+		if (infd != -1)
+		{
+			close(infd);
+		}
 
 		if (location == 0)
 		{
@@ -349,9 +1394,10 @@ pipe_loop:
 				perror("sigprocmask");
 			}
 			procgroup_load(foreground, gpid, RUNNING, cmp->cmdline);
+			shell_deadline(foreground);
 			if (cmp->background == TRUE)
 			{
-				int table_id = pidtable_add(ptable, foreground);
+				table_id = pidtable_add(ptable, foreground);
 				foreground = procgroup_init();
 				printf("[%d] %d\n", table_id, gpid);
 			}
@@ -381,7 +1427,37 @@ pipe_loop:
 
 pipe_last:
 
-	pidn = fork();
+	// a stage that cannot open its process substitutions is left out, the
+	// stages before see the end of their pipe and are waited for as usual
+	pidn = -1;
+	infd = -1;
+	if (-1 == procsub_open(cmp->procsub))
+	{
+		ret = -1;
+		count--;
+	}
+	else
+	{
+		infd = redirect_input(cmp);
+		if (infd == REDIRECT_ERR)
+		{
+			infd = -1;
+		}
+		pidn = fork();
+		if (pidn == -1)
+		{
+			perror("fork");
+			procsub_close(cmp->procsub);
+			if (infd != -1)
+			{
+				close(infd);
+			}
+			pipefd_old[0] = pipefd[0];
+			pipefd_old[1] = pipefd[1];
+			ret = -1;
+			goto pipe_stop;
+		}
+	}
 	if (pidn == 0)
 	{
 		if (-1 == setpgid(getpid(), gpid))
@@ -391,6 +1467,9 @@ pipe_last:
 #ifdef DEBUG
 	printf("CHILD: Last New child %d in group %d\n", getpid(), gpid);
 #endif
+		procsub_child(cmp->procsub);
+
+		capture_child(capfd, TRUE);
 
 		// Output redirect
 		if (cmp->outfile != NULL)
@@ -416,7 +1495,7 @@ pipe_last:
 			}
 		}
 
-		if (-1 == dup2(pipefd[0], 0))
+		if (-1 == dup2(infd != -1 ? infd : pipefd[0], 0))
 		{
 			perror("dup2");
 		}
@@ -429,9 +1508,9 @@ pipe_last:
 			perror("close");
 		}
 
-		if (execvp(cmp->argv[0], cmp->argv) == -1)
+		if (shell_exec(cmp) == -1)
 		{
-			_exit(0);
+			shell_exec_failed(cmp);
 		}
 	}
 	// Parent
@@ -444,6 +1523,15 @@ pipe_last:
 #ifdef DEBUG
 	printf("PARENT: Last New child %d in group %d\n", pidn, gpid);
 #endif
+		if (pidn != -1)
+		{
+			count += procsub_spawn(cmp->procsub, gpid);
+		}
+		procsub_close(cmp->procsub);
+		if (infd != -1)
+		{
+			close(infd);
+		}
 
 		if (-1 == close(pipefd[0]))
 		{
@@ -454,15 +1542,43 @@ pipe_last:
 			perror("close");
 		}
 
+		capture_attach(capfd, gpid, table_id);
 		foreground->count = count;
 		if (cmp->background == FALSE)
 		{
+			int status = 0, last = -1;
+			struct rusage ru;
 			wait_id = -1;
 			while(wait_id == -1 || foreground->count > 0)
 			{
-				wait_id = waitpid(-gpid, NULL, WUNTRACED|WCONTINUED);
+				wait_id = wait4(-gpid, &status, WUNTRACED|WCONTINUED, &ru);
+				if (wait_id > 0)
+				{
+					procgroup_reap(foreground, status, &ru);
+					// the status of a pipeline is the one of its last command
+					if (wait_id == pidn && !WIFSTOPPED(status) && !WIFCONTINUED(status))
+					{
+						last = foreground->exit_status;
+					}
+				}
 				foreground->count--;
 			}
+			if (last != -1)
+			{
+				foreground->exit_status = last;
+			}
+			if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			timeout_reaped(foreground);
+			histstat_job(jobstats, foreground);
+			last_status = (foreground->group_pid == 0) ? 128 + SIGTSTP : foreground->exit_status;
+			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			shell_time(foreground, 0);
 		}
 		//printf("set %d to foreground\n", getpid());
 		if (-1 == tcsetpgrp(ttyd, getpid()))
@@ -470,32 +1586,226 @@ pipe_last:
 			perror("tcsetpgrp");
 		}
 	}
-	//printf("End pipe %d\n", count);
-	print_debug("DEBUG: End piping");
-
-pipe_terminate:
+	//printf("End pipe %d\n", count);
+	print_debug("DEBUG: End piping");
+	goto pipe_terminate;
+
+pipe_abort:
+	// the stage could not start: its pipe and the one from the stage
+	// before are not used
+	close(pipefd[0]);
+	close(pipefd[1]);
+
+pipe_stop:
+	// the rest of the pipeline is not run, the stages already started
+	// cannot complete it: kill them, reap them here unless they run in the
+	// background as a job
+	while (cmp->pipe == TRUE && cmp->next != NULL)
+	{
+		cmp = cmp->next;
+	}
+	if (location != 0)
+	{
+		int status;
+		struct rusage ru;
+
+		close(pipefd_old[0]);
+		close(pipefd_old[1]);
+		if (-1 == kill(-gpid, SIGKILL))
+		{
+			perror("kill");
+		}
+		if (cmp->background == FALSE)
+		{
+			for (;;)
+			{
+				wait_id = wait4(-gpid, &status, 0, &ru);
+				if (wait_id > 0)
+				{
+					procgroup_reap(foreground, status, &ru);
+				}
+				else if (errno != EINTR)
+				{
+					break;
+				}
+			}
+			if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			timeout_reaped(foreground);
+			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			if (-1 == tcsetpgrp(ttyd, getpid()))
+			{
+				perror("tcsetpgrp");
+			}
+		}
+	}
+
+pipe_terminate:
+	capture_close(capfd);
+	if (ret == -1)
+	{
+		last_status = 1;
+	}
+
+	next = command_next(cmp, last_status);
+	if (next != NULL && run_once == FALSE)
+	{
+		ret = exec_command(next);
+	}
+
+	return ret;
+}
+
+
+/* Function: exec_command
+*/
+int exec_command(const COMMAND *cmp)
+{
+	int ret = 0, wait_id = -1, cld_pid, fd, table_id, status, infd;
+	int fatal_err = FALSE;
+	int capfd[2] = {-1, -1};
+	struct rusage ru;
+	struct timespec start, end;
+	COMMAND timed, *next;
+	ALIAS *fn;
+	REPEAT_OPTS opts;
+	MEMO_OPTS mopts;
+	WILDCARD wc;
+	char **argv, **words;
+	int n;
+
+	// time/timeout: run the rest of the command line as the job
+	time_pending = FALSE;
+	deadline_pending = FALSE;
+	timed = *cmp;
+	while (timed.argv[0] != NULL)
+	{
+		if (strcmp(timed.argv[0], "time") == 0)
+		{
+			n = 1;
+			time_pending = TRUE;
+		}
+		else if (strcmp(timed.argv[0], "repeat") == 0 || strcmp(timed.argv[0], "watch") == 0)
+		{
+			n = repeat_parse(timed.argv, &opts);
+			if (n == -1)
+			{
+				last_status = 2;
+				goto exec_next;
+			}
+			timed.argv += n;
+			timed.cmdline = shell_skip(timed.cmdline, n);
+			timed.path = NULL;
+			cmp = &timed;
+			shell_repeat(&timed, &opts);
+			// go on after the pipeline
+			while (cmp->pipe == TRUE && cmp->next != NULL)
+			{
+				cmp = cmp->next;
+			}
+			goto exec_next;
+		}
+		else if (strcmp(timed.argv[0], "memo") == 0)
+		{
+			n = memo_parse(timed.argv, &mopts);
+			if (n <= 0)
+			{
+				if (n == 0)
+				{
+					memo_action(&mopts);
+				}
+				last_status = (n == 0) ? 0 : 2;
+				goto exec_next;
+			}
+			timed.argv += n;
+			timed.cmdline = shell_skip(timed.cmdline, n);
+			timed.path = NULL;
+			cmp = &timed;
+			shell_memo(&timed, &mopts);
+			while (cmp->pipe == TRUE && cmp->next != NULL)
+			{
+				cmp = cmp->next;
+			}
+			goto exec_next;
+		}
+		else if (strcmp(timed.argv[0], "timeout") == 0)
+		{
+			n = timeout_parse(timed.argv, &deadline_after, &deadline_sig, &deadline_grace);
+			if (n == -1)
+			{
+				last_status = 2;
+				goto exec_next;
+			}
+			deadline_pending = TRUE;
+		}
+		else
+		{
+			break;
+		}
+		timed.argv += n;
+		timed.cmdline = shell_skip(timed.cmdline, n);
+		// the path looked up was the one of the word skipped
+		timed.path = NULL;
+		cmp = &timed;
+	}
+
+	// VAR=value alone sets shell variables, before a command they are
+	// left to shell_exec() in the child. Only builtins and functions run
+	// by the shell have their words expanded here, the $(cmd) of a job
+	// runs once, in the job's process
+	expand_status = last_status;
+	for (n = 0; cmp->argv[n] != NULL && vars_assignment(cmp->argv[n]) > 0; n++)
+	{
+	}
+	// functions come before builtins and $PATH, in a pipeline, a
+	// background job or with a redirect they run in the job's process
+	fn = alias_function(cmp->argv[n]);
+	if (fn != NULL && (cmp->pipe == TRUE || cmp->background == TRUE
+		|| cmp->infile != NULL || cmp->outfile != NULL || cmp->heredoc != NULL))
+	{
+		fn = NULL;
+	}
+	argv = cmp->argv;
+	if (cmp->argv[n] == NULL || fn != NULL || shell_builtin(cmp->argv[n]) == TRUE)
+	{
+		argv = vars_expand(cmp->argv, expand_status);
+	}
+	if (n > 0 && argv[n] == NULL && cmp->pipe == FALSE)
+	{
+		vars_assign(argv, n, FALSE);
+		vars_expand_free(argv, cmp->argv);
+		last_status = 0;
+		goto exec_next;
+	}
 
-	if (cmp->next != NULL)
+	// patterns are expanded here for builtins, in the child for jobs
+	words = &argv[n];
+	if (fn != NULL || shell_builtin(argv[n]) == TRUE)
 	{
-		ret = exec_command(cmp->next);
+		words = wildcard_expand(&argv[n], &wc);
 	}
 
-	return ret;
-}
-
-
-/* Function: exec_command
-*/
-int exec_command(const COMMAND *cmp)
-{
-	int ret = 0, wait_id = -1, cld_pid, fd, table_id;
-	int fatal_err = FALSE;
-
-	ret = shell_run(cmp->argv[0], cmp->argv[1]);
+	// builtins and background jobs succeed unless they say otherwise
+	last_status = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = (fn != NULL) ? shell_function(fn, words) : shell_run(words);
+	if (words != &argv[n])
+	{
+		wildcard_expand_free(words, &argv[n], &wc);
+	}
+	vars_expand_free(argv, cmp->argv);
 	switch(ret)
 	{
 		case MYSH_EXTC: break;
-		case MYSH_NEXT:	goto exec_next;
+		case MYSH_NEXT:
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			shell_time(NULL, (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000);
+			goto exec_next;
 		case MYSH_EXIT: goto exec_terminate;
 		default: break;
 	}
@@ -506,10 +1816,33 @@ int exec_command(const COMMAND *cmp)
 		goto exec_terminate;
 	}
 
+	if (-1 == procsub_open(cmp->procsub))
+	{
+		last_status = 1;
+		goto exec_next;
+	}
+	infd = redirect_input(cmp);
+	if (infd == REDIRECT_ERR)
+	{
+		procsub_close(cmp->procsub);
+		last_status = 1;
+		goto exec_next;
+	}
+
+	if (cmp->background == TRUE)
+	{
+		capture_pipe(capfd);
+	}
 	cld_pid = fork();
 	if (cld_pid == -1)
 	{
 		perror("fork");
+		capture_close(capfd);
+		procsub_close(cmp->procsub);
+		if (infd != -1)
+		{
+			close(infd);
+		}
 		goto exec_terminate;
 	}
 	// Child
@@ -527,9 +1860,18 @@ int exec_command(const COMMAND *cmp)
 				perror("tcsetpgrp");
 			}
 		}
+		procsub_child(cmp->procsub);
 
-		// Input redirect
-		if (cmp->infile != NULL)
+		// Input redirect, opened by the shell (here-document, prefetch) or here
+		if (infd != -1)
+		{
+			if (-1 == dup2(infd, 0))
+			{
+				perror("dup2");
+				fatal_err = -1;
+			}
+		}
+		else if (cmp->infile != NULL)
 		{
 			print_debug("DEBUG: Setting input file");
 			fd = open(cmp->infile, cmp->fdmode);
@@ -553,6 +1895,8 @@ int exec_command(const COMMAND *cmp)
 			}
 		}
 
+		capture_child(capfd, TRUE);
+
 		// Output redirect
 		if (cmp->outfile != NULL)
 		{
@@ -581,19 +1925,9 @@ int exec_command(const COMMAND *cmp)
 		}
 
 		// Execute command
-		if (execvp(cmp->argv[0], cmp->argv) == -1)
+		if (shell_exec(cmp) == -1)
 		{
-#ifdef WARNING
-			switch(errno)
-			{
-				case ENOENT:
-					printf("-mysh: %s: command not found\n", cmp->argv[0]);
-					break;
-				default:
-					perror("-mysh: ");
-			}
-#endif
-			_exit(-1);
+			shell_exec_failed(cmp);
 		}
 
 	}
@@ -608,8 +1942,15 @@ int exec_command(const COMMAND *cmp)
 		{
 			//Don't report error here
 		}
-		// create procgroup
+		// create procgroup, substitutions run in the same group
 		procgroup_load(foreground, cld_pid, RUNNING, cmp->cmdline);
+		shell_deadline(foreground);
+		foreground->count += procsub_spawn(cmp->procsub, cld_pid);
+		procsub_close(cmp->procsub);
+		if (infd != -1)
+		{
+			close(infd);
+		}
 		if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
 		{
 			perror("sigprocmask");
@@ -629,6 +1970,7 @@ int exec_command(const COMMAND *cmp)
 				perror("sigprocmask");
 			}
 			printf("[%d] %d\n", table_id, cld_pid);
+			capture_attach(capfd, cld_pid, table_id);
 		}
 		// Set to foreground
 		else {
@@ -636,11 +1978,34 @@ int exec_command(const COMMAND *cmp)
 			{
 				perror("tcsetpgrp");
 			}
-			// Wait for a specific PID
-			while(wait_id == -1)
+			// Wait for every process in the group, stop hands it to the pidtable
+			while(foreground->count > 0)
+			{
+				wait_id = wait4(-cld_pid, &status, WUNTRACED, &ru);
+				if (wait_id == -1 && errno == ECHILD)
+				{
+					break;
+				}
+				if (wait_id == -1 || WIFSTOPPED(status))
+				{
+					continue;
+				}
+				procgroup_reap(foreground, status, &ru);
+				foreground->count--;
+			}
+			// a stopped job was replaced by an empty PROCGROUP, not recorded
+			if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+			{
+				perror("sigprocmask");
+			}
+			timeout_reaped(foreground);
+			histstat_job(jobstats, foreground);
+			last_status = (foreground->group_pid == 0) ? 128 + SIGTSTP : foreground->exit_status;
+			if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
 			{
-				wait_id = waitpid(-cld_pid, NULL, WUNTRACED|WCONTINUED);
+				perror("sigprocmask");
 			}
+			shell_time(foreground, 0);
 			if (-1 == tcsetpgrp(ttyd, getpid()))
 			{
 				perror("tcsetpgrp");
@@ -649,9 +2014,10 @@ int exec_command(const COMMAND *cmp)
 	}
 
 exec_next:
-	if (cmp->next != NULL)
+	next = command_next(cmp, last_status);
+	if (next != NULL && run_once == FALSE)
 	{
-		ret = exec_command((COMMAND*)cmp->next);
+		ret = exec_command(next);
 	}
 
 exec_terminate:
@@ -659,13 +2025,335 @@ exec_terminate:
 }
 
 
+/* Function: shell_rc_run
+   rc file callback: the words of a builtin or of assignments
+   Returns 0, -1 if they ran exit
+*/
+int shell_rc_run(char **argv)
+{
+	int n;
+
+	for (n = 0; argv[n] != NULL && vars_assignment(argv[n]) > 0; n++)
+	{
+	}
+	if (n > 0 && argv[n] == NULL)
+	{
+		vars_assign(argv, n, FALSE);
+		last_status = 0;
+		return 0;
+	}
+
+	return (shell_run(argv) == MYSH_EXIT) ? -1 : 0;
+}
+
+
+/* Function: shell_rc_source
+   rc file callback: a line run as typed
+   Returns 0, -1 if it ran exit
+*/
+int shell_rc_source(const char *line)
+{
+	COMMAND *cmd;
+	char *expanded;
+	int ret = 0;
+
+	if (script_control(line) == TRUE)
+	{
+		return (shell_script(line) == MYSH_EXIT) ? -1 : 0;
+	}
+	expanded = alias_expand(line);
+	cmd = command_parse((expanded != NULL) ? expanded : line);
+	free(expanded);
+	if (cmd != NULL)
+	{
+		ret = (exec_command(cmd) == MYSH_EXIT) ? -1 : 0;
+		command_free(cmd);
+	}
+
+	return ret;
+}
+
+
+/* Function: shell_phase
+   --startup-profile: time of the startup phase name since the last one
+*/
+static void shell_phase(int profile, const char *name, struct timespec *last)
+{
+	struct timespec now;
+
+	if (profile == FALSE)
+	{
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(stderr, "startup: %-10s %8.3f ms\n", name,
+		(now.tv_sec - last->tv_sec) * 1e3 + (now.tv_nsec - last->tv_nsec) / 1e6);
+	*last = now;
+}
+
+
+/* Lines after the first one of a definition or construct */
+static char *more_line = NULL;
+static size_t more_size = 0;
+
+/* Script file run by mysh FILE or source, lines come from it */
+static MAPFILE *source_file = NULL;
+
+/* Nesting of source */
+static int source_depth = 0;
+
+
+/* Function: shell_getline (internal)
+   Read the next line of the script file being run, or a line from stdin
+   after "> "
+   Returns 0, -1 at the end of the input
+*/
+static int shell_getline(char **line, size_t *size)
+{
+	if (source_file != NULL)
+	{
+		return (mapfile_getline(source_file, line, size) == -1) ? -1 : 0;
+	}
+	printf("> ");
+	fflush(stdout);
+
+	return (getline(line, size, stdin) == -1) ? -1 : 0;
+}
+
+
+/* Function: shell_more (internal)
+   Read one more line (shell_getline()), append it to *buffer (*size
+   bytes)
+   Returns 0, -1 at the end of the input or on allocation failure
+*/
+static int shell_more(char **buffer, size_t *size)
+{
+	char *grow;
+	size_t len;
+
+	if (-1 == shell_getline(&more_line, &more_size))
+	{
+		return -1;
+	}
+	len = strlen(*buffer) + strlen(more_line) + 1;
+	if (len > *size)
+	{
+		grow = realloc(*buffer, len);
+		if (grow == NULL)
+		{
+			return -1;
+		}
+		*buffer = grow;
+		*size = len;
+	}
+	strcat(*buffer, more_line);
+
+	return 0;
+}
+
+
+/* Function: shell_line
+   Definitions, constructs and here-documents read the lines they need
+   with shell_more() and shell_getline(). A construct is compiled again
+   only after a line that may close it
+*/
+int shell_line(char **buffer, size_t *size)
+{
+	struct timespec start, end;
+	SCRIPT *script = NULL;
+	COMMAND *cmd, *heredoc;
+	char *line;
+	int n, ret;
+
+	if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+	{
+		perror("sigprocmask");
+	}
+	procgroup_free(foreground);
+	foreground = procgroup_init();
+	if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+	{
+		perror("sigprocmask");
+	}
+
+	// name() { ...; } defines a function, its body may take more lines
+	while ((n = alias_funcdef(*buffer, NULL)) != 0)
+	{
+		if (n > 0)
+		{
+			n += strspn(*buffer + n, " \t;");
+			memmove(*buffer, *buffer + n, strlen(*buffer + n) + 1);
+			continue;
+		}
+		if (-1 == shell_more(buffer, size))
+		{
+#ifdef WARNING
+	printf("-mysh: syntax error: unexpected end of file in function definition\n");
+#endif
+			(*buffer)[0] = '\0';
+			break;
+		}
+	}
+
+	// if, while, until, for and case take the lines up to their end,
+	// compiled and run as a whole
+	if (script_control(*buffer) == TRUE)
+	{
+		n = script_compile(*buffer, &script);
+		while (n == SCRIPT_MORE)
+		{
+			if (-1 == shell_more(buffer, size))
+			{
+#ifdef WARNING
+	printf("-mysh: syntax error: unexpected end of file\n");
+#endif
+				break;
+			}
+			if (script_closing(more_line) == TRUE)
+			{
+				n = script_compile(*buffer, &script);
+			}
+		}
+		last_status = (n != 0) ? 2 : last_status;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = (script != NULL) ? script_run(script, &shell_hooks, &last_status) : 0;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		prompt_duration(&start, &end);
+		script_free(script);
+
+		return (ret == -1) ? MYSH_EXIT : MYSH_NEXT;
+	}
+
+	// A line run before comes out of the parse cache, otherwise aliases
+	// apply to the text, then parse/tokenize command and look up the
+	// executables, kept for the next time
+	cmd = parsecache_get(parsecache, *buffer);
+	if (cmd == NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		line = alias_expand(*buffer);
+		cmd = command_parse((line != NULL) ? line : *buffer);
+		free(line);
+		shell_resolve(cmd);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		parsecache_put(parsecache, *buffer, cmd,
+			(end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec));
+	}
+
+	// Read here-document lines until each delimiter is seen
+	while ((heredoc = command_heredoc_pending(cmd)) != NULL)
+	{
+		if (-1 == shell_getline(buffer, size))
+		{
+#ifdef WARNING
+	printf("-mysh: warning: here-document delimited by end-of-file (wanted `%s')\n", heredoc->heredoc_tag);
+#endif
+			free(heredoc->heredoc_tag);
+			heredoc->heredoc_tag = NULL;
+			break;
+		}
+		command_heredoc_line(heredoc, *buffer);
+	}
+
+
+#ifdef DEBUG
+	printf("%s", MYSH_RED);
+	command_print(cmd);
+	printf("%s", MYSH_GRAY);
+	fflush(stdout);
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = exec_command(cmd);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	prompt_duration(&start, &end);
+	print_debug("DEBUG: Free command struct");
+
+	// reset data structure
+	command_free(cmd);
+
+	return (ret == MYSH_EXIT) ? MYSH_EXIT : MYSH_NEXT;
+}
+
+
+/* Function: shell_source
+   The file is mapped and run line by line as it is read, mysh FILE
+   and nested sources included
+*/
+int shell_source(char **argv)
+{
+	MAPFILE *saved = source_file, *mf;
+	char *line = NULL, **positional = NULL;
+	size_t size = 0;
+	int ret = MYSH_NEXT;
+
+	if (argv[1] == NULL)
+	{
+#ifdef WARNING
+	printf("-mysh: source: filename argument required\n");
+#endif
+		last_status = 2;
+		return MYSH_NEXT;
+	}
+	if (source_depth == MYSH_SOURCE_NEST)
+	{
+#ifdef WARNING
+	printf("-mysh: source: %s: nested too deeply\n", argv[1]);
+#endif
+		last_status = 1;
+		return MYSH_NEXT;
+	}
+	mf = mapfile_open(argv[1]);
+	if (mf == NULL)
+	{
+#ifdef WARNING
+	printf("-mysh: source: %s: %s\n", argv[1], strerror(errno));
+#endif
+		last_status = 1;
+		return MYSH_NEXT;
+	}
+	if (argv[2] != NULL)
+	{
+		positional = vars_positional(&argv[2]);
+	}
+	source_file = mf;
+	source_depth++;
+	last_status = 0;
+	while (ret != MYSH_EXIT && mapfile_getline(mf, &line, &size) != -1)
+	{
+		ret = shell_line(&line, &size);
+	}
+	source_depth--;
+	source_file = saved;
+	mapfile_close(mf);
+	free(line);
+	if (argv[2] != NULL)
+	{
+		vars_positional(positional);
+	}
+
+	return ret;
+}
+
+
 /* MAIN */
-int main()
+int main(int argc, char **argv)
 {
 	// variable and data structures
 	int ret, status;
-	COMMAND *cmd = NULL;
-	char buffer[CMD_MAX], *read;
+	char *buffer = NULL, path[PATH_MAX], cache[PATH_MAX];
+	size_t size = 0;
+	struct timespec phase, launch;
+	RC_STATS rc;
+
+	// --startup-profile reports the time of each startup phase on stderr
+	int profile = (argc > 1 && strcmp(argv[1], "--startup-profile") == 0);
+
+	// mysh FILE [args] runs the file, not the terminal
+	int file = 1 + profile;
+	clock_gettime(CLOCK_MONOTONIC, &launch);
+	phase = launch;
+
 	ptable = pidtable_init();
 	ttyd = open("/dev/tty", O_RDWR, 0700);
 	if (ttyd == -1)
@@ -718,59 +2406,98 @@ int main()
 #endif
 
 	foreground = procgroup_init();
+	shell_phase(profile, "signals", &phase);
 
-	// begin main loop
-	while(TRUE)
+	// Variables start as a copy of the environment, which they replace
+	if (-1 == vars_init(environ))
 	{
-		tcsetpgrp(ttyd, getpid());
-
-		ret = waitpid(-1, &status, WNOHANG|WCONTINUED);
-
-		// Shell prompt
-		printf("%sMysh%s ", MYSH_LGREEN, MYSH_LBLUE);
-		shell_pwd();
-		printf(" #%s ", MYSH_GRAY);
+		perror("vars_init");
+	}
+	shell_phase(profile, "vars", &phase);
 
-		// Get input from stdin
-		memset(&buffer, CMD_MAX, '\0');
-		read = NULL;
-		while (read == NULL)
-		{
-			read = fgets(buffer, CMD_MAX, stdin);
-		}
+	// Interactive shells edit lines in raw mode and keep a history
+	int interactive = isatty(STDIN_FILENO) && argc <= file;
+	if (interactive && getenv("HOME") != NULL)
+	{
+		snprintf(path, PATH_MAX, "%s/%s", getenv("HOME"), HISTORY_FILE);
+		history = history_open(path);
+		complete_init(shell_builtins, ptable);
+	}
+	shell_phase(profile, "history", &phase);
+	if (getenv("HOME") != NULL)
+	{
+		snprintf(path, PATH_MAX, "%s/%s", getenv("HOME"), HISTSTAT_FILE);
+		jobstats = histstat_open(path);
+		snprintf(path, PATH_MAX, "%s/%s", getenv("HOME"), MEMO_DIR);
+		memo_init(path);
+	}
+	parsecache = parsecache_init();
+	shell_phase(profile, "histstat", &phase);
+	if (argc > file)
+	{
+		shell_source(&argv[file-1]);
+		goto finalize;
+	}
 
-		if (-1 == sigprocmask(SIG_SETMASK, &fullset, NULL))
+	// ~/.myshrc, replayed from its compiled image when it is unchanged
+	if (getenv("HOME") != NULL)
+	{
+		snprintf(path, PATH_MAX, "%s/%s", getenv("HOME"), RC_FILE);
+		snprintf(cache, PATH_MAX, "%s/%s", getenv("HOME"), RC_CACHE);
+		ret = rc_load(path, cache, shell_rc_run, shell_rc_source, &rc);
+		shell_phase(profile, "rc", &phase);
+		if (profile && ret != -1)
 		{
-			perror("sigprocmask");
+			fprintf(stderr, "startup:   %s, %d ops, %d lines: check %.3f ms, run %.3f ms, write %.3f ms\n",
+				(rc.hit == TRUE) ? "image" : "compiled", rc.ops, rc.lines,
+				rc.check_us / 1e3, rc.run_us / 1e3, rc.write_us / 1e3);
 		}
-		procgroup_free(foreground);
-		foreground = procgroup_init();
-		if (-1 == sigprocmask(SIG_UNBLOCK, &fullset, NULL))
+		if (ret == RC_EXIT)
 		{
-			perror("sigprocmask");
+			goto finalize;
 		}
+	}
+	shell_phase(profile, "total", &launch);
 
-		// Parse/tokenize command
-		cmd = command_parse(buffer);
-
+	// begin main loop
+	while(TRUE)
+	{
+		tcsetpgrp(ttyd, getpid());
 
-#ifdef DEBUG
-	printf("%s", MYSH_RED);
-	command_print(cmd);
-	printf("%s", MYSH_GRAY);
-	fflush(stdout);
-#endif
+		ret = waitpid(-1, &status, WNOHANG|WCONTINUED);
+		jobstats_flush();
 
-		ret = exec_command(cmd);
-		print_debug("DEBUG: Free command struct");
+		// The input buffer grows to fit the line, the parser reads it in place
+		if (interactive)
+		{
+			// Line editor redraws the prompt when a segment is refreshed
+			if (-1 == lineedit_read(&buffer, &size, history, shell_prompt_render))
+			{
+				printf("exit\n");
+				goto finalize;
+			}
+			history_add(history, buffer);
+		}
+		else
+		{
+			// Shell prompt, redrawn if a segment is refreshed before input arrives
+			shell_prompt();
+			prompt_wait(STDIN_FILENO, shell_getcwd(), ptable);
 
-		// reset data structure
-		command_free(cmd);
+			// Get input from stdin, retry reads interrupted by SIGCHLD
+			while (-1 == getline(&buffer, &size, stdin))
+			{
+				if (feof(stdin))
+				{
+					goto finalize;
+				}
+				clearerr(stdin);
+			}
+		}
 
-		switch (ret)
+		if (shell_line(&buffer, &size) == MYSH_EXIT)
 		{
-			case 10: goto finalize;
-			default: break;
+			goto finalize;
 		}
 	}
 
@@ -786,5 +2513,18 @@ finalize:
 	{
 		perror("sigprocmask");
 	}
-	return 0;
+	history_close(history);
+	jobstats_flush();
+	histstat_close(jobstats);
+	parsecache_free(parsecache);
+	sampler_free(sampler);
+	capture_free();
+	timeout_free();
+	complete_free();
+	rc_free();
+	alias_free();
+	vars_free();
+	free(buffer);
+	free(more_line);
+	return (argc > file) ? last_status : 0;
 }
@@ -5,12 +5,30 @@
 #include "procgroup.h"
 #include "pidtable.h"
 #include "parser.h"
+#include "procsub.h"
+#include "redirect.h"
+#include "prompt.h"
+#include "history.h"
+#include "lineedit.h"
+#include "complete.h"
+#include "histstat.h"
+#include "sampler.h"
+#include "capture.h"
+#include "timeout.h"
+#include "dag.h"
+#include "repeat.h"
+#include "vars.h"
+#include "wildcard.h"
+#include "cmdsub.h"
+#include "memo.h"
+#include "alias.h"
+#include "rcfile.h"
+#include "script.h"
+#include "mapfile.h"
+#include "parsecache.h"
 //#include "internal.h"
 #include "sighandler.h"
 
-/* Max length for each command line */
-#define CMD_MAX 5120
-
 #define INTERNAL_BUF 32
 
 /* RETURN CODE */
@@ -21,17 +39,28 @@
 #define MYSH_ERR	-2
 #define MYSH_EXTC	9
 
+/* Max number of jobs given to jobs --follow */
+#define MYSH_FOLLOW	16
+
+/* Max nesting of source */
+#define MYSH_SOURCE_NEST	100
+
+/* Shell state shared with the signal handler, defined in sighandler.c */
+
 /* Foreground process */
-PROCGROUP *foreground;
+extern PROCGROUP *foreground;
 
 /* set of signal to block */
-sigset_t fullset;
+extern sigset_t fullset;
 
 /* Pidtable data structure */
-PIDTABLE *ptable;
+extern PIDTABLE *ptable;
 
 /* Terminal File*/
-int ttyd;
+extern int ttyd;
+
+/* Per-command latency history, NULL if unavailable (defined in sighandler.c) */
+extern HISTSTAT *jobstats;
 
 /* Functions */
 
@@ -40,6 +69,103 @@ int ttyd;
 */
 int pipe_command(const COMMAND *cmp);
 
+/* Function: shell_jobs_pgid
+   Returns the process group of job spec "%n", 0 if there is no such job
+*/
+int shell_jobs_pgid(const char *spec);
+
+/* Function: shell_jobs
+   Builtin jobs: list jobs, -l with pids and usage, -o/--follow captured
+   output (see capture.h), --stats with sampled CPU% and RSS, --top
+   refreshing the sample every SAMPLER_INTERVAL
+*/
+int shell_jobs(char **argv);
+
+/* Function: shell_skip
+   Returns line after its first n words and the blanks following them
+*/
+char *shell_skip(char *line, int n);
+
+/* Function: shell_deadline
+   Apply a pending timeout to the job just loaded into pg
+   Precondition: signals are blocked
+*/
+void shell_deadline(PROCGROUP *pg);
+
+/* Function: shell_time
+   Report the usage of a job started with the time builtin, if one is pending
+   pg is NULL for a builtin, wall (microseconds) is used then
+*/
+void shell_time(PROCGROUP *pg, long wall);
+
+/* Function: shell_exec
+   exec the command in a child, using the path cached by command_resolve()
+   Returns -1 if the exec failed
+*/
+int shell_exec(const COMMAND *cmp);
+
+/* Function: shell_repeat
+   Builtins repeat and watch: run the pipeline starting at cmp again and
+   again without parsing it, report the latency of the runs (see repeat.h)
+*/
+int shell_repeat(COMMAND *cmp, const REPEAT_OPTS *opts);
+
+/* Function: shell_memo
+   Builtin memo: replay the cached output of the pipeline starting at cmp
+   or run it and cache its output (see memo.h)
+*/
+int shell_memo(COMMAND *cmp, const MEMO_OPTS *opts);
+
+/* Function: shell_function
+   Run the function fn in the shell, argv holds its name and arguments
+   Returns MYSH_NEXT, MYSH_EXIT if the function ran exit
+*/
+int shell_function(ALIAS *fn, char **argv);
+
+/* Function: shell_script
+   Compile and run text holding if, while, until, for or case (see
+   script.h)
+   Returns MYSH_NEXT, MYSH_EXIT if it ran exit
+*/
+int shell_script(const char *text);
+
+/* Function: shell_script_list
+   Script hook: run a command list as typed
+*/
+int shell_script_list(COMMAND *cmd, int *status);
+
+/* Function: shell_script_builtin
+   Script hook: Returns TRUE if name is run by shell_script_run()
+*/
+int shell_script_builtin(const char *name);
+
+/* Function: shell_script_run
+   Script hook: run the expanded words of a builtin
+*/
+int shell_script_run(char **argv, int *status);
+
+/* Function: shell_rc_run
+   rc file callback: run the words of a builtin or of assignments
+*/
+int shell_rc_run(char **argv);
+
+/* Function: shell_rc_source
+   rc file callback: run a line as typed
+*/
+int shell_rc_source(const char *line);
+
+/* Function: shell_line
+   Run a line read into *buffer (*size bytes), reading the further lines
+   a definition, construct or here-document needs
+   Returns MYSH_EXIT to leave the shell, MYSH_NEXT otherwise
+*/
+int shell_line(char **buffer, size_t *size);
+
+/* Function: shell_source
+   Builtin source FILE [args], also run for mysh FILE [args]
+*/
+int shell_source(char **argv);
+
 /* Function: exec_command
    check command for builtin or pipe
    Otherwise execute a single command job
@@ -48,8 +174,19 @@ int exec_command(const COMMAND *cmp);
 
 /* Function: shell_run
    Check for shell builtin command and execute
+   argv is the NULL terminated argument list of the command
 */
-int shell_run(const char *cmd, const char *arg);
+int shell_run(char **argv);
+
+/* Function: shell_dag
+   Builtin dag: run the tasks of a dependency file in parallel (see dag.h)
+*/
+int shell_dag(char **argv);
+
+/* Function: shell_export
+   Builtin export: export variables, set them with NAME=value
+*/
+int shell_export(char **argv);
 
 /* Function: shell_atoi
    atio function with error handling
@@ -67,4 +204,29 @@ int shell_cd(const char *path);
 int shell_pwd();
 
 
+/* Function: shell_getcwd
+   Returns the cached current working directory, NULL if it cannot be determined
+   The cache is revalidated with stat(".") and refreshed by shell_cd()
+*/
+const char *shell_getcwd();
+
+
+/* Function: shell_prompt
+   Print the shell prompt with a single write()
+*/
+int shell_prompt();
+
+
+/* Function: shell_prompt_render
+   Render the prompt into buf for the line editor, returns its length
+*/
+int shell_prompt_render(char *buf, int size);
+
+
+/* Function: shell_prefetch
+   Builtin command prefetch
+*/
+int shell_prefetch(char **argv);
+
+
 #endif /* _MYSH_H_ */
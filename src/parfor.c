@@ -0,0 +1,460 @@
+#include "parfor.h"
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+
+
+/* Typedef: PARFOR_WORKER (internal)
+   Deque of a worker, count iterations first, first + stride, ..., the
+   iteration it runs and, while its job runs, the PROCGROUP of the job,
+   the pidfd of its last process (-1 once reaped) and the number of its
+   processes not reaped yet
+*/
+typedef struct parfor_worker {
+	int first;
+	int count;
+	int stride;
+	PARFOR_TASK task;
+	PROCGROUP *pg;
+	int pidfd;
+	int left;
+} PARFOR_WORKER;
+
+
+/* Typedef: PARFOR_STATE (internal)
+   One run: workers, jobs running, for -k the output memfd of each
+   iteration (-1 for none), which ones are finished and the next one to
+   copy out
+*/
+typedef struct parfor_state {
+	PARFOR *pf;
+	PARFOR_WORKER *workers;
+	int jobs;
+	int running;
+	int *out;
+	char *done;
+	int flushed;
+	int stop;
+	int status;
+} PARFOR_STATE;
+
+
+/* Function: parfor_front (internal)
+   The iteration worker w runs next: the front of its deque, once it is
+   empty after stealing the back half of the longest deque
+   Returns -1 when no iteration is left
+*/
+static int parfor_front(PARFOR_STATE *s, PARFOR_WORKER *w)
+{
+	PARFOR_WORKER *victim = NULL;
+	int i, half;
+
+	if (w->count == 0)
+	{
+		for (i = 0; i < s->jobs; i++)
+		{
+			if (s->workers[i].count > 0 && (victim == NULL || s->workers[i].count > victim->count))
+			{
+				victim = &s->workers[i];
+			}
+		}
+		if (victim == NULL)
+		{
+			return -1;
+		}
+		half = (victim->count + 1) / 2;
+		victim->count -= half;
+		w->first = victim->first + victim->count * victim->stride;
+		w->count = half;
+		w->stride = victim->stride;
+		s->pf->steals++;
+	}
+
+	return w->first;
+}
+
+
+/* Function: parfor_copy (internal)
+   Copy the output held in fd to stdout and close it
+*/
+static void parfor_copy(int fd)
+{
+	char buf[65536];
+	ssize_t n, done, k;
+
+	lseek(fd, 0, SEEK_SET);
+	while ((n = read(fd, buf, sizeof buf)) > 0)
+	{
+		for (done = 0; done < n; done += k)
+		{
+			k = write(STDOUT_FILENO, buf + done, n - done);
+			if (k == -1)
+			{
+				if (errno == EINTR)
+				{
+					k = 0;
+					continue;
+				}
+				close(fd);
+				return;
+			}
+		}
+	}
+	close(fd);
+}
+
+
+/* Function: parfor_flush (internal)
+   Copy out the outputs of the finished iterations that come next in
+   order
+*/
+static void parfor_flush(PARFOR_STATE *s)
+{
+	while (s->flushed < s->pf->count && s->done[s->flushed] == TRUE)
+	{
+		if (s->out[s->flushed] != -1)
+		{
+			parfor_copy(s->out[s->flushed]);
+			s->out[s->flushed] = -1;
+		}
+		s->flushed++;
+	}
+}
+
+
+/* Function: parfor_cancel (internal)
+   Terminate the running jobs, their iterations end when they are
+   reaped, start no more
+*/
+static void parfor_cancel(PARFOR_STATE *s)
+{
+	int i;
+
+	s->stop = TRUE;
+	for (i = 0; i < s->jobs; i++)
+	{
+		if (s->workers[i].task.iter != -1)
+		{
+			s->workers[i].task.cancel = TRUE;
+		}
+		if (s->workers[i].pg != NULL)
+		{
+			kill(-s->workers[i].task.pid, SIGTERM);
+		}
+	}
+}
+
+
+/* Function: parfor_end (internal)
+   The iteration of w is over with task.status: -k output, failures
+*/
+static void parfor_end(PARFOR_STATE *s, PARFOR_WORKER *w)
+{
+	PARFOR *pf = s->pf;
+	int code = w->task.status;
+
+	if (pf->flags & PARFOR_KEEP)
+	{
+		s->done[w->task.iter] = TRUE;
+		parfor_flush(s);
+	}
+	w->task.iter = -1;
+
+	if (code != 0 && s->stop == FALSE)
+	{
+		pf->failed++;
+		s->status = (s->status == 0) ? code : s->status;
+		if (pf->flags & PARFOR_FAIL)
+		{
+			parfor_cancel(s);
+		}
+	}
+}
+
+
+/* Function: parfor_job (internal)
+   Enter the job the iteration of w started in the job table
+*/
+static void parfor_job(PARFOR_STATE *s, PARFOR_WORKER *w)
+{
+	PARFOR *pf = s->pf;
+	char label[PROCGROUP_BUF];
+
+	w->pg = procgroup_init();
+	snprintf(label, sizeof label, "for %s=%s: %s", pf->name, pf->words[w->task.iter],
+		(w->task.label != NULL) ? w->task.label : "");
+	procgroup_load(w->pg, w->task.pid, RUNNING, label);
+	w->pg->count = w->task.count;
+	if (pf->table != NULL)
+	{
+		pidtable_add(pf->table, w->pg);
+	}
+	w->pidfd = syscall(SYS_pidfd_open, w->task.last, 0);
+	w->left = w->task.count;
+	s->running++;
+}
+
+
+/* Function: parfor_step (internal)
+   Step the iteration of w in the shell, stdout on its memfd for -k,
+   until it starts a job or is over
+*/
+static void parfor_step(PARFOR_STATE *s, PARFOR_WORKER *w)
+{
+	int saved = -1, r;
+
+	if (s->out != NULL && s->out[w->task.iter] != -1)
+	{
+		fflush(stdout);
+		saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+		dup2(s->out[w->task.iter], STDOUT_FILENO);
+	}
+	w->task.pid = w->task.last = -1;
+	w->task.count = 0;
+	w->task.label = NULL;
+	r = s->pf->body(&w->task, s->pf->arg);
+	if (saved != -1)
+	{
+		fflush(stdout);
+		dup2(saved, STDOUT_FILENO);
+		close(saved);
+	}
+
+	if (r == PARFOR_JOB && w->task.pid > 0 && w->task.count > 0)
+	{
+		parfor_job(s, w);
+	}
+	else
+	{
+		parfor_end(s, w);
+	}
+}
+
+
+/* Function: parfor_start (internal)
+   Begin iteration i on worker w
+   Returns 0, -1 if it could not be started
+*/
+static int parfor_start(PARFOR_STATE *s, PARFOR_WORKER *w, int i)
+{
+	PARFOR *pf = s->pf;
+
+	if (pf->flags & PARFOR_KEEP)
+	{
+		s->out[i] = memfd_create("mysh-for", MFD_CLOEXEC);
+		if (s->out[i] == -1)
+		{
+			perror("memfd_create");
+			return -1;
+		}
+	}
+	w->first += w->stride;
+	w->count--;
+	memset(&w->task, 0, sizeof (PARFOR_TASK));
+	w->task.iter = i;
+	pf->started++;
+	parfor_step(s, w);
+
+	return 0;
+}
+
+
+/* Function: parfor_reap (internal)
+   Reap what finished of the job of w. Once all its processes are
+   reaped it leaves the job table and the iteration goes on with the
+   status of the last process
+*/
+static void parfor_reap(PARFOR_STATE *s, PARFOR_WORKER *w)
+{
+	PARFOR *pf = s->pf;
+	struct rusage ru;
+	int pid, status;
+
+	while (w->left > 0 && (pid = wait4(-w->task.pid, &status, WNOHANG, &ru)) != 0)
+	{
+		if (pid == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			// nothing left in the group
+			w->left = 0;
+			break;
+		}
+		procgroup_reap(w->pg, status, &ru);
+		w->pg->count--;
+		w->left--;
+		if (pid == w->task.last)
+		{
+			w->task.status = w->pg->exit_status;
+			if (w->pidfd != -1)
+			{
+				close(w->pidfd);
+				w->pidfd = -1;
+			}
+		}
+	}
+	if (w->left > 0)
+	{
+		return;
+	}
+
+	if (w->pidfd != -1)
+	{
+		close(w->pidfd);
+		w->pidfd = -1;
+	}
+	if (pf->table != NULL)
+	{
+		pidtable_delpid(pf->table, w->task.pid, FALSE, TRUE);
+	}
+	else
+	{
+		procgroup_free(w->pg);
+	}
+	w->pg = NULL;
+	s->running--;
+	parfor_step(s, w);
+}
+
+
+/* Function: parfor_fill (internal)
+   Start iterations on every idle worker that has one, for -k within
+   PARFOR_PENDING of the first unfinished iteration. An iteration may be
+   over at once (builtins only), the worker takes the next one then
+*/
+static void parfor_fill(PARFOR_STATE *s)
+{
+	PARFOR_WORKER *w;
+	int k, i;
+
+	for (k = 0; k < s->jobs; k++)
+	{
+		w = &s->workers[k];
+		while (w->task.iter == -1 && s->stop == FALSE)
+		{
+			i = parfor_front(s, w);
+			if (i == -1 || ((s->pf->flags & PARFOR_KEEP) && i - s->flushed >= PARFOR_PENDING))
+			{
+				break;
+			}
+			if (-1 == parfor_start(s, w, i))
+			{
+				// not started, counted as cancelled
+				w->first += w->stride;
+				w->count--;
+				if (s->pf->flags & PARFOR_KEEP)
+				{
+					s->done[i] = TRUE;
+					parfor_flush(s);
+				}
+				s->status = (s->status == 0) ? 1 : s->status;
+			}
+		}
+	}
+}
+
+
+/* Function: parfor_run
+   Workers are filled, then the running iterations polled by pidfd until
+   none is left
+*/
+int parfor_run(PARFOR *pf)
+{
+	PARFOR_STATE s;
+	PARFOR_WORKER *w;
+	struct pollfd *pfd;
+	sigset_t block, old;
+	int i, n, wait;
+
+	pf->started = pf->failed = pf->cancelled = pf->steals = 0;
+	if (pf->count <= 0)
+	{
+		return 0;
+	}
+	memset(&s, 0, sizeof s);
+	s.pf = pf;
+	s.jobs = pf->jobs;
+	if (s.jobs <= 0)
+	{
+		s.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	s.jobs = (s.jobs < 1) ? 1 : ((s.jobs > pf->count) ? pf->count : s.jobs);
+	s.workers = calloc(s.jobs, sizeof (PARFOR_WORKER));
+	pfd = calloc(s.jobs, sizeof (struct pollfd));
+	if (pf->flags & PARFOR_KEEP)
+	{
+		s.out = malloc(pf->count * sizeof (int));
+		s.done = calloc(pf->count, 1);
+	}
+	if (s.workers == NULL || pfd == NULL || ((pf->flags & PARFOR_KEEP) && (s.out == NULL || s.done == NULL)))
+	{
+		perror("malloc");
+		free(s.workers);
+		free(pfd);
+		free(s.out);
+		free(s.done);
+		return 1;
+	}
+	for (i = 0; i < s.jobs; i++)
+	{
+		w = &s.workers[i];
+		w->first = i;
+		w->stride = s.jobs;
+		w->count = (pf->count - i + s.jobs - 1) / s.jobs;
+		w->task.iter = w->pidfd = -1;
+	}
+	for (i = 0; s.out != NULL && i < pf->count; i++)
+	{
+		s.out[i] = -1;
+	}
+
+	sigemptyset(&block);
+	sigaddset(&block, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &block, &old);
+
+	parfor_fill(&s);
+	while (s.running > 0)
+	{
+		wait = -1;
+		for (i = n = 0; i < s.jobs; i++)
+		{
+			if (s.workers[i].pg != NULL)
+			{
+				pfd[n].fd = s.workers[i].pidfd;
+				pfd[n].events = POLLIN;
+				wait = (s.workers[i].pidfd == -1) ? 10 : wait;
+				n++;
+			}
+		}
+		if (-1 == poll(pfd, n, wait) && errno != EINTR)
+		{
+			perror("poll");
+		}
+		for (i = 0; i < s.jobs; i++)
+		{
+			if (s.workers[i].pg != NULL)
+			{
+				parfor_reap(&s, &s.workers[i]);
+			}
+		}
+		parfor_fill(&s);
+	}
+
+	sigprocmask(SIG_SETMASK, &old, NULL);
+
+	pf->cancelled = pf->count - pf->started;
+	if (pf->flags & PARFOR_KEEP)
+	{
+		memset(s.done, TRUE, pf->count);
+		parfor_flush(&s);
+	}
+	free(s.workers);
+	free(pfd);
+	free(s.out);
+	free(s.done);
+
+	return s.status;
+}
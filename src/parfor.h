@@ -0,0 +1,105 @@
+/*
+	PARFOR runs the iterations of a parallel for loop,
+
+		for -P N [-k] [-e] name in words; do list; done
+
+	on up to N workers (-P 0: one per online CPU) inside the shell: no
+	process is forked for an iteration. A worker holds one iteration at
+	a time and steps its body (PARFOR body) in the shell; the body runs
+	its builtins and assignments there and stops at each other command,
+	which it starts as a job of its own (a process group, see
+	dag_spawn()). The job enters the job table as a PROCGROUP while it
+	runs and is accounted with procgroup_reap() when its members are
+	reaped; the worker then steps the iteration on from the status of
+	the job. The shell waits for the jobs of all the workers with one
+	poll() on their pidfds; SIGCHLD is blocked meanwhile so its handler
+	does not reap them from under the table.
+
+	The iterations are dealt to the workers in strides (worker w gets w,
+	w+N, w+2N, ...), each worker's deque is the rest of its stride. A
+	worker takes from the front of its own deque and, when it runs dry,
+	steals the back half of the longest other deque, so a worker held up
+	by slow iterations has its share taken over by the others. The
+	workers are slots of the one scheduler loop of the shell, not
+	threads: stealing decides which iteration an idle slot starts next.
+
+	With -k the output of each iteration (its jobs, and the builtins it
+	runs, stdout moved there while it is stepped) goes to a memfd and is
+	copied to stdout in iteration order, at most PARFOR_PENDING
+	iterations ahead of the first unfinished one. With -e the first
+	failure terminates the running jobs (SIGTERM to their groups) and
+	cancels the rest.
+*/
+
+#ifndef _PARFOR_H_
+#define _PARFOR_H_
+
+#include "include.h"
+#include "procgroup.h"
+#include "pidtable.h"
+
+/* Flags */
+#define PARFOR_KEEP	1	/* -k: output in iteration order */
+#define PARFOR_FAIL	2	/* -e: the first failure cancels the rest */
+
+/* Results of a step of the body */
+#define PARFOR_DONE	0	/* the iteration is over */
+#define PARFOR_JOB	1	/* the iteration started a job */
+
+/* Outputs held for -k at most */
+#define PARFOR_PENDING 256
+
+
+/* Typedef: PARFOR_TASK
+   The iteration a worker runs (iter, -1 when idle): $? of the iteration
+   (the status of the job it waited for, its own status once over), the
+   body's state (NULL before the first step) and cancel, set when -e
+   stopped the loop. A step that starts a job fills in pid (its process
+   group), last (the process whose status is the job's), count (its
+   processes) and label (its command line)
+*/
+typedef struct parfor_task {
+	int iter;
+	int status;
+	void *state;
+	int cancel;
+	int pid;
+	int last;
+	int count;
+	const char *label;
+} PARFOR_TASK;
+
+
+/* Typedef: PARFOR
+   A loop: count words, workers and flags, the job table (NULL for none),
+   name of the loop variable for the table and body, called in the shell
+   with arg to step task on. started, failed, cancelled (never started)
+   and steals are filled by parfor_run()
+*/
+typedef struct parfor {
+	char **words;
+	int count;
+	int jobs;
+	int flags;
+	PIDTABLE *table;
+	const char *name;
+	int (*body)(PARFOR_TASK *task, void *arg);
+	void *arg;
+	int started;
+	int failed;
+	int cancelled;
+	int steals;
+} PARFOR;
+
+
+/* Function: parfor_run
+   Run the iterations of pf. Each call of pf->body runs task->iter on
+   from where it stopped and returns PARFOR_JOB once it started a job,
+   PARFOR_DONE when the iteration is over (or task->cancel is set), its
+   state released and task->status its exit status
+   Returns 0 if every iteration succeeded, the exit status of the first
+   to fail otherwise
+*/
+int parfor_run(PARFOR *pf);
+
+#endif /* _PARFOR_H_ */
@@ -0,0 +1,317 @@
+#include "parfor.h"
+
+/* prototypes */
+void test_order(const char *dir);
+void test_table();
+void test_fail();
+void test_bench(int count, int jobs);
+
+/* Words of the loops */
+static char *words[64];
+
+
+/* Function: spawn (helper)
+   Start the job of task: one process in a group of its own that sleeps
+   usec, prints the iteration if print is set and exits with code
+*/
+int spawn(PARFOR_TASK *task, int usec, int print, int code)
+{
+	int pid = fork();
+
+	assert(pid != -1);
+	if (pid == 0)
+	{
+		setpgid(0, 0);
+		usleep(usec);
+		if (print == TRUE)
+		{
+			printf("%d\n", task->iter);
+		}
+		fflush(stdout);
+		_exit(code);
+	}
+	setpgid(pid, pid);
+	task->pid = task->last = pid;
+	task->count = 1;
+	task->state = task;
+
+	return PARFOR_JOB;
+}
+
+
+/* Function: body_print (helper)
+   A job printing the iteration, uneven delays
+*/
+int body_print(PARFOR_TASK *task, void *arg)
+{
+	if (task->state != NULL)
+	{
+		task->state = NULL;
+		return PARFOR_DONE;
+	}
+
+	return spawn(task, (task->iter * 7 % 5) * 2000, TRUE, 0);
+}
+
+
+/* Function: body_inline (helper)
+   Print the iteration in the shell, no job
+*/
+int body_inline(PARFOR_TASK *task, void *arg)
+{
+	printf("%d\n", task->iter);
+	task->status = 0;
+
+	return PARFOR_DONE;
+}
+
+
+/* Function: body_fail (helper)
+   Iterations listed in arg run a job failing with 3, the others one
+   sleeping 200 ms
+*/
+int body_fail(PARFOR_TASK *task, void *arg)
+{
+	const char *fails = arg;
+
+	if (task->state != NULL)
+	{
+		task->state = NULL;
+		return PARFOR_DONE;
+	}
+	if (strchr(fails, 'a' + task->iter) != NULL)
+	{
+		return spawn(task, 0, FALSE, 3);
+	}
+
+	return spawn(task, 200000, FALSE, 0);
+}
+
+
+/* Function: body_uneven (helper)
+   Every fourth iteration runs a slow job
+*/
+int body_uneven(PARFOR_TASK *task, void *arg)
+{
+	if (task->state != NULL)
+	{
+		task->state = NULL;
+		return PARFOR_DONE;
+	}
+
+	return spawn(task, (task->iter % 4 == 0) ? 40000 : 2000, FALSE, 0);
+}
+
+
+/* Function: capture (helper)
+   Run pf with stdout going to path, returns its status
+*/
+int capture(PARFOR *pf, const char *path)
+{
+	int fd, saved, status;
+
+	fflush(stdout);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	assert(fd != -1);
+	saved = dup(STDOUT_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+	status = parfor_run(pf);
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+
+	return status;
+}
+
+
+/* Function: read_file (helper)
+   Contents of path into buf
+*/
+void read_file(const char *path, char *buf, int size)
+{
+	int fd = open(path, O_RDONLY), n;
+
+	assert(fd != -1);
+	n = read(fd, buf, size - 1);
+	assert(n >= 0);
+	buf[n] = '\0';
+	close(fd);
+}
+
+
+/* Function: setup (helper)
+   A loop over count words with body
+*/
+void setup(PARFOR *pf, int count, int jobs, int flags, int (*body)(PARFOR_TASK*, void*), void *arg)
+{
+	memset(pf, 0, sizeof (PARFOR));
+	pf->words = words;
+	pf->count = count;
+	pf->jobs = jobs;
+	pf->flags = flags;
+	pf->name = "i";
+	pf->body = body;
+	pf->arg = arg;
+}
+
+
+/* Function: test_order
+   Every iteration runs once, -k keeps the output in order
+*/
+void test_order(const char *dir)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARFOR iterations and -k\n");
+#endif
+
+	char path[PATH_MAX], out[1024], expected[1024];
+	PARFOR pf;
+	int i, sum;
+
+	snprintf(path, sizeof path, "%s/out", dir);
+	expected[0] = '\0';
+	for (i = 0; i < 20; i++)
+	{
+		sprintf(expected + strlen(expected), "%d\n", i);
+	}
+
+	setup(&pf, 20, 4, PARFOR_KEEP, body_print, NULL);
+	assert(capture(&pf, path) == 0);
+	assert(pf.started == 20 && pf.failed == 0 && pf.cancelled == 0);
+	read_file(path, out, sizeof out);
+	assert(strcmp(out, expected) == 0);
+
+	// output of the shell itself while an iteration is stepped
+	setup(&pf, 20, 4, PARFOR_KEEP, body_inline, NULL);
+	assert(capture(&pf, path) == 0 && pf.started == 20);
+	read_file(path, out, sizeof out);
+	assert(strcmp(out, expected) == 0);
+
+	// without -k each line is there once, in any order
+	setup(&pf, 20, 4, 0, body_print, NULL);
+	assert(capture(&pf, path) == 0);
+	read_file(path, out, sizeof out);
+	assert(strlen(out) == strlen(expected));
+	for (sum = 0, i = 0; out[i] != '\0'; i += strcspn(out + i, "\n") + 1)
+	{
+		sum += atoi(out + i);
+	}
+	assert(sum == 190);
+
+	// more workers than words, none, one per CPU
+	setup(&pf, 3, 16, PARFOR_KEEP, body_print, NULL);
+	assert(capture(&pf, path) == 0);
+	read_file(path, out, sizeof out);
+	assert(strcmp(out, "0\n1\n2\n") == 0);
+	setup(&pf, 0, 4, 0, body_print, NULL);
+	assert(parfor_run(&pf) == 0 && pf.started == 0);
+	setup(&pf, 2, 0, PARFOR_KEEP, body_print, NULL);
+	assert(capture(&pf, path) == 0 && pf.started == 2);
+	unlink(path);
+}
+
+
+/* Function: test_table
+   The jobs of the iterations leave the job table as they found it
+*/
+void test_table()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARFOR job table\n");
+#endif
+
+	PIDTABLE *table = pidtable_init();
+	PROCGROUP *job = procgroup_init();
+	PARFOR pf;
+
+	procgroup_load(job, 99999, RUNNING, "sleep 100");
+	pidtable_add(table, job);
+	setup(&pf, 8, 3, 0, body_fail, "");
+	pf.table = table;
+	assert(parfor_run(&pf) == 0);
+	assert(pf.started == 8);
+	assert(pidtable_getsize(table) == 1 && pidtable_getpid(table, 99999) == job);
+	pidtable_free(table);
+}
+
+
+/* Function: test_fail
+   Status of the first failure, -e cancels the rest
+*/
+void test_fail()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARFOR failures\n");
+#endif
+
+	struct timespec start, end;
+	PARFOR pf;
+
+	setup(&pf, 6, 3, 0, body_fail, "bd");
+	assert(parfor_run(&pf) == 3);
+	assert(pf.started == 6 && pf.failed == 2 && pf.cancelled == 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	setup(&pf, 30, 2, PARFOR_FAIL, body_fail, "a");
+	assert(parfor_run(&pf) == 3);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	assert(pf.failed == 1 && pf.cancelled > 20 && pf.started + pf.cancelled == 30);
+	assert(end.tv_sec - start.tv_sec < 2);
+}
+
+
+/* Function: test_bench
+   Uneven iterations: wall time against a static split, where the worker
+   given the slow ones finishes last
+*/
+void test_bench(int count, int jobs)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARFOR %d uneven iterations on %d workers\n", count, jobs);
+#endif
+
+	struct timespec start, end;
+	long wall, split;
+	PARFOR pf;
+
+	setup(&pf, count, jobs, 0, body_uneven, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert(parfor_run(&pf) == 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	wall = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+	split = ((count + jobs - 1) / jobs) * 40;
+	assert(pf.started == count && pf.steals > 0);
+
+#ifdef DEBUG_TEST
+	printf("TEST: PARFOR %ld ms with %d steals, %ld ms for the slow worker of a static split\n", wall, pf.steals, split);
+#endif
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: PARFOR Module\n");
+#endif
+
+	char dir[] = "/tmp/parfor_test.XXXXXX";
+	int i;
+
+	for (i = 0; i < 64; i++)
+	{
+		words[i] = "w";
+	}
+	assert(mkdtemp(dir) != NULL);
+	test_order(dir);
+	test_table();
+	test_fail();
+	test_bench(64, 4);
+	rmdir(dir);
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: PARFOR Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+#include "parsecache.h"
+#include "alias.h"
+#include "vars.h"
+
+
+/* Function: parsecache_hash (internal)
+   FNV-1a (64 bit) of line
+*/
+static unsigned long long parsecache_hash(const char *line)
+{
+	const unsigned char *p = (const unsigned char*) line;
+	unsigned long long h = 14695981039346656037ULL;
+
+	for (; *p != '\0'; p++)
+	{
+		h = (h ^ *p) * 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+
+/* Function: parsecache_elapsed (internal)
+   Nanoseconds since start
+*/
+static long parsecache_elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000000L + (now.tv_nsec - start->tv_nsec);
+}
+
+
+/* Function: parsecache_unlink (internal)
+   Take entry out of the LRU list
+*/
+static void parsecache_unlink(PARSECACHE *pc, PARSECACHE_ENTRY *entry)
+{
+	if (entry->prev != NULL)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		pc->head = entry->next;
+	}
+	if (entry->next != NULL)
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		pc->tail = entry->prev;
+	}
+	entry->prev = entry->next = NULL;
+}
+
+
+/* Function: parsecache_front (internal)
+   Put entry first in the LRU list
+*/
+static void parsecache_front(PARSECACHE *pc, PARSECACHE_ENTRY *entry)
+{
+	entry->next = pc->head;
+	if (pc->head != NULL)
+	{
+		pc->head->prev = entry;
+	}
+	pc->head = entry;
+	if (pc->tail == NULL)
+	{
+		pc->tail = entry;
+	}
+}
+
+
+/* Function: parsecache_drop (internal)
+   Remove entry from its bucket and the LRU list, deallocate it
+*/
+static void parsecache_drop(PARSECACHE *pc, PARSECACHE_ENTRY *entry)
+{
+	PARSECACHE_ENTRY **p = &pc->slots[entry->hash & (PARSECACHE_SLOTS - 1)];
+
+	while (*p != entry)
+	{
+		p = &(*p)->chain;
+	}
+	*p = entry->chain;
+	parsecache_unlink(pc, entry);
+	command_free(entry->cmd);
+	free(entry->line);
+	free(entry);
+	pc->count--;
+}
+
+
+/* Function: parsecache_check (internal)
+   Drop the entries made with other aliases, functions or $PATH
+*/
+static void parsecache_check(PARSECACHE *pc)
+{
+	const char *path = vars_get("PATH");
+
+	if (pc->generation == alias_generation()
+		&& ((path == NULL && pc->path == NULL) || (path != NULL && pc->path != NULL && strcmp(path, pc->path) == 0)))
+	{
+		return;
+	}
+	if (pc->count > 0)
+	{
+		parsecache_clear(pc);
+		pc->flushes++;
+	}
+	pc->generation = alias_generation();
+	free(pc->path);
+	pc->path = (path != NULL) ? strdup(path) : NULL;
+}
+
+
+/* Function: parsecache_init
+*/
+PARSECACHE *parsecache_init()
+{
+	PARSECACHE *pc = calloc(1, sizeof (PARSECACHE));
+
+	if (pc != NULL)
+	{
+		parsecache_check(pc);
+	}
+
+	return pc;
+}
+
+
+/* Function: parsecache_get
+   A hit becomes the most recently used entry
+*/
+COMMAND *parsecache_get(PARSECACHE *pc, const char *line)
+{
+	PARSECACHE_ENTRY *entry;
+	struct timespec start;
+	unsigned long long hash;
+	COMMAND *cmd;
+
+	if (pc == NULL)
+	{
+		return NULL;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	parsecache_check(pc);
+	hash = parsecache_hash(line);
+	for (entry = pc->slots[hash & (PARSECACHE_SLOTS - 1)]; entry != NULL; entry = entry->chain)
+	{
+		if (entry->hash == hash && strcmp(entry->line, line) == 0)
+		{
+			break;
+		}
+	}
+	if (entry == NULL || (cmd = command_copy(entry->cmd)) == NULL)
+	{
+		pc->misses++;
+		return NULL;
+	}
+	parsecache_unlink(pc, entry);
+	parsecache_front(pc, entry);
+	pc->hits++;
+	pc->saved += entry->cost - parsecache_elapsed(&start);
+
+	return cmd;
+}
+
+
+/* Function: parsecache_put
+   The least recently used entry makes room. An executable found through
+   a relative $PATH entry is left to be looked up when it runs
+*/
+int parsecache_put(PARSECACHE *pc, const char *line, const COMMAND *cmd, long cost)
+{
+	PARSECACHE_ENTRY *entry;
+	COMMAND *copy;
+
+	if (pc == NULL || cmd == NULL || strlen(line) > PARSECACHE_LINE || command_heredoc_pending((COMMAND*) cmd) != NULL)
+	{
+		return -1;
+	}
+	entry = calloc(1, sizeof (PARSECACHE_ENTRY));
+	if (entry == NULL || (entry->line = strdup(line)) == NULL || (entry->cmd = copy = command_copy(cmd)) == NULL)
+	{
+		if (entry != NULL)
+		{
+			free(entry->line);
+		}
+		free(entry);
+		return -1;
+	}
+	for (; copy != NULL; copy = copy->next)
+	{
+		if (copy->path != NULL && copy->path[0] != '/')
+		{
+			free(copy->path);
+			copy->path = NULL;
+		}
+	}
+	if (pc->count == PARSECACHE_SIZE)
+	{
+		parsecache_drop(pc, pc->tail);
+		pc->evictions++;
+	}
+	entry->hash = parsecache_hash(line);
+	entry->cost = cost;
+	entry->chain = pc->slots[entry->hash & (PARSECACHE_SLOTS - 1)];
+	pc->slots[entry->hash & (PARSECACHE_SLOTS - 1)] = entry;
+	parsecache_front(pc, entry);
+	pc->count++;
+
+	return 0;
+}
+
+
+/* Function: parsecache_clear
+*/
+void parsecache_clear(PARSECACHE *pc)
+{
+	while (pc != NULL && pc->head != NULL)
+	{
+		parsecache_drop(pc, pc->head);
+	}
+}
+
+
+/* Function: parsecache_print
+*/
+void parsecache_print(const PARSECACHE *pc)
+{
+	long lookups = pc->hits + pc->misses;
+
+	printf("entries    %d/%d\n", pc->count, PARSECACHE_SIZE);
+	printf("hits       %ld\n", pc->hits);
+	printf("misses     %ld\n", pc->misses);
+	printf("hit rate   %.1f%%\n", (lookups > 0) ? 100.0 * pc->hits / lookups : 0.0);
+	printf("evictions  %ld\n", pc->evictions);
+	printf("flushes    %ld\n", pc->flushes);
+	printf("saved      %.3f ms\n", pc->saved / 1e6);
+}
+
+
+/* Function: parsecache_free
+*/
+void parsecache_free(PARSECACHE *pc)
+{
+	if (pc == NULL)
+	{
+		return;
+	}
+	parsecache_clear(pc);
+	free(pc->path);
+	free(pc);
+}
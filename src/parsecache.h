@@ -0,0 +1,117 @@
+/*
+	PARSECACHE keeps the parse of the command lines run last, so a line
+	typed or read again (make, git status, a polling loop in a generated
+	file) is not tokenized again. The key is the raw line as read, its
+	FNV-1a hash looked up in a chained table and the line compared on a
+	match. An entry holds a template: the COMMAND list parsed from the
+	line with its aliases applied and the executable of each pipeline
+	looked up in $PATH. A hit hands out a copy of the template
+	(command_copy(): the word buffer copied and its pointers moved, no
+	parse, no $PATH search), which the caller runs and frees as usual, so
+	the template itself is never changed.
+
+	At most PARSECACHE_SIZE lines are kept, the least recently used one
+	goes first. Entries depend on the aliases (the text parsed) and on
+	$PATH (the executables): the whole cache is dropped when an alias or
+	a function changes (alias_generation()) or $PATH is not the value it
+	was. Lines with a here-document (its body comes from the next lines)
+	and lines longer than PARSECACHE_LINE are not kept.
+
+	Hits, misses and the parse time saved (the cost of the parse of the
+	line, measured when it was parsed, less the time of the copy) are
+	counted for the parsecache builtin.
+*/
+
+#ifndef _PARSECACHE_H_
+#define _PARSECACHE_H_
+
+#include "include.h"
+#include "parser.h"
+
+/* Lines kept */
+#define PARSECACHE_SIZE 256
+
+/* Buckets of the table, a power of two */
+#define PARSECACHE_SLOTS 512
+
+/* Longest line kept */
+#define PARSECACHE_LINE 4096
+
+
+/* Typedef: PARSECACHE_ENTRY
+   One line: hash, text, template, parse time in nanoseconds, the next
+   entry of its bucket and its neighbours in the LRU list (most recent
+   first)
+*/
+typedef struct parsecache_entry {
+	unsigned long long hash;
+	char *line;
+	COMMAND *cmd;
+	long cost;
+	struct parsecache_entry *chain;
+	struct parsecache_entry *prev;
+	struct parsecache_entry *next;
+} PARSECACHE_ENTRY;
+
+
+/* Typedef: PARSECACHE
+   Table, LRU list, the alias generation and $PATH the entries were
+   made with, counters
+*/
+typedef struct parsecache {
+	PARSECACHE_ENTRY *slots[PARSECACHE_SLOTS];
+	PARSECACHE_ENTRY *head;
+	PARSECACHE_ENTRY *tail;
+	int count;
+	unsigned int generation;
+	char *path;
+	long hits;
+	long misses;
+	long evictions;
+	long flushes;
+	long saved;
+} PARSECACHE;
+
+
+/* Function: parsecache_init
+   Returns an empty cache, NULL on allocation failure
+*/
+PARSECACHE *parsecache_init();
+
+
+/* Function: parsecache_get
+   Look line up, the cache is dropped first if aliases, functions or
+   $PATH changed
+   Returns a copy of its template to be freed with command_free(), NULL
+   if the line is not in the cache
+*/
+COMMAND *parsecache_get(PARSECACHE *pc, const char *line);
+
+
+/* Function: parsecache_put
+   Keep a copy of cmd, the parse of line that took cost nanoseconds
+   (aliases applied, executables looked up), as the template of line
+   Returns 0, -1 if the line is not kept
+*/
+int parsecache_put(PARSECACHE *pc, const char *line, const COMMAND *cmd, long cost);
+
+
+/* Function: parsecache_clear
+   Drop every entry, the counters are kept
+*/
+void parsecache_clear(PARSECACHE *pc);
+
+
+/* Function: parsecache_print
+   Print entries, hits, misses, hit rate, evictions, flushes and the
+   parse time saved
+*/
+void parsecache_print(const PARSECACHE *pc);
+
+
+/* Function: parsecache_free
+   Deallocate pc, it may be NULL
+*/
+void parsecache_free(PARSECACHE *pc);
+
+#endif /* _PARSECACHE_H_ */
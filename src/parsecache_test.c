@@ -0,0 +1,267 @@
+#include "parsecache.h"
+#include "alias.h"
+#include "vars.h"
+
+/* prototypes */
+void test_hit();
+void test_lru();
+void test_invalidate();
+void test_bench(int count);
+
+
+/* Function: parse (helper)
+   Parse line and look up its executables as the shell does
+*/
+COMMAND *parse(const char *line)
+{
+	COMMAND *cmd = command_parse(line), *k;
+
+	for (k = cmd; k != NULL; k = k->next)
+	{
+		command_resolve(k);
+		while (k->pipe == TRUE && k->next != NULL)
+		{
+			k = k->next;
+		}
+	}
+
+	return cmd;
+}
+
+
+/* Function: keep (helper)
+   Parse line into pc
+*/
+void keep(PARSECACHE *pc, const char *line)
+{
+	COMMAND *cmd = parse(line);
+
+	assert(parsecache_put(pc, line, cmd, 1000) == 0);
+	command_free(cmd);
+}
+
+
+/* Function: test_hit
+   A hit is a copy of the parse, which the caller owns
+*/
+void test_hit()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARSECACHE hits\n");
+#endif
+
+	PARSECACHE *pc = parsecache_init();
+	const char *line = "sh -c true < in | cat > out && diff <(ls) x\n";
+	char long_line[PARSECACHE_LINE + 2];
+	COMMAND *cmd;
+
+	assert(parsecache_get(pc, line) == NULL);
+	assert(pc->misses == 1 && pc->hits == 0);
+	keep(pc, line);
+	assert(pc->count == 1);
+
+	cmd = parsecache_get(pc, line);
+	assert(cmd != NULL && pc->hits == 1);
+	assert(cmd != pc->head->cmd && cmd->buffer != pc->head->cmd->buffer);
+	assert(strcmp(cmd->argv[0], "sh") == 0 && strcmp(cmd->argv[2], "true") == 0 && cmd->argv[3] == NULL);
+	assert(strcmp(cmd->infile, "in") == 0 && cmd->pipe == TRUE);
+	assert(cmd->path != NULL && cmd->path != pc->head->cmd->path && strcmp(strrchr(cmd->path, '/'), "/sh") == 0);
+	assert(strcmp(cmd->next->argv[0], "cat") == 0 && strcmp(cmd->next->outfile, "out") == 0);
+	assert(cmd->next->connect == COMMAND_AND);
+	assert(cmd->next->next->argv[1] == cmd->next->next->procsub->path);
+	assert(strcmp(cmd->next->next->procsub->cmdline, "ls") == 0);
+
+	// the copy is the caller's, the template stays as it was
+	cmd->argv[0][0] = 'X';
+	command_free(cmd);
+	cmd = parsecache_get(pc, line);
+	assert(strcmp(cmd->argv[0], "sh") == 0);
+	command_free(cmd);
+
+	// other lines, a prefix of it among them, are misses
+	assert(parsecache_get(pc, "sh -c\n") == NULL);
+	assert(parsecache_get(pc, "sh -c true < in | cat > out && diff <(ls) x") == NULL);
+	assert(pc->hits == 2 && pc->misses == 3);
+
+	// here-documents wait for their body, long lines are not kept
+	cmd = parse("cat <<END\n");
+	assert(parsecache_put(pc, "cat <<END\n", cmd, 1000) == -1);
+	command_free(cmd);
+	memset(long_line, 'x', sizeof long_line - 1);
+	long_line[sizeof long_line - 1] = '\0';
+	cmd = parse(long_line);
+	assert(parsecache_put(pc, long_line, cmd, 1000) == -1);
+	command_free(cmd);
+	cmd = parse("cat <<< word\n");
+	assert(parsecache_put(pc, "cat <<< word\n", cmd, 1000) == 0);
+	command_free(cmd);
+	cmd = parsecache_get(pc, "cat <<< word\n");
+	assert(cmd != NULL && strcmp(cmd->heredoc, "word\n") == 0);
+	command_free(cmd);
+
+#ifdef DEBUG_TEST
+	parsecache_print(pc);
+#endif
+	parsecache_free(pc);
+	parsecache_free(NULL);
+	assert(parsecache_get(NULL, line) == NULL);
+}
+
+
+/* Function: test_lru
+   The least recently used line goes first
+*/
+void test_lru()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARSECACHE LRU\n");
+#endif
+
+	PARSECACHE *pc = parsecache_init();
+	char line[64];
+	COMMAND *cmd;
+	int i;
+
+	for (i = 0; i < PARSECACHE_SIZE; i++)
+	{
+		snprintf(line, sizeof line, "echo %d\n", i);
+		keep(pc, line);
+	}
+	assert(pc->count == PARSECACHE_SIZE && pc->evictions == 0);
+
+	// echo 0 is used again, echo 1 is the oldest now
+	cmd = parsecache_get(pc, "echo 0\n");
+	assert(cmd != NULL);
+	command_free(cmd);
+	keep(pc, "echo new\n");
+	assert(pc->count == PARSECACHE_SIZE && pc->evictions == 1);
+	assert(parsecache_get(pc, "echo 1\n") == NULL);
+	cmd = parsecache_get(pc, "echo 0\n");
+	assert(cmd != NULL && strcmp(cmd->argv[1], "0") == 0);
+	command_free(cmd);
+	cmd = parsecache_get(pc, "echo 2\n");
+	assert(cmd != NULL && strcmp(cmd->argv[1], "2") == 0);
+	command_free(cmd);
+
+	parsecache_clear(pc);
+	assert(pc->count == 0 && pc->head == NULL && pc->tail == NULL);
+	assert(parsecache_get(pc, "echo 2\n") == NULL);
+	parsecache_free(pc);
+}
+
+
+/* Function: test_invalidate
+   Aliases, functions and $PATH drop the cache
+*/
+void test_invalidate()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARSECACHE invalidation\n");
+#endif
+
+	PARSECACHE *pc = parsecache_init();
+	char *path = strdup(vars_get("PATH"));
+	COMMAND *cmd;
+
+	keep(pc, "ls\n");
+	assert(alias_set("ls", "ls -F") == 0);
+	assert(parsecache_get(pc, "ls\n") == NULL);
+	assert(pc->count == 0 && pc->flushes == 1);
+
+	keep(pc, "ls\n");
+	assert(alias_define_source("fn", "echo fn") == 0);
+	assert(parsecache_get(pc, "ls\n") == NULL && pc->flushes == 2);
+
+	keep(pc, "ls\n");
+	cmd = parsecache_get(pc, "ls\n");
+	assert(cmd != NULL);
+	command_free(cmd);
+	assert(vars_set("PATH", "/bin", FALSE) == 0);
+	assert(parsecache_get(pc, "ls\n") == NULL && pc->flushes == 3);
+
+	// nothing changed: no flush
+	keep(pc, "ls\n");
+	assert(vars_set("PATH", "/bin", FALSE) == 0);
+	cmd = parsecache_get(pc, "ls\n");
+	assert(cmd != NULL && pc->flushes == 3);
+	command_free(cmd);
+
+	// an executable found through a relative entry is looked up when it runs
+	assert(vars_set("PATH", ".:/bin", FALSE) == 0);
+	assert(parsecache_get(pc, "sh\n") == NULL);
+	keep(pc, "sh\n");
+	cmd = parsecache_get(pc, "sh\n");
+	assert(cmd != NULL && cmd->path != NULL && cmd->path[0] == '/');
+	command_free(cmd);
+
+	vars_set("PATH", path, FALSE);
+	alias_unset("ls");
+	alias_unset_function("fn");
+	free(path);
+	parsecache_free(pc);
+}
+
+
+/* Function: test_bench
+   Parse and look up a typical line count times, against count hits
+*/
+void test_bench(int count)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: PARSECACHE %d parses against %d hits\n", count, count);
+#endif
+
+	const char *line = "git log --oneline -n 20 --format='%h %s' | grep -v fixup > /tmp/log && wc -l /tmp/log\n";
+	struct timespec start, end;
+	long parsed, hit;
+	PARSECACHE *pc = parsecache_init();
+	COMMAND *cmd;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++)
+	{
+		cmd = parse(line);
+		command_free(cmd);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	parsed = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+
+	keep(pc, line);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++)
+	{
+		cmd = parsecache_get(pc, line);
+		assert(cmd != NULL);
+		command_free(cmd);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	hit = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	assert(pc->hits == count);
+
+#ifdef DEBUG_TEST
+	printf("TEST: PARSECACHE parse %ld ns, hit %ld ns per line\n", parsed / count, hit / count);
+#endif
+	parsecache_free(pc);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: PARSECACHE Module\n");
+#endif
+
+	vars_init(environ);
+	test_hit();
+	test_lru();
+	test_invalidate();
+	test_bench(10000);
+	alias_free();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: PARSECACHE Module\n");
+#endif
+
+	return 0;
+}
@@ -1,6 +1,152 @@
 #include "parser.h"
 
 
+/* Function: procsub_append (internal)
+   Copy the inner command of a process substitution and append it to
+   the command's substitution list
+*/
+static void procsub_append(COMMAND *cmd, short mode, const char *line, int len)
+{
+	PROCSUB *ps, **tail = &cmd->procsub;
+	ps = (PROCSUB*) malloc(sizeof (PROCSUB));
+	if (ps == NULL)
+	{
+#ifdef WARNING
+	printf("ERROR: Could not allocate %d bytes for process substitution\n", (int) sizeof (PROCSUB));
+#endif
+		return;
+	}
+	ps->cmdline = malloc(len + 2);
+	memset(ps->cmdline, '\0', len + 2);
+	strncpy(ps->cmdline, line, len);
+	ps->mode = mode;
+	ps->fd[0] = ps->fd[1] = -1;
+	ps->path[0] = '\0';
+	ps->next = NULL;
+
+	while (*tail != NULL)
+	{
+		tail = &(*tail)->next;
+	}
+	*tail = ps;
+}
+
+
+/* Function: parse_word (internal)
+   Copy one word starting at buffer[i] into out, removing '...' and "..." quotes
+   Word ends at unquoted whitespace, an operator or the end of line
+   Returns index following the word
+*/
+static int parse_word(const char *buffer, int i, char *out)
+{
+	char quote = '\0';
+
+	while (buffer[i] == ' ' || buffer[i] == '\t')
+	{
+		i++;
+	}
+	for (; buffer[i] != '\0'; i++)
+	{
+		if (quote != '\0')
+		{
+			if (buffer[i] == quote)
+			{
+				quote = '\0';
+			}
+			else
+			{
+				*out++ = buffer[i];
+			}
+		}
+		else if (buffer[i] == '\'' || buffer[i] == '"')
+		{
+			quote = buffer[i];
+		}
+		else if (isspace(buffer[i]) || strchr(";&|<>", buffer[i]) != NULL)
+		{
+			break;
+		}
+		else
+		{
+			*out++ = buffer[i];
+		}
+	}
+	*out = '\0';
+
+	return i;
+}
+
+
+/* Function: parse_cmdsub (internal)
+   Copy the command substitution $(cmd) starting at buffer[i] to out as it
+   is, quotes included, *j is moved past it
+   Returns index following the substitution
+*/
+static int parse_cmdsub(const char *buffer, int i, char *out, int *j)
+{
+	int depth = 0;
+	char quote = '\0';
+
+	out[(*j)++] = buffer[i++];
+	do
+	{
+		if (quote != '\0')
+		{
+			quote = (buffer[i] == quote) ? '\0' : quote;
+		}
+		else if (buffer[i] == '\'' || buffer[i] == '"')
+		{
+			quote = buffer[i];
+		}
+		else if (buffer[i] == '(')
+		{
+			depth++;
+		}
+		else if (buffer[i] == ')')
+		{
+			depth--;
+		}
+		out[(*j)++] = buffer[i++];
+	} while (buffer[i] != '\0' && depth > 0);
+
+	return i;
+}
+
+
+/* Function: parse_group (internal)
+   Find the ')' closing the '(' before buffer[i], parentheses in quotes
+   are skipped as the length scan of command_parse() does
+   Returns its index, the index of the '\0' if it is not closed
+*/
+static int parse_group(const char *buffer, int i)
+{
+	int depth = 1;
+	char quote = '\0';
+
+	for (; buffer[i] != '\0'; i++)
+	{
+		if (quote != '\0')
+		{
+			quote = (buffer[i] == quote) ? '\0' : quote;
+		}
+		else if (buffer[i] == '\'' || buffer[i] == '"')
+		{
+			quote = buffer[i];
+		}
+		else if (buffer[i] == '(')
+		{
+			depth++;
+		}
+		else if (buffer[i] == ')' && --depth == 0)
+		{
+			break;
+		}
+	}
+
+	return i;
+}
+
+
 /* Function: command_print
    Recursive print function for command struct
 */
@@ -16,11 +162,20 @@ void command_print(const COMMAND *cmd)
 	{
 		printf("  >[%s]\n", cmd->outfile);
 	}
+	PROCSUB *ps;
+	for (ps = cmd->procsub; ps != NULL; ps = ps->next)
+	{
+		printf("  %c(%s)\n", ps->mode == PROCSUB_IN ? '<' : '>', ps->cmdline);
+	}
 	int i;
 	for (i = 0; i < cmd->token; i++)
 	{
 		printf("  [%d]: %s\n", i, cmd->argv[i]);
 	}
+	if (cmd->heredoc != NULL)
+	{
+		printf("  <<[%s]\n", cmd->heredoc);
+	}
 	printf("}\n");
 	if (cmd->next != NULL)
 	{
@@ -43,6 +198,10 @@ void command_free(COMMAND *cmd)
 	{
 		free(cmd->buffer);
 	}
+	if (cmd->path != NULL)
+	{
+		free(cmd->path);
+	}
 	if (cmd->argv != NULL)
 	{
 		free(cmd->argv);
@@ -51,6 +210,21 @@ void command_free(COMMAND *cmd)
 	{
 		free(cmd->cmdline);
 	}
+	if (cmd->heredoc != NULL)
+	{
+		free(cmd->heredoc);
+	}
+	if (cmd->heredoc_tag != NULL)
+	{
+		free(cmd->heredoc_tag);
+	}
+	while (cmd->procsub != NULL)
+	{
+		PROCSUB *ps = cmd->procsub;
+		cmd->procsub = ps->next;
+		free(ps->cmdline);
+		free(ps);
+	}
 	if (cmd != NULL)
 	{
 		free(cmd);
@@ -61,6 +235,110 @@ void command_free(COMMAND *cmd)
 }
 
 
+/* Function: command_word (internal)
+   Where the word p of from is in to: the same offset in the buffer, or
+   the path of the same process substitution
+*/
+static char *command_word(const COMMAND *from, COMMAND *to, const char *p, size_t size)
+{
+	const PROCSUB *ps;
+	PROCSUB *copy;
+
+	if (p == NULL)
+	{
+		return NULL;
+	}
+	if (p >= from->buffer && p < from->buffer + size)
+	{
+		return to->buffer + (p - from->buffer);
+	}
+	for (ps = from->procsub, copy = to->procsub; ps != NULL && copy != NULL; ps = ps->next, copy = copy->next)
+	{
+		if (p == ps->path)
+		{
+			return copy->path;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Function: command_copy
+   The buffer is copied whole and the words pointed at the copy, nothing
+   is parsed again. A process substitution gets its path back empty
+*/
+COMMAND* command_copy(const COMMAND *cmd)
+{
+	COMMAND *copy;
+	const PROCSUB *ps;
+	PROCSUB **tail;
+	size_t size;
+	int i;
+
+	if (cmd == NULL || (copy = calloc(1, sizeof (COMMAND))) == NULL)
+	{
+		return NULL;
+	}
+	*copy = *cmd;
+	copy->argv = NULL;
+	copy->path = NULL;
+	copy->buffer = NULL;
+	copy->cmdline = NULL;
+	copy->procsub = NULL;
+	copy->heredoc = NULL;
+	copy->heredoc_tag = NULL;
+	copy->next = NULL;
+
+	// command_parse() allocates twice the command line for the words
+	size = 2 * strlen(cmd->cmdline) + 2;
+	copy->buffer = malloc(size);
+	copy->cmdline = strdup(cmd->cmdline);
+	copy->argv = calloc(sizeof (char*), cmd->token);
+	if (copy->buffer == NULL || copy->cmdline == NULL || copy->argv == NULL)
+	{
+		command_free(copy);
+		return NULL;
+	}
+	memcpy(copy->buffer, cmd->buffer, size);
+	for (ps = cmd->procsub, tail = &copy->procsub; ps != NULL; ps = ps->next, tail = &(*tail)->next)
+	{
+		*tail = malloc(sizeof (PROCSUB));
+		if (*tail == NULL || ((*tail)->cmdline = strdup(ps->cmdline)) == NULL)
+		{
+			free(*tail);
+			*tail = NULL;
+			command_free(copy);
+			return NULL;
+		}
+		(*tail)->mode = ps->mode;
+		(*tail)->fd[0] = (*tail)->fd[1] = -1;
+		(*tail)->path[0] = '\0';
+		(*tail)->next = NULL;
+	}
+	for (i = 0; i < cmd->token && cmd->argv[i] != NULL; i++)
+	{
+		copy->argv[i] = command_word(cmd, copy, cmd->argv[i], size);
+	}
+	copy->infile = command_word(cmd, copy, cmd->infile, size);
+	copy->outfile = command_word(cmd, copy, cmd->outfile, size);
+	if ((cmd->path != NULL && (copy->path = strdup(cmd->path)) == NULL)
+		|| (cmd->heredoc != NULL && (copy->heredoc = malloc(cmd->heredoc_len + 1)) == NULL)
+		|| (cmd->heredoc_tag != NULL && (copy->heredoc_tag = strdup(cmd->heredoc_tag)) == NULL)
+		|| (cmd->next != NULL && (copy->next = command_copy(cmd->next)) == NULL))
+	{
+		command_free(copy);
+		return NULL;
+	}
+	if (cmd->heredoc != NULL)
+	{
+		memcpy(copy->heredoc, cmd->heredoc, cmd->heredoc_len + 1);
+	}
+
+	return copy;
+}
+
+
 /* Function: command_parse
    Main command parser (recusive)
    Returns the first command in the list
@@ -71,15 +349,44 @@ COMMAND* command_parse(const char *buffer)
 	int finished = TRUE;
 
 	// removes leading space
-	while (i < strlen(buffer) && isspace(buffer[i]))
+	while (buffer[i] != '\0' && isspace(buffer[i]))
 	{
 		i++;
 	}
 
 	// find command length, support command separators: ';' and '|'
-	for (; i < strlen(buffer); i++)
+	// separators inside quotes or a process substitution are not command
+	// breaks, the main loop below skips the same ones
+	int depth = 0;
+	char quote = '\0';
+	for (; buffer[i] != '\0'; i++)
 	{
-		if ((buffer[i] == ';' || buffer[i] == '\n') && buffer[i-1] != '\\')
+		if (quote != '\0')
+		{
+			if (buffer[i] == quote)
+			{
+				quote = '\0';
+			}
+			continue;
+		}
+		if (buffer[i] == '\'' || buffer[i] == '"')
+		{
+			quote = buffer[i];
+		}
+		else if (buffer[i] == '(')
+		{
+			depth++;
+		}
+		else if (buffer[i] == ')' && depth > 0)
+		{
+			depth--;
+		}
+		if (depth == 0 && (buffer[i] == ';' || buffer[i] == '\n') && buffer[i-1] != '\\')
+		{
+			break;
+		}
+		// && and || end the pipeline too, each one is a job of its own
+		if (depth == 0 && (buffer[i] == '&' || buffer[i] == '|') && buffer[i+1] == buffer[i])
 		{
 			break;
 		}
@@ -103,14 +410,21 @@ COMMAND* command_parse(const char *buffer)
 		goto parser_exit;
 	}
 
-	cmd->buffer = malloc(2 * buf_len);
-	memset(cmd->buffer, '\0', 2 * buf_len);
+	cmd->buffer = malloc(2 * buf_len + 2);
+	memset(cmd->buffer, '\0', 2 * buf_len + 2);
 	cmd->background = FALSE;
 	cmd->pipe = FALSE;
+	cmd->path = NULL;
 	cmd->next = NULL;
 	cmd->infile = NULL;
 	cmd->outfile = NULL;
 	cmd->fdmode = O_RDONLY;
+	cmd->connect = COMMAND_SEQ;
+	cmd->procsub = NULL;
+	cmd->heredoc = NULL;
+	cmd->heredoc_len = 0;
+	cmd->heredoc_tag = NULL;
+	cmd->heredoc_strip = FALSE;
 
 	cmd->cmdline = malloc(buf_len + 2);
 	memset(cmd->cmdline, '\0', buf_len + 2);
@@ -145,7 +459,7 @@ COMMAND* command_parse(const char *buffer)
 	i = 0;
 
 	// removes leading space
-	while (i < strlen(buffer) && isspace(buffer[i]))
+	while (buffer[i] != '\0' && isspace(buffer[i]))
 	{
 		i++;
 	}
@@ -174,19 +488,28 @@ COMMAND* command_parse(const char *buffer)
 		}
 
 		// remove consecutive whitespace
-		while(isspace(buffer[i]))
+		while(isspace(buffer[i]) && buffer[i] != '\n')
 		{
 			i++;
 		}
 
-		// new command
-		if (buffer[i] == ';')
+		// new command, a newline ends it as the length scan above does
+		if (buffer[i] == ';' || buffer[i] == '\n')
 		{
 			finished = FALSE;
 			i++; count++;
 			goto parser_finalize;
 		}
 
+		// conditional list, end current pipeline
+		if ((buffer[i] == '&' || buffer[i] == '|') && buffer[i+1] == buffer[i])
+		{
+			cmd->connect = (buffer[i] == '&') ? COMMAND_AND : COMMAND_OR;
+			finished = FALSE;
+			i += 2; count++;
+			goto parser_finalize;
+		}
+
 		// set background task, end current command
 		if (buffer[i] == '&')
 		{
@@ -209,6 +532,60 @@ COMMAND* command_parse(const char *buffer)
 			goto parser_finalize;
 		}
 
+		// process substitution, <(cmd) or >(cmd) becomes a single argument
+		if ((buffer[i] == '<' || buffer[i] == '>') && buffer[i+1] == '(')
+		{
+			short mode = (buffer[i] == '<') ? PROCSUB_IN : PROCSUB_OUT;
+			int start = i + 2;
+			i = parse_group(buffer, start);
+			procsub_append(cmd, mode, &buffer[start], i - start);
+			if (buffer[i] == ')')
+			{
+				i++;
+			}
+			if (j > 0 && cmd->buffer[j-1] != '\0')
+			{
+				cmd->buffer[j++] = '\0';
+				count++;
+			}
+			cmd->buffer[j++] = PROCSUB_MARK;
+			if (buffer[i] != '\0' && !isspace(buffer[i]) && strchr(";&|<>", buffer[i]) == NULL)
+			{
+				cmd->buffer[j++] = '\0';
+				count++;
+			}
+			continue;
+		}
+
+		// here-string <<< word and here-document <<TAG, <<-TAG
+		if (buffer[i] == '<' && buffer[i+1] == '<')
+		{
+			char *word = malloc(strlen(&buffer[i]) + 2);
+			if (buffer[i+2] == '<')
+			{
+				i = parse_word(buffer, i + 3, word);
+				free(cmd->heredoc);
+				cmd->heredoc_len = strlen(word) + 1;
+				cmd->heredoc = word;
+				strcat(cmd->heredoc, "\n");
+			}
+			else
+			{
+				cmd->heredoc_strip = (buffer[i+2] == '-');
+				i = parse_word(buffer, i + (cmd->heredoc_strip ? 3 : 2), word);
+				free(cmd->heredoc);
+				free(cmd->heredoc_tag);
+				cmd->heredoc = calloc(1, 1);
+				cmd->heredoc_len = 0;
+				cmd->heredoc_tag = word;
+			}
+			if (j > 0 && cmd->buffer[j-1] != '\0')
+			{
+				cmd->buffer[j++] = '\0';
+			}
+			continue;
+		}
+
 		// set input redirect
 		if (buffer[i] == '<' || buffer[i] == '>')
 		{
@@ -238,10 +615,52 @@ COMMAND* command_parse(const char *buffer)
 			continue;
 		}
 
+		// command substitution, $(cmd) stays in the word as it is
+		if (buffer[i] == '$' && buffer[i+1] == '(')
+		{
+			i = parse_cmdsub(buffer, i, cmd->buffer, &j);
+			continue;
+		}
+
+		// quoted text belongs to the word, blanks and operators included,
+		// and the quotes are removed. A '$' in single quotes is marked so
+		// it is not expanded, a pattern character so it is not a pattern,
+		// a substitution in double quotes so it is not split
+		if (buffer[i] == '\'' || buffer[i] == '"')
+		{
+			quote = buffer[i++];
+			while (buffer[i] != '\0' && buffer[i] != quote)
+			{
+				if (quote == '"' && buffer[i] == '$' && buffer[i+1] == '(')
+				{
+					int start = j;
+					i = parse_cmdsub(buffer, i, cmd->buffer, &j);
+					cmd->buffer[start] = SUBST_MARK;
+					continue;
+				}
+				if (strchr("*?[{", buffer[i]) != NULL)
+				{
+					cmd->buffer[j++] = GLOB_MARK;
+				}
+				cmd->buffer[j++] = (quote == '\'' && buffer[i] == '$') ? DOLLAR_MARK : buffer[i];
+				i++;
+			}
+			if (buffer[i] == quote)
+			{
+				i++;
+			}
+			continue;
+		}
+
 		cmd->buffer[j] = buffer[i];
 
 		if (buffer[i] == '\0')
 		{
+			// count last token when the line has no trailing newline
+			if (j > 0 && cmd->buffer[j-1] != '\0')
+			{
+				count++;
+			}
 			break;
 		}
 
@@ -251,31 +670,57 @@ COMMAND* command_parse(const char *buffer)
 // created pointers to parsed tokens
 parser_finalize:
 	cmd->buffer[j] = '\0';
+
+	// count non-empty tokens for argv
+	int k = 0, len = 0, end = j;
+	for (j = count = 0; j < end; j += len + 1)
+	{
+		if ((len = strlen(&cmd->buffer[j])) > 0)
+		{
+			count++;
+		}
+	}
 	cmd->token = count + 1;
 	cmd->argv = calloc(sizeof(char*), cmd->token);
 
-	int k = 0, h = 0, len = 0;
-	for (j = k = h = 0; h < count; h++)
+	// created pointers to parsed tokens, a redirect takes the next token
+	PROCSUB *ps = cmd->procsub;
+	char **target = NULL, *word, *mark;
+	for (j = 0; j < end; j += len + 1)
 	{
-		if ((len=strlen(&cmd->buffer[j])) > 0)
+		if ((len = strlen(&cmd->buffer[j])) == 0)
 		{
-			// support IO redirect
-			if (cmd->buffer[j] == '<')
-			{
-				cmd->infile = &cmd->buffer[j+2];
-				j += strlen(&cmd->buffer[j+2]) + 3;
-				continue;
-			}
-			if (cmd->buffer[j] == '>')
+			continue;
+		}
+		word = &cmd->buffer[j];
+
+		// process substitution, argument is the /dev/fd path
+		if (*word == PROCSUB_MARK && ps != NULL)
+		{
+			word = ps->path;
+			ps = ps->next;
+		}
+		// support IO redirect
+		else if (target == NULL && len == 1 && (*word == '<' || *word == '>'))
+		{
+			target = (*word == '<') ? &cmd->infile : &cmd->outfile;
+			continue;
+		}
+
+		if (target != NULL)
+		{
+			// a file name is not a pattern, nor split: its substitution
+			// is kept as typed
+			command_unmark(word);
+			for (mark = strchr(word, SUBST_MARK); mark != NULL; mark = strchr(mark, SUBST_MARK))
 			{
-				cmd->outfile = &cmd->buffer[j+2];
-				j += strlen(&cmd->buffer[j+2]) + 3;
-				continue;
+				*mark = '$';
 			}
-
-			cmd->argv[k++] = &cmd->buffer[j];
-			j += len+1;
+			*target = word;
+			target = NULL;
+			continue;
 		}
+		cmd->argv[k++] = word;
 	}
 
 	// There are more command, begin recursive parse
@@ -285,8 +730,9 @@ parser_finalize:
 	printf("PARSER: Begin parsing next command\n");
 #endif
 		cmd->next = (struct command*) command_parse(&buffer[i]);
-		// Set background if next command goes to background
-		if (cmd->next->background == TRUE)
+		// Set background if next command goes to background, a conditional
+		// list runs its pipelines one after the other
+		if (cmd->next->background == TRUE && cmd->connect == COMMAND_SEQ)
 		{
 			cmd->background = TRUE;
 		}
@@ -308,3 +754,144 @@ parser_finalize:
 parser_exit:
 	return cmd;
 }
+
+
+/* Function: command_next
+   Skip whole pipelines while the connector does not match the status
+*/
+COMMAND* command_next(const COMMAND *cmd, int status)
+{
+	COMMAND *next = cmd->next;
+	int connect = cmd->connect;
+
+	while (next != NULL && ((connect == COMMAND_AND && status != 0) || (connect == COMMAND_OR && status == 0)))
+	{
+		while (next->pipe == TRUE && next->next != NULL)
+		{
+			next = next->next;
+		}
+		connect = next->connect;
+		next = next->next;
+	}
+
+	return next;
+}
+
+
+/* Function: command_unmark
+   The word is copied over itself without the marks
+*/
+void command_unmark(char *word)
+{
+	char *out = word;
+
+	for (; *word != '\0'; word++)
+	{
+		if (*word != GLOB_MARK)
+		{
+			*out++ = *word;
+		}
+	}
+	*out = '\0';
+}
+
+
+/* Function: command_resolve
+   First executable file named argv[0] in the $PATH directories
+*/
+void command_resolve(COMMAND *cmd)
+{
+	const char *dir, *end, *env = getenv("PATH");
+	char path[PATH_MAX];
+	int len;
+
+	for (; cmd != NULL; cmd = cmd->next)
+	{
+		if (cmd->path == NULL && cmd->argv[0] != NULL && strchr(cmd->argv[0], '/') == NULL && env != NULL)
+		{
+			for (dir = env; cmd->path == NULL && *dir != '\0'; dir = (*end == ':') ? end + 1 : end)
+			{
+				end = strchrnul(dir, ':');
+				// an empty entry is the current directory
+				if (end == dir)
+				{
+					len = snprintf(path, PATH_MAX, "./%s", cmd->argv[0]);
+				}
+				else
+				{
+					len = snprintf(path, PATH_MAX, "%.*s/%s", (int) (end - dir), dir, cmd->argv[0]);
+				}
+				if (len < PATH_MAX && access(path, X_OK) == 0)
+				{
+					cmd->path = strdup(path);
+				}
+			}
+		}
+		if (cmd->pipe == FALSE)
+		{
+			break;
+		}
+	}
+}
+
+
+/* Function: command_heredoc_pending
+   Find the first command with an unterminated here-document
+*/
+COMMAND* command_heredoc_pending(COMMAND *cmd)
+{
+	for (; cmd != NULL; cmd = cmd->next)
+	{
+		if (cmd->heredoc_tag != NULL)
+		{
+			return cmd;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Function: command_heredoc_line
+   Add a line to the here-document body, stop at the delimiter
+*/
+int command_heredoc_line(COMMAND *cmd, const char *line)
+{
+	int len;
+
+	if (cmd->heredoc_strip == TRUE)
+	{
+		while (*line == '\t')
+		{
+			line++;
+		}
+	}
+
+	len = strlen(line);
+	if (len > 0 && line[len-1] == '\n')
+	{
+		len--;
+	}
+	if (len == strlen(cmd->heredoc_tag) && strncmp(line, cmd->heredoc_tag, len) == 0)
+	{
+		free(cmd->heredoc_tag);
+		cmd->heredoc_tag = NULL;
+		return TRUE;
+	}
+
+	char *body = realloc(cmd->heredoc, cmd->heredoc_len + len + 2);
+	if (body == NULL)
+	{
+#ifdef WARNING
+	printf("ERROR: Could not allocate %d bytes for here-document\n", cmd->heredoc_len + len + 2);
+#endif
+		return FALSE;
+	}
+	memcpy(&body[cmd->heredoc_len], line, len);
+	cmd->heredoc_len += len;
+	body[cmd->heredoc_len++] = '\n';
+	body[cmd->heredoc_len] = '\0';
+	cmd->heredoc = body;
+
+	return FALSE;
+}
@@ -4,22 +4,73 @@
 #include "include.h"
 
 
+/* Process substitution direction */
+#define PROCSUB_IN	1
+#define PROCSUB_OUT	2
+
+/* Size of the /dev/fd/N path handed to the command */
+#define PROCSUB_PATH 24
+
+/* Marker token placed in the parse buffer for each substitution */
+#define PROCSUB_MARK '\001'
+
+/* Stands for a '$' in single quotes, expansion turns it back into '$' */
+#define DOLLAR_MARK '\002'
+
+/* Precedes a quoted '*', '?', '[' or '{': it is no pattern character,
+   wildcard_expand() drops the mark */
+#define GLOB_MARK '\003'
+
+/* Stands for the '$' of a $(cmd) in double quotes: its output is neither
+   split nor a pattern */
+#define SUBST_MARK '\004'
+
+/* Connector to the next pipeline: ';' or '&', "&&", "||" */
+#define COMMAND_SEQ	0
+#define COMMAND_AND	1
+#define COMMAND_OR	2
+
+
+/* Typedef: PROCSUB
+   Process substitution <(cmd) or >(cmd) attached to a command
+   cmdline is the inner command text, path is filled in by the launcher
+   with /dev/fd/N once the pipe is created
+*/
+typedef struct procsub
+{
+	char *cmdline;
+	short mode;
+	int fd[2];
+	char path[PROCSUB_PATH];
+	struct procsub *next;
+} PROCSUB;
+
+
 /* Typedef: COMMAND
    Basic struct for storing command
    buffer is dynamically allocated
    argv is an array of pointers
+   connect is set on the last command of a pipeline followed by && or ||
+   path is the executable found for argv[0] by command_resolve(), or NULL
 */
 typedef struct command
 {
 	char **argv;
+	char *path;
 	char *buffer;
 	char *cmdline;
 	char *infile;
 	char *outfile;
-	short token;
+	int token;
 	short background;
 	short pipe;
 	short fdmode;
+	short connect;
+	PROCSUB *procsub;
+	char *heredoc;
+	int heredoc_len;
+	char *heredoc_tag;
+	short heredoc_strip;
 	struct command *next;
 } COMMAND;
 
@@ -38,10 +89,56 @@ void command_print(const COMMAND *cmd);
 void command_free(COMMAND *cmd);
 
 
+/* Function: command_copy
+   Copy the COMMAND list starting at cmd, the executables looked up
+   included, without parsing it again
+   Returns the copy, NULL on allocation failure
+*/
+COMMAND* command_copy(const COMMAND *cmd);
+
+
 /* Function: command_parse
    Parse buffer to create one or more COMMAND
    Returns the first command to be executed
 */
 COMMAND* command_parse(const char *buffer);
 
+
+/* Function: command_next
+   Next command to run after the pipeline ending with cmd exited with
+   status: pipelines after && are skipped on failure, after || on success
+   Returns NULL at the end of the list
+   Precondition: cmd is the last command of a pipeline
+*/
+COMMAND* command_next(const COMMAND *cmd, int status);
+
+
+/* Function: command_unmark
+   Remove the GLOB_MARKs of word in place
+*/
+void command_unmark(char *word);
+
+
+/* Function: command_resolve
+   Look up argv[0] of each command of the pipeline starting at cmd in $PATH
+   once and keep the result in cmd->path, so running the same COMMAND
+   again does not search $PATH. Commands not found keep path NULL
+*/
+void command_resolve(COMMAND *cmd);
+
+
+/* Function: command_heredoc_pending
+   Returns the first command still waiting for here-document lines, NULL if none
+   Precondition: cmd is a valid pointer to COMMAND returned by parse_command()
+*/
+COMMAND* command_heredoc_pending(COMMAND *cmd);
+
+
+/* Function: command_heredoc_line
+   Append one input line to the pending here-document of cmd
+   Returns TRUE when line is the delimiter and the here-document is complete
+   Precondition: cmd->heredoc_tag is not NULL
+*/
+int command_heredoc_line(COMMAND *cmd, const char *line);
+
 #endif /* _PARSER_H_ */
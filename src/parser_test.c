@@ -5,6 +5,13 @@
 void test_standard();
 void test_redirect();
 void test_pipe();
+void test_conditional();
+void test_quote();
+void test_resolve();
+void test_procsub();
+void test_heredoc();
+void test_copy();
+void test_long(int words);
 void direct_input();
 
 
@@ -129,6 +136,277 @@ void test_pipe()
 }
 
 
+/* Function: test_conditional
+   Test && and || lists and skipping of pipelines
+*/
+void test_conditional()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: Checking && and ||\n");
+#endif
+
+	cmd = command_parse("a && b|c || d&&e\n");
+	assert(cmd != NULL);
+	assert(strcmp(cmd->argv[0], "a") == 0);
+	assert(strcmp(cmd->cmdline, "a ") == 0);
+	assert(cmd->connect == COMMAND_AND && cmd->pipe == FALSE);
+	assert(strcmp(cmd->next->argv[0], "b") == 0);
+	assert(cmd->next->pipe == TRUE && cmd->next->connect == COMMAND_SEQ);
+	assert(strcmp(cmd->next->next->argv[0], "c") == 0);
+	assert(cmd->next->next->connect == COMMAND_OR);
+	assert(strcmp(cmd->next->next->next->argv[0], "d") == 0);
+	assert(cmd->next->next->next->connect == COMMAND_AND);
+	assert(strcmp(cmd->next->next->next->next->argv[0], "e") == 0);
+
+	// a fails: b|c skipped, d runs
+	assert(command_next(cmd, 1) == cmd->next->next->next);
+	assert(command_next(cmd, 0) == cmd->next);
+	// b|c succeeds: d skipped, e runs since the status is still 0
+	assert(command_next(cmd->next->next, 0) == cmd->next->next->next->next);
+	assert(command_next(cmd->next->next, 1) == cmd->next->next->next);
+	assert(command_next(cmd->next->next->next, 2) == NULL);
+	command_free(cmd);
+
+	cmd = command_parse("a || b; c && d &\n");
+	assert(cmd != NULL);
+	assert(cmd->connect == COMMAND_OR);
+	assert(command_next(cmd, 0) == cmd->next->next);
+	assert(cmd->next->next->connect == COMMAND_AND);
+	assert(cmd->next->next->background == FALSE);
+	assert(cmd->next->next->next->background == TRUE);
+	command_free(cmd);
+}
+
+
+/* Function: test_quote
+   Test quoted words: separators and blanks inside are kept, quotes removed
+*/
+void test_quote()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: Checking quotes\n");
+#endif
+
+	cmd = command_parse("echo 'a;b' \"p|q\" x\"y  z\"w > 'o f' ; ls\n");
+	assert(cmd != NULL);
+	assert(strcmp(cmd->argv[0], "echo") == 0);
+	assert(strcmp(cmd->argv[1], "a;b") == 0);
+	assert(strcmp(cmd->argv[2], "p|q") == 0);
+	assert(strcmp(cmd->argv[3], "xy  zw") == 0);
+	assert(cmd->argv[4] == NULL);
+	assert(strcmp(cmd->outfile, "o f") == 0);
+	assert(cmd->pipe == FALSE);
+	assert(strcmp(cmd->next->argv[0], "ls") == 0 && cmd->next->next == NULL);
+	command_free(cmd);
+
+	// '$' in single quotes is marked, a substitution in double quotes is kept
+	// with its '$' marked
+	cmd = command_parse("X=\"hello world\" '$HOME' \"$(echo \"a)b\")\"\n");
+	assert(cmd != NULL);
+	assert(strcmp(cmd->argv[0], "X=hello world") == 0);
+	assert(cmd->argv[1][0] == DOLLAR_MARK && strcmp(&cmd->argv[1][1], "HOME") == 0);
+	assert(cmd->argv[2][0] == SUBST_MARK && strcmp(&cmd->argv[2][1], "(echo \"a)b\")") == 0);
+	assert(cmd->next == NULL);
+	command_free(cmd);
+
+	// pattern characters in quotes are marked, a file name is not
+	cmd = command_parse("rm \"*.txt\" 'a?' \"{x,y}\"[ab] > \"o*\"\n");
+	assert(cmd != NULL);
+	assert(strcmp(cmd->argv[1], "\003*.txt") == 0);
+	assert(strcmp(cmd->argv[2], "a\003?") == 0);
+	assert(strcmp(cmd->argv[3], "\003{x,y}[ab]") == 0);
+	assert(strcmp(cmd->outfile, "o*") == 0);
+	command_free(cmd);
+	cmd = command_parse("echo > \"$(echo f)\"\n");
+	assert(cmd != NULL && strcmp(cmd->outfile, "$(echo f)") == 0);
+	command_free(cmd);
+
+	// a newline ends the command as ';' does
+	cmd = command_parse("a 'b\nc'\nd\n");
+	assert(cmd != NULL);
+	assert(strcmp(cmd->argv[1], "b\nc") == 0 && cmd->argv[2] == NULL);
+	assert(strcmp(cmd->next->argv[0], "d") == 0);
+	command_free(cmd);
+}
+
+
+/* Function: test_resolve
+   Executables of a pipeline are looked up in $PATH once
+*/
+void test_resolve()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: Checking executable lookup\n");
+#endif
+
+	cmd = command_parse("sh -x | mysh_no_such_command; sh\n");
+	assert(cmd != NULL);
+	assert(cmd->path == NULL);
+	command_resolve(cmd);
+	assert(cmd->path != NULL && access(cmd->path, X_OK) == 0);
+	assert(strcmp(strrchr(cmd->path, '/'), "/sh") == 0);
+	assert(cmd->next->path == NULL);
+	// the next pipeline is left alone
+	assert(cmd->next->next->path == NULL);
+	command_free(cmd);
+
+	cmd = command_parse("./sh\n");
+	command_resolve(cmd);
+	assert(cmd->path == NULL);
+	command_free(cmd);
+}
+
+
+/* Function: test_procsub
+   Test process substitution <(cmd) and >(cmd)
+*/
+void test_procsub()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: Checking process substitution\n");
+#endif
+
+	cmd = command_parse("diff <(sort a) <(sort b | uniq)\n");
+	assert(cmd != NULL);
+	assert(cmd->next == NULL);
+	assert(strcmp(cmd->argv[0], "diff") == 0);
+	assert(cmd->argv[1] == cmd->procsub->path);
+	assert(cmd->argv[2] == cmd->procsub->next->path);
+	assert(cmd->argv[3] == NULL);
+	assert(cmd->procsub->mode == PROCSUB_IN);
+	assert(strcmp(cmd->procsub->cmdline, "sort a") == 0);
+	assert(strcmp(cmd->procsub->next->cmdline, "sort b | uniq") == 0);
+	command_free(cmd);
+
+	cmd = command_parse("tee >(wc -l; ls)>out|cat\n");
+	assert(cmd != NULL);
+	assert(cmd->pipe == TRUE);
+	assert(strcmp(cmd->argv[0], "tee") == 0);
+	assert(cmd->argv[1] == cmd->procsub->path);
+	assert(cmd->procsub->mode == PROCSUB_OUT);
+	assert(strcmp(cmd->procsub->cmdline, "wc -l; ls") == 0);
+	assert(strcmp(cmd->outfile, "out") == 0);
+	assert(strcmp(cmd->next->argv[0], "cat") == 0);
+	command_free(cmd);
+
+	// parentheses in quotes do not end or open the substitution
+	cmd = command_parse("cat <(echo \")\") && echo a long line after it\n");
+	assert(cmd != NULL && cmd->connect == COMMAND_AND);
+	assert(strcmp(cmd->procsub->cmdline, "echo \")\"") == 0);
+	assert(cmd->argv[1] == cmd->procsub->path && cmd->argv[2] == NULL);
+	assert(strcmp(cmd->next->argv[0], "echo") == 0 && strcmp(cmd->next->argv[4], "after") == 0);
+	command_free(cmd);
+	cmd = command_parse("cat <(echo '(') && echo after\n");
+	assert(cmd != NULL && cmd->connect == COMMAND_AND);
+	assert(strcmp(cmd->procsub->cmdline, "echo '('") == 0);
+	assert(strcmp(cmd->next->argv[1], "after") == 0 && cmd->next->argv[2] == NULL);
+	command_free(cmd);
+}
+
+
+/* Function: test_copy
+   A copy has its own buffer and words, the same parse
+*/
+void test_copy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: Checking command copy\n");
+#endif
+
+	COMMAND *copy;
+
+	cmd = command_parse("sh -x <in | tee >(wc -l) >>out & cat <<< here\n");
+	command_resolve(cmd);
+	copy = command_copy(cmd);
+	assert(copy != NULL && copy->buffer != cmd->buffer);
+	assert(strcmp(copy->cmdline, cmd->cmdline) == 0);
+	assert(strcmp(copy->argv[0], "sh") == 0 && strcmp(copy->argv[1], "-x") == 0 && copy->argv[2] == NULL);
+	assert(copy->argv[0] != cmd->argv[0] && strcmp(copy->infile, "in") == 0);
+	assert(copy->path != cmd->path && strcmp(copy->path, cmd->path) == 0);
+	assert(copy->pipe == TRUE && copy->next->background == TRUE);
+	assert(copy->next->argv[1] == copy->next->procsub->path);
+	assert(strcmp(copy->next->procsub->cmdline, "wc -l") == 0);
+	assert(copy->next->fdmode == (O_RDWR|O_APPEND) && strcmp(copy->next->outfile, "out") == 0);
+	assert(strcmp(copy->next->next->heredoc, "here\n") == 0);
+	assert(copy->next->next->heredoc != cmd->next->next->heredoc);
+	command_free(cmd);
+	assert(strcmp(copy->next->next->argv[0], "cat") == 0);
+	command_free(copy);
+	assert(command_copy(NULL) == NULL);
+}
+
+
+/* Function: test_heredoc
+   Test here-strings and here-documents
+*/
+void test_heredoc()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: Checking here-documents\n");
+#endif
+
+	cmd = command_parse("tr a-z A-Z <<< \"a b; c\" > out\n");
+	assert(cmd != NULL);
+	assert(cmd->next == NULL);
+	assert(strcmp(cmd->argv[0], "tr") == 0);
+	assert(strcmp(cmd->argv[2], "A-Z") == 0);
+	assert(cmd->argv[3] == NULL);
+	assert(strcmp(cmd->heredoc, "a b; c\n") == 0);
+	assert(cmd->heredoc_len == 7);
+	assert(strcmp(cmd->outfile, "out") == 0);
+	assert(command_heredoc_pending(cmd) == NULL);
+	command_free(cmd);
+
+	cmd = command_parse("cat <<EOF | wc; cat <<-'END'\n");
+	assert(cmd != NULL);
+	assert(command_heredoc_pending(cmd) == cmd);
+	assert(strcmp(cmd->heredoc_tag, "EOF") == 0);
+	assert(command_heredoc_line(cmd, "one\n") == FALSE);
+	assert(command_heredoc_line(cmd, "\ttwo\n") == FALSE);
+	assert(command_heredoc_line(cmd, "EOF\n") == TRUE);
+	assert(strcmp(cmd->heredoc, "one\n\ttwo\n") == 0);
+	assert(command_heredoc_pending(cmd) == cmd->next->next);
+	assert(strcmp(cmd->next->next->heredoc_tag, "END") == 0);
+	assert(command_heredoc_line(cmd->next->next, "\tthree\n") == FALSE);
+	assert(command_heredoc_line(cmd->next->next, "\t\tEND\n") == TRUE);
+	assert(strcmp(cmd->next->next->heredoc, "three\n") == 0);
+	assert(command_heredoc_pending(cmd) == NULL);
+	command_free(cmd);
+}
+
+
+/* Function: test_long
+   Test a line far longer than a terminal line, a generated file list
+*/
+void test_long(int words)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: Checking a line of %d words\n", words);
+#endif
+
+	char *line = malloc(words * 12 + 16), *p = line, last[16];
+	int i;
+
+	p += sprintf(p, "ls");
+	for (i = 0; i < words; i++)
+	{
+		p += sprintf(p, " file%06d", i);
+	}
+	sprintf(p, " | wc\n");
+
+	cmd = command_parse(line);
+	assert(cmd != NULL);
+	assert(cmd->token == words + 2);
+	assert(cmd->pipe == TRUE);
+	sprintf(last, "file%06d", words - 1);
+	assert(strcmp(cmd->argv[words], last) == 0);
+	assert(cmd->argv[words + 1] == NULL);
+	assert(strcmp(cmd->next->argv[0], "wc") == 0);
+	command_free(cmd);
+	free(line);
+}
+
+
 /* Function: direct_input
 */
 void direct_input()
@@ -154,6 +432,13 @@ int main()
 	test_standard();
 	test_redirect();
 	test_pipe();
+	test_conditional();
+	test_quote();
+	test_resolve();
+	test_procsub();
+	test_heredoc();
+	test_copy();
+	test_long(100000);
 //	direct_input();
 
 	return 0;
@@ -111,6 +111,7 @@ int pidtable_add(PIDTABLE *table, PROCGROUP *pg)
 int pidtable_delpid(PIDTABLE *table, int pid, int type, int free)
 {
 	PIDTABLE *np = table;
+	char usage[PTABLE_USAGE];
 	while(np)
 	{
 		int i = 0;
@@ -122,10 +123,14 @@ int pidtable_delpid(PIDTABLE *table, int pid, int type, int free)
 				switch(type)
 				{
 					case JOB_EXITED:
-						printf("[%d]  Done\t %s\n", np->offset * PTABLE_SIZE + i + 1, np->job[i]->cmdline);
+						printf("[%d]  %s\t %s\t(%s)\n", np->offset * PTABLE_SIZE + i + 1,
+							(np->job[i]->timed_out == TRUE) ? "Timed out" : "Done", np->job[i]->cmdline,
+							procgroup_usage(np->job[i], usage, PTABLE_USAGE));
 						break;
 					case JOB_KILLED:
-						printf("[%d]  Terminated\t %s\n", np->offset * PTABLE_SIZE + i + 1, np->job[i]->cmdline);
+						printf("[%d]  %s\t %s\t(%s)\n", np->offset * PTABLE_SIZE + i + 1,
+							(np->job[i]->timed_out == TRUE) ? "Timed out" : "Terminated", np->job[i]->cmdline,
+							procgroup_usage(np->job[i], usage, PTABLE_USAGE));
 						break;
 					case FALSE:
 						break;
@@ -186,11 +191,12 @@ void pidtable_shrink(PIDTABLE *table)
 /* Function: pidtable_print
    Print current process listed in the table
 */
-void pidtable_print(PIDTABLE *table)
+void pidtable_print(PIDTABLE *table, int verbose)
 {
 #ifdef DEBUG_PTABLE_INFO
 	printf("Jobs[%d]\n", table->size);
 #endif
+	char usage[PTABLE_USAGE];
 	int i;
 
 	// loop through table and print entries
@@ -199,14 +205,22 @@ void pidtable_print(PIDTABLE *table)
 		if (table->job[i] != NULL)
 		{
 			printf("[%d] ", 1 + i + (PTABLE_SIZE * table->offset));
+			if (verbose == TRUE)
+			{
+				printf("%d ", table->job[i]->group_pid);
+			}
 			procgroup_print(table->job[i]);
+			if (verbose == TRUE)
+			{
+				printf("\t%s\n", procgroup_usage(table->job[i], usage, PTABLE_USAGE));
+			}
 		}
 	}
 
 	// recursive print
 	if (table->next != NULL)
 	{
-		pidtable_print((PIDTABLE*)table->next);
+		pidtable_print((PIDTABLE*)table->next, verbose);
 	}
 }
 
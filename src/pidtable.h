@@ -31,6 +31,9 @@
 */
 #define PTABLE_LIMIT 50
 
+/* Buffer size of a usage summary in job listings and notifications */
+#define PTABLE_USAGE 128
+
 /* Typedef: PIDTABLE
    Unrolled linkedlist structure for storing background process info
    Each node stores up to PTABLE_SIZE elements. New node is created and added to
@@ -89,9 +92,10 @@ int pidtable_delpid(PIDTABLE *table, int pid, int echo, int free);
 /* Function: print_pidtable
    Print the current table. In non-debug mode, print lists all non-empty entries in the table
    Precondition: assume process entries are valid, ie pointer to command is not null
+   With verbose, the group pid and the resource usage of each job are shown too
    Precondition: *table is a valid pointer to a PIDTABLE
 */
-void pidtable_print(PIDTABLE *table);
+void pidtable_print(PIDTABLE *table, int verbose);
 
 
 /* Function: shrink_pidtable (internal)
@@ -14,7 +14,8 @@ void test_add(int size);
 void test_remove();
 void test_size(int num_link, int num_size);
 
-PIDTABLE *ptable;
+/* Defined in sighandler.c, linked into every test */
+extern PIDTABLE *ptable;
 
 
 /* Function: test_setup
@@ -13,6 +13,17 @@ PROCGROUP *procgroup_init()
 	pg->status = 0;
 	pg->cmdline = (char*) malloc(sizeof (char) * PROCGROUP_BUF);
 	memset(pg->cmdline, '\0', PROCGROUP_BUF);
+	memset(&pg->start, 0, sizeof pg->start);
+	pg->started = 0;
+	memset(&pg->end, 0, sizeof pg->end);
+	timerclear(&pg->utime);
+	timerclear(&pg->stime);
+	pg->maxrss = 0;
+	pg->nvcsw = 0;
+	pg->nivcsw = 0;
+	pg->exit_status = -1;
+	memset(&pg->deadline, 0, sizeof pg->deadline);
+	pg->timed_out = FALSE;
 
 #ifdef DEBUG_PROCGROUP_INFO
 	printf("PROCGROUP: Struct initialized (%d bytes)\n", sizeof (PROCGROUP));
@@ -31,6 +42,17 @@ void procgroup_clear(PROCGROUP *pg)
 	pg->count = 0;
 	pg->status = 0;
 	memset(pg->cmdline, '\0', PROCGROUP_BUF);
+	memset(&pg->start, 0, sizeof pg->start);
+	pg->started = 0;
+	memset(&pg->end, 0, sizeof pg->end);
+	timerclear(&pg->utime);
+	timerclear(&pg->stime);
+	pg->maxrss = 0;
+	pg->nvcsw = 0;
+	pg->nivcsw = 0;
+	pg->exit_status = -1;
+	memset(&pg->deadline, 0, sizeof pg->deadline);
+	pg->timed_out = FALSE;
 
 #ifdef DEBUG_PROCGROUP_INFO
 	printf("PROCGROUP: Procgroup data reset\n");
@@ -62,6 +84,17 @@ void procgroup_load(PROCGROUP *pg, int gpid, short status, char *line)
 	pg->status = status;
 	pg->count = 1;
 	strncpy(pg->cmdline, line, PROCGROUP_BUF);
+	clock_gettime(CLOCK_MONOTONIC, &pg->start);
+	pg->started = time(NULL);
+	memset(&pg->end, 0, sizeof pg->end);
+	timerclear(&pg->utime);
+	timerclear(&pg->stime);
+	pg->maxrss = 0;
+	pg->nvcsw = 0;
+	pg->nivcsw = 0;
+	pg->exit_status = -1;
+	memset(&pg->deadline, 0, sizeof pg->deadline);
+	pg->timed_out = FALSE;
 
 #ifdef DEBUG_PROCGROUP_INFO
 	printf("PROCGROUP: Data loaded\n");
@@ -69,15 +102,94 @@ void procgroup_load(PROCGROUP *pg, int gpid, short status, char *line)
 }
 
 
+/* Function: procgroup_reap
+   Add CPU time of a reaped member, keep its exit status
+*/
+void procgroup_reap(PROCGROUP *pg, int status, const struct rusage *ru)
+{
+	if (WIFEXITED(status))
+	{
+		pg->exit_status = WEXITSTATUS(status);
+	}
+	else if (WIFSIGNALED(status))
+	{
+		pg->exit_status = 128 + WTERMSIG(status);
+	}
+	else
+	{
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &pg->end);
+	if (ru != NULL)
+	{
+		timeradd(&pg->utime, &ru->ru_utime, &pg->utime);
+		timeradd(&pg->stime, &ru->ru_stime, &pg->stime);
+		pg->maxrss = (ru->ru_maxrss > pg->maxrss) ? ru->ru_maxrss : pg->maxrss;
+		pg->nvcsw += ru->ru_nvcsw;
+		pg->nivcsw += ru->ru_nivcsw;
+	}
+}
+
+
+/* Function: procgroup_wall
+   Elapsed time since the job was loaded
+*/
+long procgroup_wall(PROCGROUP *pg)
+{
+	struct timespec now = pg->end;
+
+	if (now.tv_sec == 0 && now.tv_nsec == 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	}
+
+	return (now.tv_sec - pg->start.tv_sec) * 1000000L + (now.tv_nsec - pg->start.tv_nsec) / 1000;
+}
+
+
+/* Function: procgroup_usage
+   Format usage summary
+*/
+char *procgroup_usage(PROCGROUP *pg, char *buf, int size)
+{
+	long wall = procgroup_wall(pg);
+
+	snprintf(buf, size, "%ld.%06lds real %ld.%06lds user %ld.%06lds sys %ldK rss %ld/%ld csw",
+		wall / 1000000, wall % 1000000,
+		(long) pg->utime.tv_sec, (long) pg->utime.tv_usec,
+		(long) pg->stime.tv_sec, (long) pg->stime.tv_usec,
+		pg->maxrss, pg->nvcsw, pg->nivcsw);
+
+	return buf;
+}
+
+
 /* Function: procgroup_print
    Print out procgroup (debug)
 */
 void procgroup_print(PROCGROUP *pg)
 {
+	struct timespec now;
+	double left;
+
 	switch(pg->status)
 	{
 		case RUNNING:
-			printf("Running\t%s\n", pg->cmdline);
+			if (pg->deadline.tv_sec == 0 && pg->deadline.tv_nsec == 0)
+			{
+				printf("Running\t%s\n", pg->cmdline);
+				break;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			left = (pg->deadline.tv_sec - now.tv_sec) + (pg->deadline.tv_nsec - now.tv_nsec) / 1e9;
+			if (left > 0)
+			{
+				printf("Running\t%s\t(timeout in %.1fs)\n", pg->cmdline, left);
+			}
+			else
+			{
+				printf("Timed out\t%s\n", pg->cmdline);
+			}
 			break;
 		case STOPPED:
 			printf("Stopped\t%s\n", pg->cmdline);
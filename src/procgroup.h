@@ -11,6 +11,8 @@
 #define _PROCGROUP_H_
 
 #include "include.h"
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #define STOPPED 2
 #define RUNNING 3
@@ -21,12 +23,31 @@
 /* Typedef PROCGROUP
    Stores pid/pgid, status and command line
    At init, group_pid and status defaults to 0, cmdline is dynamically allocated and set to '\0'
+   start (monotonic) and started (wall clock) are set when the job is loaded,
+   end when the last member so far was reaped (zero while none was).
+   utime/stime and nvcsw/nivcsw (voluntary/involuntary context switches) sum
+   the usage of the members reaped so far, maxrss (KB) is the largest of them,
+   exit_status is the status of the last member to finish (128 + signal if
+   killed, -1 if none). deadline (monotonic, zero if none) is set for jobs
+   started with the timeout builtin, timed_out once the job was signalled
+   for passing it
 */
 typedef struct procgroup {
 	int group_pid;
 	int count;
 	short status;
 	char *cmdline;
+	struct timespec start;
+	struct timespec end;
+	time_t started;
+	struct timeval utime;
+	struct timeval stime;
+	long maxrss;
+	long nvcsw;
+	long nivcsw;
+	int exit_status;
+	struct timespec deadline;
+	int timed_out;
 } PROCGROUP;
 
 
@@ -59,6 +80,30 @@ void procgroup_free(PROCGROUP *pg);
 void procgroup_load(PROCGROUP *pg, int gpid, short status, char *line);
 
 
+/* Function: procgroup_reap
+   Account for a member process reaped with wait4(): add its usage from ru
+   and record its exit status (status as returned by wait4())
+   Precondition: pg is a valid pointer to a PROCGROUP struct
+*/
+void procgroup_reap(PROCGROUP *pg, int status, const struct rusage *ru);
+
+
+/* Function: procgroup_wall
+   Returns the wall clock time of the job in microseconds, up to the last
+   reaped member, or up to now if none was reaped yet
+   Precondition: pg is a valid pointer to a PROCGROUP struct
+*/
+long procgroup_wall(PROCGROUP *pg);
+
+
+/* Function: procgroup_usage
+   Write a one line summary of the usage ("real user sys rss csw") to buf
+   Returns buf
+   Precondition: pg is a valid pointer to a PROCGROUP struct
+*/
+char *procgroup_usage(PROCGROUP *pg, char *buf, int size);
+
+
 /* Function: procgroup_print
    Prints out process info
    Precondition: pg is a valid pointer to a PROCGROUP struct
@@ -12,6 +12,7 @@ PROCGROUP *pg;
 void test_setup();
 void test_destroy();
 void test_load();
+void test_reap();
 
 
 /* Function: test_setup
@@ -75,6 +76,62 @@ void test_load()
 }
 
 
+/* Function: test_reap
+   Usage of reaped members is aggregated
+*/
+void test_reap()
+{
+
+#ifdef DEBUG_TEST
+	printf("TEST: PROCGROUP Reap\n");
+#endif
+
+	struct rusage ru;
+	char buf[128];
+	int i, pid, status;
+
+	procgroup_load(pg, 1, RUNNING, CMD2);
+	assert(pg->end.tv_sec == 0);
+	assert(procgroup_wall(pg) >= 0);
+
+	// two real children, the second one is killed
+	for (i = 0; i < 2; i++)
+	{
+		pid = fork();
+		assert(pid != -1);
+		if (pid == 0)
+		{
+			if (i == 1)
+			{
+				pause();
+			}
+			_exit(3);
+		}
+		if (i == 1)
+		{
+			kill(pid, SIGKILL);
+		}
+		assert(wait4(pid, &status, 0, &ru) == pid);
+		procgroup_reap(pg, status, &ru);
+		assert(pg->exit_status == ((i == 0) ? 3 : 128 + SIGKILL));
+	}
+	assert(pg->maxrss > 0);
+	assert(pg->end.tv_sec != 0);
+	assert(procgroup_wall(pg) == procgroup_wall(pg));
+
+	// a stop is not a termination
+	status = 0x137f;
+	procgroup_reap(pg, status, NULL);
+	assert(pg->exit_status == 128 + SIGKILL);
+
+	procgroup_usage(pg, buf, sizeof buf);
+	assert(strstr(buf, " real ") != NULL && strstr(buf, " csw") != NULL);
+
+	procgroup_clear(pg);
+	assert(pg->maxrss == 0 && pg->nvcsw == 0 && pg->exit_status == -1);
+}
+
+
 /* Run tests */
 int main()
 {
@@ -85,6 +142,7 @@ int main()
 
 	test_setup();
 	test_load();
+	test_reap();
 	test_destroy();
 
 #ifdef DEBUG_TEST
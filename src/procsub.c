@@ -0,0 +1,150 @@
+#include "procsub.h"
+#include "dag.h"
+
+
+/* Function: procsub_open
+   Create pipes, argument is the end used by the outer command
+*/
+int procsub_open(PROCSUB *ps)
+{
+	PROCSUB *np;
+	for (np = ps; np != NULL; np = np->next)
+	{
+		if (pipe(np->fd) == -1)
+		{
+#ifdef WARNING
+			perror("pipe");
+#endif
+			np->fd[0] = np->fd[1] = -1;
+			procsub_close(ps);
+			return -1;
+		}
+		snprintf(np->path, PROCSUB_PATH, "/dev/fd/%d",
+			np->mode == PROCSUB_IN ? np->fd[0] : np->fd[1]);
+	}
+
+	return 0;
+}
+
+
+/* Function: procsub_child
+   Close the inner ends in the outer command
+*/
+void procsub_child(PROCSUB *ps)
+{
+	int fd;
+	for (; ps != NULL; ps = ps->next)
+	{
+		fd = (ps->mode == PROCSUB_IN) ? ps->fd[1] : ps->fd[0];
+		if (fd != -1 && -1 == close(fd))
+		{
+			perror("close");
+		}
+	}
+}
+
+
+/* Function: procsub_spawn
+   Fork inner commands into the job's process group
+*/
+int procsub_spawn(PROCSUB *ps, int gpid)
+{
+	PROCSUB *np;
+	int count = 0, pid;
+
+	for (np = ps; np != NULL; np = np->next)
+	{
+		pid = fork();
+		if (pid == -1)
+		{
+			perror("fork");
+			break;
+		}
+		// Child
+		if (pid == 0)
+		{
+			if (-1 == setpgid(0, gpid))
+			{
+				perror("setpgid");
+			}
+			if (np->mode == PROCSUB_IN)
+			{
+				if (-1 == dup2(np->fd[1], STDOUT_FILENO))
+				{
+					perror("dup2");
+				}
+			}
+			else
+			{
+				if (-1 == dup2(np->fd[0], STDIN_FILENO))
+				{
+					perror("dup2");
+				}
+			}
+			// drop every other descriptor (substitution pipes, the job's own
+			// pipeline) so the readers on the other side see EOF when we exit
+			if (-1 == close_range(STDERR_FILENO + 1, ~0U, 0))
+			{
+				procsub_close(ps);
+			}
+
+			COMMAND *inner = command_parse(np->cmdline);
+			if (inner == NULL || inner->argv == NULL || inner->argv[0] == NULL)
+			{
+				_exit(0);
+			}
+			procsub_exec(inner);
+		}
+		// Parent
+		if (-1 == setpgid(pid, gpid))
+		{
+			// Dont report error, child may have done it already
+		}
+		count++;
+	}
+
+	return count;
+}
+
+
+/* Function: procsub_close
+   Close pipes in the shell
+*/
+void procsub_close(PROCSUB *ps)
+{
+	for (; ps != NULL; ps = ps->next)
+	{
+		if (ps->fd[0] != -1)
+		{
+			close(ps->fd[0]);
+		}
+		if (ps->fd[1] != -1)
+		{
+			close(ps->fd[1]);
+		}
+		ps->fd[0] = ps->fd[1] = -1;
+	}
+}
+
+
+/* Function: procsub_exec
+   The whole list is run by dag_list(), each pipeline in a child of this
+   process, with the signals of a job
+*/
+void procsub_exec(COMMAND *cmd)
+{
+	sigset_t none;
+	int status = 0;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGTTOU, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+	sigemptyset(&none);
+	sigprocmask(SIG_SETMASK, &none, NULL);
+
+	dag_list(cmd, &status);
+	fflush(stdout);
+	_exit(status);
+}
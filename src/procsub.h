@@ -0,0 +1,52 @@
+/*
+	Process substitution support for <(cmd) and >(cmd).
+	The parser records each substitution in the COMMAND's PROCSUB list and
+	places /dev/fd/N into argv. Before the command is forked the launcher opens
+	one pipe per substitution. After the fork the inner commands are started in
+	the same process group as the job, so they are counted in the job's
+	PROCGROUP and are stopped, continued and reaped together with it.
+*/
+
+#ifndef _PROCSUB_H_
+#define _PROCSUB_H_
+
+#include "include.h"
+#include "parser.h"
+
+
+/* Function: procsub_open
+   Create a pipe for each substitution and fill in its /dev/fd path
+   Returns 0 on success, -1 if a pipe could not be created (all pipes are closed)
+   Precondition: ps is NULL or a valid PROCSUB list from command_parse()
+*/
+int procsub_open(PROCSUB *ps);
+
+
+/* Function: procsub_child
+   Called in the forked command: close the pipe ends used by the inner commands
+   so that the command sees EOF / SIGPIPE correctly
+*/
+void procsub_child(PROCSUB *ps);
+
+
+/* Function: procsub_spawn
+   Fork the inner command of every substitution into process group gpid
+   Returns number of processes started
+*/
+int procsub_spawn(PROCSUB *ps, int gpid);
+
+
+/* Function: procsub_close
+   Close all pipe ends held by the shell, called after procsub_spawn()
+*/
+void procsub_close(PROCSUB *ps);
+
+
+/* Function: procsub_exec
+   Execute the command list starting at cmd (pipelines, ';', && and ||) in
+   the current process, never returns: exits with the status of the last
+   pipeline. Used by the inner process of a substitution
+*/
+void procsub_exec(COMMAND *cmd);
+
+#endif /* _PROCSUB_H_ */
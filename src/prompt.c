@@ -0,0 +1,525 @@
+#include "prompt.h"
+#include <pthread.h>
+#include <poll.h>
+
+
+/* Typedef: PROMPT_ENTRY
+   Cached VCS segment of one directory
+   head is the HEAD file the value was read from, mtime its modification time
+*/
+typedef struct prompt_entry {
+	char cwd[PATH_MAX];
+	char head[PATH_MAX];
+	struct timespec mtime;
+	char branch[PROMPT_SEG];
+	int valid;
+} PROMPT_ENTRY;
+
+
+int prompt_segments = PROMPT_VCS | PROMPT_TIME | PROMPT_JOBS;
+
+static PROMPT_ENTRY cache[PROMPT_CACHE];
+static int cache_next = 0;
+
+/* worker state, protected by lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static char request[PATH_MAX];
+static int pending = FALSE;
+static int started = FALSE;
+static int notify[2] = {-1, -1};
+
+/* duration of the last command line in ms, -1 before the first one */
+static long last_ms = -1;
+
+/* prompt currently on screen */
+static char shown[PATH_MAX + PROMPT_SEG * 4];
+
+
+/* Function: prompt_lookup (internal)
+   Find cache entry for cwd, with create return the oldest slot instead of NULL
+   Precondition: lock is held
+*/
+static PROMPT_ENTRY *prompt_lookup(const char *cwd, int create)
+{
+	int i;
+	for (i = 0; i < PROMPT_CACHE; i++)
+	{
+		if (cache[i].valid && strcmp(cache[i].cwd, cwd) == 0)
+		{
+			return &cache[i];
+		}
+	}
+	if (create == FALSE)
+	{
+		return NULL;
+	}
+
+	PROMPT_ENTRY *e = &cache[cache_next];
+	cache_next = (cache_next + 1) % PROMPT_CACHE;
+	strncpy(e->cwd, cwd, PATH_MAX - 1);
+	e->cwd[PATH_MAX - 1] = '\0';
+	e->head[0] = '\0';
+	e->branch[0] = '\0';
+	e->valid = FALSE;
+
+	return e;
+}
+
+
+/* Function: prompt_vcs_find (internal)
+   Walk up from cwd to the repository root, store path of its HEAD file in head
+   Returns TRUE if cwd is inside a git repository and the path fits in head
+*/
+static int prompt_vcs_find(const char *cwd, char *head)
+{
+	char path[PATH_MAX], line[PATH_MAX], *dir, *slash;
+	struct stat st;
+	int fd, n;
+
+	strncpy(path, cwd, PATH_MAX - 1);
+	path[PATH_MAX - 1] = '\0';
+
+	while (TRUE)
+	{
+		dir = (strcmp(path, "/") == 0) ? "" : path;
+		// a path too long for head is not a repository we can read
+		if (snprintf(head, PATH_MAX, "%s/.git", dir) >= PATH_MAX)
+		{
+			return FALSE;
+		}
+		if (stat(head, &st) == 0)
+		{
+			if (S_ISDIR(st.st_mode))
+			{
+				return snprintf(head, PATH_MAX, "%s/.git/HEAD", dir) < PATH_MAX;
+			}
+			// worktree or submodule: "gitdir: <path>"
+			fd = open(head, O_RDONLY | O_CLOEXEC);
+			if (fd == -1)
+			{
+				return FALSE;
+			}
+			n = read(fd, line, sizeof line - 1);
+			close(fd);
+			if (n <= 8 || strncmp(line, "gitdir: ", 8) != 0)
+			{
+				return FALSE;
+			}
+			line[n] = '\0';
+			line[strcspn(line, "\n")] = '\0';
+			if (line[8] == '/')
+			{
+				n = snprintf(head, PATH_MAX, "%s/HEAD", &line[8]);
+			}
+			else
+			{
+				n = snprintf(head, PATH_MAX, "%s/%s/HEAD", dir, &line[8]);
+			}
+			return n < PATH_MAX;
+		}
+
+		// parent directory
+		slash = strrchr(path, '/');
+		if (dir[0] == '\0' || slash == NULL)
+		{
+			return FALSE;
+		}
+		if (slash == path)
+		{
+			slash[1] = '\0';
+		}
+		else
+		{
+			*slash = '\0';
+		}
+	}
+
+	return FALSE;
+}
+
+
+/* Function: prompt_vcs_read (internal)
+   Read branch name (or abbreviated commit) from HEAD file
+*/
+static void prompt_vcs_read(const char *head, char *branch)
+{
+	char line[PATH_MAX];
+	int fd, n;
+
+	branch[0] = '\0';
+	fd = open(head, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return;
+	}
+	n = read(fd, line, sizeof line - 1);
+	close(fd);
+	if (n <= 0)
+	{
+		return;
+	}
+	line[n] = '\0';
+	line[strcspn(line, "\n")] = '\0';
+
+	if (strncmp(line, "ref: refs/heads/", 16) == 0)
+	{
+		snprintf(branch, PROMPT_SEG, "%.*s", PROMPT_SEG - 1, &line[16]);
+	}
+	else if (strncmp(line, "ref: ", 5) == 0)
+	{
+		snprintf(branch, PROMPT_SEG, "%.*s", PROMPT_SEG - 1, &line[5]);
+	}
+	else
+	{
+		// detached HEAD
+		snprintf(branch, PROMPT_SEG, "%.7s", line);
+	}
+}
+
+
+/* Function: prompt_worker (internal)
+   Worker thread computing the VCS segment for requested directories
+*/
+static void *prompt_worker(void *arg)
+{
+	char cwd[PATH_MAX], head[PATH_MAX], branch[PROMPT_SEG];
+	struct timespec mtime;
+	struct stat st;
+	PROMPT_ENTRY *e;
+	int fresh, changed;
+
+	while (TRUE)
+	{
+		pthread_mutex_lock(&lock);
+		while (pending == FALSE)
+		{
+			pthread_cond_wait(&wake, &lock);
+		}
+		memcpy(cwd, request, PATH_MAX);
+		pending = FALSE;
+		e = prompt_lookup(cwd, FALSE);
+		head[0] = '\0';
+		if (e != NULL)
+		{
+			memcpy(head, e->head, PATH_MAX);
+			mtime = e->mtime;
+		}
+		pthread_mutex_unlock(&lock);
+
+		// cached value is still fresh if HEAD was not touched
+		fresh = (head[0] != '\0' && stat(head, &st) == 0 &&
+			st.st_mtim.tv_sec == mtime.tv_sec && st.st_mtim.tv_nsec == mtime.tv_nsec);
+		if (fresh == TRUE)
+		{
+			continue;
+		}
+
+		branch[0] = '\0';
+		head[0] = '\0';
+		mtime.tv_sec = mtime.tv_nsec = 0;
+		if (prompt_vcs_find(cwd, head) == TRUE && stat(head, &st) == 0)
+		{
+			mtime = st.st_mtim;
+			prompt_vcs_read(head, branch);
+		}
+		else
+		{
+			head[0] = '\0';
+		}
+
+		pthread_mutex_lock(&lock);
+		e = prompt_lookup(cwd, TRUE);
+		changed = (e->valid == FALSE || strcmp(e->branch, branch) != 0);
+		memcpy(e->head, head, PATH_MAX);
+		memcpy(e->branch, branch, PROMPT_SEG);
+		e->mtime = mtime;
+		e->valid = TRUE;
+		pthread_mutex_unlock(&lock);
+
+		if (changed == TRUE && -1 == write(notify[1], "", 1))
+		{
+			// pipe full, a redraw is already pending
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Function: prompt_start (internal)
+   Start the worker thread on first use, with all signals blocked: they are
+   handled by the main thread only
+*/
+static int prompt_start()
+{
+	pthread_t thread;
+	sigset_t all, old;
+	int ret;
+
+	if (started == TRUE)
+	{
+		return 0;
+	}
+	if (-1 == pipe2(notify, O_CLOEXEC | O_NONBLOCK))
+	{
+		perror("pipe");
+		return -1;
+	}
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&thread, NULL, prompt_worker, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret != 0)
+	{
+#ifdef WARNING
+		printf("-mysh: prompt: could not start worker thread\n");
+#endif
+		close(notify[0]);
+		close(notify[1]);
+		notify[0] = notify[1] = -1;
+		prompt_segments &= ~PROMPT_VCS;
+		return -1;
+	}
+	pthread_detach(thread);
+	started = TRUE;
+
+	return 0;
+}
+
+
+/* Function: prompt_append (internal)
+   snprintf at buf[len], clamped to size
+*/
+static int prompt_append(char *buf, int len, int size, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (len >= size - 1)
+	{
+		return len;
+	}
+	va_start(ap, fmt);
+	n = vsnprintf(&buf[len], size - len, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+	{
+		return len;
+	}
+
+	return (len + n >= size) ? size - 1 : len + n;
+}
+
+
+/* Function: prompt_format (internal)
+   Render the prompt from the current segment values
+*/
+static int prompt_format(char *buf, int size, const char *cwd, PIDTABLE *table)
+{
+	char branch[PROMPT_SEG];
+	int len, known = FALSE, jobs;
+	PROMPT_ENTRY *e;
+
+	len = prompt_append(buf, 0, size, "%sMysh%s %s", MYSH_LGREEN, MYSH_LBLUE, cwd != NULL ? cwd : "?");
+
+	if ((prompt_segments & PROMPT_VCS) && cwd != NULL && started == TRUE)
+	{
+		pthread_mutex_lock(&lock);
+		e = prompt_lookup(cwd, FALSE);
+		if (e != NULL)
+		{
+			memcpy(branch, e->branch, PROMPT_SEG);
+			known = TRUE;
+		}
+		pthread_mutex_unlock(&lock);
+
+		if (known == FALSE)
+		{
+			len = prompt_append(buf, len, size, " %s(...)", MYSH_DGRAY);
+		}
+		else if (branch[0] != '\0')
+		{
+			len = prompt_append(buf, len, size, " %s(%s)", MYSH_YELLOW, branch);
+		}
+	}
+
+	if ((prompt_segments & PROMPT_JOBS) && table != NULL && (jobs = pidtable_getsize(table)) > 0)
+	{
+		len = prompt_append(buf, len, size, " %s[%d]", MYSH_CYAN, jobs);
+	}
+
+	if ((prompt_segments & PROMPT_TIME) && last_ms >= 0)
+	{
+		if (last_ms < 1000)
+		{
+			len = prompt_append(buf, len, size, " %s%ldms", MYSH_MAGENTA, last_ms);
+		}
+		else if (last_ms < 60000)
+		{
+			len = prompt_append(buf, len, size, " %s%ld.%02lds", MYSH_MAGENTA, last_ms / 1000, (last_ms % 1000) / 10);
+		}
+		else
+		{
+			len = prompt_append(buf, len, size, " %s%ldm%02lds", MYSH_MAGENTA, last_ms / 60000, (last_ms / 1000) % 60);
+		}
+	}
+
+	return prompt_append(buf, len, size, "%s #%s ", MYSH_LBLUE, MYSH_GRAY);
+}
+
+
+/* Function: prompt_render
+   Render prompt and ask the worker to refresh the VCS segment
+*/
+int prompt_render(char *buf, int size, const char *cwd, PIDTABLE *table)
+{
+	if ((prompt_segments & PROMPT_VCS) && cwd != NULL && prompt_start() == 0)
+	{
+		pthread_mutex_lock(&lock);
+		strncpy(request, cwd, PATH_MAX - 1);
+		request[PATH_MAX - 1] = '\0';
+		pending = TRUE;
+		pthread_cond_signal(&wake);
+		pthread_mutex_unlock(&lock);
+	}
+
+	int len = prompt_format(buf, size, cwd, table);
+	snprintf(shown, sizeof shown, "%s", buf);
+
+	return len;
+}
+
+
+/* Function: prompt_wait
+   Redraw prompt when a fresh value arrives shortly after it was printed
+*/
+void prompt_wait(int fd, const char *cwd, PIDTABLE *table)
+{
+	char buf[PATH_MAX + PROMPT_SEG * 4];
+	struct pollfd pfd[2];
+	struct timespec start, now;
+	int len, ret, remaining = PROMPT_REDRAW_MS;
+
+	// nothing to wait for in batch mode
+	if (notify[0] == -1 || !isatty(fd))
+	{
+		return;
+	}
+
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = notify[0];
+	pfd[1].events = POLLIN;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (remaining > 0)
+	{
+		ret = poll(pfd, 2, remaining);
+		if (ret == 0 || (ret == -1 && errno != EINTR) || (ret > 0 && pfd[0].revents != 0))
+		{
+			return;
+		}
+		if (ret > 0 && prompt_changed() == TRUE)
+		{
+			len = prompt_format(buf, sizeof buf, cwd, table);
+			if (strcmp(buf, shown) != 0)
+			{
+				memcpy(shown, buf, len + 1);
+				fflush(stdout);
+				if (-1 == write(STDOUT_FILENO, "\r\033[K", 4) || -1 == write(STDOUT_FILENO, buf, len))
+				{
+					return;
+				}
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = PROMPT_REDRAW_MS - ((now.tv_sec - start.tv_sec) * 1000 +
+			(now.tv_nsec - start.tv_nsec) / 1000000);
+	}
+}
+
+
+/* Function: prompt_notify_fd
+   Descriptor signalled by the worker
+*/
+int prompt_notify_fd()
+{
+	return notify[0];
+}
+
+
+/* Function: prompt_changed
+   Drain notifications
+*/
+int prompt_changed()
+{
+	char buf[32];
+	int changed = FALSE;
+
+	if (notify[0] == -1)
+	{
+		return FALSE;
+	}
+	while (read(notify[0], buf, sizeof buf) > 0)
+	{
+		changed = TRUE;
+	}
+
+	return changed;
+}
+
+
+/* Function: prompt_duration
+   Store duration of the last command line
+*/
+void prompt_duration(const struct timespec *start, const struct timespec *end)
+{
+	last_ms = (end->tv_sec - start->tv_sec) * 1000 + (end->tv_nsec - start->tv_nsec) / 1000000;
+}
+
+
+/* Function: prompt_config
+   Builtin: enable/disable prompt segments
+*/
+int prompt_config(char **argv)
+{
+	static const char *names[] = {"vcs", "time", "jobs"};
+	int i, bit;
+
+	if (argv[1] == NULL)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			printf("%s\t%s\n", names[i], (prompt_segments & (1 << i)) ? "on" : "off");
+		}
+		return 0;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		if (strcmp(argv[1], names[i]) == 0)
+		{
+			break;
+		}
+	}
+	if (i == 3 || argv[2] == NULL || (strcmp(argv[2], "on") != 0 && strcmp(argv[2], "off") != 0))
+	{
+#ifdef WARNING
+	printf("-mysh: prompt: usage: prompt [vcs|time|jobs on|off]\n");
+#endif
+		return -1;
+	}
+
+	bit = 1 << i;
+	if (strcmp(argv[2], "on") == 0)
+	{
+		prompt_segments |= bit;
+	}
+	else
+	{
+		prompt_segments &= ~bit;
+	}
+
+	return 0;
+}
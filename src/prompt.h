@@ -0,0 +1,79 @@
+/*
+	Prompt segments
+	The prompt shows the current directory followed by optional segments:
+	VCS branch, duration of the last command and number of jobs.
+	The VCS segment can be slow to compute (walking up to the repository
+	root, reading .git files), so it is computed by a worker thread and
+	cached per directory together with the mtime of the HEAD file it was
+	read from. The prompt is printed immediately with the cached (possibly
+	stale) value or a placeholder; when the worker posts a different value
+	the prompt is redrawn in place.
+	Duration and job count are cheap and computed on the main thread, the
+	job count reads the PIDTABLE counters directly.
+*/
+
+#ifndef _PROMPT_H_
+#define _PROMPT_H_
+
+#include "include.h"
+#include "pidtable.h"
+
+/* Segments */
+#define PROMPT_VCS		0x01
+#define PROMPT_TIME		0x02
+#define PROMPT_JOBS		0x04
+
+/* Max length of a segment value */
+#define PROMPT_SEG 64
+
+/* Number of directories kept in the VCS cache */
+#define PROMPT_CACHE 16
+
+/* Window after printing the prompt during which a fresh value is redrawn */
+#define PROMPT_REDRAW_MS 250
+
+/* Enabled segments, bitmask of PROMPT_* */
+extern int prompt_segments;
+
+
+/* Function: prompt_render
+   Render the prompt for directory cwd into buf (at most size bytes)
+   Requests an asynchronous refresh of the VCS segment for cwd
+   Returns length of the rendered prompt
+*/
+int prompt_render(char *buf, int size, const char *cwd, PIDTABLE *table);
+
+
+/* Function: prompt_wait
+   Called after the prompt is printed: wait until fd has input, redrawing the
+   prompt in place when the worker posts a new value within PROMPT_REDRAW_MS
+*/
+void prompt_wait(int fd, const char *cwd, PIDTABLE *table);
+
+
+/* Function: prompt_notify_fd
+   Returns file descriptor that becomes readable when a segment changed, -1 if
+   the worker is not running
+*/
+int prompt_notify_fd();
+
+
+/* Function: prompt_changed
+   Drain the notify descriptor, returns TRUE if a segment changed since the
+   last call
+*/
+int prompt_changed();
+
+
+/* Function: prompt_duration
+   Record the wall clock duration of the last command line
+*/
+void prompt_duration(const struct timespec *start, const struct timespec *end);
+
+
+/* Function: prompt_config
+   Builtin command prompt: prompt [vcs|time|jobs on|off]
+*/
+int prompt_config(char **argv);
+
+#endif /* _PROMPT_H_ */
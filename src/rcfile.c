@@ -0,0 +1,680 @@
+#include "rcfile.h"
+#include "alias.h"
+#include "script.h"
+#include "vars.h"
+#include "wildcard.h"
+#include <sys/mman.h>
+
+/* Builtins whose words are cached, when they have arguments */
+static const char *rc_builtins[] = {"alias", "unalias", "export", "unset", "prompt", NULL};
+
+/* Image mapped by the last rc_load() */
+static void *image = NULL;
+static long image_len = 0;
+
+
+/* Typedef: RC_BUILD (internal)
+   Image being compiled: ops, word offsets, string table and its intern
+   table (offsets, -1 if free)
+*/
+typedef struct rc_build {
+	RC_OP *ops;
+	int nops;
+	int opcap;
+	int *words;
+	int nwords;
+	int wordcap;
+	char *strings;
+	long len;
+	long cap;
+	int *intern;
+	int nintern;
+	int count;
+	int failed;
+} RC_BUILD;
+
+
+/* Function: rc_hash (internal)
+   FNV-1a (64 bit) of len bytes of data, continuing from h
+*/
+static unsigned long long rc_hash(unsigned long long h, const void *data, long len)
+{
+	const unsigned char *p = data;
+	long i;
+
+	for (i = 0; i < len; i++)
+	{
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+
+/* Function: rc_elapsed (internal)
+   Microseconds since start
+*/
+static long rc_elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+
+/* Function: rc_string (internal)
+   Intern s in the string table
+   Returns its offset, -1 on allocation failure
+*/
+static int rc_string(RC_BUILD *b, const char *s)
+{
+	int len = strlen(s), i, *old, oldsize, k;
+	unsigned int h = (unsigned int) rc_hash(0xcbf29ce484222325ULL, s, len);
+	char *grow;
+
+	// keep the intern table below 50% load
+	if (2 * (b->count + 1) > b->nintern)
+	{
+		old = b->intern;
+		oldsize = b->nintern;
+		b->nintern = (oldsize == 0) ? 256 : 2 * oldsize;
+		b->intern = malloc(b->nintern * sizeof (int));
+		if (b->intern == NULL)
+		{
+			b->intern = old;
+			b->nintern = oldsize;
+			b->failed = TRUE;
+			return -1;
+		}
+		memset(b->intern, -1, b->nintern * sizeof (int));
+		for (i = 0; i < oldsize; i++)
+		{
+			if (old[i] != -1)
+			{
+				k = (unsigned int) rc_hash(0xcbf29ce484222325ULL, b->strings + old[i], strlen(b->strings + old[i]));
+				for (k &= b->nintern - 1; b->intern[k] != -1; k = (k + 1) & (b->nintern - 1))
+				{
+				}
+				b->intern[k] = old[i];
+			}
+		}
+		free(old);
+	}
+
+	for (i = h & (b->nintern - 1); b->intern[i] != -1; i = (i + 1) & (b->nintern - 1))
+	{
+		if (strcmp(b->strings + b->intern[i], s) == 0)
+		{
+			return b->intern[i];
+		}
+	}
+	if (b->len + len + 1 > b->cap)
+	{
+		b->cap = 2 * (b->len + len + 1);
+		grow = realloc(b->strings, b->cap);
+		if (grow == NULL)
+		{
+			b->failed = TRUE;
+			return -1;
+		}
+		b->strings = grow;
+	}
+	memcpy(b->strings + b->len, s, len + 1);
+	b->intern[i] = b->len;
+	b->count++;
+	b->len += len + 1;
+
+	return b->intern[i];
+}
+
+
+/* Function: rc_word (internal)
+   Append the offset of s to the words
+*/
+static void rc_word(RC_BUILD *b, const char *s)
+{
+	int *grow, off = rc_string(b, s);
+
+	if (b->nwords == b->wordcap)
+	{
+		b->wordcap = (b->wordcap > 0) ? 2 * b->wordcap : 64;
+		grow = realloc(b->words, b->wordcap * sizeof (int));
+		if (grow == NULL)
+		{
+			b->failed = TRUE;
+			return;
+		}
+		b->words = grow;
+	}
+	b->words[b->nwords++] = off;
+}
+
+
+/* Function: rc_op (internal)
+   Append an op of type with the words words (NULL terminated)
+*/
+static void rc_op(RC_BUILD *b, int type, char **words)
+{
+	RC_OP *grow;
+	int i;
+
+	if (b->nops == b->opcap)
+	{
+		b->opcap = (b->opcap > 0) ? 2 * b->opcap : 32;
+		grow = realloc(b->ops, b->opcap * sizeof (RC_OP));
+		if (grow == NULL)
+		{
+			b->failed = TRUE;
+			return;
+		}
+		b->ops = grow;
+	}
+	b->ops[b->nops].type = type;
+	b->ops[b->nops].word = b->nwords;
+	for (i = 0; words[i] != NULL; i++)
+	{
+		rc_word(b, words[i]);
+	}
+	b->ops[b->nops].nwords = i;
+	b->nops++;
+}
+
+
+/* Function: rc_names (internal)
+   Add the names of the variables text uses to the words (the first ones
+   of the image), hash their values
+   Returns the number of names
+*/
+static int rc_names(RC_BUILD *b, const char *text, unsigned long long *vars)
+{
+	const char *p, *value;
+	char name[256];
+	int n, k, brace, first = b->nwords;
+
+	*vars = 0xcbf29ce484222325ULL;
+	for (p = strchr(text, '$'); p != NULL; p = strchr(p + 1, '$'))
+	{
+		brace = (p[1] == '{');
+		if (!isalpha(p[1 + brace]) && p[1 + brace] != '_')
+		{
+			continue;
+		}
+		for (n = 0; isalnum(p[1+brace+n]) || p[1+brace+n] == '_'; n++)
+		{
+		}
+		if (n >= (int) sizeof name)
+		{
+			continue;
+		}
+		snprintf(name, sizeof name, "%.*s", n, p + 1 + brace);
+		for (k = first; k < b->nwords && strcmp(b->strings + b->words[k], name) != 0; k++)
+		{
+		}
+		if (k < b->nwords)
+		{
+			continue;
+		}
+		rc_word(b, name);
+		value = vars_get(name);
+		*vars = rc_hash(*vars, name, n + 1);
+		*vars = rc_hash(*vars, (value != NULL) ? value : "\0unset", (value != NULL) ? strlen(value) + 1 : 6);
+	}
+
+	return b->nwords - first;
+}
+
+
+/* Function: rc_cacheable (internal)
+   Parse line, *words receives its expanded words if it is a single
+   builtin of rc_builtins or assignments whose words do not depend on
+   anything but variables (tainted: not even on them)
+   Returns the command parsed, NULL if the line is not cacheable
+*/
+static COMMAND *rc_cacheable(const char *line, int tainted, char ***words)
+{
+	static const char *dynamic[] = {"`", "$(", "<(", ">(", "$?", "$$", "$#", "$@", "$*", NULL};
+	COMMAND *cmd;
+	char *expanded;
+	int i, n;
+
+	for (i = 0; dynamic[i] != NULL; i++)
+	{
+		if (strstr(line, dynamic[i]) != NULL)
+		{
+			return NULL;
+		}
+	}
+	if (tainted == TRUE && strchr(line, '$') != NULL)
+	{
+		return NULL;
+	}
+
+	expanded = alias_expand(line);
+	cmd = command_parse((expanded != NULL) ? expanded : line);
+	free(expanded);
+	if (cmd == NULL)
+	{
+		return NULL;
+	}
+	for (n = 0; cmd->argv[n] != NULL && vars_assignment(cmd->argv[n]) > 0; n++)
+	{
+	}
+	for (i = 0; n == 0 && cmd->argv[0] != NULL && rc_builtins[i] != NULL; i++)
+	{
+		if (strcmp(cmd->argv[0], rc_builtins[i]) == 0)
+		{
+			break;
+		}
+	}
+	if (cmd->next != NULL || cmd->pipe == TRUE || cmd->background == TRUE || cmd->infile != NULL
+		|| cmd->outfile != NULL || cmd->heredoc != NULL || cmd->heredoc_tag != NULL || cmd->procsub != NULL
+		|| cmd->argv[0] == NULL || (cmd->argv[n] != NULL && (n > 0 || rc_builtins[i] == NULL || cmd->argv[1] == NULL)))
+	{
+		command_free(cmd);
+		return NULL;
+	}
+
+	*words = vars_expand(cmd->argv, 0);
+	for (i = 0; (*words)[i] != NULL; i++)
+	{
+		if (wildcard_magic((*words)[i]) == TRUE)
+		{
+			vars_expand_free(*words, cmd->argv);
+			command_free(cmd);
+			return NULL;
+		}
+	}
+
+	return cmd;
+}
+
+
+/* Function: rc_write (internal)
+   Write the image of b to cache, under a temporary name renamed into place
+*/
+static void rc_write(RC_BUILD *b, RC_HEADER *h, const char *cache)
+{
+	char tmp[PATH_MAX];
+	long ops = b->nops * sizeof (RC_OP), words = b->nwords * sizeof (int);
+	int fd;
+
+	memcpy(h->magic, RC_MAGIC, sizeof h->magic);
+	h->version = RC_VERSION;
+	h->nops = b->nops;
+	h->nwords = b->nwords;
+	h->strings = sizeof (RC_HEADER) + ops + words;
+	h->length = h->strings + b->len;
+
+	if (snprintf(tmp, sizeof tmp, "%s.XXXXXX", cache) >= (int) sizeof tmp || (fd = mkostemp(tmp, O_CLOEXEC)) == -1)
+	{
+		return;
+	}
+	if ((long) sizeof (RC_HEADER) != write(fd, h, sizeof (RC_HEADER))
+		|| ops != write(fd, b->ops, ops) || words != write(fd, b->words, words)
+		|| b->len != write(fd, b->strings, b->len) || -1 == rename(tmp, cache))
+	{
+		unlink(tmp);
+	}
+	close(fd);
+}
+
+
+/* Function: rc_extend (internal)
+   Append the next line of the text (at *next) to *line, *p keeps its
+   offset in it
+   Returns 0, -1 on allocation failure
+*/
+static int rc_extend(char **line, char **p, const char **next)
+{
+	const char *eol = strchrnul(*next, '\n');
+	long n = *p - *line;
+	char *grow;
+
+	grow = realloc(*line, strlen(*line) + (eol - *next) + 2);
+	if (grow == NULL)
+	{
+		return -1;
+	}
+	*line = grow;
+	*p = grow + n;
+	strcat(grow, "\n");
+	strncat(grow, *next, eol - *next);
+	*next = (*eol == '\n') ? eol + 1 : eol;
+
+	return 0;
+}
+
+
+/* Function: rc_compile (internal)
+   Run the rc file text line by line, record the ops into an image
+   Returns 0, RC_EXIT if a line ran exit
+*/
+static int rc_compile(const char *text, const struct stat *st, const char *cache,
+	RC_RUN run, RC_SOURCE source, RC_STATS *stats)
+{
+	RC_BUILD b;
+	RC_HEADER h;
+	ALIAS *fn;
+	COMMAND *cmd;
+	SCRIPT *script = NULL;
+	char *line = NULL, *p, **words, *func[3] = {NULL, NULL, NULL}, *rest[2] = {NULL, NULL};
+	const char *eol, *next;
+	int n, ret = 0, tainted = FALSE, nnames;
+	struct timespec start;
+
+	memset(&b, 0, sizeof b);
+	memset(&h, 0, sizeof h);
+	h.size = st->st_size;
+	h.mtime_sec = st->st_mtim.tv_sec;
+	h.mtime_nsec = st->st_mtim.tv_nsec;
+	h.text = rc_hash(0xcbf29ce484222325ULL, text, st->st_size);
+	// values before the rc file runs, as when the image is checked
+	nnames = rc_names(&b, text, &h.vars);
+
+	for (next = text; *next != '\0' && ret == 0; )
+	{
+		eol = strchrnul(next, '\n');
+		n = eol - next;
+		next = (*eol == '\n') ? eol + 1 : eol;
+		free(line);
+		line = strndup(eol - n, n);
+		if (line == NULL)
+		{
+			break;
+		}
+		p = line + strspn(line, " \t");
+		if (*p == '\0' || *p == '#')
+		{
+			continue;
+		}
+		stats->lines++;
+
+		// function definitions, the body may take the next lines
+		while (*p != '\0' && (n = alias_funcdef(p, &fn)) != 0)
+		{
+			if (n == -1 && *next == '\0')
+			{
+#ifdef WARNING
+	printf("-mysh: %s: unexpected end of file in function definition\n", RC_FILE);
+#endif
+				*p = '\0';
+				break;
+			}
+			if (n == -1)
+			{
+				if (-1 == rc_extend(&line, &p, &next))
+				{
+					break;
+				}
+				continue;
+			}
+			if (fn != NULL)
+			{
+				func[0] = fn->name;
+				func[1] = fn->source;
+				rc_op(&b, RC_FUNC, func);
+			}
+			p += n;
+			p += strspn(p, " \t;");
+		}
+		if (*p == '\0')
+		{
+			continue;
+		}
+
+		// if, while, for ... take the lines up to their end, kept as text
+		while (script_control(p) == TRUE && *next != '\0' && script_compile(p, &script) == SCRIPT_MORE)
+		{
+			if (-1 == rc_extend(&line, &p, &next))
+			{
+				break;
+			}
+		}
+		script_free(script);
+		script = NULL;
+
+		// words of a builtin or of assignments, else the line itself
+		cmd = (script_control(p) == FALSE) ? rc_cacheable(p, tainted, &words) : NULL;
+		if (cmd != NULL)
+		{
+			rc_op(&b, RC_WORDS, words);
+			ret = (run(words) == -1) ? RC_EXIT : 0;
+			vars_expand_free(words, cmd->argv);
+			command_free(cmd);
+		}
+		else
+		{
+			rest[0] = p;
+			rc_op(&b, RC_LINE, rest);
+			tainted = TRUE;
+			ret = (source(p) == -1) ? RC_EXIT : 0;
+		}
+	}
+	free(line);
+
+	// nothing is written if the rc file exited, it did not run to the end
+	if (b.failed == FALSE && ret == 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		h.nnames = nnames;
+		rc_write(&b, &h, cache);
+		stats->write_us = rc_elapsed(&start);
+	}
+	stats->ops = b.nops;
+	free(b.ops);
+	free(b.words);
+	free(b.strings);
+	free(b.intern);
+
+	return ret;
+}
+
+
+/* Function: rc_valid (internal)
+   Check the image at image (len bytes) against the rc file fd: layout,
+   size and mtime or contents, values of the variables
+   Returns TRUE if it can be replayed
+*/
+static int rc_valid(const RC_HEADER *h, long len, int fd, const struct stat *st)
+{
+	const RC_OP *ops = (const RC_OP*) (h + 1);
+	const int *words = (const int*) (ops + h->nops);
+	const char *strings = (const char*) h + h->strings, *value;
+	unsigned long long vars = 0xcbf29ce484222325ULL, text = 0xcbf29ce484222325ULL;
+	char buf[16384];
+	long n, done;
+	int i;
+
+	if (len < (long) sizeof (RC_HEADER) || memcmp(h->magic, RC_MAGIC, sizeof h->magic) != 0
+		|| h->version != RC_VERSION || h->length != len || h->nops < 0 || h->nwords < 0
+		|| h->nnames < 0 || h->nnames > h->nwords
+		|| h->strings != (long long) (sizeof (RC_HEADER) + h->nops * sizeof (RC_OP) + h->nwords * sizeof (int))
+		|| h->strings >= len || ((const char*) h)[len-1] != '\0')
+	{
+		return FALSE;
+	}
+	for (i = 0; i < h->nwords; i++)
+	{
+		if (words[i] < 0 || words[i] >= len - h->strings)
+		{
+			return FALSE;
+		}
+	}
+	for (i = 0; i < h->nops; i++)
+	{
+		if (ops[i].word < h->nnames || ops[i].nwords < 1 || ops[i].word + ops[i].nwords > h->nwords)
+		{
+			return FALSE;
+		}
+	}
+
+	// same file, else same contents (touched)
+	if (h->size != st->st_size)
+	{
+		return FALSE;
+	}
+	if (h->mtime_sec != st->st_mtim.tv_sec || h->mtime_nsec != st->st_mtim.tv_nsec)
+	{
+		for (done = 0; done < st->st_size && (n = pread(fd, buf, sizeof buf, done)) > 0; done += n)
+		{
+			text = rc_hash(text, buf, n);
+		}
+		if (done != st->st_size || text != h->text)
+		{
+			return FALSE;
+		}
+	}
+
+	for (i = 0; i < h->nnames; i++)
+	{
+		value = vars_get(strings + words[i]);
+		vars = rc_hash(vars, strings + words[i], strlen(strings + words[i]) + 1);
+		vars = rc_hash(vars, (value != NULL) ? value : "\0unset", (value != NULL) ? strlen(value) + 1 : 6);
+	}
+
+	return vars == h->vars;
+}
+
+
+/* Function: rc_replay (internal)
+   Run the ops of the image
+   Returns 0, RC_EXIT if a line ran exit
+*/
+static int rc_replay(const RC_HEADER *h, RC_RUN run, RC_SOURCE source)
+{
+	const RC_OP *ops = (const RC_OP*) (h + 1);
+	const int *words = (const int*) (ops + h->nops);
+	char *strings = (char*) h + h->strings, **argv = NULL, **grow;
+	int i, k, size = 0, ret = 0;
+
+	for (i = 0; i < h->nops && ret == 0; i++)
+	{
+		if (ops[i].nwords + 1 > size)
+		{
+			size = ops[i].nwords + 1;
+			grow = realloc(argv, size * sizeof (char*));
+			if (grow == NULL)
+			{
+				break;
+			}
+			argv = grow;
+		}
+		for (k = 0; k < ops[i].nwords; k++)
+		{
+			argv[k] = strings + words[ops[i].word + k];
+		}
+		argv[k] = NULL;
+
+		switch (ops[i].type)
+		{
+			case RC_FUNC:
+				if (ops[i].nwords == 2)
+				{
+					alias_define_source(argv[0], argv[1]);
+				}
+				break;
+			case RC_WORDS:
+				ret = (run(argv) == -1) ? RC_EXIT : 0;
+				break;
+			case RC_LINE:
+				ret = (source(argv[0]) == -1) ? RC_EXIT : 0;
+				break;
+			default:
+				break;
+		}
+	}
+	free(argv);
+
+	return ret;
+}
+
+
+/* Function: rc_load
+   The rc file is only read when the image cannot be used
+*/
+int rc_load(const char *path, const char *cache, RC_RUN run, RC_SOURCE source, RC_STATS *stats)
+{
+	RC_STATS none;
+	struct timespec start;
+	struct stat st, cst;
+	char *text;
+	long n, done;
+	int fd, cfd, ret;
+
+	if (stats == NULL)
+	{
+		stats = &none;
+	}
+	memset(stats, 0, sizeof (RC_STATS));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || -1 == fstat(fd, &st))
+	{
+		if (fd != -1)
+		{
+			close(fd);
+		}
+		return -1;
+	}
+
+	rc_free();
+	cfd = open(cache, O_RDONLY | O_CLOEXEC);
+	if (cfd != -1 && 0 == fstat(cfd, &cst) && cst.st_size >= (long) sizeof (RC_HEADER))
+	{
+		image = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+		image_len = cst.st_size;
+		if (image == MAP_FAILED || rc_valid(image, image_len, fd, &st) == FALSE)
+		{
+			rc_free();
+		}
+	}
+	if (cfd != -1)
+	{
+		close(cfd);
+	}
+	stats->check_us = rc_elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (image != NULL)
+	{
+		close(fd);
+		stats->hit = TRUE;
+		stats->ops = ((RC_HEADER*) image)->nops;
+		ret = rc_replay(image, run, source);
+		stats->run_us = rc_elapsed(&start);
+		return ret;
+	}
+
+	text = malloc(st.st_size + 1);
+	for (done = 0; text != NULL && done < st.st_size && (n = pread(fd, text + done, st.st_size - done, done)) > 0; done += n)
+	{
+	}
+	close(fd);
+	if (text == NULL)
+	{
+		return -1;
+	}
+	text[done] = '\0';
+	st.st_size = done;
+	ret = rc_compile(text, &st, cache, run, source, stats);
+	free(text);
+	stats->run_us = rc_elapsed(&start) - stats->write_us;
+
+	return ret;
+}
+
+
+/* Function: rc_free
+   The image stays mapped while the shell runs, nothing points into it
+   once the ops are replayed but it costs no memory
+*/
+void rc_free()
+{
+	if (image != NULL && image != MAP_FAILED)
+	{
+		munmap(image, image_len);
+	}
+	image = NULL;
+	image_len = 0;
+}
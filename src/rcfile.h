@@ -0,0 +1,115 @@
+/*
+	RCFILE runs ~/.myshrc when the shell starts. Lines are run in order:
+	blank lines and lines starting with '#' are skipped, a function
+	definition takes the lines up to the end of its body.
+
+	Most of an rc file only defines things: functions, aliases, variables,
+	prompt segments. The first run compiles such lines into an image kept
+	next to the rc file: a function is stored as its normalized body, an
+	alias, export, unset, prompt or assignment line as its words already
+	expanded. The image is a header, an array of ops, an array of word
+	offsets and one table of interned strings, all offsets so it is used
+	as mapped with mmap(), no pointer to fix and nothing to parse. Later
+	starts replay the ops (functions are parsed on their first call).
+
+	Lines that do something else (external commands, $(...), patterns,
+	cd, function calls) are kept as text and run as typed on each start,
+	in their place; an if, while, for or case is kept with all its
+	lines. Once such a line ran, later lines using variables are kept as
+	text too, the line may have changed them.
+
+	The image is used while the rc file has the same size and mtime (or,
+	if touched, the same contents) and the variables the rc file uses
+	hold the values they had when it was compiled.
+*/
+
+#ifndef _RCFILE_H_
+#define _RCFILE_H_
+
+#include "include.h"
+
+/* rc file and its image, relative to $HOME */
+#define RC_FILE ".myshrc"
+#define RC_CACHE ".myshrc.cache"
+
+/* Header of an image, RC_VERSION changes with its layout */
+#define RC_MAGIC "MYSHRC\0"
+#define RC_VERSION 1
+
+/* Op types */
+#define RC_FUNC 1
+#define RC_WORDS 2
+#define RC_LINE 3
+
+/* rc_load() stopped at an exit */
+#define RC_EXIT 1
+
+
+/* Typedef: RC_HEADER
+   Start of an image. size, mtime and text (a hash of the contents)
+   identify the rc file compiled, vars hashes the values of the nnames
+   variables it uses, named by the first nnames words. The arrays follow
+   the header: nops RC_OP, nwords word offsets, then the string table
+   (from offset strings up to length)
+*/
+typedef struct rc_header {
+	char magic[8];
+	int version;
+	int nops;
+	int nwords;
+	int nnames;
+	long long size;
+	long long mtime_sec;
+	long long mtime_nsec;
+	unsigned long long text;
+	unsigned long long vars;
+	long long strings;
+	long long length;
+} RC_HEADER;
+
+
+/* Typedef: RC_OP
+   One op: nwords words from index word of the word array. RC_FUNC has
+   the name and the body, RC_WORDS the words of a builtin or of
+   assignments, RC_LINE the line
+*/
+typedef struct rc_op {
+	int type;
+	int nwords;
+	int word;
+} RC_OP;
+
+
+/* Typedef: RC_STATS
+   What rc_load() did, times in microseconds
+*/
+typedef struct rc_stats {
+	int hit;
+	int ops;
+	int lines;
+	long check_us;
+	long run_us;
+	long write_us;
+} RC_STATS;
+
+
+/* Callbacks of the shell: run the words of a builtin or of assignments,
+   run a line as typed. Both return -1 to stop at an exit */
+typedef int (*RC_RUN)(char **argv);
+typedef int (*RC_SOURCE)(const char *line);
+
+
+/* Function: rc_load
+   Run the rc file path, from the image cache if it is valid, else line by
+   line, compiling a new image. stats may be NULL
+   Returns 0, RC_EXIT if the rc file exited, -1 if path cannot be read
+*/
+int rc_load(const char *path, const char *cache, RC_RUN run, RC_SOURCE source, RC_STATS *stats);
+
+
+/* Function: rc_free
+   Unmap the image
+*/
+void rc_free();
+
+#endif /* _RCFILE_H_ */
@@ -0,0 +1,341 @@
+#include "rcfile.h"
+#include "alias.h"
+#include "vars.h"
+
+extern char **environ;
+
+/* prototypes */
+void test_compile(const char *dir);
+void test_valid(const char *dir);
+void test_exit(const char *dir);
+void test_bench(const char *dir, int count);
+
+/* rc file of the tests */
+static const char *rc_text =
+	"# comment\n"
+	"\n"
+	"alias ll='ls -l'\n"
+	"greet() {\n"
+	"  echo hi $1\n"
+	"}\n"
+	"GREETING=hello\n"
+	"export TARGET=$GREETING/world\n"
+	"prompt add x\n"
+	"echo started\n"
+	"export LATE=$GREETING\n";
+
+/* What the callbacks ran */
+static char log_text[4096];
+
+
+/* Function: run (helper)
+   Callback for words: assignments, alias and export, others are logged
+*/
+int run(char **argv)
+{
+	int n;
+
+	for (n = 0; argv[n] != NULL && vars_assignment(argv[n]) > 0; n++)
+	{
+	}
+	if (n > 0 && argv[n] == NULL)
+	{
+		vars_assign(argv, n, FALSE);
+	}
+	else if (strcmp(argv[0], "alias") == 0)
+	{
+		alias_command(argv);
+	}
+	else if (strcmp(argv[0], "export") == 0)
+	{
+		for (n = 1; argv[n] != NULL; n++)
+		{
+			vars_assign(&argv[n], 1, TRUE);
+		}
+	}
+	else
+	{
+		strcat(log_text, "run:");
+		for (n = 0; argv[n] != NULL; n++)
+		{
+			strcat(log_text, argv[n]);
+			strcat(log_text, (argv[n+1] != NULL) ? " " : "\n");
+		}
+	}
+
+	return 0;
+}
+
+
+/* Function: source (helper)
+   Callback for lines: logged, exit stops
+*/
+int source(const char *line)
+{
+	strcat(log_text, "line:");
+	strcat(log_text, line);
+	strcat(log_text, "\n");
+
+	return (strcmp(line, "exit") == 0) ? -1 : 0;
+}
+
+
+/* Function: reset (helper)
+   Forget what an rc file defined
+*/
+void reset()
+{
+	alias_unset(NULL);
+	alias_unset_function("greet");
+	vars_unset("GREETING");
+	vars_unset("TARGET");
+	vars_unset("LATE");
+	log_text[0] = '\0';
+}
+
+
+/* Function: write_rc (helper)
+   Replace the contents of path
+*/
+void write_rc(const char *path, const char *text)
+{
+	FILE *f = fopen(path, "w");
+
+	assert(f != NULL);
+	fputs(text, f);
+	fclose(f);
+}
+
+
+/* Function: check_state (helper)
+   What rc_text defines
+*/
+void check_state()
+{
+	assert(alias_get("ll") != NULL && strcmp(alias_get("ll"), "ls -l") == 0);
+	assert(alias_function("greet") != NULL && strcmp(alias_function("greet")->source, "echo hi $1") == 0);
+	assert(vars_get("TARGET") != NULL && strcmp(vars_get("TARGET"), "hello/world") == 0);
+	assert(strcmp(log_text, "run:prompt add x\nline:echo started\nline:export LATE=$GREETING\n") == 0);
+}
+
+
+/* Function: test_compile
+   The first load compiles, the second replays the image
+*/
+void test_compile(const char *dir)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: RCFILE compile and replay\n");
+#endif
+
+	char path[PATH_MAX], cache[PATH_MAX];
+	RC_STATS stats;
+	struct stat st;
+
+	snprintf(path, sizeof path, "%s/rc", dir);
+	snprintf(cache, sizeof cache, "%s/rc.cache", dir);
+	assert(rc_load(path, cache, run, source, &stats) == -1);
+
+	write_rc(path, rc_text);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(stats.hit == FALSE && stats.ops == 7 && stats.lines == 7);
+	check_state();
+	assert(stat(cache, &st) == 0 && st.st_size > (long) sizeof (RC_HEADER));
+
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(stats.hit == TRUE && stats.ops == 7);
+	check_state();
+	// parsed on its first call
+	assert(alias_function("greet")->parsed == FALSE);
+	assert(alias_enter(alias_function("greet")) == 0);
+	assert(strcmp(alias_function("greet")->body->argv[0], "echo") == 0);
+	alias_leave(alias_function("greet"));
+
+	// without stats
+	reset();
+	assert(rc_load(path, cache, run, source, NULL) == 0);
+	check_state();
+	rc_free();
+}
+
+
+/* Function: test_valid
+   Touched, edited, variables changed, corrupt image
+*/
+void test_valid(const char *dir)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: RCFILE image checks\n");
+#endif
+
+	char path[PATH_MAX], cache[PATH_MAX], edited[1024];
+	struct timespec times[2] = {{0, UTIME_NOW}, {12345, 0}};
+	RC_STATS stats;
+	int fd;
+
+	snprintf(path, sizeof path, "%s/rc", dir);
+	snprintf(cache, sizeof cache, "%s/rc.cache", dir);
+
+	// same contents, other mtime
+	assert(utimensat(AT_FDCWD, path, times, 0) == 0);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(stats.hit == TRUE);
+	check_state();
+
+	// edited, same size
+	snprintf(edited, sizeof edited, "%s", rc_text);
+	*strstr(edited, "hello") = 'j';
+	write_rc(path, edited);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(stats.hit == FALSE);
+	assert(strcmp(vars_get("TARGET"), "jello/world") == 0);
+	write_rc(path, rc_text);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0 && stats.hit == FALSE);
+	check_state();
+
+	// a variable the rc file uses has another value
+	reset();
+	assert(vars_set("GREETING", "before", FALSE) == 0);
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(stats.hit == FALSE);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(stats.hit == FALSE);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(stats.hit == TRUE);
+
+	// corrupt images are compiled again
+	fd = open(cache, O_WRONLY);
+	assert(fd != -1 && pwrite(fd, "X", 1, 0) == 1);
+	close(fd);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0 && stats.hit == FALSE);
+	check_state();
+	assert(truncate(cache, sizeof (RC_HEADER) + 4) == 0);
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0 && stats.hit == FALSE);
+	check_state();
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0 && stats.hit == TRUE);
+	rc_free();
+}
+
+
+/* Function: test_exit
+   An rc file that exits stops and is not compiled
+*/
+void test_exit(const char *dir)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: RCFILE exit\n");
+#endif
+
+	char path[PATH_MAX], cache[PATH_MAX];
+	RC_STATS stats;
+
+	snprintf(path, sizeof path, "%s/exiting", dir);
+	snprintf(cache, sizeof cache, "%s/exiting.cache", dir);
+	write_rc(path, "alias a=b\nexit\nalias c=d\nbroken() {\n");
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == RC_EXIT);
+	assert(alias_get("a") != NULL && alias_get("c") == NULL);
+	assert(access(cache, F_OK) == -1);
+
+	// a definition left open ends with the file
+	write_rc(path, "alias c=d\nbroken() {\n  true\n");
+	reset();
+	assert(rc_load(path, cache, run, source, &stats) == 0);
+	assert(alias_get("c") != NULL && alias_function("broken") == NULL);
+	unlink(path);
+	unlink(cache);
+	rc_free();
+}
+
+
+/* Function: test_bench
+   Loads of an rc file of many aliases and functions, compiled and
+   from the image
+*/
+void test_bench(const char *dir, int count)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: RCFILE %d loads\n", count);
+#endif
+
+	char path[PATH_MAX], cache[PATH_MAX], line[128];
+	struct timespec start, end;
+	long miss = 0, hit = 0;
+	RC_STATS stats;
+	FILE *f;
+	int i;
+
+	snprintf(path, sizeof path, "%s/big", dir);
+	snprintf(cache, sizeof cache, "%s/big.cache", dir);
+	f = fopen(path, "w");
+	assert(f != NULL);
+	for (i = 0; i < 300; i++)
+	{
+		snprintf(line, sizeof line, "alias a%d='ls -l --color %d'\nf%d() {\n  echo %d | wc -c; true\n}\n", i, i, i, i);
+		fputs(line, f);
+	}
+	fclose(f);
+
+	for (i = 0; i < count; i++)
+	{
+		unlink(cache);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		assert(rc_load(path, cache, run, source, &stats) == 0 && stats.hit == FALSE);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		miss += (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		assert(rc_load(path, cache, run, source, &stats) == 0 && stats.hit == TRUE);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		hit += (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	}
+	assert(stats.ops == 600);
+	assert(strcmp(alias_get("a299"), "ls -l --color 299") == 0);
+	unlink(path);
+	unlink(cache);
+	rc_free();
+
+#ifdef DEBUG_TEST
+	printf("TEST: RCFILE %ld us compiled, %ld us from the image\n", miss / count / 1000, hit / count / 1000);
+#endif
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: RCFILE Module\n");
+#endif
+
+	char dir[] = "/tmp/rcfile_test.XXXXXX", path[PATH_MAX];
+
+	assert(vars_init(environ) == 0);
+	assert(mkdtemp(dir) != NULL);
+	test_compile(dir);
+	test_valid(dir);
+	test_exit(dir);
+	test_bench(dir, 20);
+	snprintf(path, sizeof path, "%s/rc", dir);
+	unlink(path);
+	snprintf(path, sizeof path, "%s/rc.cache", dir);
+	unlink(path);
+	rmdir(dir);
+	alias_free();
+	vars_free();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: RCFILE Module\n");
+#endif
+
+	return 0;
+}
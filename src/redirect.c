@@ -0,0 +1,131 @@
+#include "redirect.h"
+#include <sys/mman.h>
+
+int redirect_prefetch = 0;
+
+
+/* Function: redirect_heredoc
+   Copy here-document body into a sealed memfd
+*/
+int redirect_heredoc(const COMMAND *cmd)
+{
+	int fd, len, ret;
+	char *p;
+
+	if (cmd->heredoc == NULL)
+	{
+		return -1;
+	}
+
+	fd = memfd_create("mysh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd == -1)
+	{
+#ifdef WARNING
+		perror("memfd_create");
+#endif
+		return -1;
+	}
+
+	for (p = cmd->heredoc, len = cmd->heredoc_len; len > 0; p += ret, len -= ret)
+	{
+		ret = write(fd, p, len);
+		if (ret == -1)
+		{
+			if (errno == EINTR)
+			{
+				ret = 0;
+				continue;
+			}
+#ifdef WARNING
+			perror("write");
+#endif
+			close(fd);
+			return -1;
+		}
+	}
+
+	// contents are final, the child only ever reads
+	if (-1 == fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL))
+	{
+		perror("fcntl");
+	}
+	if (-1 == lseek(fd, 0, SEEK_SET))
+	{
+		perror("lseek");
+	}
+
+	return fd;
+}
+
+
+/* Function: redirect_input
+   Open stdin of the job in the shell
+*/
+int redirect_input(const COMMAND *cmd)
+{
+	int fd;
+
+	if (cmd->heredoc != NULL)
+	{
+		return redirect_heredoc(cmd);
+	}
+	if (cmd->infile == NULL || redirect_prefetch <= 0)
+	{
+		return -1;
+	}
+
+	fd = open(cmd->infile, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+#ifdef WARNING
+		printf("-mysh: %s: %s\n", cmd->infile, strerror(errno));
+#endif
+		return REDIRECT_ERR;
+	}
+	redirect_advise(fd, (off_t) redirect_prefetch << 20);
+
+	return fd;
+}
+
+
+/* Function: redirect_advise
+   Sequential access hint plus asynchronous readahead of the first window
+*/
+int redirect_advise(int fd, off_t len)
+{
+	int ret;
+
+	// errors are only hints, e.g. pipes and ttys do not support fadvise
+	ret = posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	if (ret == 0)
+	{
+		ret = posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+	}
+
+	return (ret == 0) ? 0 : -1;
+}
+
+
+/* Function: redirect_prefetch_file
+   Warm the page cache for a file used by an upcoming job
+*/
+int redirect_prefetch_file(const char *path)
+{
+	int fd, window = redirect_prefetch > 0 ? redirect_prefetch : REDIRECT_WINDOW;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+	// page cache keeps the data after the descriptor is closed
+	if (-1 == redirect_advise(fd, (off_t) window << 20))
+	{
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	close(fd);
+
+	return 0;
+}
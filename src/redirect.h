@@ -0,0 +1,59 @@
+/*
+	Redirections prepared by the shell before the job is forked.
+	Here-documents and here-strings are written once into a sealed memfd
+	which the child takes as stdin: no temp file, no helper process, and
+	the data is seekable like a regular file.
+	When prefetching is enabled, "< file" is opened by the shell instead of
+	the child, so open errors are reported before anything is forked, and
+	the kernel is asked to start reading the first window of the file while
+	the job is being set up.
+*/
+
+#ifndef _REDIRECT_H_
+#define _REDIRECT_H_
+
+#include "include.h"
+#include "parser.h"
+
+/* redirect_input() result when the input file cannot be opened */
+#define REDIRECT_ERR -2
+
+/* Default prefetch window in MB used by the prefetch builtin */
+#define REDIRECT_WINDOW 8
+
+/* Prefetch window in MB for "< file" redirects, 0 disables prefetching */
+extern int redirect_prefetch;
+
+
+/* Function: redirect_heredoc
+   Create a sealed memfd holding the here-document/here-string of cmd
+   Returns the file descriptor positioned at offset 0 (close-on-exec), or -1 if
+   cmd has no here-document or the memfd could not be created
+*/
+int redirect_heredoc(const COMMAND *cmd);
+
+
+/* Function: redirect_input
+   Prepare stdin for cmd in the shell: here-document memfd, or the prefetched
+   input file when redirect_prefetch is enabled
+   Returns close-on-exec file descriptor to dup2 onto stdin in the child,
+   -1 if the child should handle its own input redirect, or REDIRECT_ERR if
+   the input file could not be opened (message already printed)
+*/
+int redirect_input(const COMMAND *cmd);
+
+
+/* Function: redirect_advise
+   Hint sequential access and start readahead of the first len bytes of fd
+   Returns 0 on success, -1 on error
+*/
+int redirect_advise(int fd, off_t len);
+
+
+/* Function: redirect_prefetch_file
+   Open path and start readahead of its first redirect window (for the prefetch builtin)
+   Returns 0 on success, -1 on error
+*/
+int redirect_prefetch_file(const char *path);
+
+#endif /* _REDIRECT_H_ */
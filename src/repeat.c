@@ -0,0 +1,269 @@
+#include "repeat.h"
+
+
+/* Function: repeat_parse
+   repeat [-v] N, watch [-n SECS] [-c COUNT] [-d]
+*/
+int repeat_parse(char **argv, REPEAT_OPTS *opts)
+{
+	char *end;
+	double secs;
+	int i;
+
+	memset(opts, 0, sizeof (REPEAT_OPTS));
+	opts->watch = (strcmp(argv[0], "watch") == 0);
+	opts->count = -1;
+	opts->interval = REPEAT_INTERVAL;
+
+	for (i = 1; argv[i] != NULL && argv[i][0] == '-'; i++)
+	{
+		if (strcmp(argv[i], "-v") == 0)
+		{
+			opts->verbose = TRUE;
+		}
+		else if (opts->watch && strcmp(argv[i], "-d") == 0)
+		{
+			opts->diff = TRUE;
+		}
+		else if (opts->watch && strcmp(argv[i], "-n") == 0 && argv[i+1] != NULL)
+		{
+			secs = strtod(argv[++i], &end);
+			if (*end != '\0' || secs < 0.01)
+			{
+				goto repeat_usage;
+			}
+			opts->interval = (long) (secs * 1000);
+		}
+		else if (opts->watch && strcmp(argv[i], "-c") == 0 && argv[i+1] != NULL)
+		{
+			opts->count = strtol(argv[++i], &end, 10);
+			if (*end != '\0' || opts->count < 1)
+			{
+				goto repeat_usage;
+			}
+		}
+		else
+		{
+			goto repeat_usage;
+		}
+	}
+	if (opts->watch == FALSE && argv[i] != NULL)
+	{
+		opts->count = strtol(argv[i++], &end, 10);
+		if (*end != '\0' || opts->count < 0)
+		{
+			goto repeat_usage;
+		}
+	}
+	if (argv[i] == NULL || (opts->count == -1 && opts->watch == FALSE))
+	{
+		goto repeat_usage;
+	}
+
+	return i;
+
+repeat_usage:
+#ifdef WARNING
+	if (opts->watch)
+	{
+		printf("-mysh: watch: usage: watch [-n SECS] [-c COUNT] [-d] cmd ...\n");
+	}
+	else
+	{
+		printf("-mysh: repeat: usage: repeat [-v] N cmd ...\n");
+	}
+#endif
+	return -1;
+}
+
+
+/* Function: repeat_stats_init
+   Latency array sized for the expected number of runs
+*/
+REPEAT_STATS *repeat_stats_init(long expected)
+{
+	REPEAT_STATS *st = calloc(1, sizeof (REPEAT_STATS));
+
+	if (st == NULL)
+	{
+		return NULL;
+	}
+	st->size = (expected > 0 && expected < 1048576) ? expected : 64;
+	st->lat = malloc(st->size * sizeof (long));
+	if (st->lat == NULL)
+	{
+		free(st);
+		return NULL;
+	}
+
+	return st;
+}
+
+
+/* Function: repeat_stats_add
+   Double the array when full, drop the run if that fails
+*/
+void repeat_stats_add(REPEAT_STATS *st, long usec, int status)
+{
+	long *grow;
+
+	if (status != 0)
+	{
+		st->failed++;
+	}
+	if (st->count == st->size)
+	{
+		grow = realloc(st->lat, 2 * st->size * sizeof (long));
+		if (grow == NULL)
+		{
+			return;
+		}
+		st->lat = grow;
+		st->size *= 2;
+	}
+	st->lat[st->count++] = usec;
+}
+
+
+/* Function: repeat_compare (internal)
+   qsort order of latencies
+*/
+static int repeat_compare(const void *a, const void *b)
+{
+	long x = *(const long*) a, y = *(const long*) b;
+
+	return (x > y) - (x < y);
+}
+
+
+/* Function: repeat_ms (internal)
+   Print usec as milliseconds into buf
+*/
+static char *repeat_ms(long usec, char *buf)
+{
+	sprintf(buf, "%ld.%03ldms", usec / 1000, usec % 1000);
+	return buf;
+}
+
+
+/* Function: repeat_stats_summary
+   Sorts the latencies, later runs may still be added
+*/
+char *repeat_stats_summary(REPEAT_STATS *st, char *buf, int size)
+{
+	char min[32], p50[32], p95[32], max[32];
+	long total = 0, i;
+
+	if (st->count == 0)
+	{
+		snprintf(buf, size, "0 runs");
+		return buf;
+	}
+	for (i = 0; i < st->count; i++)
+	{
+		total += st->lat[i];
+	}
+	qsort(st->lat, st->count, sizeof (long), repeat_compare);
+	snprintf(buf, size, "%ld runs, %ld failed: min %s p50 %s p95 %s max %s, total %ld.%06lds",
+		st->count, st->failed, repeat_ms(st->lat[0], min),
+		repeat_ms(st->lat[(st->count - 1) / 2], p50),
+		repeat_ms(st->lat[(st->count * 95 + 99) / 100 - 1], p95),
+		repeat_ms(st->lat[st->count - 1], max),
+		total / 1000000, total % 1000000);
+
+	return buf;
+}
+
+
+/* Function: repeat_stats_free
+   Free the array and the struct
+*/
+void repeat_stats_free(REPEAT_STATS *st)
+{
+	if (st == NULL)
+	{
+		return;
+	}
+	free(st->lat);
+	free(st);
+}
+
+
+/* Function: repeat_write (internal)
+   write() all of buf
+*/
+static void repeat_write(int fd, const char *buf, long len)
+{
+	long n;
+
+	while (len > 0)
+	{
+		n = write(fd, buf, len);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("write");
+			return;
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+
+/* Function: repeat_diff
+   Walk both outputs line by line
+*/
+long repeat_diff(const char *prev, long prevlen, const char *cur, long curlen, int fd)
+{
+	const char *line = cur, *end = cur + curlen, *nl, *old, *oldend, *oldnl;
+	long len, oldlen, changed = 0;
+
+	if (prev == NULL)
+	{
+		repeat_write(fd, cur, curlen);
+		return 0;
+	}
+	old = prev;
+	oldend = prev + prevlen;
+	while (line < end)
+	{
+		nl = memchr(line, '\n', end - line);
+		len = (nl != NULL) ? nl - line : end - line;
+		if (old < oldend)
+		{
+			oldnl = memchr(old, '\n', oldend - old);
+			oldlen = (oldnl != NULL) ? oldnl - old : oldend - old;
+		}
+		else
+		{
+			oldlen = -1;
+		}
+
+		if (oldlen == len && memcmp(line, old, len) == 0)
+		{
+			repeat_write(fd, line, len);
+		}
+		else
+		{
+			changed++;
+			repeat_write(fd, REPEAT_MARK, strlen(REPEAT_MARK));
+			repeat_write(fd, line, len);
+			repeat_write(fd, REPEAT_UNMARK, strlen(REPEAT_UNMARK));
+		}
+		if (nl != NULL)
+		{
+			repeat_write(fd, "\n", 1);
+		}
+		line += len + 1;
+		if (oldlen != -1)
+		{
+			old += oldlen + 1;
+		}
+	}
+
+	return changed;
+}
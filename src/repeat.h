@@ -0,0 +1,92 @@
+/*
+	REPEAT holds the parts of the repeat and watch builtins that do not
+	start jobs: option parsing, per-run latency statistics and the line
+	diff shown by watch -d.
+
+	"repeat [-v] N cmd ..." runs the pipeline N times, "watch [-n SECS]
+	[-c COUNT] [-d] cmd ..." every SECS seconds until Enter is pressed. The
+	command line is parsed once: every run launches the same COMMAND list,
+	whose executables were looked up in $PATH before the first run (see
+	command_resolve()), so a run costs the fork and exec of the job only.
+*/
+
+#ifndef _REPEAT_H_
+#define _REPEAT_H_
+
+#include "include.h"
+
+/* Interval of watch unless given with -n, in milliseconds */
+#define REPEAT_INTERVAL 2000
+
+/* Changed lines of watch -d are shown in reverse video */
+#define REPEAT_MARK "\033[7m"
+#define REPEAT_UNMARK "\033[27m"
+
+
+/* Typedef: REPEAT_OPTS
+   Options of repeat (watch FALSE) and watch. count is the number of runs,
+   -1 for no limit, interval in milliseconds
+*/
+typedef struct repeat_opts {
+	int watch;
+	long count;
+	long interval;
+	int diff;
+	int verbose;
+} REPEAT_OPTS;
+
+
+/* Typedef: REPEAT_STATS
+   Latency of each run in microseconds (count of size used), number of
+   runs with a non zero exit status
+*/
+typedef struct repeat_stats {
+	long *lat;
+	long count;
+	long size;
+	long failed;
+} REPEAT_STATS;
+
+
+/* Function: repeat_parse
+   Parse the options of repeat or watch, argv[0] is the builtin name
+   Returns the index of the command in argv, -1 on a usage error
+*/
+int repeat_parse(char **argv, REPEAT_OPTS *opts);
+
+
+/* Function: repeat_stats_init
+   Create an empty set of statistics, room for expected runs (it grows)
+   Returns NULL on allocation failure
+*/
+REPEAT_STATS *repeat_stats_init(long expected);
+
+
+/* Function: repeat_stats_add
+   Record one run: its latency (microseconds) and exit status
+*/
+void repeat_stats_add(REPEAT_STATS *st, long usec, int status);
+
+
+/* Function: repeat_stats_summary
+   Format "N runs, F failed: min ... p50 ... p95 ... max ... total ..." into
+   buf, returns buf
+*/
+char *repeat_stats_summary(REPEAT_STATS *st, char *buf, int size);
+
+
+/* Function: repeat_stats_free
+   Deallocate the statistics, st may be NULL
+*/
+void repeat_stats_free(REPEAT_STATS *st);
+
+
+/* Function: repeat_diff
+   Write the output cur (curlen bytes) of a run to fd, lines that differ
+   from the same line of the previous output prev are marked; prev NULL
+   marks nothing
+   Returns the number of changed lines
+*/
+long repeat_diff(const char *prev, long prevlen, const char *cur, long curlen, int fd);
+
+#endif /* _REPEAT_H_ */
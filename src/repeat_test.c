@@ -0,0 +1,119 @@
+#include "repeat.h"
+
+/* prototypes */
+void test_parse();
+void test_stats();
+void test_diff();
+
+
+/* Function: test_parse
+   Options of repeat and watch
+*/
+void test_parse()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: REPEAT parse\n");
+#endif
+
+	char *a1[] = {"repeat", "100", "ls", "-l", NULL};
+	char *a2[] = {"repeat", "-v", "3", "true", NULL};
+	char *a3[] = {"watch", "-n", "0.5", "-d", "-c", "4", "date", NULL};
+	char *a4[] = {"watch", "uptime", NULL};
+	char *a5[] = {"repeat", "x", "ls", NULL};
+	char *a6[] = {"repeat", "5", NULL};
+	char *a7[] = {"watch", "-n", "0", "ls", NULL};
+	char *a8[] = {"repeat", "-d", "2", "ls", NULL};
+	REPEAT_OPTS opts;
+
+	assert(repeat_parse(a1, &opts) == 2);
+	assert(opts.watch == FALSE && opts.count == 100 && opts.verbose == FALSE);
+	assert(repeat_parse(a2, &opts) == 3);
+	assert(opts.count == 3 && opts.verbose == TRUE);
+	assert(repeat_parse(a3, &opts) == 6);
+	assert(opts.watch == TRUE && opts.interval == 500 && opts.diff == TRUE && opts.count == 4);
+	assert(repeat_parse(a4, &opts) == 1);
+	assert(opts.count == -1 && opts.interval == REPEAT_INTERVAL && opts.diff == FALSE);
+	assert(repeat_parse(a5, &opts) == -1);
+	assert(repeat_parse(a6, &opts) == -1);
+	assert(repeat_parse(a7, &opts) == -1);
+	assert(repeat_parse(a8, &opts) == -1);
+}
+
+
+/* Function: test_stats
+   Percentiles and failures, the array grows past the expected runs
+*/
+void test_stats()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: REPEAT stats\n");
+#endif
+
+	REPEAT_STATS *st;
+	char buf[256];
+	long i;
+
+	st = repeat_stats_init(10);
+	assert(st != NULL);
+	assert(strcmp(repeat_stats_summary(st, buf, sizeof buf), "0 runs") == 0);
+	for (i = 100; i >= 1; i--)
+	{
+		repeat_stats_add(st, i * 1000, (i % 10 == 0) ? 1 : 0);
+	}
+	assert(st->count == 100 && st->failed == 10);
+	assert(st->size >= 100);
+	repeat_stats_summary(st, buf, sizeof buf);
+	assert(strcmp(buf, "100 runs, 10 failed: min 1.000ms p50 50.000ms p95 95.000ms max 100.000ms, total 5.050000s") == 0);
+	repeat_stats_free(st);
+	repeat_stats_free(NULL);
+}
+
+
+/* Function: test_diff
+   Changed, added and unchanged lines
+*/
+void test_diff()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: REPEAT diff\n");
+#endif
+
+	const char *prev = "a\nbb\nc\n", *cur = "a\nbx\nc\nd";
+	char buf[256];
+	int fd[2];
+	long n;
+
+	assert(pipe(fd) == 0);
+	assert(repeat_diff(NULL, 0, cur, strlen(cur), fd[1]) == 0);
+	n = read(fd[0], buf, sizeof buf);
+	assert(n == strlen(cur) && memcmp(buf, cur, n) == 0);
+
+	assert(repeat_diff(prev, strlen(prev), cur, strlen(cur), fd[1]) == 2);
+	n = read(fd[0], buf, sizeof buf - 1);
+	buf[n] = '\0';
+	assert(strcmp(buf, "a\n" REPEAT_MARK "bx" REPEAT_UNMARK "\nc\n" REPEAT_MARK "d" REPEAT_UNMARK) == 0);
+
+	assert(repeat_diff(cur, strlen(cur), cur, strlen(cur), fd[1]) == 0);
+	n = read(fd[0], buf, sizeof buf);
+	assert(n == strlen(cur));
+	close(fd[0]);
+	close(fd[1]);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: REPEAT Module\n");
+#endif
+
+	test_parse();
+	test_stats();
+	test_diff();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: REPEAT Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,318 @@
+#include "sampler.h"
+
+
+/* Function: sampler_init
+   Open the children list of the shell
+*/
+SAMPLER *sampler_init()
+{
+	SAMPLER *s;
+	char path[64];
+	int i;
+
+	s = (SAMPLER*) malloc(sizeof (SAMPLER));
+	if (s == NULL)
+	{
+		return NULL;
+	}
+	snprintf(path, sizeof path, "/proc/self/task/%d/children", getpid());
+	s->childfd = open(path, O_RDONLY | O_CLOEXEC);
+	if (s->childfd == -1)
+	{
+#ifdef WARNING
+	printf("-mysh: jobs: %s not available\n", path);
+#endif
+		free(s);
+		return NULL;
+	}
+	for (i = 0; i < SAMPLER_SLOTS; i++)
+	{
+		s->proc[i].pid = 0;
+	}
+	s->count = 0;
+	s->generation = 0;
+	s->hz = sysconf(_SC_CLK_TCK);
+	s->pagekb = sysconf(_SC_PAGESIZE) / 1024;
+	s->cost = 0;
+	s->total = 0;
+	s->samples = 0;
+
+	return s;
+}
+
+
+/* Function: sampler_drop (internal)
+   Close the files of a slot and release it
+*/
+static void sampler_drop(SAMPLER *s, SAMPLE *p)
+{
+	close(p->statfd);
+	close(p->statmfd);
+	p->pid = 0;
+	s->count--;
+}
+
+
+/* Function: sampler_free
+   Close all cached files
+*/
+void sampler_free(SAMPLER *s)
+{
+	int i;
+
+	if (s == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < SAMPLER_SLOTS; i++)
+	{
+		if (s->proc[i].pid != 0)
+		{
+			sampler_drop(s, &s->proc[i]);
+		}
+	}
+	close(s->childfd);
+	free(s);
+}
+
+
+/* Function: sampler_slot (internal)
+   Find the slot of pid, open its files in a free slot if it is new
+   Returns NULL if the table is full or the process is gone
+*/
+static SAMPLE *sampler_slot(SAMPLER *s, int pid)
+{
+	SAMPLE *p, *free_slot = NULL;
+	char path[64];
+	int i;
+
+	for (i = 0; i < SAMPLER_SLOTS; i++)
+	{
+		p = &s->proc[i];
+		if (p->pid == pid)
+		{
+			return p;
+		}
+		if (p->pid == 0 && free_slot == NULL)
+		{
+			free_slot = p;
+		}
+	}
+	if (free_slot == NULL)
+	{
+		return NULL;
+	}
+
+	p = free_slot;
+	snprintf(path, sizeof path, "/proc/%d/stat", pid);
+	p->statfd = open(path, O_RDONLY | O_CLOEXEC);
+	snprintf(path, sizeof path, "/proc/%d/statm", pid);
+	p->statmfd = open(path, O_RDONLY | O_CLOEXEC);
+	if (p->statfd == -1 || p->statmfd == -1)
+	{
+		if (p->statfd != -1)
+		{
+			close(p->statfd);
+		}
+		if (p->statmfd != -1)
+		{
+			close(p->statmfd);
+		}
+		return NULL;
+	}
+	p->pid = pid;
+	p->ticks = 0;
+	p->when.tv_sec = 0;
+	p->when.tv_nsec = 0;
+	p->cpu = 0;
+	p->rss = 0;
+	s->count++;
+
+	return p;
+}
+
+
+/* Function: sampler_read (internal)
+   Read stat and statm of one process into its slot
+   Returns -1 if the process is gone
+*/
+static int sampler_read(SAMPLER *s, SAMPLE *p)
+{
+	unsigned long long utime, stime, starttime, ticks;
+	struct timespec now;
+	double elapsed;
+	unsigned long resident;
+	char *q;
+	ssize_t n;
+
+	n = pread(p->statfd, s->buf, SAMPLER_BUF - 1, 0);
+	if (n <= 0)
+	{
+		return -1;
+	}
+	s->buf[n] = '\0';
+	clock_gettime(CLOCK_BOOTTIME, &now);
+
+	// the command name may hold spaces and parentheses, fields follow the last ')'
+	q = strrchr(s->buf, ')');
+	if (q == NULL || sscanf(q + 2, "%c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+		"%*d %*d %*d %*d %*d %*d %llu", &p->state, &p->pgrp, &utime, &stime, &starttime) != 5)
+	{
+		return -1;
+	}
+	ticks = utime + stime;
+
+	// first sample: average over the life of the process
+	if (p->when.tv_sec == 0 && p->when.tv_nsec == 0)
+	{
+		elapsed = now.tv_sec + now.tv_nsec / 1e9 - (double) starttime / s->hz;
+		p->cpu = (elapsed > 0) ? 100.0 * ticks / s->hz / elapsed : 0;
+	}
+	else
+	{
+		elapsed = (now.tv_sec - p->when.tv_sec) + (now.tv_nsec - p->when.tv_nsec) / 1e9;
+		p->cpu = (elapsed > 0) ? 100.0 * (ticks - p->ticks) / s->hz / elapsed : p->cpu;
+	}
+	p->ticks = ticks;
+	p->when = now;
+
+	n = pread(p->statmfd, s->buf, SAMPLER_BUF - 1, 0);
+	if (n <= 0)
+	{
+		return -1;
+	}
+	s->buf[n] = '\0';
+	if (sscanf(s->buf, "%*u %lu", &resident) != 1)
+	{
+		return -1;
+	}
+	p->rss = resident * s->pagekb;
+
+	return 0;
+}
+
+
+/* Function: sampler_sample
+   Walk the children list, read each child, drop the ones not seen
+*/
+int sampler_sample(SAMPLER *s)
+{
+	struct timespec start, end;
+	SAMPLE *p;
+	char *q, *next;
+	ssize_t n;
+	int pids[SAMPLER_SLOTS], npids = 0;
+	int i, pid, sampled = 0;
+
+	if (s == NULL)
+	{
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	s->generation++;
+
+	n = pread(s->childfd, s->buf, SAMPLER_BUF - 1, 0);
+	if (n < 0)
+	{
+		return -1;
+	}
+	s->buf[n] = '\0';
+
+	// the list is parsed from the buffer before it is reused by sampler_read
+	for (q = s->buf; npids < SAMPLER_SLOTS; q = next)
+	{
+		pid = (int) strtol(q, &next, 10);
+		if (next == q)
+		{
+			break;
+		}
+		pids[npids++] = pid;
+	}
+
+	for (i = 0; i < npids; i++)
+	{
+		p = sampler_slot(s, pids[i]);
+		if (p == NULL)
+		{
+			continue;
+		}
+		if (-1 == sampler_read(s, p))
+		{
+			sampler_drop(s, p);
+			continue;
+		}
+		p->seen = s->generation;
+		sampled++;
+	}
+	for (i = 0; i < SAMPLER_SLOTS; i++)
+	{
+		if (s->proc[i].pid != 0 && s->proc[i].seen != s->generation)
+		{
+			sampler_drop(s, &s->proc[i]);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	s->cost = (end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec;
+	s->total += s->cost;
+	s->samples++;
+
+	return sampled;
+}
+
+
+/* Function: sampler_job
+   Sum over the members of a process group
+*/
+int sampler_job(SAMPLER *s, int pgid, double *cpu, long *rss, char *state)
+{
+	int i, n = 0;
+
+	*cpu = 0;
+	*rss = 0;
+	*state = '?';
+	for (i = 0; i < SAMPLER_SLOTS; i++)
+	{
+		if (s->proc[i].pid != 0 && s->proc[i].pgrp == pgid)
+		{
+			*cpu += s->proc[i].cpu;
+			*rss += s->proc[i].rss;
+			if (s->proc[i].pid == pgid)
+			{
+				*state = s->proc[i].state;
+			}
+			n++;
+		}
+	}
+
+	return n;
+}
+
+
+/* Function: sampler_print
+   One line per job, then the cost of the last sample
+*/
+void sampler_print(SAMPLER *s, PIDTABLE *table)
+{
+	PROCGROUP *pg;
+	double cpu;
+	long rss;
+	char state, job[16];
+	int i, n, max;
+
+	printf("%-6s %7s %5s %6s %10s %5s  %s\n", "job", "pgid", "procs", "%CPU", "RSS", "state", "command");
+	max = pidtable_getcapacity(table);
+	for (i = 1; i <= max; i++)
+	{
+		pg = pidtable_getindex(table, i);
+		if (pg == NULL)
+		{
+			continue;
+		}
+		n = sampler_job(s, pg->group_pid, &cpu, &rss, &state);
+		snprintf(job, sizeof job, "[%d]", i);
+		printf("%-6s %7d %5d %6.1f %9ldK %5c  %s\n", job, pg->group_pid, n, cpu, rss, state, pg->cmdline);
+	}
+	printf("sampled %d processes in %ldus (avg %ldus over %ld samples)\n", s->count,
+		s->cost / 1000, (s->samples > 0) ? s->total / s->samples / 1000 : 0, s->samples);
+}
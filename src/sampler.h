@@ -0,0 +1,104 @@
+/*
+	SAMPLER measures the CPU and memory use of background jobs.
+	A sample reads the list of the shell's children from
+	/proc/self/task/<tid>/children, then /proc/<pid>/stat and
+	/proc/<pid>/statm of every child. The files of a process are opened the
+	first time it is seen and kept open, each sample reads them again with
+	pread() into one buffer owned by the sampler; processes that are gone are
+	closed at the end of the sample. Children are matched to jobs by their
+	process group, so pipeline members and process substitutions are counted
+	with their job.
+
+	CPU% is the CPU time used since the previous sample over the elapsed
+	time (since the start of the process on its first sample). The number of
+	processes read per sample is bounded by SAMPLER_SLOTS and the time taken
+	by each sample is kept so its cost can be reported.
+*/
+
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include "include.h"
+#include "procgroup.h"
+#include "pidtable.h"
+
+/* Processes tracked, children beyond that are not sampled */
+#define SAMPLER_SLOTS 256
+
+/* Read buffer, holds the children list and one stat file */
+#define SAMPLER_BUF 4096
+
+/* Refresh interval of jobs --top in milliseconds */
+#define SAMPLER_INTERVAL 1000
+
+
+/* Typedef: SAMPLE
+   Last sample of one child, statfd/statmfd are its cached /proc files
+   ticks is utime + stime in clock ticks, when the time it was read
+*/
+typedef struct sample {
+	int pid;
+	int pgrp;
+	int statfd;
+	int statmfd;
+	char state;
+	unsigned long long ticks;
+	struct timespec when;
+	double cpu;
+	long rss;
+	int seen;
+} SAMPLE;
+
+
+/* Typedef: SAMPLER
+   Sampled children and sampling cost (nanoseconds)
+*/
+typedef struct sampler {
+	SAMPLE proc[SAMPLER_SLOTS];
+	int count;
+	int generation;
+	int childfd;
+	long hz;
+	long pagekb;
+	long cost;
+	long total;
+	long samples;
+	char buf[SAMPLER_BUF];
+} SAMPLER;
+
+
+/* Function: sampler_init
+   Returns dynamically allocated SAMPLER, NULL if /proc is not available
+*/
+SAMPLER *sampler_init();
+
+
+/* Function: sampler_free
+   Close cached files and deallocate, s may be NULL
+*/
+void sampler_free(SAMPLER *s);
+
+
+/* Function: sampler_sample
+   Read the current usage of every child
+   Returns the number of processes sampled, -1 on error
+*/
+int sampler_sample(SAMPLER *s);
+
+
+/* Function: sampler_job
+   Sum the last sample over the children in process group pgid
+   cpu (percent) and rss (KB) receive the totals, state the state of the
+   group leader ('?' if it was not sampled)
+   Returns the number of processes in the group
+*/
+int sampler_job(SAMPLER *s, int pgid, double *cpu, long *rss, char *state);
+
+
+/* Function: sampler_print
+   Builtin jobs --stats, print the jobs in table with their last sample
+   Precondition: signals are blocked (table is read)
+*/
+void sampler_print(SAMPLER *s, PIDTABLE *table);
+
+#endif /* _SAMPLER_H_ */
@@ -0,0 +1,138 @@
+#include "sampler.h"
+
+/* prototypes */
+void test_setup();
+void test_destroy();
+void test_sample();
+void test_exit();
+
+SAMPLER *sampler;
+int busy, idle;
+
+
+/* Function: spawn (helper)
+   fork a child in its own group, spinning or sleeping
+*/
+int spawn(int spin)
+{
+	int pid = fork();
+	assert(pid != -1);
+	if (pid == 0)
+	{
+		setpgid(0, 0);
+		while (spin)
+		{
+		}
+		pause();
+		_exit(0);
+	}
+	setpgid(pid, pid);
+
+	return pid;
+}
+
+
+/* Function: test_setup
+   Open the sampler, start a busy and an idle child
+*/
+void test_setup()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SAMPLER Initialized\n");
+#endif
+
+	sampler = sampler_init();
+	assert(sampler != NULL);
+	assert(sampler_sample(sampler) == 0);
+	busy = spawn(TRUE);
+	idle = spawn(FALSE);
+}
+
+
+/* Function: test_destroy
+   Kill the children, free the sampler
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SAMPLER Closed\n");
+#endif
+
+	kill(idle, SIGKILL);
+	waitpid(idle, NULL, 0);
+	sampler_free(sampler);
+}
+
+
+/* Function: test_sample
+   CPU% of a spinning child, fds are reused between samples
+*/
+void test_sample()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SAMPLER sample\n");
+#endif
+
+	double cpu;
+	long rss;
+	char state;
+	int fd;
+
+	assert(sampler_sample(sampler) == 2);
+	fd = sampler->proc[0].statfd;
+	usleep(300000);
+	assert(sampler_sample(sampler) == 2);
+	assert(sampler->proc[0].statfd == fd);
+	assert(sampler->count == 2);
+
+	assert(sampler_job(sampler, busy, &cpu, &rss, &state) == 1);
+	assert(cpu > 20);
+	assert(rss > 0);
+	assert(state == 'R');
+	assert(sampler_job(sampler, idle, &cpu, &rss, &state) == 1);
+	assert(cpu < 10);
+	assert(state == 'S');
+	assert(sampler_job(sampler, 1, &cpu, &rss, &state) == 0);
+	assert(sampler->samples == 3);
+	assert(sampler->cost > 0);
+}
+
+
+/* Function: test_exit
+   Reaped children are dropped
+*/
+void test_exit()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SAMPLER exit\n");
+#endif
+
+	double cpu;
+	long rss;
+	char state;
+
+	kill(busy, SIGKILL);
+	waitpid(busy, NULL, 0);
+	assert(sampler_sample(sampler) == 1);
+	assert(sampler->count == 1);
+	assert(sampler_job(sampler, busy, &cpu, &rss, &state) == 0);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: SAMPLER Module\n");
+#endif
+
+	test_setup();
+	test_sample();
+	test_exit();
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: SAMPLER Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,1610 @@
+#include "script.h"
+#include "alias.h"
+#include "wildcard.h"
+#include "dag.h"
+
+/* script_list() reached the end of the text */
+#define SCRIPT_END -3
+
+/* script_ops() stopped at a job an iteration waits for */
+#define SCRIPT_WAIT 1
+
+/* Reserved words opening a construct, in the order of script_list() */
+static const char *script_open[] = {"if", "while", "until", "for", "case", NULL};
+
+/* Reserved words continuing or closing one */
+static const char *script_reserved[] = {"then", "elif", "else", "fi", "do", "done", "esac", NULL};
+
+
+/* Typedef: SCRIPT_LOOP (internal)
+   Enclosing loop while compiling: op continue goes to, chain of the
+   jumps of its breaks
+*/
+typedef struct script_loop {
+	int cont;
+	int breaks;
+} SCRIPT_LOOP;
+
+
+/* Typedef: SCRIPT_BUILD (internal)
+   Compiler state: program, position in the text, enclosing loops
+*/
+typedef struct script_build {
+	SCRIPT *s;
+	const char *p;
+	SCRIPT_LOOP loops[SCRIPT_NEST];
+	int depth;
+	int failed;
+} SCRIPT_BUILD;
+
+
+/* Typedef: SCRIPT_SLOT (internal)
+   Words of a for (the word of a case) for command cmd, as expanded, and
+   the next one to give
+*/
+typedef struct script_slot {
+	const SCRIPT_CMD *cmd;
+	char **argv;
+	char **words;
+	WILDCARD wc;
+	int count;
+	int next;
+} SCRIPT_SLOT;
+
+
+/* Typedef: SCRIPT_FRAME (internal)
+   State of one run: slots, words of the command being run and the
+   buffer they are copied into. For an iteration of a parallel for: op
+   of the loop (par, -1 for none), its task and the op it goes on from
+*/
+typedef struct script_frame {
+	SCRIPT_SLOT *slots;
+	char **argv;
+	int argc;
+	char *buf;
+	long size;
+	int par;
+	PARFOR_TASK *task;
+	int pc;
+} SCRIPT_FRAME;
+
+
+/* Typedef: SCRIPT_ITER (internal)
+   What the iterations of the parallel for at op pc start from
+*/
+typedef struct script_iter {
+	const SCRIPT *script;
+	SCRIPT_FRAME *f;
+	int pc;
+	const SCRIPT_HOOKS *hooks;
+	int status;
+} SCRIPT_ITER;
+
+
+/* Function: script_skip (internal)
+   Skip blanks, newlines, ';' (not ";;") and comments
+*/
+static const char *script_skip(const char *p)
+{
+	while (TRUE)
+	{
+		if (*p == ' ' || *p == '\t' || *p == '\n' || (*p == ';' && p[1] != ';'))
+		{
+			p++;
+		}
+		else if (*p == '#')
+		{
+			p = strchrnul(p, '\n');
+		}
+		else
+		{
+			return p;
+		}
+	}
+}
+
+
+/* Function: script_wordlen (internal)
+   Length of the word at p, for reserved words
+*/
+static int script_wordlen(const char *p)
+{
+	return strcspn(p, " \t\n;&|()<>");
+}
+
+
+/* Function: script_is (internal)
+   Returns TRUE if the word at p is word
+*/
+static int script_is(const char *p, const char *word)
+{
+	int n = script_wordlen(p);
+
+	return (n == (int) strlen(word) && strncmp(p, word, n) == 0);
+}
+
+
+/* Function: script_find (internal)
+   Returns the index of the word at p in words, -1 if it is not there
+*/
+static int script_find(const char *p, const char **words)
+{
+	int i;
+
+	for (i = 0; words[i] != NULL; i++)
+	{
+		if (script_is(p, words[i]) == TRUE)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+/* Function: script_scan (internal)
+   Length of the text at p up to an unquoted character of stop outside
+   parentheses, or to an unmatched ')'
+*/
+static int script_scan(const char *p, const char *stop)
+{
+	char quote = '\0';
+	int n, depth = 0;
+
+	for (n = 0; p[n] != '\0'; n++)
+	{
+		if (quote != '\0')
+		{
+			quote = (p[n] == quote) ? '\0' : quote;
+		}
+		else if (p[n] == '\\' && p[n+1] != '\0')
+		{
+			n++;
+		}
+		else if (p[n] == '\'' || p[n] == '"' || p[n] == '`')
+		{
+			quote = p[n];
+		}
+		else if (p[n] == '(')
+		{
+			depth++;
+		}
+		else if (p[n] == ')' && depth-- == 0)
+		{
+			break;
+		}
+		else if (depth == 0 && strchr(stop, p[n]) != NULL)
+		{
+			break;
+		}
+	}
+
+	return n;
+}
+
+
+/* Function: script_control
+   Look at the first word of each command
+*/
+int script_control(const char *text)
+{
+	const char *p = text;
+
+	while (*(p = script_skip(p)) != '\0')
+	{
+		if (script_find(p, script_open) != -1)
+		{
+			return TRUE;
+		}
+		p += script_scan(p, ";\n");
+		if (*p == ';' || *p == ')')
+		{
+			p++;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/* Function: script_closing
+   Look at the start of each word
+*/
+int script_closing(const char *line)
+{
+	static const char *closing[] = {"fi", "done", "esac", NULL};
+	const char *p;
+
+	for (p = line; *p != '\0'; p++)
+	{
+		if ((p == line || strchr(" \t;&|()", p[-1]) != NULL) && script_find(p, closing) != -1)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/* Function: script_error (internal)
+   Report the token at p
+   Returns SCRIPT_ERR
+*/
+static int script_error(const char *p)
+{
+	int n = script_wordlen(p);
+
+#ifdef WARNING
+	printf("-mysh: syntax error near unexpected token `%.*s'\n", (n > 0) ? n : 1, p);
+#else
+	(void) n;
+#endif
+
+	return SCRIPT_ERR;
+}
+
+
+/* Function: script_emit (internal)
+   Append an op
+   Returns its index, -1 on allocation failure
+*/
+static int script_emit(SCRIPT_BUILD *b, int code, int slot, int cmd, int arg)
+{
+	SCRIPT *s = b->s;
+	SCRIPT_OP *grow;
+
+	if (s->nops == s->opcap)
+	{
+		grow = realloc(s->ops, ((s->opcap > 0) ? 2 * s->opcap : 32) * sizeof (SCRIPT_OP));
+		if (grow == NULL)
+		{
+			b->failed = TRUE;
+			return -1;
+		}
+		s->ops = grow;
+		s->opcap = (s->opcap > 0) ? 2 * s->opcap : 32;
+	}
+	s->ops[s->nops].code = code;
+	s->ops[s->nops].slot = slot;
+	s->ops[s->nops].cmd = cmd;
+	s->ops[s->nops].arg = arg;
+	s->ops[s->nops].var = NULL;
+	s->ops[s->nops].jobs = 0;
+	s->ops[s->nops].flags = 0;
+
+	return s->nops++;
+}
+
+
+/* Function: script_patch (internal)
+   Point the jumps of the chain starting at op chain (linked by their
+   arg, -1 ends it) to target
+*/
+static void script_patch(SCRIPT *s, int chain, int target)
+{
+	int next;
+
+	while (chain != -1)
+	{
+		next = s->ops[chain].arg;
+		s->ops[chain].arg = target;
+		chain = next;
+	}
+}
+
+
+/* Function: script_name (internal)
+   Returns the length of the variable name at p, 0 if there is none
+*/
+static int script_name(const char *p)
+{
+	int n = 0;
+
+	if (isalpha(p[0]) || p[0] == '_')
+	{
+		for (n = 1; isalnum(p[n]) || p[n] == '_'; n++)
+		{
+		}
+	}
+
+	return n;
+}
+
+
+/* Function: script_part (internal)
+   Append a piece to the templates of c (*cap allocated)
+   Returns 0, -1 on allocation failure
+*/
+static int script_part(SCRIPT_CMD *c, int *count, int *cap, int kind, const char *text, int len, VAR *var)
+{
+	SCRIPT_PART *grow;
+
+	if (*count == *cap)
+	{
+		*cap = (*cap > 0) ? 2 * *cap : 8;
+		grow = realloc(c->parts, *cap * sizeof (SCRIPT_PART));
+		if (grow == NULL)
+		{
+			return -1;
+		}
+		c->parts = grow;
+	}
+	c->parts[*count].kind = kind;
+	c->parts[*count].text = text;
+	c->parts[*count].len = len;
+	c->parts[*count].var = var;
+	(*count)++;
+
+	return 0;
+}
+
+
+/* Function: script_template (internal)
+   Templates of the words of c, none if one needs vars_expand(): $$,
+   $(cmd), positional parameters, a quoted '$'
+*/
+static void script_template(SCRIPT_CMD *c)
+{
+	char **argv = c->cmd->argv, name[256];
+	const char *p;
+	int i, n, brace, count = 0, cap = 0;
+	VAR *var;
+
+	c->first = malloc((c->nwords + 1) * sizeof (int));
+	for (i = 0; c->first != NULL && i < c->nwords; i++)
+	{
+		c->first[i] = count;
+		c->magic |= wildcard_magic(argv[i]);
+		// a '$' that was in single quotes and a substitution that was in
+		// double quotes are left to vars_expand() too
+		if (strchr(argv[i], DOLLAR_MARK) != NULL || strchr(argv[i], SUBST_MARK) != NULL)
+		{
+			goto template_none;
+		}
+		for (p = argv[i]; *p != '\0'; )
+		{
+			if (*p != '$')
+			{
+				n = strcspn(p, "$");
+				if (-1 == script_part(c, &count, &cap, SCRIPT_TEXT, p, n, NULL))
+				{
+					goto template_none;
+				}
+				p += n;
+				continue;
+			}
+			if (p[1] == '?')
+			{
+				if (-1 == script_part(c, &count, &cap, SCRIPT_STATUS, NULL, 0, NULL))
+				{
+					goto template_none;
+				}
+				p += 2;
+				continue;
+			}
+			// $$, $(cmd) and the positional parameters are left to
+			// vars_expand()
+			brace = (p[1] == '{');
+			if ((p[1] != '\0' && strchr("$#@*(", p[1]) != NULL) || isdigit(p[1 + brace]))
+			{
+				goto template_none;
+			}
+			n = script_name(p + 1 + brace);
+			if (n == 0 || (brace && p[2 + n] != '}'))
+			{
+				// not a variable, the '$' stays
+				if (-1 == script_part(c, &count, &cap, SCRIPT_TEXT, p, 1, NULL))
+				{
+					goto template_none;
+				}
+				p++;
+				continue;
+			}
+			if (n >= (int) sizeof name)
+			{
+				goto template_none;
+			}
+			memcpy(name, p + 1 + brace, n);
+			name[n] = '\0';
+			var = vars_ref(name);
+			if (var == NULL || -1 == script_part(c, &count, &cap, SCRIPT_VAR, NULL, 0, var))
+			{
+				goto template_none;
+			}
+			// the value may hold a pattern
+			c->magic = TRUE;
+			p += 1 + n + 2 * brace;
+		}
+	}
+	if (c->first != NULL)
+	{
+		c->first[c->nwords] = count;
+		return;
+	}
+
+template_none:
+	free(c->parts);
+	free(c->first);
+	c->parts = NULL;
+	c->first = NULL;
+	c->magic = TRUE;
+}
+
+
+/* Function: script_command (internal)
+   Compile the command of len bytes at p. A command run (resolve TRUE)
+   gets its aliases and the executables of its pipelines, words of for,
+   case and patterns are kept as they are
+   Returns its index, -1 if it is empty or on allocation failure
+*/
+static int script_command(SCRIPT_BUILD *b, const char *p, int len, int resolve)
+{
+	SCRIPT *s = b->s;
+	SCRIPT_CMD *c, *grow;
+	COMMAND *cmd, *k;
+	char *text, *expanded = NULL, name[256];
+	int i, n;
+
+	text = strndup(p, len);
+	if (text != NULL && resolve == TRUE)
+	{
+		expanded = alias_expand(text);
+	}
+	cmd = (text != NULL) ? command_parse((expanded != NULL) ? expanded : text) : NULL;
+	free(expanded);
+	free(text);
+	if (cmd == NULL || (cmd->token < 2 && cmd->next == NULL))
+	{
+		if (cmd == NULL)
+		{
+			b->failed = TRUE;
+			return -1;
+		}
+		command_free(cmd);
+		return -1;
+	}
+	if (s->ncmds == s->cmdcap)
+	{
+		grow = realloc(s->cmds, ((s->cmdcap > 0) ? 2 * s->cmdcap : 16) * sizeof (SCRIPT_CMD));
+		if (grow == NULL)
+		{
+			b->failed = TRUE;
+			command_free(cmd);
+			return -1;
+		}
+		s->cmds = grow;
+		s->cmdcap = (s->cmdcap > 0) ? 2 * s->cmdcap : 16;
+	}
+	c = &s->cmds[s->ncmds];
+	memset(c, 0, sizeof (SCRIPT_CMD));
+	c->cmd = cmd;
+	c->simple = (cmd->next == NULL && cmd->pipe == FALSE && cmd->background == FALSE && cmd->infile == NULL
+		&& cmd->outfile == NULL && cmd->heredoc == NULL && cmd->heredoc_tag == NULL && cmd->procsub == NULL);
+	for (c->nwords = 0; cmd->argv[c->nwords] != NULL; c->nwords++)
+	{
+	}
+	script_template(c);
+
+	// only assignments: their variables are resolved too
+	for (i = 0; c->simple == TRUE && i < c->nwords && vars_assignment(cmd->argv[i]) > 0; i++)
+	{
+	}
+	if (resolve == TRUE && c->nwords > 0 && i == c->nwords && (c->assign = malloc(i * sizeof (VAR*))) != NULL)
+	{
+		for (i = 0; i < c->nwords; i++)
+		{
+			n = vars_assignment(cmd->argv[i]);
+			snprintf(name, sizeof name, "%.*s", n, cmd->argv[i]);
+			c->assign[i] = vars_ref(name);
+			if (c->assign[i] == NULL || n >= (int) sizeof name)
+			{
+				free(c->assign);
+				c->assign = NULL;
+				break;
+			}
+		}
+	}
+
+	// executables are looked up once, here
+	for (k = cmd; resolve == TRUE && c->assign == NULL && k != NULL; k = k->next)
+	{
+		command_resolve(k);
+		while (k->pipe == TRUE && k->next != NULL)
+		{
+			k = k->next;
+		}
+	}
+
+	return s->ncmds++;
+}
+
+
+/* Function: script_close (internal)
+   Consume the reserved word of len bytes ending a construct, which must
+   end its command
+   Returns 0, SCRIPT_ERR
+*/
+static int script_close(SCRIPT_BUILD *b, int len)
+{
+	const char *p;
+
+	b->p += len;
+	p = b->p + strspn(b->p, " \t");
+	if (*p != '\0' && *p != '\n' && *p != ';' && *p != '#')
+	{
+		return script_error(p);
+	}
+
+	return (b->failed == TRUE) ? SCRIPT_ERR : 0;
+}
+
+
+/* Function: script_nested (internal)
+   Result of a list inside a construct: the end of the text means more
+   lines are needed
+*/
+static int script_nested(int r)
+{
+	return (r == SCRIPT_END) ? SCRIPT_MORE : r;
+}
+
+
+static int script_list(SCRIPT_BUILD *b, const char **stops);
+
+
+/* Function: script_if (internal)
+   if list; then list; [elif list; then list;] ... [else list;] fi
+*/
+static int script_if(SCRIPT_BUILD *b)
+{
+	static const char *then[] = {"then", NULL}, *branch[] = {"elif", "else", "fi", NULL}, *fi[] = {"fi", NULL};
+	int r, jf, j, ends = -1;
+
+	b->p += 2;
+	while (TRUE)
+	{
+		r = script_list(b, then);
+		if (r < 0)
+		{
+			return script_nested(r);
+		}
+		b->p += 4;
+		jf = script_emit(b, SCRIPT_JUMPF, 0, 0, -1);
+		r = script_list(b, branch);
+		if (r < 0)
+		{
+			return script_nested(r);
+		}
+		if (r == 2)
+		{
+			break;
+		}
+		// the branch taken goes to the end, a false condition here
+		j = script_emit(b, SCRIPT_JUMP, 0, 0, ends);
+		ends = (j != -1) ? j : ends;
+		script_patch(b->s, jf, b->s->nops);
+		jf = -1;
+		b->p += 4;
+		if (r == 1)
+		{
+			r = script_list(b, fi);
+			if (r < 0)
+			{
+				return script_nested(r);
+			}
+			break;
+		}
+	}
+	script_patch(b->s, jf, b->s->nops);
+	script_patch(b->s, ends, b->s->nops);
+
+	return script_close(b, 2);
+}
+
+
+/* Function: script_loop (internal)
+   Compile the body of a loop up to done, continue goes to op cont
+   Returns 0, SCRIPT_MORE, SCRIPT_ERR
+*/
+static int script_loop(SCRIPT_BUILD *b, int cont)
+{
+	static const char *done[] = {"done", NULL};
+	int r;
+
+	if (b->depth == SCRIPT_NEST)
+	{
+		return script_error(b->p);
+	}
+	b->loops[b->depth].cont = cont;
+	b->loops[b->depth].breaks = -1;
+	b->depth++;
+	r = script_list(b, done);
+	b->depth--;
+	if (r < 0)
+	{
+		return script_nested(r);
+	}
+	script_emit(b, SCRIPT_JUMP, 0, 0, cont);
+	script_patch(b->s, b->loops[b->depth].breaks, b->s->nops);
+
+	return 0;
+}
+
+
+/* Function: script_while (internal)
+   while list; do list; done, until list; do list; done
+*/
+static int script_while(SCRIPT_BUILD *b, int until)
+{
+	static const char *dos[] = {"do", NULL};
+	int start = b->s->nops, r, jf;
+
+	b->p += 5;
+	r = script_list(b, dos);
+	if (r < 0)
+	{
+		return script_nested(r);
+	}
+	b->p += 2;
+	jf = script_emit(b, (until == TRUE) ? SCRIPT_JUMPT : SCRIPT_JUMPF, 0, 0, -1);
+	r = script_loop(b, start);
+	if (r < 0)
+	{
+		return r;
+	}
+	script_patch(b->s, jf, b->s->nops);
+
+	return script_close(b, 4);
+}
+
+
+/* Function: script_options (internal)
+   Options of a parallel for: -P N (or -PN), -k, -e. *jobs is -1 without
+   -P
+   Returns 0, SCRIPT_MORE, SCRIPT_ERR
+*/
+static int script_options(SCRIPT_BUILD *b, int *jobs, int *flags)
+{
+	const char *n;
+
+	*jobs = -1;
+	*flags = 0;
+	while (*b->p == '-')
+	{
+		if (b->p[1] == 'P')
+		{
+			n = b->p + 2;
+			n += (*n == ' ' || *n == '\t') ? strspn(n, " \t") : 0;
+			if (isdigit(*n) == 0)
+			{
+				return (*n == '\0') ? SCRIPT_MORE : script_error(b->p);
+			}
+			*jobs = atoi(n);
+			b->p = n + strspn(n, "0123456789");
+		}
+		else if ((b->p[1] == 'k' || b->p[1] == 'e') && script_wordlen(b->p) == 2)
+		{
+			*flags |= (b->p[1] == 'k') ? PARFOR_KEEP : PARFOR_FAIL;
+			b->p += 2;
+		}
+		else
+		{
+			return script_error(b->p);
+		}
+		if (*b->p != ' ' && *b->p != '\t')
+		{
+			return (*b->p == '\0') ? SCRIPT_MORE : script_error(b->p);
+		}
+		b->p += strspn(b->p, " \t");
+	}
+
+	return (*flags != 0 && *jobs == -1) ? script_error(b->p) : 0;
+}
+
+
+/* Function: script_for (internal)
+   for NAME [in words]; do list; done, "$@" without in
+*/
+static int script_for(SCRIPT_BUILD *b)
+{
+	char name[256];
+	int n, words, slot, next, r, jobs, flags;
+	VAR *var = NULL;
+
+	b->p += 3;
+	b->p += strspn(b->p, " \t");
+	r = script_options(b, &jobs, &flags);
+	if (r != 0)
+	{
+		return r;
+	}
+	n = script_wordlen(b->p);
+	if (n > 0 && n < (int) sizeof name)
+	{
+		snprintf(name, sizeof name, "%.*s", n, b->p);
+		var = vars_ref(name);
+	}
+	if (var == NULL)
+	{
+		return (*b->p == '\0') ? SCRIPT_MORE : script_error(b->p);
+	}
+	b->p += n;
+	b->p += strspn(b->p, " \t");
+	if (script_is(b->p, "in") == TRUE)
+	{
+		b->p += 2;
+		n = script_scan(b->p, ";\n");
+		words = script_command(b, b->p, n, FALSE);
+		b->p += n;
+	}
+	else
+	{
+		words = script_command(b, "$@", 2, FALSE);
+	}
+	b->p = script_skip(b->p);
+	if (script_is(b->p, "do") == FALSE)
+	{
+		return (*b->p == '\0') ? SCRIPT_MORE : script_error(b->p);
+	}
+	b->p += 2;
+
+	// a parallel body runs in the iterations, its end and continue go
+	// back to SCRIPT_PAR, which ends an iteration
+	slot = b->s->nslots++;
+	script_emit(b, SCRIPT_FOR, slot, words, 0);
+	next = script_emit(b, (jobs == -1) ? SCRIPT_NEXT : SCRIPT_PAR, slot, 0, -1);
+	if (next != -1)
+	{
+		b->s->ops[next].var = var;
+		b->s->ops[next].jobs = jobs;
+		b->s->ops[next].flags = flags;
+	}
+	r = script_loop(b, next);
+	if (r < 0)
+	{
+		return r;
+	}
+	script_patch(b->s, next, b->s->nops);
+
+	return script_close(b, 4);
+}
+
+
+/* Function: script_case (internal)
+   case word in [(]pattern[|pattern]...) list;; ... esac
+*/
+static int script_case(SCRIPT_BUILD *b)
+{
+	static const char *end[] = {"esac", ";;", NULL};
+	int n, k, word, slot, r, j, body, skip, ends = -1;
+
+	b->p += 4;
+	b->p += strspn(b->p, " \t");
+	n = script_scan(b->p, " \t;\n");
+	if (n == 0)
+	{
+		return (*b->p == '\0') ? SCRIPT_MORE : script_error(b->p);
+	}
+	word = script_command(b, b->p, n, FALSE);
+	b->p = script_skip(b->p + n);
+	if (script_is(b->p, "in") == FALSE)
+	{
+		return (*b->p == '\0') ? SCRIPT_MORE : script_error(b->p);
+	}
+	b->p += 2;
+	slot = b->s->nslots++;
+	script_emit(b, SCRIPT_CASE, slot, word, 0);
+
+	while (TRUE)
+	{
+		b->p = script_skip(b->p);
+		if (*b->p == '\0')
+		{
+			return SCRIPT_MORE;
+		}
+		if (script_is(b->p, "esac") == TRUE)
+		{
+			break;
+		}
+
+		// each pattern jumps to the body when it matches
+		b->p += (*b->p == '(');
+		body = -1;
+		while (TRUE)
+		{
+			b->p += strspn(b->p, " \t");
+			n = script_scan(b->p, "|\n");
+			for (k = n; k > 0 && (b->p[k-1] == ' ' || b->p[k-1] == '\t'); k--)
+			{
+			}
+			if (k == 0)
+			{
+				return (b->p[n] == '\0') ? SCRIPT_MORE : script_error(b->p + n);
+			}
+			j = script_emit(b, SCRIPT_MATCH, slot, script_command(b, b->p, k, FALSE), body);
+			body = (j != -1) ? j : body;
+			b->p += n;
+			if (*b->p == '|')
+			{
+				b->p++;
+				continue;
+			}
+			if (*b->p == ')')
+			{
+				b->p++;
+				break;
+			}
+			return (*b->p == '\0') ? SCRIPT_MORE : script_error(b->p);
+		}
+		skip = script_emit(b, SCRIPT_JUMP, 0, 0, -1);
+		script_patch(b->s, body, b->s->nops);
+		r = script_list(b, end);
+		if (r < 0)
+		{
+			return script_nested(r);
+		}
+		j = script_emit(b, SCRIPT_JUMP, 0, 0, ends);
+		ends = (j != -1) ? j : ends;
+		script_patch(b->s, skip, b->s->nops);
+		if (r == 0)
+		{
+			break;
+		}
+		b->p += 2;
+	}
+	script_patch(b->s, ends, b->s->nops);
+
+	return script_close(b, 4);
+}
+
+
+/* Function: script_tail (internal)
+   Where break or continue ends the n bytes of the list at p: 0 if the
+   list is one, the offset of the && or || before it, -1 if it does not
+*/
+static int script_tail(const char *p, int n)
+{
+	const char *q;
+	int i, op = -1;
+
+	for (i = 0; i < n; i += (i < n && p[i] == p[i+1]) ? 2 : 1)
+	{
+		i += script_scan(p + i, "&|;\n");
+		if (i + 1 < n && p[i] == p[i+1])
+		{
+			op = i;
+		}
+	}
+	q = (op == -1) ? p : p + op + 2;
+	q += strspn(q, " \t");
+	if (script_is(q, "break") == FALSE && script_is(q, "continue") == FALSE)
+	{
+		return -1;
+	}
+	q += script_wordlen(q);
+	q += strspn(q, " \t");
+	q += strspn(q, "0123456789");
+	q += strspn(q, " \t");
+
+	return (q == p + n) ? ((op == -1) ? 0 : op) : -1;
+}
+
+
+/* Function: script_jump (internal)
+   Emit the op code jumping out of (break) or to the next round of
+   (continue) the loop the word at p names
+*/
+static void script_jump(SCRIPT_BUILD *b, const char *p, int code)
+{
+	SCRIPT_LOOP *loop;
+	int level, j;
+
+	level = atoi(p + script_wordlen(p));
+	level = (level < 1) ? 1 : ((level > b->depth) ? b->depth : level);
+	loop = &b->loops[b->depth - level];
+	if (*p == 'b')
+	{
+		j = script_emit(b, code, 0, 0, loop->breaks);
+		loop->breaks = (j != -1) ? j : loop->breaks;
+	}
+	else
+	{
+		script_emit(b, code, 0, 0, loop->cont);
+	}
+}
+
+
+/* Function: script_simple (internal)
+   A command list up to the end of its line or ';', break and continue
+   inside a loop are jumps, after && or || conditional ones
+*/
+static int script_simple(SCRIPT_BUILD *b)
+{
+	int n = script_scan(b->p, ";\n"), tail, cmd;
+
+	tail = (b->depth > 0) ? script_tail(b->p, n) : -1;
+	if (tail == 0)
+	{
+		script_jump(b, b->p + strspn(b->p, " \t"), SCRIPT_JUMP);
+	}
+	else
+	{
+		cmd = script_command(b, b->p, (tail > 0) ? tail : n, TRUE);
+		if (cmd != -1)
+		{
+			script_emit(b, SCRIPT_EXEC, 0, cmd, 0);
+		}
+		if (tail > 0)
+		{
+			script_jump(b, b->p + tail + 2 + strspn(b->p + tail + 2, " \t"),
+				(b->p[tail] == '&') ? SCRIPT_JUMPT : SCRIPT_JUMPF);
+		}
+	}
+	b->p += n;
+
+	return (b->failed == TRUE) ? SCRIPT_ERR : 0;
+}
+
+
+/* Function: script_list (internal)
+   Compile commands up to one of the words of stops (NULL for none, ";;"
+   stands for itself), which is not consumed
+   Returns the index of the stop, SCRIPT_END at the end of the text,
+   SCRIPT_MORE, SCRIPT_ERR
+*/
+static int script_list(SCRIPT_BUILD *b, const char **stops)
+{
+	int i, r;
+
+	while (TRUE)
+	{
+		b->p = script_skip(b->p);
+		if (*b->p == '\0')
+		{
+			return SCRIPT_END;
+		}
+		for (i = 0; stops != NULL && stops[i] != NULL; i++)
+		{
+			if ((strcmp(stops[i], ";;") == 0) ? strncmp(b->p, ";;", 2) == 0 : script_is(b->p, stops[i]))
+			{
+				return i;
+			}
+		}
+		if (*b->p == ';' || *b->p == ')' || script_find(b->p, script_reserved) != -1)
+		{
+			return script_error(b->p);
+		}
+		switch (script_find(b->p, script_open))
+		{
+			case 0: r = script_if(b); break;
+			case 1: r = script_while(b, FALSE); break;
+			case 2: r = script_while(b, TRUE); break;
+			case 3: r = script_for(b); break;
+			case 4: r = script_case(b); break;
+			default: r = script_simple(b); break;
+		}
+		if (r != 0)
+		{
+			return r;
+		}
+	}
+}
+
+
+/* Function: script_compile
+   One pass over the text, jumps forward are patched when their target
+   is known
+*/
+int script_compile(const char *text, SCRIPT **script)
+{
+	SCRIPT_BUILD b;
+	int r;
+
+	memset(&b, 0, sizeof b);
+	*script = NULL;
+	b.p = text;
+	b.s = calloc(1, sizeof (SCRIPT));
+	if (b.s == NULL)
+	{
+		return SCRIPT_ERR;
+	}
+	r = script_list(&b, NULL);
+	if (r != SCRIPT_END || b.failed == TRUE)
+	{
+		script_free(b.s);
+		return (r == SCRIPT_MORE) ? SCRIPT_MORE : SCRIPT_ERR;
+	}
+	*script = b.s;
+
+	return 0;
+}
+
+
+/* Function: script_value (internal)
+   Text of a template piece, *len receives its length
+*/
+static const char *script_value(const SCRIPT_PART *part, const char *status, int *len)
+{
+	const char *value;
+
+	switch (part->kind)
+	{
+		case SCRIPT_VAR:
+			value = (part->var->value != NULL) ? part->var->value : "";
+			*len = strlen(value);
+			return value;
+		case SCRIPT_STATUS:
+			*len = strlen(status);
+			return status;
+		default:
+			*len = part->len;
+			return part->text;
+	}
+}
+
+
+/* Function: script_argv (internal)
+   Words of c expanded into the frame, a literal word is used as it is
+   Returns them, or an array from vars_expand() if c has no templates
+*/
+static char **script_argv(SCRIPT_FRAME *f, const SCRIPT_CMD *c, int status)
+{
+	const char *value;
+	char num[16], **words, *buf;
+	long size = 0, len;
+	int i, k, n;
+
+	if (c->parts == NULL)
+	{
+		return vars_expand(c->cmd->argv, status);
+	}
+	snprintf(num, sizeof num, "%d", status);
+	for (k = 0; k < c->first[c->nwords]; k++)
+	{
+		script_value(&c->parts[k], num, &n);
+		size += n;
+	}
+	size += c->nwords;
+	if (c->nwords + 1 > f->argc)
+	{
+		words = realloc(f->argv, (c->nwords + 1) * sizeof (char*));
+		if (words == NULL)
+		{
+			return vars_expand(c->cmd->argv, status);
+		}
+		f->argv = words;
+		f->argc = c->nwords + 1;
+	}
+	if (size > f->size)
+	{
+		buf = realloc(f->buf, size);
+		if (buf == NULL)
+		{
+			return vars_expand(c->cmd->argv, status);
+		}
+		f->buf = buf;
+		f->size = size;
+	}
+
+	for (i = 0, len = 0; i < c->nwords; i++)
+	{
+		k = c->first[i];
+		if (c->first[i+1] == k + 1 && c->parts[k].kind == SCRIPT_TEXT)
+		{
+			f->argv[i] = c->cmd->argv[i];
+			continue;
+		}
+		f->argv[i] = f->buf + len;
+		for (; k < c->first[i+1]; k++)
+		{
+			value = script_value(&c->parts[k], num, &n);
+			memcpy(f->buf + len, value, n);
+			len += n;
+		}
+		f->buf[len++] = '\0';
+	}
+	f->argv[c->nwords] = NULL;
+
+	return f->argv;
+}
+
+
+/* Function: script_spawn (internal)
+   In an iteration: start command c as a job of the iteration
+   Returns SCRIPT_WAIT, 0 if it could not be started
+*/
+static int script_spawn(SCRIPT_FRAME *f, const SCRIPT_CMD *c, int *status)
+{
+	PARFOR_TASK *task = f->task;
+
+	task->pid = dag_spawn(c->cmd, *status, &task->last, &task->count);
+	if (task->pid == -1)
+	{
+		*status = 1;
+		return 0;
+	}
+	task->label = c->cmd->cmdline;
+
+	return SCRIPT_WAIT;
+}
+
+
+/* Function: script_exec (internal)
+   Run command c: assignments here, a builtin by hooks->run, the rest by
+   hooks->list or, in an iteration, as a job of its own
+   Returns 0, -1 if the shell exits, SCRIPT_WAIT if the iteration waits
+   for a job
+*/
+static int script_exec(SCRIPT_FRAME *f, const SCRIPT_CMD *c, const SCRIPT_HOOKS *hooks, int *status)
+{
+	WILDCARD wc;
+	char **argv, **words;
+	int i, ret;
+
+	if (c->assign != NULL)
+	{
+		argv = script_argv(f, c, *status);
+		if (argv == f->argv)
+		{
+			for (i = 0; i < c->nwords; i++)
+			{
+				vars_put(c->assign[i], argv[i] + strlen(c->assign[i]->name) + 1);
+			}
+		}
+		else
+		{
+			for (i = 0; argv[i] != NULL; i++)
+			{
+			}
+			vars_assign(argv, i, FALSE);
+			vars_expand_free(argv, c->cmd->argv);
+		}
+		*status = 0;
+		return 0;
+	}
+
+	if (c->simple == FALSE || hooks->builtin == NULL || hooks->run == NULL
+		|| strchr(c->cmd->argv[0], '$') != NULL || hooks->builtin(c->cmd->argv[0]) == FALSE)
+	{
+		if (f->task != NULL)
+		{
+			return script_spawn(f, c, status);
+		}
+		return (hooks->list != NULL) ? hooks->list(c->cmd, status) : 0;
+	}
+	argv = script_argv(f, c, *status);
+	words = (c->magic == TRUE) ? wildcard_expand(argv, &wc) : argv;
+	ret = hooks->run(words, status);
+	if (words != argv)
+	{
+		wildcard_expand_free(words, argv, &wc);
+	}
+	if (argv != f->argv)
+	{
+		vars_expand_free(argv, c->cmd->argv);
+	}
+
+	return ret;
+}
+
+
+/* Function: script_release (internal)
+   Free the words of a slot
+*/
+static void script_release(SCRIPT_SLOT *slot)
+{
+	if (slot->cmd != NULL)
+	{
+		if (slot->words != slot->argv)
+		{
+			wildcard_expand_free(slot->words, slot->argv, &slot->wc);
+		}
+		vars_expand_free(slot->argv, slot->cmd->cmd->argv);
+	}
+	memset(slot, 0, sizeof (SCRIPT_SLOT));
+}
+
+
+/* Function: script_words (internal)
+   Expand the words of a for (patterns too) or the word of a case into
+   slot
+*/
+static void script_words(SCRIPT_SLOT *slot, const SCRIPT_CMD *c, int code, int status)
+{
+	script_release(slot);
+	if (c == NULL)
+	{
+		return;
+	}
+	slot->cmd = c;
+	slot->argv = vars_expand(c->cmd->argv, status);
+	slot->words = (code == SCRIPT_FOR) ? wildcard_expand(slot->argv, &slot->wc) : slot->argv;
+	for (slot->count = 0; slot->words[slot->count] != NULL; slot->count++)
+	{
+	}
+}
+
+
+/* Function: script_match (internal)
+   Returns TRUE if the word of slot, without its GLOB_MARKs, matches the
+   pattern of c
+*/
+static int script_match(const SCRIPT_SLOT *slot, const SCRIPT_CMD *c, int status)
+{
+	const char *word = (slot->count > 0) ? slot->words[0] : "";
+	char **pattern, *plain = NULL;
+	int match;
+
+	if (c == NULL)
+	{
+		return FALSE;
+	}
+	if (strchr(word, GLOB_MARK) != NULL && (plain = strdup(word)) != NULL)
+	{
+		command_unmark(plain);
+		word = plain;
+	}
+	pattern = vars_expand(c->cmd->argv, status);
+	match = wildcard_match((pattern[0] != NULL) ? pattern[0] : "", word);
+	vars_expand_free(pattern, c->cmd->argv);
+	free(plain);
+
+	return match;
+}
+
+
+static int script_ops(const SCRIPT *script, SCRIPT_FRAME *f, int pc, int end, const SCRIPT_HOOKS *hooks, int *status);
+
+
+/* Function: script_drop (internal)
+   Free what frame f holds
+*/
+static void script_drop(const SCRIPT *script, SCRIPT_FRAME *f)
+{
+	int i;
+
+	for (i = 0; i < script->nslots; i++)
+	{
+		script_release(&f->slots[i]);
+	}
+	free(f->slots);
+	free(f->argv);
+	free(f->buf);
+}
+
+
+/* Function: script_iteration (internal)
+   Step iteration task->iter in the shell: set the variable and run the
+   body in a frame of its own from where it stopped, until it starts a
+   job or reaches the end of the loop or SCRIPT_PAR again
+   Returns PARFOR_JOB, PARFOR_DONE
+*/
+static int script_iteration(PARFOR_TASK *task, void *arg)
+{
+	SCRIPT_ITER *iter = arg;
+	const SCRIPT_OP *op = &iter->script->ops[iter->pc];
+	SCRIPT_FRAME *f = task->state;
+
+	if (f == NULL)
+	{
+		f = calloc(1, sizeof (SCRIPT_FRAME));
+		if (f == NULL || (f->slots = calloc(iter->script->nslots + 1, sizeof (SCRIPT_SLOT))) == NULL)
+		{
+			perror("calloc");
+			free(f);
+			task->status = 1;
+			return PARFOR_DONE;
+		}
+		f->par = iter->pc;
+		f->pc = iter->pc + 1;
+		f->task = task;
+		task->state = f;
+		task->status = iter->status;
+	}
+
+	if (task->cancel == FALSE)
+	{
+		vars_put(op->var, iter->f->slots[op->slot].words[task->iter]);
+		if (script_ops(iter->script, f, f->pc, op->arg, iter->hooks, &task->status) == SCRIPT_WAIT)
+		{
+			return PARFOR_JOB;
+		}
+	}
+	script_drop(iter->script, f);
+	free(f);
+	task->state = NULL;
+
+	return PARFOR_DONE;
+}
+
+
+/* Function: script_parallel (internal)
+   Run the iterations of the parallel for at op pc over the words of its
+   slot
+   Returns the status of the loop
+*/
+static int script_parallel(const SCRIPT *script, SCRIPT_FRAME *f, int pc, const SCRIPT_HOOKS *hooks, int status)
+{
+	const SCRIPT_OP *op = &script->ops[pc];
+	SCRIPT_ITER iter = {script, f, pc, hooks, status};
+	char *saved = (op->var->value != NULL) ? strdup(op->var->value) : NULL;
+	PARFOR pf;
+	int ret;
+
+	memset(&pf, 0, sizeof pf);
+	pf.words = f->slots[op->slot].words;
+	pf.count = f->slots[op->slot].count;
+	pf.jobs = op->jobs;
+	pf.flags = op->flags;
+	pf.table = (hooks->jobs != NULL) ? *hooks->jobs : NULL;
+	pf.name = op->var->name;
+	pf.body = script_iteration;
+	pf.arg = &iter;
+	ret = parfor_run(&pf);
+
+	// the iterations set name in the shell, it is left as it was
+	if (saved != NULL)
+	{
+		vars_put(op->var, saved);
+		free(saved);
+	}
+	else
+	{
+		vars_unset(op->var->name);
+	}
+
+	return ret;
+}
+
+
+/* Function: script_ops (internal)
+   Run the ops from pc until end, a hook says the shell exits or, in an
+   iteration, the body is over or waits for a job (f->pc receives the
+   op it goes on from)
+   Returns 0, -1 if the shell exits, SCRIPT_WAIT
+*/
+static int script_ops(const SCRIPT *script, SCRIPT_FRAME *f, int pc, int end, const SCRIPT_HOOKS *hooks, int *status)
+{
+	SCRIPT_SLOT *slot;
+	const SCRIPT_OP *op;
+	const SCRIPT_CMD *c;
+	int ret = 0;
+
+	while (pc < end && ret == 0)
+	{
+		op = &script->ops[pc++];
+		c = (op->cmd >= 0 && op->cmd < script->ncmds) ? &script->cmds[op->cmd] : NULL;
+		switch (op->code)
+		{
+			case SCRIPT_EXEC:
+				ret = script_exec(f, c, hooks, status);
+				break;
+			case SCRIPT_JUMP:
+				pc = op->arg;
+				break;
+			case SCRIPT_JUMPF:
+				if (*status != 0)
+				{
+					*status = 0;
+					pc = op->arg;
+				}
+				break;
+			case SCRIPT_JUMPT:
+				pc = (*status == 0) ? op->arg : pc;
+				break;
+			case SCRIPT_FOR:
+			case SCRIPT_CASE:
+				script_words(&f->slots[op->slot], c, op->code, *status);
+				*status = 0;
+				break;
+			case SCRIPT_NEXT:
+				slot = &f->slots[op->slot];
+				if (slot->next < slot->count)
+				{
+					vars_put(op->var, slot->words[slot->next++]);
+				}
+				else
+				{
+					pc = op->arg;
+				}
+				break;
+			case SCRIPT_MATCH:
+				pc = (script_match(&f->slots[op->slot], c, *status) == TRUE) ? op->arg : pc;
+				break;
+			case SCRIPT_PAR:
+				if (f->par == pc - 1)
+				{
+					return 0;
+				}
+				*status = script_parallel(script, f, pc - 1, hooks, *status);
+				pc = op->arg;
+				break;
+			default:
+				break;
+		}
+	}
+	f->pc = pc;
+
+	return ret;
+}
+
+
+/* Function: script_run
+   The ops run until the end of the program, or until a hook says the
+   shell exits. A false if or while condition leaves the status 0
+*/
+int script_run(const SCRIPT *script, const SCRIPT_HOOKS *hooks, int *status)
+{
+	SCRIPT_FRAME f;
+	int ret;
+
+	memset(&f, 0, sizeof f);
+	f.par = -1;
+	f.slots = calloc(script->nslots + 1, sizeof (SCRIPT_SLOT));
+	if (f.slots == NULL)
+	{
+		perror("calloc");
+		return 0;
+	}
+
+	ret = script_ops(script, &f, 0, script->nops, hooks, status);
+	script_drop(script, &f);
+
+	return ret;
+}
+
+
+/* Function: script_number (internal)
+   Parse the integer s of test, *n receives it
+   Returns 0, -1 if s is not an integer
+*/
+static int script_number(const char *s, long *n)
+{
+	char *end;
+
+	errno = 0;
+	*n = strtol(s, &end, 10);
+	if (*s == '\0' || *end != '\0' || errno != 0)
+	{
+#ifdef WARNING
+	printf("-mysh: test: %s: integer expression expected\n", s);
+#endif
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Function: script_expr (internal)
+   Evaluate the argc words of argv
+   Returns 0 if true, 1 if false, 2 on error
+*/
+static int script_expr(char **argv, int argc)
+{
+	static const char *binary[] = {"=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL};
+	struct stat st;
+	long a, b;
+	int i, r = FALSE;
+
+	if (argc == 0)
+	{
+		return 1;
+	}
+	if (argc == 1)
+	{
+		return (argv[0][0] != '\0') ? 0 : 1;
+	}
+	if (argc == 2 && argv[0][0] == '-' && argv[0][1] != '\0' && argv[0][2] == '\0')
+	{
+		switch (argv[0][1])
+		{
+			case 'n': return (argv[1][0] != '\0') ? 0 : 1;
+			case 'z': return (argv[1][0] == '\0') ? 0 : 1;
+			case 'e': return (stat(argv[1], &st) == 0) ? 0 : 1;
+			case 'f': return (stat(argv[1], &st) == 0 && S_ISREG(st.st_mode)) ? 0 : 1;
+			case 'd': return (stat(argv[1], &st) == 0 && S_ISDIR(st.st_mode)) ? 0 : 1;
+			case 's': return (stat(argv[1], &st) == 0 && st.st_size > 0) ? 0 : 1;
+			case 'h':
+			case 'L': return (lstat(argv[1], &st) == 0 && S_ISLNK(st.st_mode)) ? 0 : 1;
+			case 'r': return (access(argv[1], R_OK) == 0) ? 0 : 1;
+			case 'w': return (access(argv[1], W_OK) == 0) ? 0 : 1;
+			case 'x': return (access(argv[1], X_OK) == 0) ? 0 : 1;
+			default: break;
+		}
+	}
+	if (argc == 3)
+	{
+		for (i = 0; binary[i] != NULL && strcmp(binary[i], argv[1]) != 0; i++)
+		{
+		}
+		if (i < 3)
+		{
+			r = (strcmp(argv[0], argv[2]) == 0);
+			return ((i == 2) ? !r : r) ? 0 : 1;
+		}
+		if (binary[i] != NULL)
+		{
+			if (-1 == script_number(argv[0], &a) || -1 == script_number(argv[2], &b))
+			{
+				return 2;
+			}
+			switch (i)
+			{
+				case 3: r = (a == b); break;
+				case 4: r = (a != b); break;
+				case 5: r = (a < b); break;
+				case 6: r = (a <= b); break;
+				case 7: r = (a > b); break;
+				default: r = (a >= b); break;
+			}
+			return (r) ? 0 : 1;
+		}
+	}
+
+#ifdef WARNING
+	printf("-mysh: test: %s: %s\n", argv[(argc == 3) ? 1 : 0], (argc > 3) ? "too many arguments" : "unknown operator");
+#endif
+	return 2;
+}
+
+
+/* Function: script_test
+   [ wants ] as its last word, a leading ! negates
+*/
+int script_test(char **argv)
+{
+	int argc, ret, not = FALSE;
+
+	for (argc = 0; argv[argc] != NULL; argc++)
+	{
+	}
+	if (strcmp(argv[0], "[") == 0)
+	{
+		if (strcmp(argv[argc-1], "]") != 0 || argc < 2)
+		{
+#ifdef WARNING
+	printf("-mysh: [: missing `]'\n");
+#endif
+			return 2;
+		}
+		argc--;
+	}
+	argv++;
+	argc--;
+	if (argc > 1 && strcmp(argv[0], "!") == 0)
+	{
+		not = TRUE;
+		argv++;
+		argc--;
+	}
+	ret = script_expr(argv, argc);
+
+	return (ret != 2 && not == TRUE) ? !ret : ret;
+}
+
+
+/* Function: script_free
+   Commands own their COMMAND and templates
+*/
+void script_free(SCRIPT *script)
+{
+	int i;
+
+	if (script == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < script->ncmds; i++)
+	{
+		command_free(script->cmds[i].cmd);
+		free(script->cmds[i].parts);
+		free(script->cmds[i].first);
+		free(script->cmds[i].assign);
+	}
+	free(script->cmds);
+	free(script->ops);
+	free(script);
+}
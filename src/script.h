@@ -0,0 +1,180 @@
+/*
+	SCRIPT runs the control flow of the shell language: if/then/elif/
+	else/fi, while and until loops, for NAME in words and case word in
+	pattern) ... ;; esac, with break and continue (break N, continue N).
+	The words are reserved at the start of a command; the commands
+	between them are the usual lists of the parser (pipes, redirects,
+	&&, ||, &). A construct ends its command: it cannot be piped,
+	redirected or followed by && or ||.
+
+	Text is compiled once into a flat program: an array of ops with jump
+	offsets, and the commands parsed by command_parse(), aliases applied
+	and the executable of each pipeline looked up in $PATH
+	(command_resolve()) when they are compiled. The words of a simple
+	command are kept as templates, literal pieces and variables resolved
+	to their VAR entry ($NAME, ${NAME}, $?), so an iteration only copies
+	strings: no parse, no hash lookup. A loop runs its ops again without
+	looking at the text.
+
+	The interpreter sets variables itself, hands builtins to the shell
+	(SCRIPT_HOOKS run) and everything else, external commands,
+	functions, pipelines and lists, to its launch path (SCRIPT_HOOKS
+	list).
+
+	for -P N [-k] [-e] name in words runs its iterations in parallel
+	(see parfor.h): each one runs the ops of the body in the shell in a
+	frame of its own, name set before each step. Builtins and assignments
+	run there, shared by the iterations; any other command is started by
+	dag_spawn() as a job the iteration waits for, then its ops go on from
+	where they stopped. break and continue end the iteration, so does
+	exit; name is left as it was in the shell.
+*/
+
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+
+#include "include.h"
+#include "parser.h"
+#include "vars.h"
+#include "parfor.h"
+
+/* Loops nest SCRIPT_NEST deep at most in one script */
+#define SCRIPT_NEST 64
+
+/* script_compile() results */
+#define SCRIPT_MORE -1
+#define SCRIPT_ERR -2
+
+/* Op codes */
+#define SCRIPT_EXEC	1	/* run command cmd */
+#define SCRIPT_JUMP	2	/* go to arg */
+#define SCRIPT_JUMPF	3	/* go to arg if the status is not 0, the status becomes 0 */
+#define SCRIPT_JUMPT	4	/* go to arg if the status is 0 */
+#define SCRIPT_FOR	5	/* expand the words of command cmd into slot */
+#define SCRIPT_NEXT	6	/* set var to the next word of slot, at the end go to arg */
+#define SCRIPT_CASE	7	/* expand the word of command cmd into slot */
+#define SCRIPT_MATCH	8	/* go to arg if the word of slot matches the pattern of command cmd */
+#define SCRIPT_PAR	9	/* run the body once per word of slot on jobs workers, go to arg */
+
+/* Kinds of template pieces */
+#define SCRIPT_TEXT	0
+#define SCRIPT_VAR	1
+#define SCRIPT_STATUS	2
+
+
+/* Typedef: SCRIPT_OP
+   One instruction: code, slot of a for or case, index of a command,
+   jump target (op index), loop variable, workers and PARFOR flags of a
+   parallel for
+*/
+typedef struct script_op {
+	int code;
+	int slot;
+	int cmd;
+	int arg;
+	VAR *var;
+	int jobs;
+	int flags;
+} SCRIPT_OP;
+
+
+/* Typedef: SCRIPT_PART
+   Piece of a word template: len bytes of text, the value of var or $?
+*/
+typedef struct script_part {
+	int kind;
+	int len;
+	const char *text;
+	VAR *var;
+} SCRIPT_PART;
+
+
+/* Typedef: SCRIPT_CMD
+   A compiled command. parts holds the templates of its words, word i
+   from part first[i] to first[i+1], NULL if they need vars_expand()
+   ($(cmd), $1 ...). assign holds the variables set when the command only
+   assigns. simple is TRUE for one command without pipe, redirect or &,
+   magic if a word may hold a pattern
+*/
+typedef struct script_cmd {
+	COMMAND *cmd;
+	SCRIPT_PART *parts;
+	int *first;
+	int nwords;
+	VAR **assign;
+	int simple;
+	int magic;
+} SCRIPT_CMD;
+
+
+/* Typedef: SCRIPT
+   A compiled script: ops, commands, number of for/case slots
+*/
+typedef struct script {
+	SCRIPT_OP *ops;
+	int nops;
+	int opcap;
+	SCRIPT_CMD *cmds;
+	int ncmds;
+	int cmdcap;
+	int nslots;
+} SCRIPT;
+
+
+/* Typedef: SCRIPT_HOOKS
+   What the shell runs for the script. list runs a command list, builtin
+   tells if name is a builtin to hand to run with its words expanded
+   (either may be NULL: everything goes to list). *status is $?, the
+   hooks update it. They return 0, -1 when the shell exits. jobs points
+   to the job table the iterations of a parallel for enter, NULL for none
+*/
+typedef struct script_hooks {
+	int (*list)(COMMAND *cmd, int *status);
+	int (*builtin)(const char *name);
+	int (*run)(char **argv, int *status);
+	PIDTABLE **jobs;
+} SCRIPT_HOOKS;
+
+
+/* Function: script_control
+   Returns TRUE if a command of text starts with if, while, until, for
+   or case
+*/
+int script_control(const char *text);
+
+
+/* Function: script_closing
+   Returns TRUE if a word of line is fi, done or esac: a construct left
+   open can only be complete after such a line
+*/
+int script_closing(const char *line);
+
+
+/* Function: script_compile
+   Compile text, *script receives the program
+   Returns 0, SCRIPT_MORE if a construct is not closed yet (more lines
+   are needed), SCRIPT_ERR on a syntax error
+*/
+int script_compile(const char *text, SCRIPT **script);
+
+
+/* Function: script_run
+   Run script, *status is $? and receives the status of the last command
+   Returns 0, -1 if a command ran exit
+*/
+int script_run(const SCRIPT *script, const SCRIPT_HOOKS *hooks, int *status);
+
+
+/* Function: script_test
+   Builtin test and [: strings, integers and files
+   Returns 0 if the expression is true, 1 if it is false, 2 on error
+*/
+int script_test(char **argv);
+
+
+/* Function: script_free
+   Deallocate script, it may be NULL
+*/
+void script_free(SCRIPT *script);
+
+#endif /* _SCRIPT_H_ */
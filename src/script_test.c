@@ -0,0 +1,460 @@
+#include "script.h"
+#include "vars.h"
+
+extern char **environ;
+
+/* prototypes */
+void test_compile();
+void test_if();
+void test_loops();
+void test_case();
+void test_template();
+void test_test();
+void test_parallel();
+void test_bench(int outer, int inner);
+
+/* What the hooks ran */
+static char log_text[4096];
+
+/* Runs left before the builtin count fails */
+static int counter;
+
+
+/* Function: hook_list (helper)
+   Commands the script does not run itself: logged by name
+*/
+int hook_list(COMMAND *cmd, int *status)
+{
+	strcat(log_text, "list:");
+	strcat(log_text, cmd->argv[0]);
+	strcat(log_text, " ");
+	*status = 0;
+
+	return 0;
+}
+
+
+/* Function: hook_builtin (helper)
+   Builtins of the tests
+*/
+int hook_builtin(const char *name)
+{
+	return strcmp(name, "log") == 0 || strcmp(name, "nop") == 0 || strcmp(name, "true") == 0
+		|| strcmp(name, "false") == 0 || strcmp(name, "count") == 0 || strcmp(name, "test") == 0
+		|| strcmp(name, "[") == 0 || strcmp(name, "exit") == 0;
+}
+
+
+/* Function: hook_run (helper)
+   log appends its words, count fails once counter reaches 0, exit stops
+*/
+int hook_run(char **argv, int *status)
+{
+	int i;
+
+	*status = 0;
+	if (strcmp(argv[0], "log") == 0)
+	{
+		for (i = 1; argv[i] != NULL; i++)
+		{
+			strcat(log_text, argv[i]);
+			strcat(log_text, " ");
+		}
+	}
+	else if (strcmp(argv[0], "false") == 0)
+	{
+		*status = 1;
+	}
+	else if (strcmp(argv[0], "count") == 0)
+	{
+		*status = (counter-- > 0) ? 0 : 1;
+	}
+	else if (strcmp(argv[0], "test") == 0 || strcmp(argv[0], "[") == 0)
+	{
+		*status = script_test(argv);
+	}
+	else if (strcmp(argv[0], "exit") == 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static const SCRIPT_HOOKS hooks = {hook_list, hook_builtin, hook_run, NULL};
+
+
+/* Function: run (helper)
+   Compile and run text, compare the log to expected
+   Returns the status of the script
+*/
+int run(const char *text, const char *expected)
+{
+	SCRIPT *script = NULL;
+	int status = 0;
+
+	log_text[0] = '\0';
+	assert(script_compile(text, &script) == 0 && script != NULL);
+	assert(script_run(script, &hooks, &status) == 0);
+	script_free(script);
+	assert(strcmp(log_text, expected) == 0);
+
+	return status;
+}
+
+
+/* Function: test_compile
+   Control words, constructs left open, syntax errors
+*/
+void test_compile()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT compile\n");
+#endif
+
+	SCRIPT *script = NULL;
+
+	assert(script_control("if true; then log a; fi") == TRUE);
+	assert(script_control("  for i in a; do log $i; done") == TRUE);
+	assert(script_control("log a; while true; do nop; done") == TRUE);
+	assert(script_control("log if; iffy; 'case' x") == FALSE);
+	assert(script_control("log \"; if\"") == FALSE);
+
+	assert(script_compile("if true; then", &script) == SCRIPT_MORE);
+	assert(script_compile("if true\nthen\n  log a\n", &script) == SCRIPT_MORE);
+	assert(script_compile("for i in a b; do\n  while false; do\n", &script) == SCRIPT_MORE);
+	assert(script_compile("case x in\n  a) log a;;\n", &script) == SCRIPT_MORE);
+	assert(script_compile("if true; then log a; done", &script) == SCRIPT_ERR);
+	assert(script_compile("fi", &script) == SCRIPT_ERR);
+	assert(script_compile("for 1x in a; do nop; done", &script) == SCRIPT_ERR);
+	assert(script_compile("while true; do nop; done | wc", &script) == SCRIPT_ERR);
+
+	assert(script_compile("for i in a b\ndo\n  log $i\ndone\n", &script) == 0);
+	assert(script != NULL && script->nops > 0 && script->nslots == 1);
+	script_free(script);
+	script_free(NULL);
+}
+
+
+/* Function: test_if
+   if, elif, else, status of the branches
+*/
+void test_if()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT if\n");
+#endif
+
+	assert(run("if true; then log yes; else log no; fi", "yes ") == 0);
+	assert(run("if false; then log yes; else log no; fi", "no ") == 0);
+	assert(run("if false; then log a; elif false; then log b; elif true; then log c; else log d; fi", "c ") == 0);
+	assert(run("if false; then log a; fi", "") == 0);
+	assert(run("if true; then false; fi", "") == 1);
+	assert(run("if false || true; then log or; fi; log after", "list:false or after ") == 0);
+	assert(run("if\n  true\nthen\n  if false; then log inner; else log outer; fi\nfi\n", "outer ") == 0);
+	assert(run("if ls; then log ran; fi", "list:ls ran ") == 0);
+}
+
+
+/* Function: test_loops
+   while, until, for, break and continue
+*/
+void test_loops()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT loops\n");
+#endif
+
+	SCRIPT *script = NULL;
+	int status = 0;
+
+	counter = 3;
+	run("while count; do log w; done", "w w w ");
+	counter = 2;
+	run("until false; do log u; count || break; done", "u u u ");
+	run("for i in a b c; do log $i; done; log $i", "a b c c ");
+	run("for i in; do log $i; done", "");
+	run("for i in a b c d; do\n  if test $i = b; then continue; fi\n  if [ $i = d ]; then break; fi\n  log $i\ndone", "a c ");
+	run("for i in 1 2 3; do for j in x y z; do if test $j = y; then continue 2; fi; log $i$j; done; log never; done", "1x 2x 3x ");
+	run("for i in 1 2; do for j in x y; do log $i$j; break 2; done; done; log end", "1x end ");
+	run("for i in a b; do while true; do log $i; break; done; done", "a b ");
+	run("for i in a b c; do test $i = b && continue; log $i; [ $i = c ] || break 1; done", "a ");
+	run("for i in a b; do ls && break; done", "list:ls ");
+
+	// exit stops the program
+	log_text[0] = '\0';
+	assert(script_compile("for i in a b; do log $i; exit; done", &script) == 0);
+	assert(script_run(script, &hooks, &status) == -1);
+	assert(strcmp(log_text, "a ") == 0);
+	script_free(script);
+}
+
+
+/* Function: test_case
+   Patterns, alternatives, default
+*/
+void test_case()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT case\n");
+#endif
+
+	const char *text = "for w in apple b cherry zzz; do\n"
+		"  case $w in\n"
+		"    a*) log A:$w;;\n"
+		"    b|c*) log BC:$w;;\n"
+		"    *) log other;;\n"
+		"  esac\n"
+		"done";
+
+	run(text, "A:apple BC:b BC:cherry other ");
+	run("case x in y) log y;; esac; log done", "done ");
+	run("case x in\n  x)\n    log one\n    log two\n    ;;\nesac", "one two ");
+}
+
+
+/* Function: test_template
+   Variables resolved at compile time, $?, assignments, fallback to
+   vars_expand()
+*/
+void test_template()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT templates\n");
+#endif
+
+	assert(vars_set("X", "hello", FALSE) == 0);
+	run("log $X ${X}x pre$X", "hello hellox prehello ");
+	run("false; log $?; log $?", "1 0 ");
+	run("for i in a b; do Y=$i-$X; done; log $Y", "b-hello ");
+	assert(strcmp(vars_get("Y"), "b-hello") == 0);
+	run("Z=1 W=2; log $Z$W", "12 ");
+	vars_unset("X");
+	vars_unset("Y");
+	vars_unset("Z");
+	vars_unset("W");
+	vars_unset("i");
+	vars_unset("j");
+	vars_unset("w");
+}
+
+
+/* Function: test_test
+   Operators of test and [
+*/
+void test_test()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT test builtin\n");
+#endif
+
+	char *empty[] = {"test", NULL};
+	char *n[] = {"test", "-n", "x", NULL};
+	char *z[] = {"test", "-z", "x", NULL};
+	char *eq[] = {"[", "a", "=", "a", "]", NULL};
+	char *ne[] = {"[", "a", "!=", "a", "]", NULL};
+	char *noclose[] = {"[", "a", "=", "a", NULL};
+	char *lt[] = {"test", "3", "-lt", "10", NULL};
+	char *ge[] = {"test", "3", "-ge", "10", NULL};
+	char *nan[] = {"test", "x", "-eq", "1", NULL};
+	char *dir[] = {"test", "-d", "/tmp", NULL};
+	char *file[] = {"test", "-f", "/tmp", NULL};
+	char *not[] = {"test", "!", "-e", "/nonexistent", NULL};
+	char *word[] = {"test", "word", NULL};
+
+	assert(script_test(empty) == 1);
+	assert(script_test(n) == 0);
+	assert(script_test(z) == 1);
+	assert(script_test(eq) == 0);
+	assert(script_test(ne) == 1);
+	assert(script_test(noclose) == 2);
+	assert(script_test(lt) == 0);
+	assert(script_test(ge) == 1);
+	assert(script_test(nan) == 2);
+	assert(script_test(dir) == 0);
+	assert(script_test(file) == 1);
+	assert(script_test(not) == 0);
+	assert(script_test(word) == 0);
+}
+
+
+/* Function: output (helper)
+   Run text with stdout going to a file, compare what it printed to
+   expected
+   Returns the status of the script
+*/
+int output(const char *text, const char *expected)
+{
+	char path[] = "/tmp/script_test.XXXXXX", buf[1024];
+	SCRIPT *script = NULL;
+	int fd, saved, status = 0, n;
+
+	fflush(stdout);
+	fd = mkstemp(path);
+	assert(fd != -1);
+	saved = dup(STDOUT_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	assert(script_compile(text, &script) == 0);
+	assert(script_run(script, &hooks, &status) == 0);
+	script_free(script);
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+	n = pread(fd, buf, sizeof buf - 1, 0);
+	assert(n >= 0);
+	buf[n] = '\0';
+	close(fd);
+	unlink(path);
+	assert(strcmp(buf, expected) == 0);
+
+	return status;
+}
+
+
+/* Function: test_parallel
+   for -P: options, iterations stepped in the shell, -k, -e, break and
+   continue
+*/
+void test_parallel()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT parallel for\n");
+#endif
+
+	SCRIPT *script = NULL;
+	struct timespec start, end;
+
+	assert(script_compile("for -k i in a; do echo $i; done", &script) == SCRIPT_ERR);
+	assert(script_compile("for -P x i in a; do echo $i; done", &script) == SCRIPT_ERR);
+	assert(script_compile("for -P 2 -z i in a; do echo $i; done", &script) == SCRIPT_ERR);
+	assert(script_compile("for -P", &script) == SCRIPT_MORE);
+	assert(script_compile("for -P 2 -k i in a b; do", &script) == SCRIPT_MORE);
+	assert(script_compile("for -P2 -k -e i in a b; do echo $i; done", &script) == 0);
+	script_free(script);
+
+	assert(vars_set("i", "before", FALSE) == 0);
+	assert(output("for -P 3 -k i in 1 2 3 4 5 6 7; do echo x$i; done", "x1\nx2\nx3\nx4\nx5\nx6\nx7\n") == 0);
+	assert(strcmp(vars_get("i"), "before") == 0);
+	assert(output("for -P 2 -k i in a b c d; do test $i = b && continue; [ $i = d ] && break; echo $i; done", "a\nc\n") == 0);
+	assert(output("for -P 2 -k i in a b; do for j in 1 2; do echo $i$j; done; done", "a1\na2\nb1\nb2\n") == 0);
+	assert(output("for -P 4 -k i in 1 2 3; do test $i != 2; done", "") == 1);
+
+	// builtins of the iterations run in the shell
+	log_text[0] = '\0';
+	assert(output("for -P 2 i in a b c; do log $i; done", "") == 0);
+	assert(strlen(log_text) == 6 && strstr(log_text, "a ") && strstr(log_text, "b ") && strstr(log_text, "c "));
+
+	// the first failure stops the sleeping iterations
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert(output("for -P 2 -e i in 1 2 3 4 5 6; do sleep 0.$i; test $i != 1; done", "") == 1);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	assert((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000 < 1000);
+	vars_unset("i");
+	vars_unset("j");
+}
+
+
+/* Function: test_bench
+   outer x inner iterations of an assignment and a builtin, compiled once
+   against parsed and expanded on every iteration
+*/
+void test_bench(int outer, int inner)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT %d iterations\n", outer * inner);
+#endif
+
+	struct timespec start, end;
+	long compiled, parsed;
+	char *text, *list;
+	SCRIPT *script = NULL;
+	COMMAND *cmd;
+	char **argv;
+	int status = 0, i, j, len;
+
+	// for i in 0 .. outer; do for j in 0 .. inner; do X=$i$j; nop $X; done; done
+	len = 64 + 8 * (outer + inner);
+	text = malloc(len);
+	list = malloc(len);
+	assert(text != NULL && list != NULL);
+	strcpy(text, "for i in");
+	for (i = 0; i < outer; i++)
+	{
+		sprintf(text + strlen(text), " %d", i);
+	}
+	strcpy(list, "; do for j in");
+	for (j = 0; j < inner; j++)
+	{
+		sprintf(list + strlen(list), " %d", j);
+	}
+	strcat(text, list);
+	strcat(text, "; do X=$i$j; nop $X; done; done");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert(script_compile(text, &script) == 0);
+	assert(script_run(script, &hooks, &status) == 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	compiled = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	script_free(script);
+	snprintf(list, len, "%d%d", outer - 1, inner - 1);
+	assert(strcmp(vars_get("X"), list) == 0);
+
+	// the same work, parsing the commands each time
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < outer; i++)
+	{
+		snprintf(list, len, "%d", i);
+		vars_set("i", list, FALSE);
+		for (j = 0; j < inner; j++)
+		{
+			snprintf(list, len, "%d", j);
+			vars_set("j", list, FALSE);
+			cmd = command_parse("X=$i$j; nop $X");
+			argv = vars_expand(cmd->argv, status);
+			vars_assign(argv, 1, FALSE);
+			vars_expand_free(argv, cmd->argv);
+			argv = vars_expand(cmd->next->argv, status);
+			hook_run(argv, &status);
+			vars_expand_free(argv, cmd->next->argv);
+			command_free(cmd);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	parsed = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	snprintf(list, len, "%d%d", outer - 1, inner - 1);
+	assert(strcmp(vars_get("X"), list) == 0);
+	free(text);
+	free(list);
+	vars_unset("X");
+	vars_unset("i");
+	vars_unset("j");
+
+#ifdef DEBUG_TEST
+	printf("TEST: SCRIPT %ld ms compiled, %ld ms parsed each time\n", compiled / 1000000, parsed / 1000000);
+#endif
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: SCRIPT Module\n");
+#endif
+
+	assert(vars_init(environ) == 0);
+	test_compile();
+	test_if();
+	test_loops();
+	test_case();
+	test_template();
+	test_test();
+	test_parallel();
+	test_bench(1000, 1000);
+	vars_free();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: SCRIPT Module\n");
+#endif
+
+	return 0;
+}
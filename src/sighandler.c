@@ -1,9 +1,17 @@
 #include "sighandler.h"
 
-extern sigset_t fullset;
-extern PIDTABLE *ptable;
-extern PROCGROUP *foreground;
-extern int ttyd;
+/* Shell state declared in mysh.h. Defined here, where the tests that
+   link sighandler.o find it too */
+sigset_t fullset;
+PIDTABLE *ptable = NULL;
+PROCGROUP *foreground = NULL;
+int ttyd;
+HISTSTAT *jobstats = NULL;
+
+/* Jobs reaped by the handler, waiting for jobstats_flush(). histstat_add()
+   locks and writes the file, so the handler only fills these records */
+static HISTSTAT_REC pending[JOBSTATS_PENDING];
+static volatile sig_atomic_t npending = 0;
 
 
 /* Function: sighandler
@@ -29,6 +37,7 @@ void sighandler(int signum, siginfo_t *si, void *context)
 			switch(si->si_code)
 			{
 				case CLD_EXITED:
+					record_job(cldgrp, cldpid);
 					ret = tcgetpgrp(ttyd);
 					if (ret == -1)
 					{
@@ -80,6 +89,7 @@ void sighandler(int signum, siginfo_t *si, void *context)
 				case CLD_KILLED:
 					if (cldgrp != NULL && (--cldgrp->count) <= 0)
 					{
+						record_job(cldgrp, cldpid);
 						pidtable_delpid(ptable, cldpid, JOB_KILLED, TRUE);
 					}
 					break;
@@ -114,13 +124,14 @@ void sighandler(int signum, siginfo_t *si, void *context)
 void manage_job(PROCGROUP *pg)
 {
 	int status, res;
+	struct rusage ru;
 	if (pg != NULL)
 	{
 		status = 0;
-		res = waitpid(-pg->group_pid, &status, WNOHANG|WUNTRACED|WCONTINUED);
+		res = wait4(-pg->group_pid, &status, WNOHANG|WUNTRACED|WCONTINUED, &ru);
 		if (res == -1)
 		{
-			perror("waitpid");
+			perror("wait4");
 		}
 		if (res == 0)
 		{
@@ -133,12 +144,18 @@ void manage_job(PROCGROUP *pg)
 		else if (WIFEXITED(status) == TRUE)
 		{
 			{
+				procgroup_reap(pg, status, (res > 0) ? &ru : NULL);
+				timeout_reaped(pg);
+				queue_job(pg);
 				pidtable_delpid(ptable, pg->group_pid, JOB_EXITED, TRUE);
 			}
 		}
 		else if (WIFSIGNALED(status) == TRUE)
 		{
 			{
+				procgroup_reap(pg, status, (res > 0) ? &ru : NULL);
+				timeout_reaped(pg);
+				queue_job(pg);
 				pidtable_delpid(ptable, pg->group_pid, JOB_KILLED, TRUE);
 			}
 		}
@@ -149,3 +166,76 @@ void manage_job(PROCGROUP *pg)
 	}
 }
 
+
+
+/* Function: record_job
+   Reap the group leader that just terminated, cancel its deadline and queue
+   the job for the latency history before it is removed from the table
+*/
+void record_job(PROCGROUP *pg, int pid)
+{
+	struct rusage ru;
+	int status, reaped;
+
+	if (pg == NULL || pg->group_pid != pid)
+	{
+		return;
+	}
+	reaped = (wait4(pid, &status, WNOHANG, &ru) > 0);
+	if (reaped)
+	{
+		procgroup_reap(pg, status, &ru);
+	}
+	timeout_reaped(pg);
+	if (reaped)
+	{
+		queue_job(pg);
+	}
+}
+
+
+/* Function: queue_job
+   Keep the record of a finished job for jobstats_flush(), the job is lost
+   if JOBSTATS_PENDING jobs are already waiting
+   Precondition: signals are blocked
+*/
+void queue_job(PROCGROUP *pg)
+{
+	if (jobstats != NULL && npending < JOBSTATS_PENDING
+		&& histstat_record(&pending[npending], pg) == 0)
+	{
+		npending++;
+	}
+}
+
+
+/* Function: jobstats_flush
+   Add the jobs queued by the handler to jobstats, from the main loop
+*/
+void jobstats_flush()
+{
+	HISTSTAT_REC recs[JOBSTATS_PENDING];
+	sigset_t old;
+	int i, n;
+
+	if (npending == 0)
+	{
+		return;
+	}
+	if (-1 == sigprocmask(SIG_SETMASK, &fullset, &old))
+	{
+		perror("sigprocmask");
+	}
+	n = npending;
+	memcpy(recs, pending, n * sizeof recs[0]);
+	npending = 0;
+	if (-1 == sigprocmask(SIG_SETMASK, &old, NULL))
+	{
+		perror("sigprocmask");
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		histstat_add(jobstats, &recs[i]);
+	}
+}
@@ -7,7 +7,13 @@
 #include "parser.h"
 #include "mysh.h"
 
+/* Jobs the handler can queue for the latency history between two lines */
+#define JOBSTATS_PENDING 64
+
 void sighandler(int signum, siginfo_t *si, void *context);
 void manage_job(PROCGROUP *pg);
+void record_job(PROCGROUP *pg, int pid);
+void queue_job(PROCGROUP *pg);
+void jobstats_flush();
 
 #endif /* _SIGHANDLER_H_ */
@@ -0,0 +1,441 @@
+#include "timeout.h"
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+/* Slots of the table, pgid 0 is a free slot. Slots are filled and freed
+   under timeout_lock; timeout_reaped() runs in the SIGCHLD handler, so it
+   takes no lock: it only reads pgid and stage and sets reaped, atomically */
+static TIMEOUT_ENTRY entries[TIMEOUT_JOBS];
+static pthread_mutex_t timeout_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Timer thread, tfd is the timerfd, wake stops the thread, reap tells it
+   to free the slots of reaped jobs */
+static pthread_t timer_thread;
+static int timer_started = FALSE;
+static int tfd = -1, wake = -1, reap = -1;
+
+/* Signals accepted by -s, also with a SIG prefix or as a number */
+static const struct {
+	const char *name;
+	int sig;
+} timeout_signals[] = {
+	{"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+	{"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"ALRM", SIGALRM}, {"TERM", SIGTERM},
+	{NULL, 0}
+};
+
+
+/* Function: timeout_duration (internal)
+   Parse a number of seconds with an optional s/m/h/d suffix
+   Returns 0, -1 if s is not a duration
+*/
+static int timeout_duration(const char *s, struct timespec *ts)
+{
+	double value;
+	char *end;
+
+	value = strtod(s, &end);
+	if (end == s || value < 0)
+	{
+		return -1;
+	}
+	switch (*end)
+	{
+		// each unit falls through to the next smaller one
+		case 'd': value *= 24;
+			/* fallthrough */
+		case 'h': value *= 60;
+			/* fallthrough */
+		case 'm': value *= 60;
+			/* fallthrough */
+		case 's': end++;
+			/* fallthrough */
+		case '\0': break;
+		default: return -1;
+	}
+	if (*end != '\0')
+	{
+		return -1;
+	}
+	ts->tv_sec = (time_t) value;
+	ts->tv_nsec = (long) ((value - ts->tv_sec) * 1e9);
+
+	return 0;
+}
+
+
+/* Function: timeout_signal (internal)
+   Signal by name or number, -1 if unknown
+*/
+static int timeout_signal(const char *s)
+{
+	int i;
+
+	if (isdigit(*s))
+	{
+		i = atoi(s);
+		return (i > 0 && i < NSIG) ? i : -1;
+	}
+	if (strncmp(s, "SIG", 3) == 0)
+	{
+		s += 3;
+	}
+	for (i = 0; timeout_signals[i].name != NULL; i++)
+	{
+		if (strcmp(s, timeout_signals[i].name) == 0)
+		{
+			return timeout_signals[i].sig;
+		}
+	}
+
+	return -1;
+}
+
+
+/* Function: timeout_parse
+   Options may come before or after the duration
+*/
+int timeout_parse(char **argv, struct timespec *duration, int *sig, struct timespec *grace)
+{
+	int i, have_duration = FALSE;
+
+	*sig = SIGTERM;
+	grace->tv_sec = TIMEOUT_GRACE;
+	grace->tv_nsec = 0;
+	for (i = 1; argv[i] != NULL; i++)
+	{
+		if (strcmp(argv[i], "-s") == 0 && argv[i+1] != NULL)
+		{
+			*sig = timeout_signal(argv[++i]);
+			if (*sig == -1)
+			{
+#ifdef WARNING
+	printf("-mysh: timeout: %s: invalid signal\n", argv[i]);
+#endif
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-k") == 0 && argv[i+1] != NULL)
+		{
+			if (-1 == timeout_duration(argv[++i], grace))
+			{
+				break;
+			}
+		}
+		else if (have_duration == FALSE)
+		{
+			if (-1 == timeout_duration(argv[i], duration))
+			{
+				break;
+			}
+			have_duration = TRUE;
+		}
+		else
+		{
+			return i;
+		}
+	}
+
+#ifdef WARNING
+	printf("-mysh: timeout: usage: timeout [-s SIG] [-k DURATION] DURATION cmd ...\n");
+#endif
+	return -1;
+}
+
+
+/* Function: timeout_before (internal)
+   a earlier than b
+*/
+static int timeout_before(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+
+/* Function: timeout_pending (internal)
+   e still has a signal to send: the first one, or SIGKILL after grace
+*/
+static int timeout_pending(const TIMEOUT_ENTRY *e)
+{
+	if (e->pgid == 0 || __atomic_load_n(&e->reaped, __ATOMIC_ACQUIRE))
+	{
+		return FALSE;
+	}
+	if (e->stage == 0)
+	{
+		return TRUE;
+	}
+	return e->stage == 1 && e->sig != SIGKILL && (e->grace.tv_sec != 0 || e->grace.tv_nsec != 0);
+}
+
+
+/* Function: timeout_arm (internal)
+   Arm the timer to the earliest pending action, disarm if there is none
+   Precondition: timeout_lock is held
+*/
+static void timeout_arm()
+{
+	struct itimerspec its;
+	int i, first = -1;
+
+	memset(&its, 0, sizeof its);
+	for (i = 0; i < TIMEOUT_JOBS; i++)
+	{
+		if (timeout_pending(&entries[i]) && (first == -1 || timeout_before(&entries[i].when, &entries[first].when)))
+		{
+			first = i;
+		}
+	}
+	if (first != -1)
+	{
+		its.it_value = entries[first].when;
+		// zero would disarm the timer
+		if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+		{
+			its.it_value.tv_nsec = 1;
+		}
+	}
+	if (-1 == timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL))
+	{
+		perror("timerfd_settime");
+	}
+}
+
+
+/* Function: timeout_worker (internal)
+   Timer thread, signal every group whose deadline passed and free the
+   slots of the jobs reaped meanwhile
+*/
+static void *timeout_worker(void *arg)
+{
+	struct pollfd pfd[3] = {{-1, POLLIN, 0}, {-1, POLLIN, 0}, {-1, POLLIN, 0}};
+	struct timespec now;
+	uint64_t expired;
+	int i;
+
+	pfd[0].fd = tfd;
+	pfd[1].fd = wake;
+	pfd[2].fd = reap;
+
+	for (;;)
+	{
+		if (poll(pfd, 3, -1) == -1)
+		{
+			continue;
+		}
+		if (pfd[1].revents & POLLIN)
+		{
+			return NULL;
+		}
+		if (read(tfd, &expired, sizeof expired) == -1)
+		{
+			// re-armed meanwhile, nothing expired
+		}
+		if ((pfd[2].revents & POLLIN) && read(reap, &expired, sizeof expired) == -1)
+		{
+			perror("read");
+		}
+
+		pthread_mutex_lock(&timeout_lock);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for (i = 0; i < TIMEOUT_JOBS; i++)
+		{
+			if (entries[i].pgid != 0 && __atomic_load_n(&entries[i].reaped, __ATOMIC_ACQUIRE))
+			{
+				__atomic_store_n(&entries[i].pgid, 0, __ATOMIC_RELEASE);
+				continue;
+			}
+			if (!timeout_pending(&entries[i]) || timeout_before(&now, &entries[i].when))
+			{
+				continue;
+			}
+			if (entries[i].stage == 0)
+			{
+				kill(-entries[i].pgid, entries[i].sig);
+				kill(-entries[i].pgid, SIGCONT);
+				__atomic_store_n(&entries[i].stage, 1, __ATOMIC_RELEASE);
+				entries[i].when.tv_sec = now.tv_sec + entries[i].grace.tv_sec;
+				entries[i].when.tv_nsec = now.tv_nsec + entries[i].grace.tv_nsec;
+				if (entries[i].when.tv_nsec >= 1000000000L)
+				{
+					entries[i].when.tv_sec++;
+					entries[i].when.tv_nsec -= 1000000000L;
+				}
+			}
+			else
+			{
+				kill(-entries[i].pgid, SIGKILL);
+				__atomic_store_n(&entries[i].stage, 2, __ATOMIC_RELEASE);
+			}
+		}
+		timeout_arm();
+		pthread_mutex_unlock(&timeout_lock);
+	}
+
+	return NULL;
+}
+
+
+/* Function: timeout_start (internal)
+   Create the timer and its thread on first use, the thread starts with all
+   signals blocked so the shell's handlers run on the main thread only
+*/
+static int timeout_start()
+{
+	sigset_t all, old;
+	int ret = -1;
+
+	if (timer_started == TRUE)
+	{
+		return 0;
+	}
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	wake = eventfd(0, EFD_CLOEXEC);
+	reap = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (tfd != -1 && wake != -1 && reap != -1)
+	{
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		ret = pthread_create(&timer_thread, NULL, timeout_worker, NULL);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+	}
+	if (ret != 0)
+	{
+		perror("timeout");
+		close(tfd);
+		close(wake);
+		close(reap);
+		tfd = wake = reap = -1;
+		return -1;
+	}
+	timer_started = TRUE;
+
+	return 0;
+}
+
+
+/* Function: timeout_add
+   Take a free slot (or the slot of a reaped job), publish pgid last, re-arm
+*/
+int timeout_add(int pgid, const struct timespec *deadline, int sig, const struct timespec *grace)
+{
+	int i;
+
+	if (-1 == timeout_start())
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&timeout_lock);
+	for (i = 0; i < TIMEOUT_JOBS; i++)
+	{
+		if (entries[i].pgid == 0 || __atomic_load_n(&entries[i].reaped, __ATOMIC_ACQUIRE))
+		{
+			break;
+		}
+	}
+	if (i == TIMEOUT_JOBS)
+	{
+		pthread_mutex_unlock(&timeout_lock);
+#ifdef WARNING
+	printf("-mysh: timeout: too many jobs with a deadline\n");
+#endif
+		return -1;
+	}
+	__atomic_store_n(&entries[i].pgid, 0, __ATOMIC_RELEASE);
+	entries[i].sig = sig;
+	entries[i].stage = 0;
+	entries[i].reaped = FALSE;
+	entries[i].when = *deadline;
+	entries[i].grace = *grace;
+	__atomic_store_n(&entries[i].pgid, pgid, __ATOMIC_RELEASE);
+	timeout_arm();
+	pthread_mutex_unlock(&timeout_lock);
+
+	return 0;
+}
+
+
+/* Function: timeout_cancel
+   Free the slot, re-arm
+*/
+int timeout_cancel(int pgid)
+{
+	int i, stage = -1;
+
+	pthread_mutex_lock(&timeout_lock);
+	for (i = 0; i < TIMEOUT_JOBS; i++)
+	{
+		if (entries[i].pgid == pgid && !__atomic_load_n(&entries[i].reaped, __ATOMIC_ACQUIRE))
+		{
+			stage = entries[i].stage;
+			__atomic_store_n(&entries[i].pgid, 0, __ATOMIC_RELEASE);
+			timeout_arm();
+			break;
+		}
+	}
+	pthread_mutex_unlock(&timeout_lock);
+
+	return stage;
+}
+
+
+/* Function: timeout_reaped
+   Mark the slot reaped before reading its stage, so the thread sends no
+   signal it would not see. The thread frees the slot and re-arms
+*/
+void timeout_reaped(PROCGROUP *pg)
+{
+	uint64_t one = 1;
+	int i, stage = -1;
+
+	if (pg->deadline.tv_sec == 0 && pg->deadline.tv_nsec == 0)
+	{
+		return;
+	}
+	for (i = 0; i < TIMEOUT_JOBS; i++)
+	{
+		if (__atomic_load_n(&entries[i].pgid, __ATOMIC_ACQUIRE) == pg->group_pid
+			&& !__atomic_exchange_n(&entries[i].reaped, TRUE, __ATOMIC_SEQ_CST))
+		{
+			stage = __atomic_load_n(&entries[i].stage, __ATOMIC_SEQ_CST);
+			if (write(reap, &one, sizeof one) == -1)
+			{
+				// the counter is full, the thread is woken already
+			}
+			break;
+		}
+	}
+	pg->deadline.tv_sec = 0;
+	pg->deadline.tv_nsec = 0;
+	if (stage > 0)
+	{
+		pg->timed_out = TRUE;
+		pg->exit_status = (stage == 2 && pg->exit_status == 128 + SIGKILL) ? 128 + SIGKILL : TIMEOUT_STATUS;
+	}
+}
+
+
+/* Function: timeout_free
+   Stop the thread
+*/
+void timeout_free()
+{
+	uint64_t one = 1;
+
+	if (timer_started == FALSE)
+	{
+		return;
+	}
+	if (write(wake, &one, sizeof one) == -1)
+	{
+		perror("write");
+	}
+	pthread_join(timer_thread, NULL);
+	close(tfd);
+	close(wake);
+	close(reap);
+	tfd = wake = reap = -1;
+	memset(entries, 0, sizeof entries);
+	timer_started = FALSE;
+}
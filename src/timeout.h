@@ -0,0 +1,86 @@
+/*
+	TIMEOUT enforces job deadlines set with the timeout builtin
+	("timeout [-s SIG] [-k DURATION] DURATION cmd ...").
+	The job runs in its own process group as any other job, no extra
+	process is started. Deadlines are kept in a table served by one thread
+	waiting on a timerfd armed (absolute, CLOCK_MONOTONIC) to the earliest
+	deadline: when it expires the thread sends the signal to the process
+	group, and SIGKILL once the grace period (-k, TIMEOUT_GRACE by default)
+	has passed too. Adding or cancelling a deadline re-arms the timer.
+
+	The shell cancels the deadline when the job is reaped; a job that was
+	signalled gets exit status TIMEOUT_STATUS (128 + SIGKILL if it had to be
+	killed) and is reported as timed out.
+*/
+
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+#include "include.h"
+#include "procgroup.h"
+#include <pthread.h>
+
+/* Jobs with a deadline at the same time */
+#define TIMEOUT_JOBS 256
+
+/* Exit status of a job that timed out */
+#define TIMEOUT_STATUS 124
+
+/* Time between the signal and SIGKILL unless given with -k, in seconds */
+#define TIMEOUT_GRACE 5
+
+
+/* Typedef: TIMEOUT_ENTRY
+   Deadline of one process group. when is the next action (signal, then
+   SIGKILL after grace), stage the number of signals sent so far, reaped
+   set once the job is reaped until the timer thread frees the slot
+*/
+typedef struct timeout_entry {
+	int pgid;
+	int sig;
+	int stage;
+	int reaped;
+	struct timespec when;
+	struct timespec grace;
+} TIMEOUT_ENTRY;
+
+
+/* Function: timeout_parse
+   Parse the options and duration of the timeout builtin, argv[0] is
+   "timeout". duration, sig and grace receive the values
+   Returns the index of the command in argv, -1 on a usage error
+*/
+int timeout_parse(char **argv, struct timespec *duration, int *sig, struct timespec *grace);
+
+
+/* Function: timeout_add
+   Signal process group pgid at deadline (CLOCK_MONOTONIC), then SIGKILL
+   after grace unless grace is zero
+   Returns 0 on success, -1 if the table is full or the timer failed
+*/
+int timeout_add(int pgid, const struct timespec *deadline, int sig, const struct timespec *grace);
+
+
+/* Function: timeout_cancel
+   Remove the deadline of pgid
+   Returns the number of signals sent (0 if it did not expire), -1 if pgid
+   had no deadline
+*/
+int timeout_cancel(int pgid);
+
+
+/* Function: timeout_reaped
+   Cancel the deadline of a job that finished and set its timed_out and
+   exit_status if it was signalled. Does nothing for a job without deadline
+   Takes no lock, so it may be called from the SIGCHLD handler
+   Precondition: pg is a valid pointer to a PROCGROUP struct
+*/
+void timeout_reaped(PROCGROUP *pg);
+
+
+/* Function: timeout_free
+   Stop the timer thread, pending deadlines are dropped
+*/
+void timeout_free();
+
+#endif /* _TIMEOUT_H_ */
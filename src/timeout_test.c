@@ -0,0 +1,198 @@
+#include "timeout.h"
+
+/* prototypes */
+void test_parse();
+void test_expire();
+void test_escalate();
+void test_cancel();
+void test_destroy();
+
+
+/* Function: spawn (helper)
+   fork a child in its own group sleeping, ignoring SIGTERM if asked
+*/
+int spawn(int ignore)
+{
+	int pid = fork();
+	assert(pid != -1);
+	if (pid == 0)
+	{
+		setpgid(0, 0);
+		if (ignore)
+		{
+			signal(SIGTERM, SIG_IGN);
+		}
+		sleep(10);
+		_exit(0);
+	}
+	setpgid(pid, pid);
+
+	return pid;
+}
+
+
+/* Function: after (helper)
+   deadline ms milliseconds from now
+*/
+struct timespec after(long ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	return ts;
+}
+
+
+/* Function: test_parse
+   Options, durations and errors
+*/
+void test_parse()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: TIMEOUT parse\n");
+#endif
+
+	char *a1[] = {"timeout", "1.5", "sleep", "5", NULL};
+	char *a2[] = {"timeout", "-s", "KILL", "-k", "2", "2m", "ls", NULL};
+	char *a3[] = {"timeout", "3", "-s", "SIGINT", "cat", NULL};
+	char *a4[] = {"timeout", "5x", "ls", NULL};
+	char *a5[] = {"timeout", "1", NULL};
+	char *a6[] = {"timeout", "-s", "NOPE", "1", "ls", NULL};
+	struct timespec d, g;
+	int sig;
+
+	assert(timeout_parse(a1, &d, &sig, &g) == 2);
+	assert(d.tv_sec == 1 && d.tv_nsec == 500000000L);
+	assert(sig == SIGTERM && g.tv_sec == TIMEOUT_GRACE);
+	assert(timeout_parse(a2, &d, &sig, &g) == 6);
+	assert(d.tv_sec == 120 && sig == SIGKILL && g.tv_sec == 2);
+	assert(timeout_parse(a3, &d, &sig, &g) == 4);
+	assert(d.tv_sec == 3 && sig == SIGINT);
+	assert(timeout_parse(a4, &d, &sig, &g) == -1);
+	assert(timeout_parse(a5, &d, &sig, &g) == -1);
+	assert(timeout_parse(a6, &d, &sig, &g) == -1);
+}
+
+
+/* Function: test_expire
+   The group gets the signal at the deadline
+*/
+void test_expire()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: TIMEOUT expire\n");
+#endif
+
+	struct timespec d = after(50), g = {0, 0};
+	PROCGROUP *pg = procgroup_init();
+	int pid, status;
+
+	pid = spawn(FALSE);
+	procgroup_load(pg, pid, RUNNING, "sleep 10");
+	pg->deadline = d;
+	assert(timeout_add(pid, &d, SIGTERM, &g) == 0);
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGTERM);
+
+	procgroup_reap(pg, status, NULL);
+	assert(pg->exit_status == 128 + SIGTERM);
+	timeout_reaped(pg);
+	assert(pg->timed_out == TRUE);
+	assert(pg->exit_status == TIMEOUT_STATUS);
+	assert(timeout_cancel(pid) == -1);
+	procgroup_free(pg);
+}
+
+
+/* Function: test_escalate
+   SIGKILL after the grace period
+*/
+void test_escalate()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: TIMEOUT escalate\n");
+#endif
+
+	struct timespec d, g = {0, 50000000L}, start, end;
+	int pid, status;
+
+	pid = spawn(TRUE);
+	usleep(20000);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	d = after(30);
+	assert(timeout_add(pid, &d, SIGTERM, &g) == 0);
+	assert(waitpid(pid, &status, 0) == pid);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+	assert((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000 >= 75);
+	assert(timeout_cancel(pid) == 2);
+}
+
+
+/* Function: test_cancel
+   A cancelled deadline does not fire, the earliest one fires first
+*/
+void test_cancel()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: TIMEOUT cancel\n");
+#endif
+
+	struct timespec d1 = after(40), d2 = after(400), g = {0, 0};
+	int p1, p2, status;
+
+	p1 = spawn(FALSE);
+	p2 = spawn(FALSE);
+	assert(timeout_add(p2, &d2, SIGTERM, &g) == 0);
+	assert(timeout_add(p1, &d1, SIGTERM, &g) == 0);
+	assert(timeout_cancel(p2) == 0);
+	assert(waitpid(p1, &status, 0) == p1);
+	assert(WIFSIGNALED(status));
+	assert(timeout_cancel(p1) == 1);
+
+	usleep(500000);
+	assert(waitpid(p2, &status, WNOHANG) == 0);
+	kill(p2, SIGKILL);
+	waitpid(p2, NULL, 0);
+}
+
+
+/* Function: test_destroy
+   Stop the timer thread
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: TIMEOUT Closed\n");
+#endif
+
+	timeout_free();
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: TIMEOUT Module\n");
+#endif
+
+	test_parse();
+	test_expire();
+	test_escalate();
+	test_cancel();
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: TIMEOUT Module\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,837 @@
+#include "vars.h"
+#include "cmdsub.h"
+
+extern char **environ;
+
+/* Chunk of the name arena */
+typedef struct vars_chunk {
+	struct vars_chunk *next;
+	size_t used;
+	size_t size;
+	char data[];
+} VARS_CHUNK;
+
+/* Hash table of VAR pointers */
+static VAR **slots = NULL;
+static unsigned int nslots = 0, used = 0;
+static VARS_CHUNK *arena = NULL;
+
+/* Characters vars_word() acts on: '$' and the mark of a quoted one */
+static const char vars_special[] = {'$', DOLLAR_MARK, SUBST_MARK, '\0'};
+
+/* Environment: envp[i] is the string of envvar[i], NULL terminated */
+static char **envp = NULL;
+static VAR **envvar = NULL;
+static int envcount = 0, envcap = 0;
+
+/* environ while no store exists */
+static char *empty_env[] = {NULL};
+
+/* Value of $$, the shell's pid in its children too */
+static pid_t shell_pid = 0;
+
+/* Positional parameters of the running function, $1 is positional[0],
+   no_words outside functions */
+static char *no_words[] = {NULL};
+static char **positional = no_words;
+
+
+/* Function: vars_hash (internal)
+   FNV-1a of the len first bytes of name
+*/
+static unsigned int vars_hash(const char *name, int len)
+{
+	unsigned int h = 2166136261u;
+	int i;
+
+	for (i = 0; i < len; i++)
+	{
+		h = (h ^ (unsigned char) name[i]) * 16777619u;
+	}
+
+	return h;
+}
+
+
+/* Function: vars_intern (internal)
+   Copy name (len bytes) into the arena
+*/
+static const char *vars_intern(const char *name, int len)
+{
+	VARS_CHUNK *chunk;
+	char *copy;
+	size_t size;
+
+	if (arena == NULL || arena->used + len + 1 > arena->size)
+	{
+		size = (len + 1 > VARS_ARENA) ? len + 1 : VARS_ARENA;
+		chunk = malloc(sizeof (VARS_CHUNK) + size);
+		if (chunk == NULL)
+		{
+			return NULL;
+		}
+		chunk->next = arena;
+		chunk->used = 0;
+		chunk->size = size;
+		arena = chunk;
+	}
+	copy = &arena->data[arena->used];
+	memcpy(copy, name, len);
+	copy[len] = '\0';
+	arena->used += len + 1;
+
+	return copy;
+}
+
+
+/* Function: vars_grow (internal)
+   Double the table and reinsert the entries
+   Returns 0, -1 on allocation failure
+*/
+static int vars_grow()
+{
+	VAR **old = slots;
+	unsigned int oldsize = nslots, i, j;
+
+	nslots = (oldsize == 0) ? VARS_SLOTS : 2 * oldsize;
+	slots = calloc(nslots, sizeof (VAR*));
+	if (slots == NULL)
+	{
+		slots = old;
+		nslots = oldsize;
+		return -1;
+	}
+	for (i = 0; i < oldsize; i++)
+	{
+		if (old[i] != NULL)
+		{
+			for (j = old[i]->hash & (nslots - 1); slots[j] != NULL; j = (j + 1) & (nslots - 1))
+			{
+			}
+			slots[j] = old[i];
+		}
+	}
+	free(old);
+
+	return 0;
+}
+
+
+/* Function: vars_lookup (internal)
+   Find the entry of name (len bytes), create it if create is TRUE
+   Returns NULL if there is none or on allocation failure
+*/
+static VAR *vars_lookup(const char *name, int len, int create)
+{
+	unsigned int h = vars_hash(name, len), i;
+	VAR *var;
+
+	if (nslots != 0)
+	{
+		for (i = h & (nslots - 1); slots[i] != NULL; i = (i + 1) & (nslots - 1))
+		{
+			var = slots[i];
+			if (var->hash == h && strncmp(var->name, name, len) == 0 && var->name[len] == '\0')
+			{
+				return var;
+			}
+		}
+	}
+	if (create == FALSE)
+	{
+		return NULL;
+	}
+
+	// keep the load below 70%
+	if ((used + 1) * 10 > nslots * 7)
+	{
+		if (-1 == vars_grow())
+		{
+			return NULL;
+		}
+	}
+	var = calloc(1, sizeof (VAR));
+	if (var == NULL || (var->name = vars_intern(name, len)) == NULL)
+	{
+		free(var);
+		return NULL;
+	}
+	var->hash = h;
+	var->envidx = -1;
+	for (i = h & (nslots - 1); slots[i] != NULL; i = (i + 1) & (nslots - 1))
+	{
+	}
+	slots[i] = var;
+	used++;
+
+	return var;
+}
+
+
+/* Function: vars_env_put (internal)
+   Give var its "NAME=value" string, replacing its old one in place or
+   appending a new entry to envp
+   Returns 0, -1 on allocation failure
+*/
+static int vars_env_put(VAR *var)
+{
+	int nlen = strlen(var->name), vlen = strlen(var->value), cap;
+	char *env, **grow;
+	VAR **growvar;
+
+	env = malloc(nlen + vlen + 2);
+	if (env == NULL)
+	{
+		return -1;
+	}
+	memcpy(env, var->name, nlen);
+	env[nlen] = '=';
+	memcpy(&env[nlen + 1], var->value, vlen + 1);
+
+	if (var->envidx != -1)
+	{
+		envp[var->envidx] = env;
+		free(var->env);
+		var->env = env;
+		return 0;
+	}
+
+	if (envcount + 1 >= envcap)
+	{
+		cap = (envcap < 64) ? 64 : 2 * envcap;
+		grow = realloc(envp, cap * sizeof (char*));
+		if (grow == NULL)
+		{
+			free(env);
+			return -1;
+		}
+		envp = grow;
+		environ = envp;
+		growvar = realloc(envvar, cap * sizeof (VAR*));
+		if (growvar == NULL)
+		{
+			free(env);
+			return -1;
+		}
+		envvar = growvar;
+		envcap = cap;
+	}
+	var->env = env;
+	var->envidx = envcount;
+	envp[envcount] = env;
+	envvar[envcount++] = var;
+	envp[envcount] = NULL;
+
+	return 0;
+}
+
+
+/* Function: vars_env_drop (internal)
+   Remove the environment entry of var, the last entry takes its place
+*/
+static void vars_env_drop(VAR *var)
+{
+	int i = var->envidx;
+
+	if (i == -1)
+	{
+		return;
+	}
+	envcount--;
+	envp[i] = envp[envcount];
+	envvar[i] = envvar[envcount];
+	envvar[i]->envidx = i;
+	envp[envcount] = NULL;
+	free(var->env);
+	var->env = NULL;
+	var->envidx = -1;
+}
+
+
+/* Function: vars_name (internal)
+   Length of the valid name at the start of s: letter or '_', then
+   letters, digits or '_'
+*/
+static int vars_name(const char *s)
+{
+	int i = 0;
+
+	if (!isalpha(s[0]) && s[0] != '_')
+	{
+		return 0;
+	}
+	while (isalnum(s[i]) || s[i] == '_')
+	{
+		i++;
+	}
+
+	return i;
+}
+
+
+/* Function: vars_init
+   Import every NAME=value of envp as an exported variable
+*/
+int vars_init(char **env)
+{
+	const char *eq;
+	VAR *var;
+	int i;
+
+	if (slots == NULL && -1 == vars_grow())
+	{
+		return -1;
+	}
+	shell_pid = getpid();
+	for (i = 0; env != NULL && env[i] != NULL; i++)
+	{
+		eq = strchr(env[i], '=');
+		if (eq == NULL || eq == env[i])
+		{
+			continue;
+		}
+		var = vars_lookup(env[i], eq - env[i], TRUE);
+		if (var == NULL)
+		{
+			return -1;
+		}
+		free(var->value);
+		var->value = strdup(eq + 1);
+		var->exported = TRUE;
+		if (var->value == NULL || -1 == vars_env_put(var))
+		{
+			return -1;
+		}
+	}
+	if (envp == NULL)
+	{
+		// nothing exported yet, environ still needs a terminated array
+		envp = calloc(1, sizeof (char*));
+		envvar = calloc(1, sizeof (VAR*));
+		envcap = 1;
+	}
+	environ = envp;
+
+	return 0;
+}
+
+
+/* Function: vars_get
+   Hash lookup
+*/
+const char *vars_get(const char *name)
+{
+	VAR *var = vars_lookup(name, strlen(name), FALSE);
+
+	return (var != NULL) ? var->value : NULL;
+}
+
+
+/* Function: vars_set
+   Validate the name, vars_put() does the rest
+*/
+int vars_set(const char *name, const char *value, int export)
+{
+	int len = vars_name(name);
+	VAR *var;
+
+	if (len == 0 || name[len] != '\0')
+	{
+#ifdef WARNING
+	printf("-mysh: %s: not a valid identifier\n", name);
+#endif
+		return -1;
+	}
+	var = vars_lookup(name, len, TRUE);
+	if (var == NULL)
+	{
+		return -1;
+	}
+	if (export == TRUE)
+	{
+		var->exported = TRUE;
+	}
+
+	return vars_put(var, value);
+}
+
+
+/* Function: vars_ref
+   Lookup creating the entry
+*/
+VAR *vars_ref(const char *name)
+{
+	int len = vars_name(name);
+
+	if (len == 0 || name[len] != '\0')
+	{
+		return NULL;
+	}
+
+	return vars_lookup(name, len, TRUE);
+}
+
+
+/* Function: vars_put
+   Replace the value, update the environment string when exported. A
+   value is no pattern any more, its GLOB_MARKs are dropped
+*/
+int vars_put(VAR *var, const char *value)
+{
+	char *copy = strdup(value);
+
+	if (copy == NULL)
+	{
+		return -1;
+	}
+	command_unmark(copy);
+	free(var->value);
+	var->value = copy;
+	if (var->exported == TRUE)
+	{
+		return vars_env_put(var);
+	}
+
+	return 0;
+}
+
+
+/* Function: vars_export
+   Flag the variable, add its string if it has a value
+*/
+int vars_export(const char *name)
+{
+	int len = vars_name(name);
+	VAR *var;
+
+	if (len == 0 || name[len] != '\0')
+	{
+#ifdef WARNING
+	printf("-mysh: export: %s: not a valid identifier\n", name);
+#endif
+		return -1;
+	}
+	var = vars_lookup(name, len, TRUE);
+	if (var == NULL)
+	{
+		return -1;
+	}
+	var->exported = TRUE;
+	if (var->value != NULL && var->envidx == -1)
+	{
+		return vars_env_put(var);
+	}
+
+	return 0;
+}
+
+
+/* Function: vars_unset
+   The entry stays in the table without value
+*/
+void vars_unset(const char *name)
+{
+	VAR *var = vars_lookup(name, strlen(name), FALSE);
+
+	if (var == NULL)
+	{
+		return;
+	}
+	vars_env_drop(var);
+	free(var->value);
+	var->value = NULL;
+	var->exported = FALSE;
+}
+
+
+/* Function: vars_assignment
+   NAME=value
+*/
+int vars_assignment(const char *word)
+{
+	int len = vars_name(word);
+
+	return (len > 0 && word[len] == '=') ? len : 0;
+}
+
+
+/* Function: vars_assign
+   Split each word at its '='
+*/
+void vars_assign(char **argv, int n, int export)
+{
+	char name[PATH_MAX];
+	int i, len;
+
+	for (i = 0; i < n; i++)
+	{
+		len = vars_assignment(argv[i]);
+		if (len == 0 || len >= PATH_MAX)
+		{
+			continue;
+		}
+		memcpy(name, argv[i], len);
+		name[len] = '\0';
+		vars_set(name, &argv[i][len + 1], export);
+	}
+}
+
+
+/* Function: vars_append (internal)
+   Append len bytes of s to the growing buffer *buf
+   Returns 0, -1 on allocation failure
+*/
+static int vars_append(char **buf, int *len, int *size, const char *s, int n)
+{
+	char *grow;
+
+	if (*len + n + 1 > *size)
+	{
+		*size = 2 * (*len + n + 1);
+		grow = realloc(*buf, *size);
+		if (grow == NULL)
+		{
+			return -1;
+		}
+		*buf = grow;
+	}
+	memcpy(*buf + *len, s, n);
+	*len += n;
+	(*buf)[*len] = '\0';
+
+	return 0;
+}
+
+
+/* Function: vars_quoted (internal)
+   Append s to the growing buffer *buf with its pattern characters marked
+*/
+static void vars_quoted(char **buf, int *len, int *size, const char *s)
+{
+	char mark[2] = {GLOB_MARK, '\0'};
+	int n;
+
+	while (*s != '\0')
+	{
+		n = strcspn(s, "*?[{");
+		vars_append(buf, len, size, s, n);
+		s += n;
+		if (*s != '\0')
+		{
+			mark[1] = *s++;
+			vars_append(buf, len, size, mark, 2);
+		}
+	}
+}
+
+
+/* Function: vars_word (internal)
+   Expand the variables and command substitutions of one word into a new
+   string, *subst is set TRUE if it held a substitution
+*/
+static char *vars_word(const char *word, int status, int *subst)
+{
+	char *buf = NULL, num[16], *out;
+	const char *p, *value;
+	int len = 0, size = 0, n, i, k, brace;
+	VAR *var;
+
+	for (p = word; *p != '\0'; )
+	{
+		n = strcspn(p, vars_special);
+		vars_append(&buf, &len, &size, p, n);
+		p += n;
+		if (*p == '\0')
+		{
+			break;
+		}
+
+		// a '$' that was in single quotes
+		if (*p == DOLLAR_MARK)
+		{
+			vars_append(&buf, &len, &size, "$", 1);
+			p++;
+			continue;
+		}
+
+		// special parameters $? and $$
+		if (p[1] == '?' || p[1] == '$')
+		{
+			snprintf(num, sizeof num, "%d", (p[1] == '?') ? status : (int) ((shell_pid > 0) ? shell_pid : getpid()));
+			vars_append(&buf, &len, &size, num, strlen(num));
+			p += 2;
+			continue;
+		}
+		// positional parameters $1 ... ${10} ..., $# and $@ (or $*), only
+		// in a function, elsewhere they stay as they are
+		if (positional != no_words && (p[1] == '#' || p[1] == '@' || p[1] == '*'))
+		{
+			for (n = 0; positional[n] != NULL; n++)
+			{
+				if (p[1] != '#')
+				{
+					vars_append(&buf, &len, &size, " ", (n > 0) ? 1 : 0);
+					vars_append(&buf, &len, &size, positional[n], strlen(positional[n]));
+				}
+			}
+			if (p[1] == '#')
+			{
+				snprintf(num, sizeof num, "%d", n);
+				vars_append(&buf, &len, &size, num, strlen(num));
+			}
+			*subst |= (p[1] != '#');
+			p += 2;
+			continue;
+		}
+		brace = (p[1] == '{');
+		n = (brace) ? (int) strspn(p + 2, "0123456789") : (isdigit(p[1]) != 0);
+		if (positional != no_words && n > 0 && p[1 + brace] != '0' && (!brace || p[2 + n] == '}'))
+		{
+			for (i = (brace) ? atoi(p + 2) : p[1] - '0', k = 0; k + 1 < i && positional[k] != NULL; k++)
+			{
+			}
+			value = (positional[k] != NULL) ? positional[k] : "";
+			vars_append(&buf, &len, &size, value, strlen(value));
+			p += 1 + n + 2 * brace;
+			continue;
+		}
+		// $(cmd), an unclosed one is kept as it is. The output of one that
+		// was in double quotes is not split and holds no pattern
+		if (p[1] == '(' && (n = cmdsub_length(p)) > 0)
+		{
+			out = cmdsub_run(p + 2, n - 3, status);
+			if (out != NULL && *p == SUBST_MARK)
+			{
+				vars_quoted(&buf, &len, &size, out);
+			}
+			else if (out != NULL)
+			{
+				vars_append(&buf, &len, &size, out, strlen(out));
+			}
+			free(out);
+			*subst |= (*p == '$');
+			p += n;
+			continue;
+		}
+		n = vars_name(p + 1 + brace);
+		if (n == 0 || (brace && p[2 + n] != '}'))
+		{
+			// not a variable, keep the '$'
+			vars_append(&buf, &len, &size, "$", 1);
+			p++;
+			continue;
+		}
+		var = vars_lookup(p + 1 + brace, n, FALSE);
+		value = (var != NULL && var->value != NULL) ? var->value : "";
+		vars_append(&buf, &len, &size, value, strlen(value));
+		p += 1 + n + 2 * brace;
+	}
+	if (buf == NULL)
+	{
+		buf = strdup("");
+	}
+
+	return buf;
+}
+
+
+/* Function: vars_push (internal)
+   Append word to *expanded (n used of *size, room kept for the NULL)
+   Returns 0, -1 on allocation failure
+*/
+static int vars_push(char *word, char ***expanded, int *n, int *size)
+{
+	char **grow;
+
+	if (*n + 1 == *size)
+	{
+		grow = realloc(*expanded, 2 * *size * sizeof (char*));
+		if (grow == NULL)
+		{
+			return -1;
+		}
+		*expanded = grow;
+		*size *= 2;
+	}
+	(*expanded)[(*n)++] = word;
+
+	return 0;
+}
+
+
+/* Function: vars_split (internal)
+   Append the blank separated words of word to *expanded, word is freed
+*/
+static void vars_split(char *word, char ***expanded, int *n, int *size)
+{
+	char *p = word, *piece;
+	int len;
+
+	while (*p != '\0')
+	{
+		p += strspn(p, " \t\n");
+		len = strcspn(p, " \t\n");
+		if (len == 0)
+		{
+			break;
+		}
+		piece = strndup(p, len);
+		if (piece == NULL || -1 == vars_push(piece, expanded, n, size))
+		{
+			free(piece);
+			break;
+		}
+		p += len;
+	}
+	free(word);
+}
+
+
+/* Function: vars_expand
+   Words without '$' (or a quoted one) are shared with argv. A word with a command
+   substitution outside double quotes is split at blanks unless it is an
+   assignment
+*/
+char **vars_expand(char **argv, int status)
+{
+	char **expanded, *word;
+	int i, n, k = 0, size, any = FALSE, subst;
+
+	for (n = 0; argv[n] != NULL; n++)
+	{
+		if (strpbrk(argv[n], vars_special) != NULL)
+		{
+			any = TRUE;
+		}
+	}
+	if (any == FALSE)
+	{
+		return argv;
+	}
+	size = n + 1;
+	expanded = malloc(size * sizeof (char*));
+	if (expanded == NULL)
+	{
+		return argv;
+	}
+	for (i = 0; i < n; i++)
+	{
+		subst = FALSE;
+		word = (strpbrk(argv[i], vars_special) != NULL) ? vars_word(argv[i], status, &subst) : argv[i];
+		if (word == NULL)
+		{
+			word = argv[i];
+		}
+		if (subst == TRUE && vars_assignment(argv[i]) == 0)
+		{
+			vars_split(word, &expanded, &k, &size);
+			continue;
+		}
+		if (-1 == vars_push(word, &expanded, &k, &size) && word != argv[i])
+		{
+			free(word);
+		}
+	}
+	expanded[k] = NULL;
+
+	return expanded;
+}
+
+
+/* Function: vars_expand_free
+   Free the words that were expanded, then the array
+*/
+void vars_expand_free(char **expanded, char **argv)
+{
+	int i, j;
+
+	if (expanded == argv)
+	{
+		return;
+	}
+	for (i = 0; expanded[i] != NULL; i++)
+	{
+		for (j = 0; argv[j] != NULL && argv[j] != expanded[i]; j++)
+		{
+		}
+		if (argv[j] == NULL)
+		{
+			free(expanded[i]);
+		}
+	}
+	free(expanded);
+}
+
+
+/* Function: vars_positional
+   NULL leaves the function, $1 ... are kept as they are again
+*/
+char **vars_positional(char **argv)
+{
+	char **old = positional;
+
+	positional = (argv != NULL) ? argv : no_words;
+	return old;
+}
+
+
+/* Function: vars_envp
+   The managed array, also in environ
+*/
+char **vars_envp()
+{
+	return (envp != NULL) ? envp : empty_env;
+}
+
+
+/* Function: vars_print
+   Table order
+*/
+void vars_print(int all)
+{
+	unsigned int i;
+
+	for (i = 0; i < nslots; i++)
+	{
+		if (slots[i] == NULL || slots[i]->value == NULL || (all == FALSE && slots[i]->exported == FALSE))
+		{
+			continue;
+		}
+		printf("%s%s=%s\n", (all == FALSE) ? "export " : "", slots[i]->name, slots[i]->value);
+	}
+}
+
+
+/* Function: vars_free
+   Entries, table, environment and arena
+*/
+void vars_free()
+{
+	VARS_CHUNK *chunk;
+	unsigned int i;
+
+	environ = empty_env;
+	for (i = 0; i < nslots; i++)
+	{
+		if (slots[i] != NULL)
+		{
+			free(slots[i]->value);
+			free(slots[i]->env);
+			free(slots[i]);
+		}
+	}
+	free(slots);
+	free(envp);
+	free(envvar);
+	while (arena != NULL)
+	{
+		chunk = arena->next;
+		free(arena);
+		arena = chunk;
+	}
+	slots = NULL;
+	nslots = used = 0;
+	envp = NULL;
+	envvar = NULL;
+	envcount = envcap = 0;
+}
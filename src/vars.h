@@ -0,0 +1,157 @@
+/*
+	VARS is the store of shell variables and of the environment given to
+	jobs. Variables live in an open addressing hash table (linear probing,
+	power of two size); names are interned in an arena when a variable is
+	first set and entries are never moved or removed, an unset variable
+	only loses its value, so a VAR pointer stays valid for the life of the
+	shell.
+
+	Exported variables own a "NAME=value" string in the envp array, and
+	environ points at that array: setting an exported variable replaces its
+	string in place, exporting appends one and unsetting moves the last one
+	into the hole. Spawning a job never rebuilds the environment; the child
+	gets the array through fork() (copy-on-write) and exec uses it as is.
+	Per-command assignments ("VAR=x cmd") are applied by the child to its
+	own copy.
+
+	Expansion handles $NAME, ${NAME}, $? (status of the last pipeline), $$
+	(pid of the shell), $(cmd) (see cmdsub.h) and the positional parameters
+	of a shell function, $1 ... ${10} ..., $# and $@ (split into words like
+	a substitution; outside functions they are left as they are), in
+	command words.
+*/
+
+#ifndef _VARS_H_
+#define _VARS_H_
+
+#include "include.h"
+
+/* Initial table size, a power of two */
+#define VARS_SLOTS 256
+
+/* Size of an arena chunk for interned names */
+#define VARS_ARENA 4096
+
+
+/* Typedef: VAR
+   One variable. name is interned, value NULL once unset, env the
+   "NAME=value" string at envp[envidx] while exported (envidx -1 otherwise)
+*/
+typedef struct var {
+	const char *name;
+	unsigned int hash;
+	char *value;
+	char *env;
+	int exported;
+	int envidx;
+} VAR;
+
+
+/* Function: vars_init
+   Create the store and import envp (normally environ), every entry
+   exported, then point environ to the managed array
+   Returns 0, -1 on allocation failure
+*/
+int vars_init(char **envp);
+
+
+/* Function: vars_get
+   Returns the value of name, NULL if it is not set
+*/
+const char *vars_get(const char *name);
+
+
+/* Function: vars_set
+   Set name to value. export TRUE exports the variable, FALSE keeps its
+   export flag as it is
+   Returns 0, -1 if name is not a valid name or on allocation failure
+*/
+int vars_set(const char *name, const char *value, int export);
+
+
+/* Function: vars_ref
+   Entry of name, created without a value if there is none yet; it stays
+   valid for the life of the shell, so a caller may keep it instead of
+   looking the name up each time
+   Returns NULL if name is not a valid name or on allocation failure
+*/
+VAR *vars_ref(const char *name);
+
+
+/* Function: vars_put
+   Set the variable var (from vars_ref()) to value, its export flag is
+   kept
+   Returns 0, -1 on allocation failure
+*/
+int vars_put(VAR *var, const char *value);
+
+
+/* Function: vars_export
+   Mark name as exported, it enters the environment once it has a value
+   Returns 0, -1 if name is not a valid name
+*/
+int vars_export(const char *name);
+
+
+/* Function: vars_unset
+   Remove the value of name and its environment entry
+*/
+void vars_unset(const char *name);
+
+
+/* Function: vars_assignment
+   Returns the length of the name if word is NAME=value, 0 otherwise
+*/
+int vars_assignment(const char *word);
+
+
+/* Function: vars_assign
+   Apply the n assignment words of argv, export as in vars_set()
+*/
+void vars_assign(char **argv, int n, int export);
+
+
+/* Function: vars_expand
+   Expand the variables and command substitutions of argv, status is the
+   value of $?. The output of a substitution is split into words at blanks
+   except in an assignment or in double quotes (SUBST_MARK), where its
+   pattern characters are marked (GLOB_MARK) instead
+   Returns argv itself when no word holds a '$' (or a DOLLAR_MARK, a '$'
+   quoted in the line, which becomes '$', or a SUBST_MARK), else a new
+   NULL terminated array to be released with vars_expand_free()
+*/
+char **vars_expand(char **argv, int status);
+
+
+/* Function: vars_expand_free
+   Free an array returned by vars_expand() for argv
+*/
+void vars_expand_free(char **expanded, char **argv);
+
+
+/* Function: vars_positional
+   Make the words of argv (NULL terminated, not copied) $1, $2 ..., $#
+   and $@, NULL when no function runs
+   Returns the previous words, to be set back once argv goes away
+*/
+char **vars_positional(char **argv);
+
+
+/* Function: vars_envp
+   Returns the environment array of the exported variables
+*/
+char **vars_envp();
+
+
+/* Function: vars_print
+   Print exported variables as "export NAME=value", all with all TRUE
+*/
+void vars_print(int all);
+
+
+/* Function: vars_free
+   Deallocate the store, environ is left empty
+*/
+void vars_free();
+
+#endif /* _VARS_H_ */
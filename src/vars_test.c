@@ -0,0 +1,317 @@
+#include "vars.h"
+#include "parser.h"
+
+extern char **environ;
+
+/* prototypes */
+void test_init();
+void test_set();
+void test_env();
+void test_expand();
+void test_quoted();
+void test_bench(int count);
+void test_destroy();
+
+
+/* Function: env_find (helper)
+   Index of "name=" in envp, -1 if missing
+*/
+int env_find(char **envp, const char *name)
+{
+	int i, len = strlen(name);
+
+	for (i = 0; envp[i] != NULL; i++)
+	{
+		if (strncmp(envp[i], name, len) == 0 && envp[i][len] == '=')
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+/* Function: test_init
+   The environment is imported and environ replaced
+*/
+void test_init()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: VARS Initialized\n");
+#endif
+
+	char *env[] = {"HOME=/home/test", "PATH=/bin:/usr/bin", "EMPTY=", "=bad", "noequal", NULL};
+
+	assert(vars_init(env) == 0);
+	assert(environ == vars_envp());
+	assert(strcmp(vars_get("HOME"), "/home/test") == 0);
+	assert(strcmp(getenv("PATH"), "/bin:/usr/bin") == 0);
+	assert(strcmp(vars_get("EMPTY"), "") == 0);
+	assert(vars_get("noequal") == NULL);
+	assert(env_find(environ, "HOME") != -1);
+	assert(environ[3] == NULL);
+}
+
+
+/* Function: test_set
+   Shell variables, names and unset
+*/
+void test_set()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: VARS set/unset\n");
+#endif
+
+	char *words[] = {"A=1", "B_2=x=y", "3C=no", "echo", NULL};
+
+	assert(vars_set("LOCAL", "one", FALSE) == 0);
+	assert(strcmp(vars_get("LOCAL"), "one") == 0);
+	assert(getenv("LOCAL") == NULL);
+	assert(vars_set("LOCAL", "two", FALSE) == 0);
+	assert(strcmp(vars_get("LOCAL"), "two") == 0);
+	assert(vars_set("1BAD", "x", FALSE) == -1);
+	assert(vars_set("BAD-NAME", "x", FALSE) == -1);
+
+	assert(vars_assignment(words[0]) == 1);
+	assert(vars_assignment(words[1]) == 3);
+	assert(vars_assignment(words[2]) == 0);
+	assert(vars_assignment(words[3]) == 0);
+	vars_assign(words, 2, FALSE);
+	assert(strcmp(vars_get("A"), "1") == 0);
+	assert(strcmp(vars_get("B_2"), "x=y") == 0);
+
+	vars_unset("LOCAL");
+	assert(vars_get("LOCAL") == NULL);
+	vars_unset("NEVER_SET");
+	assert(vars_set("LOCAL", "three", FALSE) == 0);
+	assert(strcmp(vars_get("LOCAL"), "three") == 0);
+}
+
+
+/* Function: test_env
+   Exported entries are replaced in place, other entries are untouched
+*/
+void test_env()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: VARS environment\n");
+#endif
+
+	char *home, path[64];
+	int n;
+
+	home = environ[env_find(environ, "HOME")];
+	assert(vars_export("LOCAL") == 0);
+	assert(strcmp(getenv("LOCAL"), "three") == 0);
+	assert(vars_set("PATH", "/opt/bin", FALSE) == 0);
+	assert(strcmp(getenv("PATH"), "/opt/bin") == 0);
+	// an update does not touch the other strings
+	assert(environ[env_find(environ, "HOME")] == home);
+
+	assert(vars_export("LATER") == 0);
+	assert(getenv("LATER") == NULL);
+	assert(vars_set("LATER", "now", FALSE) == 0);
+	assert(strcmp(getenv("LATER"), "now") == 0);
+
+	for (n = 0; environ[n] != NULL; n++)
+	{
+	}
+	snprintf(path, sizeof path, "%s", environ[n-1]);
+	*strchr(path, '=') = '\0';
+	vars_unset("HOME");
+	assert(getenv("HOME") == NULL);
+	assert(environ[n-1] == NULL);
+	// the last entry moved into the hole
+	assert(strcmp(path, "HOME") == 0 || env_find(environ, path) != -1);
+	assert(vars_export("bad name") == -1);
+}
+
+
+/* Function: test_expand
+   $NAME, ${NAME}, $?, $$ and words without variables
+*/
+void test_expand()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: VARS expand\n");
+#endif
+
+	char *plain[] = {"ls", "-l", NULL};
+	char *words[] = {"echo", "$A", "${B_2}x", "$Ax", "pre$?post", "$", "cost$5", "${A", "$NONE.", "keep", NULL};
+	char **out, pid[16];
+
+	assert(vars_expand(plain, 0) == plain);
+	vars_expand_free(plain, plain);
+
+	out = vars_expand(words, 3);
+	assert(out != words);
+	assert(out[0] == words[0] && out[9] == words[9]);
+	assert(strcmp(out[1], "1") == 0);
+	assert(strcmp(out[2], "x=yx") == 0);
+	assert(strcmp(out[3], "") == 0);
+	assert(strcmp(out[4], "pre3post") == 0);
+	assert(strcmp(out[5], "$") == 0);
+	assert(strcmp(out[6], "cost$5") == 0);
+	assert(strcmp(out[7], "${A") == 0);
+	assert(strcmp(out[8], ".") == 0);
+	assert(out[10] == NULL);
+	vars_expand_free(out, words);
+
+	char *dollar[] = {"$$", NULL};
+	out = vars_expand(dollar, 0);
+	snprintf(pid, sizeof pid, "%d", (int) getpid());
+	assert(strcmp(out[0], pid) == 0);
+	vars_expand_free(out, dollar);
+}
+
+
+/* Function: test_quoted
+   Assignments and words of a parsed line with quoted blanks and '$'
+*/
+void test_quoted()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: VARS quoted words\n");
+#endif
+
+	COMMAND *cmd = command_parse("X=\"hello world\" Y='$X is' Z=\"$A  b\" echo \"$X\" '$X'\n");
+	char **out;
+
+	assert(cmd != NULL && cmd->next == NULL);
+	out = vars_expand(cmd->argv, 0);
+	assert(strcmp(out[0], "X=hello world") == 0);
+	vars_assign(out, 1, FALSE);
+	assert(strcmp(vars_get("X"), "hello world") == 0);
+	vars_expand_free(out, cmd->argv);
+
+	out = vars_expand(cmd->argv, 0);
+	vars_assign(out, 3, FALSE);
+	assert(strcmp(vars_get("Y"), "$X is") == 0);
+	assert(strcmp(vars_get("Z"), "1  b") == 0);
+	assert(strcmp(out[3], "echo") == 0);
+	assert(strcmp(out[4], "hello world") == 0);
+	assert(strcmp(out[5], "$X") == 0);
+	assert(out[6] == NULL);
+	vars_expand_free(out, cmd->argv);
+	command_free(cmd);
+
+	// a substitution in double quotes is one word, its output no pattern
+	cmd = command_parse("echo \"$(echo 'x   y')\" $(echo 'p   q') \"$(echo '*')\"\n");
+	assert(cmd != NULL);
+	out = vars_expand(cmd->argv, 0);
+	assert(strcmp(out[1], "x   y") == 0);
+	assert(strcmp(out[2], "p") == 0 && strcmp(out[3], "q") == 0);
+	assert(strcmp(out[4], "\003*") == 0 && out[5] == NULL);
+	vars_expand_free(out, cmd->argv);
+	command_free(cmd);
+	vars_unset("X");
+	vars_unset("Y");
+	vars_unset("Z");
+}
+
+
+/* Function: test_bench
+   Spawn with count exported variables: updating one between spawns
+   costs the same as not touching the environment
+*/
+void test_bench(int count)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: VARS %d exported variables\n", count);
+#endif
+
+	struct timespec start, end;
+	char name[32], value[32], *argv[] = {"true", NULL};
+	long set_ns, spawn_ns;
+	int i, pid, status, runs = 200;
+
+	assert(vars_set("PATH", "/bin:/usr/bin", FALSE) == 0);
+	for (i = 0; i < count; i++)
+	{
+		snprintf(name, sizeof name, "BENCH_%d", i);
+		snprintf(value, sizeof value, "value_%d", i);
+		assert(vars_set(name, value, TRUE) == 0);
+	}
+	assert(strcmp(getenv("BENCH_4321"), "value_4321") == 0);
+
+	// update one variable 100000 times
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < 100000; i++)
+	{
+		snprintf(value, sizeof value, "%d", i);
+		vars_set("BENCH_17", value, FALSE);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	set_ns = ((end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec)) / 100000;
+
+	// spawn with the environment, changing a variable before each spawn
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < runs; i++)
+	{
+		snprintf(value, sizeof value, "%d", i);
+		vars_set("BENCH_17", value, FALSE);
+		pid = fork();
+		assert(pid != -1);
+		if (pid == 0)
+		{
+			execvp(argv[0], argv);
+			_exit(127);
+		}
+		assert(waitpid(pid, &status, 0) == pid);
+		assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	spawn_ns = ((end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec)) / runs;
+
+#ifdef DEBUG_TEST
+	printf("TEST: VARS set %ldns, spawn %ldus with %d variables\n", set_ns, spawn_ns / 1000, count);
+#endif
+	// a set must not depend on the size of the environment
+	assert(set_ns < 20000);
+
+	// the child sees the last value
+	pid = fork();
+	if (pid == 0)
+	{
+		_exit(strcmp(getenv("BENCH_17"), value) == 0 && getenv("BENCH_0") != NULL ? 0 : 1);
+	}
+	assert(waitpid(pid, &status, 0) == pid && WEXITSTATUS(status) == 0);
+}
+
+
+/* Function: test_destroy
+   environ is empty afterwards
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: VARS Closed\n");
+#endif
+
+	vars_free();
+	assert(environ[0] == NULL);
+	assert(vars_get("PATH") == NULL);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: VARS Module\n");
+#endif
+
+	test_init();
+	test_set();
+	test_env();
+	test_expand();
+	test_quoted();
+	test_bench(5000);
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: VARS Module\n");
+#endif
+
+	return 0;
+}
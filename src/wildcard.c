@@ -0,0 +1,943 @@
+#include "wildcard.h"
+#include "parser.h"
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+/* Kinds of pattern components */
+#define WILDCARD_LITERAL 0
+#define WILDCARD_PATTERN 1
+#define WILDCARD_RECURSIVE 2
+
+/* A '\' or a GLOB_MARK (a quoted character) takes the next one literally */
+#define WILDCARD_QUOTED(p) ((*(p) == '\\' || *(p) == GLOB_MARK) && (p)[1] != '\0')
+
+
+/* Typedef: WILDCARD_TASK (internal)
+   Directory path (len bytes) still to match from component comp on
+*/
+typedef struct wildcard_task {
+	const char *path;
+	int len;
+	int comp;
+} WILDCARD_TASK;
+
+
+struct wildcard_walk;
+
+/* Typedef: WILDCARD_WORKER (internal)
+   Deque of tasks (head to tail) of one thread, the paths it found and its
+   getdents64() buffer
+*/
+typedef struct wildcard_worker {
+	pthread_mutex_t lock;
+	WILDCARD_TASK *tasks;
+	long head;
+	long tail;
+	long size;
+	WILDCARD out;
+	char *dents;
+	int id;
+	struct wildcard_walk *walk;
+} WILDCARD_WORKER;
+
+
+/* Typedef: WILDCARD_WALK (internal)
+   Components of the pattern and their kinds, pending the number of tasks
+   queued or being visited
+*/
+typedef struct wildcard_walk {
+	char *comp[WILDCARD_DEPTH];
+	int kind[WILDCARD_DEPTH];
+	int ncomp;
+	int dironly;
+	WILDCARD_WORKER *workers;
+	int nworkers;
+	long pending;
+} WILDCARD_WALK;
+
+
+/* Function: wildcard_alloc (internal)
+   len bytes from the arena of wc, NULL on allocation failure
+*/
+static char *wildcard_alloc(WILDCARD *wc, long len)
+{
+	WILDCARD_CHUNK *chunk = wc->arena;
+	long size;
+
+	if (chunk == NULL || chunk->used + len > chunk->size)
+	{
+		size = (len > WILDCARD_ARENA) ? len : WILDCARD_ARENA;
+		chunk = malloc(sizeof (WILDCARD_CHUNK) + size);
+		if (chunk == NULL)
+		{
+			return NULL;
+		}
+		chunk->used = 0;
+		chunk->size = size;
+		chunk->next = wc->arena;
+		wc->arena = chunk;
+	}
+	chunk->used += len;
+
+	return chunk->data + chunk->used - len;
+}
+
+
+/* Function: wildcard_add (internal)
+   Append path to the paths of wc, -1 on allocation failure
+*/
+static int wildcard_add(WILDCARD *wc, char *path)
+{
+	char **grow;
+	long size;
+
+	if (wc->count == wc->size)
+	{
+		size = (wc->size > 0) ? 2 * wc->size : 64;
+		grow = realloc(wc->paths, size * sizeof (char*));
+		if (grow == NULL)
+		{
+			return -1;
+		}
+		wc->paths = grow;
+		wc->size = size;
+	}
+	wc->paths[wc->count++] = path;
+
+	return 0;
+}
+
+
+/* Function: wildcard_magic
+   Unquoted '*', '?', '[', or a '{' followed by ',' and '}', or a
+   GLOB_MARK to drop
+*/
+int wildcard_magic(const char *word)
+{
+	const char *p;
+
+	for (p = word; *p != '\0'; p++)
+	{
+		if (*p == GLOB_MARK)
+		{
+			return TRUE;
+		}
+		else if (WILDCARD_QUOTED(p))
+		{
+			p++;
+		}
+		else if (*p == '*' || *p == '?' || *p == '[')
+		{
+			return TRUE;
+		}
+		else if (*p == '{' && strchr(p, ',') != NULL && strchr(p, '}') != NULL)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/* Function: wildcard_kind (internal)
+   Kind of one pattern component
+*/
+static int wildcard_kind(const char *comp)
+{
+	const char *p;
+
+	if (strcmp(comp, "**") == 0)
+	{
+		return WILDCARD_RECURSIVE;
+	}
+	for (p = comp; *p != '\0'; p++)
+	{
+		if (WILDCARD_QUOTED(p))
+		{
+			p++;
+		}
+		else if (*p == '*' || *p == '?' || *p == '[')
+		{
+			return WILDCARD_PATTERN;
+		}
+	}
+
+	return WILDCARD_LITERAL;
+}
+
+
+/* Function: wildcard_class (internal)
+   Match c against the bracket expression after '[' at p, *matched
+   receives the result
+   Returns the pattern after the closing ']', NULL if there is none
+*/
+static const char *wildcard_class(const char *p, unsigned char c, int *matched)
+{
+	unsigned char lo, hi;
+	int negate = FALSE, found = FALSE, first = TRUE;
+
+	if (*p == '!' || *p == '^')
+	{
+		negate = TRUE;
+		p++;
+	}
+	while (*p != '\0' && (*p != ']' || first))
+	{
+		first = FALSE;
+		if (WILDCARD_QUOTED(p))
+		{
+			p++;
+		}
+		lo = *p++;
+		if (*p == '-' && p[1] != ']' && p[1] != '\0')
+		{
+			p++;
+			if (WILDCARD_QUOTED(p))
+			{
+				p++;
+			}
+			hi = *p++;
+			found |= (lo <= c && c <= hi);
+		}
+		else
+		{
+			found |= (lo == c);
+		}
+	}
+	if (*p != ']')
+	{
+		return NULL;
+	}
+	*matched = (found != negate);
+
+	return p + 1;
+}
+
+
+/* Function: wildcard_match
+   Iterative, back to the last '*' on a mismatch
+*/
+int wildcard_match(const char *pattern, const char *name)
+{
+	const char *p = pattern, *s = name, *star = NULL, *back = NULL, *next;
+	int matched;
+
+	while (*s != '\0')
+	{
+		matched = FALSE;
+		if (*p == '*')
+		{
+			star = ++p;
+			back = s;
+			continue;
+		}
+		else if (*p == '?')
+		{
+			matched = TRUE;
+			p++;
+		}
+		else if (*p == '[' && (next = wildcard_class(p + 1, *s, &matched)) != NULL)
+		{
+			p = (matched == TRUE) ? next : p;
+		}
+		else
+		{
+			if (WILDCARD_QUOTED(p))
+			{
+				p++;
+			}
+			if (*p == *s)
+			{
+				matched = TRUE;
+				p++;
+			}
+		}
+
+		if (matched == TRUE)
+		{
+			s++;
+		}
+		else if (star != NULL)
+		{
+			p = star;
+			s = ++back;
+		}
+		else
+		{
+			return FALSE;
+		}
+	}
+	while (*p == '*')
+	{
+		p++;
+	}
+
+	return (*p == '\0');
+}
+
+
+/* Function: wildcard_push (internal)
+   Queue a task at the back of the deque of w
+*/
+static void wildcard_push(WILDCARD_WORKER *w, const char *path, int len, int comp)
+{
+	WILDCARD_TASK *grow;
+	long size;
+
+	__atomic_add_fetch(&w->walk->pending, 1, __ATOMIC_ACQ_REL);
+	pthread_mutex_lock(&w->lock);
+	if (w->tail == w->size)
+	{
+		if (w->head > 0)
+		{
+			memmove(w->tasks, w->tasks + w->head, (w->tail - w->head) * sizeof (WILDCARD_TASK));
+			w->tail -= w->head;
+			w->head = 0;
+		}
+		else
+		{
+			size = (w->size > 0) ? 2 * w->size : 256;
+			grow = realloc(w->tasks, size * sizeof (WILDCARD_TASK));
+			if (grow == NULL)
+			{
+				pthread_mutex_unlock(&w->lock);
+				__atomic_sub_fetch(&w->walk->pending, 1, __ATOMIC_ACQ_REL);
+				return;
+			}
+			w->tasks = grow;
+			w->size = size;
+		}
+	}
+	w->tasks[w->tail].path = path;
+	w->tasks[w->tail].len = len;
+	w->tasks[w->tail].comp = comp;
+	w->tail++;
+	pthread_mutex_unlock(&w->lock);
+}
+
+
+/* Function: wildcard_take (internal)
+   Take a task from the back of w (own deque) or from its front (steal)
+   Returns TRUE if there was one
+*/
+static int wildcard_take(WILDCARD_WORKER *w, WILDCARD_TASK *task, int steal)
+{
+	int found = FALSE;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->tail > w->head)
+	{
+		*task = (steal == TRUE) ? w->tasks[w->head++] : w->tasks[--w->tail];
+		found = TRUE;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return found;
+}
+
+
+/* Function: wildcard_join (internal)
+   path/name in the arena of w, *joined receives its length
+*/
+static char *wildcard_join(WILDCARD_WORKER *w, const char *path, int len, const char *name, int *joined)
+{
+	int n = strlen(name), sep = (len > 0 && path[len-1] != '/');
+	char *out = wildcard_alloc(&w->out, len + sep + n + 1);
+
+	if (out == NULL)
+	{
+		return NULL;
+	}
+	memcpy(out, path, len);
+	out[len] = '/';
+	memcpy(out + len + sep, name, n + 1);
+	*joined = len + sep + n;
+
+	return out;
+}
+
+
+/* Function: wildcard_emit (internal)
+   Record a path found, with a trailing '/' for a pattern ending in one
+*/
+static void wildcard_emit(WILDCARD_WORKER *w, char *path, int len)
+{
+	char *out = path;
+
+	if (w->walk->dironly == TRUE)
+	{
+		out = wildcard_alloc(&w->out, len + 2);
+		if (out == NULL)
+		{
+			return;
+		}
+		memcpy(out, path, len);
+		strcpy(out + len, "/");
+	}
+	wildcard_add(&w->out, out);
+}
+
+
+/* Function: wildcard_isdir (internal)
+   d_type first, fstatat() for links (when followed) and unknown types
+*/
+static int wildcard_isdir(int fd, struct dirent64 *ent, int follow)
+{
+	struct stat st;
+
+	if (ent->d_type == DT_DIR)
+	{
+		return TRUE;
+	}
+	if (ent->d_type != DT_UNKNOWN && (ent->d_type != DT_LNK || follow == FALSE))
+	{
+		return FALSE;
+	}
+	if (-1 == fstatat(fd, ent->d_name, &st, (follow == TRUE) ? 0 : AT_SYMLINK_NOFOLLOW))
+	{
+		return FALSE;
+	}
+
+	return S_ISDIR(st.st_mode);
+}
+
+
+/* Function: wildcard_visit (internal)
+   Match component task->comp in directory task->path: literal components
+   are joined without reading the directory, matching entries are
+   recorded (last component) or queued with the next component, '**'
+   queues the directory itself with the next component and every
+   subdirectory with '**' again
+*/
+static void wildcard_visit(WILDCARD_WORKER *w, WILDCARD_TASK *task)
+{
+	WILDCARD_WALK *walk = w->walk;
+	struct dirent64 *ent;
+	struct stat st;
+	const char *comp, *name;
+	char *path;
+	long n, off;
+	int k = task->comp, last, fd, len, dir;
+
+	if (k == walk->ncomp)
+	{
+		if (task->len > 0)
+		{
+			wildcard_emit(w, (char*) task->path, task->len);
+		}
+		return;
+	}
+	comp = walk->comp[k];
+	last = (k == walk->ncomp - 1);
+
+	if (walk->kind[k] == WILDCARD_LITERAL)
+	{
+		path = wildcard_join(w, task->path, task->len, comp, &len);
+		if (path == NULL)
+		{
+			return;
+		}
+		if (last == FALSE)
+		{
+			wildcard_push(w, path, len, k + 1);
+		}
+		else if (0 == fstatat(AT_FDCWD, path, &st, (walk->dironly == TRUE) ? 0 : AT_SYMLINK_NOFOLLOW)
+			&& (walk->dironly == FALSE || S_ISDIR(st.st_mode)))
+		{
+			wildcard_emit(w, path, len);
+		}
+		return;
+	}
+
+	if (walk->kind[k] == WILDCARD_RECURSIVE && last == FALSE)
+	{
+		wildcard_push(w, task->path, task->len, k + 1);
+	}
+	fd = open((task->len > 0) ? task->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return;
+	}
+	while ((n = syscall(SYS_getdents64, fd, w->dents, WILDCARD_BATCH)) > 0)
+	{
+		for (off = 0; off < n; off += ent->d_reclen)
+		{
+			ent = (struct dirent64*) (w->dents + off);
+			name = ent->d_name;
+			if (name[0] == '.' && (comp[0] != '.' || name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			{
+				continue;
+			}
+
+			if (walk->kind[k] == WILDCARD_RECURSIVE)
+			{
+				dir = wildcard_isdir(fd, ent, FALSE);
+				if (dir == FALSE && last == FALSE)
+				{
+					continue;
+				}
+				path = wildcard_join(w, task->path, task->len, name, &len);
+				if (path == NULL)
+				{
+					continue;
+				}
+				if (last == TRUE && (walk->dironly == FALSE || dir == TRUE))
+				{
+					wildcard_emit(w, path, len);
+				}
+				if (dir == TRUE)
+				{
+					wildcard_push(w, path, len, k);
+				}
+				continue;
+			}
+
+			if (wildcard_match(comp, name) == FALSE)
+			{
+				continue;
+			}
+			if (last == FALSE || walk->dironly == TRUE)
+			{
+				if (wildcard_isdir(fd, ent, TRUE) == FALSE)
+				{
+					continue;
+				}
+			}
+			path = wildcard_join(w, task->path, task->len, name, &len);
+			if (path == NULL)
+			{
+				continue;
+			}
+			if (last == TRUE)
+			{
+				wildcard_emit(w, path, len);
+			}
+			else
+			{
+				wildcard_push(w, path, len, k + 1);
+			}
+		}
+	}
+	close(fd);
+}
+
+
+/* Function: wildcard_work (internal)
+   Thread body: own tasks first, then steal from the other workers; done
+   when no task is queued or being visited anywhere
+*/
+static void *wildcard_work(void *arg)
+{
+	WILDCARD_WORKER *self = arg;
+	WILDCARD_WALK *walk = self->walk;
+	WILDCARD_TASK task;
+	int i, found;
+
+	while (TRUE)
+	{
+		found = wildcard_take(self, &task, FALSE);
+		for (i = 1; found == FALSE && i < walk->nworkers; i++)
+		{
+			found = wildcard_take(&walk->workers[(self->id + i) % walk->nworkers], &task, TRUE);
+		}
+		if (found == TRUE)
+		{
+			wildcard_visit(self, &task);
+			__atomic_sub_fetch(&walk->pending, 1, __ATOMIC_ACQ_REL);
+		}
+		else if (__atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) == 0)
+		{
+			break;
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Function: wildcard_compare (internal)
+   qsort order of paths
+*/
+static int wildcard_compare(const void *a, const void *b)
+{
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+
+/* Function: wildcard_unquote (internal)
+   Remove the '\' quoting characters of s in place
+*/
+static void wildcard_unquote(char *s)
+{
+	char *out = s;
+
+	for (; *s != '\0'; s++)
+	{
+		if (WILDCARD_QUOTED(s))
+		{
+			s++;
+		}
+		*out++ = *s;
+	}
+	*out = '\0';
+}
+
+
+/* Function: wildcard_glob
+   The calling thread is worker 0, the others are started for '**' only
+   and run with all signals blocked
+*/
+long wildcard_glob(const char *pattern, WILDCARD *wc)
+{
+	WILDCARD_WALK walk;
+	WILDCARD_WORKER *w;
+	WILDCARD_CHUNK *tail;
+	pthread_t threads[WILDCARD_THREADS];
+	sigset_t all, old;
+	char *copy, *comp, *save;
+	long start = wc->count, len = strlen(pattern), i, j, cpus;
+	int recursive = FALSE, started = 0;
+
+	memset(&walk, 0, sizeof walk);
+	copy = wildcard_alloc(wc, len + 1);
+	if (copy == NULL || len == 0)
+	{
+		return 0;
+	}
+	strcpy(copy, pattern);
+	walk.dironly = (pattern[len-1] == '/');
+	for (comp = strtok_r(copy, "/", &save); comp != NULL; comp = strtok_r(NULL, "/", &save))
+	{
+		if (walk.ncomp == WILDCARD_DEPTH)
+		{
+			return 0;
+		}
+		walk.kind[walk.ncomp] = wildcard_kind(comp);
+		if (walk.kind[walk.ncomp] == WILDCARD_LITERAL)
+		{
+			wildcard_unquote(comp);
+		}
+		recursive |= (walk.kind[walk.ncomp] == WILDCARD_RECURSIVE);
+		walk.comp[walk.ncomp++] = comp;
+	}
+	if (walk.ncomp == 0)
+	{
+		return 0;
+	}
+
+	walk.nworkers = 1;
+	if (recursive == TRUE)
+	{
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		walk.nworkers = (cpus > WILDCARD_THREADS) ? WILDCARD_THREADS : (cpus > 1) ? cpus : 1;
+	}
+	walk.workers = calloc(walk.nworkers, sizeof (WILDCARD_WORKER));
+	if (walk.workers == NULL)
+	{
+		return 0;
+	}
+	for (i = 0; i < walk.nworkers; i++)
+	{
+		w = &walk.workers[i];
+		pthread_mutex_init(&w->lock, NULL);
+		w->id = i;
+		w->walk = &walk;
+		w->dents = malloc(WILDCARD_BATCH);
+		if (w->dents == NULL)
+		{
+			walk.nworkers = i;
+			break;
+		}
+	}
+	if (walk.nworkers == 0)
+	{
+		free(walk.workers);
+		return 0;
+	}
+
+	wildcard_push(&walk.workers[0], (pattern[0] == '/') ? "/" : "", (pattern[0] == '/') ? 1 : 0, 0);
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (started = 1; started < walk.nworkers; started++)
+	{
+		if (0 != pthread_create(&threads[started], NULL, wildcard_work, &walk.workers[started]))
+		{
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	wildcard_work(&walk.workers[0]);
+	for (i = 1; i < started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	// hand paths and arenas of the workers to wc
+	for (i = 0; i < walk.nworkers; i++)
+	{
+		w = &walk.workers[i];
+		for (j = 0; j < w->out.count; j++)
+		{
+			wildcard_add(wc, w->out.paths[j]);
+		}
+		if (w->out.arena != NULL)
+		{
+			for (tail = w->out.arena; tail->next != NULL; tail = tail->next)
+			{
+			}
+			tail->next = wc->arena;
+			wc->arena = w->out.arena;
+		}
+		free(w->out.paths);
+		free(w->tasks);
+		free(w->dents);
+		pthread_mutex_destroy(&w->lock);
+	}
+	free(walk.workers);
+
+	if (wc->count == start)
+	{
+		return 0;
+	}
+	qsort(wc->paths + start, wc->count - start, sizeof (char*), wildcard_compare);
+	for (i = j = start; i < wc->count; i++)
+	{
+		if (j == start || strcmp(wc->paths[j-1], wc->paths[i]) != 0)
+		{
+			wc->paths[j++] = wc->paths[i];
+		}
+	}
+	wc->count = j;
+
+	return wc->count - start;
+}
+
+
+/* Function: wildcard_braces (internal)
+   Expand the first brace expression of word and recurse on each result,
+   words without one are appended to list
+*/
+static void wildcard_braces(char *word, WILDCARD *wc, char **list, int *n)
+{
+	char *open, *close = NULL, *alt, *p, *out;
+	int depth, comma = FALSE, plen, slen, len;
+
+	for (open = word; *open != '\0'; open++)
+	{
+		if (WILDCARD_QUOTED(open))
+		{
+			open++;
+			continue;
+		}
+		if (*open != '{')
+		{
+			continue;
+		}
+		depth = 0;
+		comma = FALSE;
+		for (close = open; *close != '\0'; close++)
+		{
+			if (WILDCARD_QUOTED(close))
+			{
+				close++;
+			}
+			else if (*close == '{')
+			{
+				depth++;
+			}
+			else if (*close == '}' && --depth == 0)
+			{
+				break;
+			}
+			else if (*close == ',' && depth == 1)
+			{
+				comma = TRUE;
+			}
+		}
+		if (*close == '}' && comma == TRUE)
+		{
+			break;
+		}
+	}
+	if (*open == '\0')
+	{
+		if (*n < WILDCARD_BRACES)
+		{
+			list[(*n)++] = word;
+		}
+		return;
+	}
+
+	plen = open - word;
+	slen = strlen(close + 1);
+	depth = 0;
+	for (alt = p = open + 1; p <= close && *n < WILDCARD_BRACES; p++)
+	{
+		if ((*p == '\\' || *p == GLOB_MARK) && p + 1 < close)
+		{
+			p++;
+		}
+		else if (*p == '{')
+		{
+			depth++;
+		}
+		else if (*p == '}' && depth > 0)
+		{
+			depth--;
+		}
+		else if ((*p == ',' && depth == 0) || p == close)
+		{
+			len = p - alt;
+			out = wildcard_alloc(wc, plen + len + slen + 1);
+			if (out == NULL)
+			{
+				return;
+			}
+			memcpy(out, word, plen);
+			memcpy(out + plen, alt, len);
+			memcpy(out + plen + len, close + 1, slen + 1);
+			wildcard_braces(out, wc, list, n);
+			alt = p + 1;
+		}
+	}
+}
+
+
+/* Function: wildcard_word (internal)
+   Append word to expanded, n used of *size, -1 on allocation failure
+*/
+static int wildcard_word(char ***expanded, long *n, long *size, char *word)
+{
+	char **grow;
+
+	if (*n + 1 == *size)
+	{
+		grow = realloc(*expanded, 2 * *size * sizeof (char*));
+		if (grow == NULL)
+		{
+			return -1;
+		}
+		*expanded = grow;
+		*size *= 2;
+	}
+	(*expanded)[(*n)++] = word;
+
+	return 0;
+}
+
+
+/* Function: wildcard_plain (internal)
+   word without its GLOB_MARKs, a copy in the arena of wc if it has any
+*/
+static char *wildcard_plain(char *word, WILDCARD *wc)
+{
+	char *copy;
+
+	if (strchr(word, GLOB_MARK) == NULL)
+	{
+		return word;
+	}
+	copy = wildcard_alloc(wc, strlen(word) + 1);
+	if (copy == NULL)
+	{
+		return word;
+	}
+	strcpy(copy, word);
+	command_unmark(copy);
+
+	return copy;
+}
+
+
+/* Function: wildcard_expand
+   Brace results keep their order, the paths of each pattern are sorted
+*/
+char **wildcard_expand(char **argv, WILDCARD *wc)
+{
+	char **expanded, *list[WILDCARD_BRACES];
+	long n = 0, size, start, j;
+	int i, k, nlist, any = FALSE;
+
+	memset(wc, 0, sizeof (WILDCARD));
+	for (i = 0; argv[i] != NULL; i++)
+	{
+		any |= wildcard_magic(argv[i]);
+	}
+	if (any == FALSE)
+	{
+		return argv;
+	}
+	size = i + 1;
+	expanded = malloc(size * sizeof (char*));
+	if (expanded == NULL)
+	{
+		return argv;
+	}
+
+	for (i = 0; argv[i] != NULL; i++)
+	{
+		nlist = 0;
+		if (wildcard_magic(argv[i]) == TRUE)
+		{
+			wildcard_braces(argv[i], wc, list, &nlist);
+		}
+		else
+		{
+			list[nlist++] = argv[i];
+		}
+		for (k = 0; k < nlist; k++)
+		{
+			start = wc->count;
+			if (wildcard_kind(list[k]) != WILDCARD_LITERAL && wildcard_glob(list[k], wc) > 0)
+			{
+				for (j = start; j < wc->count; j++)
+				{
+					wildcard_word(&expanded, &n, &size, wc->paths[j]);
+				}
+			}
+			else
+			{
+				wildcard_word(&expanded, &n, &size, wildcard_plain(list[k], wc));
+			}
+		}
+	}
+	expanded[n] = NULL;
+
+	return expanded;
+}
+
+
+/* Function: wildcard_expand_free
+   The words belong to argv or to wc
+*/
+void wildcard_expand_free(char **expanded, char **argv, WILDCARD *wc)
+{
+	if (expanded != argv)
+	{
+		free(expanded);
+	}
+	wildcard_free(wc);
+}
+
+
+/* Function: wildcard_free
+   Release every arena chunk
+*/
+void wildcard_free(WILDCARD *wc)
+{
+	WILDCARD_CHUNK *chunk, *next;
+
+	for (chunk = wc->arena; chunk != NULL; chunk = next)
+	{
+		next = chunk->next;
+		free(chunk);
+	}
+	free(wc->paths);
+	memset(wc, 0, sizeof (WILDCARD));
+}
@@ -0,0 +1,110 @@
+/*
+	WILDCARD expands file name patterns in command words: '*', '?', '[...]'
+	(with '!' or '^' to negate and a-z ranges), brace alternatives
+	"{a,b}" and '**', which matches any number of directories. A word
+	matching no file is kept as it is; names starting with '.' are matched
+	only by a pattern component starting with '.'. A character the parser
+	marked as quoted (GLOB_MARK) is matched literally and the mark is
+	dropped from the words returned.
+
+	Directories are read with getdents64() in WILDCARD_BATCH byte batches
+	and d_type tells directories from files, a stat is only needed for
+	symbolic links and file systems that do not fill d_type. '**' does not
+	follow symbolic links.
+
+	The walk is a queue of (directory, pattern component) tasks. A pattern
+	holding '**' is walked by up to WILDCARD_THREADS threads, each popping
+	tasks from the back of its own deque and stealing from the front of
+	the others' when it runs dry. Paths are carved from arenas of
+	WILDCARD_ARENA bytes rather than allocated one by one, the result is a
+	sorted array of pointers into them.
+*/
+
+#ifndef _WILDCARD_H_
+#define _WILDCARD_H_
+
+#include "include.h"
+#include <pthread.h>
+
+/* Size of an arena chunk for paths */
+#define WILDCARD_ARENA 65536
+
+/* Buffer of one getdents64() call */
+#define WILDCARD_BATCH 32768
+
+/* Threads walking a '**' pattern at most */
+#define WILDCARD_THREADS 8
+
+/* Components of a pattern at most */
+#define WILDCARD_DEPTH 64
+
+/* Patterns a word expands to through braces at most */
+#define WILDCARD_BRACES 1024
+
+
+/* Typedef: WILDCARD_CHUNK
+   One arena chunk, used of size bytes taken
+*/
+typedef struct wildcard_chunk {
+	struct wildcard_chunk *next;
+	long used;
+	long size;
+	char data[];
+} WILDCARD_CHUNK;
+
+
+/* Typedef: WILDCARD
+   Paths found (count of size used) and the arena holding them
+*/
+typedef struct wildcard {
+	char **paths;
+	long count;
+	long size;
+	WILDCARD_CHUNK *arena;
+} WILDCARD;
+
+
+/* Function: wildcard_magic
+   Returns TRUE if word holds a pattern, a brace expression or a quoted
+   pattern character (GLOB_MARK) to drop
+*/
+int wildcard_magic(const char *word);
+
+
+/* Function: wildcard_match
+   Match name against one pattern component ('*', '?', '[...]', '\' or
+   a GLOB_MARK to quote)
+   Returns TRUE if it matches
+*/
+int wildcard_match(const char *pattern, const char *name);
+
+
+/* Function: wildcard_glob
+   Append the paths matching pattern ('*', '?', '[...]', '**', no braces)
+   to wc, sorted and without duplicates. wc starts zeroed
+   Returns the number of paths appended
+*/
+long wildcard_glob(const char *pattern, WILDCARD *wc);
+
+
+/* Function: wildcard_expand
+   Expand braces and patterns in argv, wc (not initialized) receives the
+   paths and the words copied without their GLOB_MARKs
+   Returns argv itself when no word needs it, else a new NULL terminated
+   array to be released with wildcard_expand_free()
+*/
+char **wildcard_expand(char **argv, WILDCARD *wc);
+
+
+/* Function: wildcard_expand_free
+   Free an array returned by wildcard_expand() and the paths of wc
+*/
+void wildcard_expand_free(char **expanded, char **argv, WILDCARD *wc);
+
+
+/* Function: wildcard_free
+   Deallocate the paths and arena of wc, leave it zeroed
+*/
+void wildcard_free(WILDCARD *wc);
+
+#endif /* _WILDCARD_H_ */
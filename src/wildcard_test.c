@@ -0,0 +1,277 @@
+#include "wildcard.h"
+
+/* Directory the tests run in */
+static char tree[] = "/tmp/wildcard_test.XXXXXX";
+
+/* prototypes */
+void test_match();
+void test_glob();
+void test_expand();
+void test_bench(int dirs, int files);
+void test_destroy();
+
+
+/* Function: touch (helper)
+   Create an empty file
+*/
+void touch(const char *path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	assert(fd != -1);
+	close(fd);
+}
+
+
+/* Function: glob_is (helper)
+   Glob pattern and compare with the expected paths, in order
+*/
+void glob_is(const char *pattern, const char **expected)
+{
+	WILDCARD wc;
+	long i;
+
+	memset(&wc, 0, sizeof wc);
+	wildcard_glob(pattern, &wc);
+	for (i = 0; expected[i] != NULL; i++)
+	{
+		assert(i < wc.count);
+		assert(strcmp(wc.paths[i], expected[i]) == 0);
+	}
+	assert(wc.count == i);
+	wildcard_free(&wc);
+}
+
+
+/* Function: test_match
+   Components: '*', '?', classes, ranges and quoting
+*/
+void test_match()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: WILDCARD match\n");
+#endif
+
+	assert(wildcard_match("*", "anything") == TRUE);
+	assert(wildcard_match("*.log", "a.log") == TRUE);
+	assert(wildcard_match("*.log", "a.log.gz") == FALSE);
+	assert(wildcard_match("a*b*c", "aXbYbZc") == TRUE);
+	assert(wildcard_match("a*b*c", "aXbYbZ") == FALSE);
+	assert(wildcard_match("?.c", "x.c") == TRUE);
+	assert(wildcard_match("?.c", "xy.c") == FALSE);
+	assert(wildcard_match("[abc]1", "b1") == TRUE);
+	assert(wildcard_match("[!abc]1", "b1") == FALSE);
+	assert(wildcard_match("[^abc]1", "d1") == TRUE);
+	assert(wildcard_match("file[0-9].txt", "file7.txt") == TRUE);
+	assert(wildcard_match("file[0-9].txt", "filex.txt") == FALSE);
+	assert(wildcard_match("[]]x", "]x") == TRUE);
+	assert(wildcard_match("[a-]", "-") == TRUE);
+	assert(wildcard_match("[ab", "[ab") == TRUE);
+	assert(wildcard_match("\\*x", "*x") == TRUE);
+	assert(wildcard_match("\\*x", "ax") == FALSE);
+	assert(wildcard_match("**", "") == TRUE);
+
+	assert(wildcard_magic("plain") == FALSE);
+	assert(wildcard_magic("a\\*b") == FALSE);
+	assert(wildcard_magic("a*b") == TRUE);
+	assert(wildcard_magic("{a,b}") == TRUE);
+	assert(wildcard_magic("{}") == FALSE);
+}
+
+
+/* Function: test_glob
+   Sorted results, hidden names, directories, '**' and absolute patterns
+*/
+void test_glob()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: WILDCARD glob\n");
+#endif
+
+	char path[PATH_MAX], pattern[PATH_MAX];
+	const char *logs[] = {"a.log", "b.log", NULL};
+	const char *hidden[] = {".hidden.log", NULL};
+	const char *single[] = {"c.txt", NULL};
+	const char *notb[] = {"a.log", NULL};
+	const char *dirs[] = {"dir1/", "dir2/", "link/", NULL};
+	const char *nested[] = {"dir1/x.log", "dir2/z.log", "link/x.log", NULL};
+	const char *deep[] = {"a.log", "b.log", "dir1/sub/y.log", "dir1/x.log", "dir2/z.log", NULL};
+	const char *under[] = {"dir1/sub/y.log", "dir1/x.log", NULL};
+	const char *all[] = {"dir1/", "dir1/sub/", "dir2/", "link/", NULL};
+	const char *none[] = {NULL};
+	const char *absolute[2] = {path, NULL};
+
+	assert(mkdtemp(tree) != NULL);
+	assert(chdir(tree) == 0);
+	touch("a.log");
+	touch("b.log");
+	touch("c.txt");
+	touch(".hidden.log");
+	assert(mkdir("dir1", 0755) == 0);
+	assert(mkdir("dir1/sub", 0755) == 0);
+	assert(mkdir("dir2", 0755) == 0);
+	assert(mkdir("dir2/.h", 0755) == 0);
+	touch("dir1/x.log");
+	touch("dir1/sub/y.log");
+	touch("dir2/z.log");
+	touch("dir2/.h/w.log");
+	assert(symlink("dir1", "link") == 0);
+
+	glob_is("*.log", logs);
+	glob_is(".*", hidden);
+	glob_is("?.txt", single);
+	glob_is("[!b].log", notb);
+	glob_is("*/", dirs);
+	glob_is("*/*.log", nested);
+	glob_is("**/*.log", deep);
+	glob_is("dir1/**/*.log", under);
+	glob_is("**/*/", all);
+	glob_is("*.none", none);
+	glob_is("nodir/*.log", none);
+	glob_is("dir1/x.log", under + 1);
+
+	snprintf(path, sizeof path, "%s/c.txt", tree);
+	snprintf(pattern, sizeof pattern, "%s/?.t[xy]t", tree);
+	glob_is(path, absolute);
+	glob_is(pattern, absolute);
+}
+
+
+/* Function: test_expand
+   Braces keep their order, patterns without match are kept
+*/
+void test_expand()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: WILDCARD expand\n");
+#endif
+
+	char *plain[] = {"ls", "-l", NULL};
+	char *words[] = {"echo", "{a,b}.log", "*.none", "x{1,2{3,4}}", "{c,a}.*", "{x}", NULL};
+	const char *expected[] = {"echo", "a.log", "b.log", "*.none", "x1", "x23", "x24", "c.txt", "a.log", "{x}", NULL};
+	WILDCARD wc;
+	char **out;
+	int i;
+
+	out = wildcard_expand(plain, &wc);
+	assert(out == plain);
+	wildcard_expand_free(out, plain, &wc);
+
+	out = wildcard_expand(words, &wc);
+	assert(out != words);
+	assert(out[0] == words[0]);
+	for (i = 0; expected[i] != NULL; i++)
+	{
+		assert(out[i] != NULL);
+		assert(strcmp(out[i], expected[i]) == 0);
+	}
+	assert(out[i] == NULL);
+	wildcard_expand_free(out, words, &wc);
+	assert(wc.arena == NULL && wc.paths == NULL);
+
+	// quoted pattern characters are literal, the words lose their marks
+	char *quoted[] = {"rm", "\003*.log", "\003{a,b}.log", "a\003?log", "\003[ab].log", "[ab]\003*", NULL};
+	const char *literal[] = {"rm", "*.log", "{a,b}.log", "a?log", "[ab].log", "[ab]*", NULL};
+	out = wildcard_expand(quoted, &wc);
+	for (i = 0; literal[i] != NULL; i++)
+	{
+		assert(out[i] != NULL);
+		assert(strcmp(out[i], literal[i]) == 0);
+	}
+	assert(out[i] == NULL);
+	wildcard_expand_free(out, quoted, &wc);
+}
+
+
+/* Function: test_bench
+   '**' over dirs directories of files each against find | sort
+*/
+void test_bench(int dirs, int files)
+{
+#ifdef DEBUG_TEST
+	printf("TEST: WILDCARD ** over %d files\n", dirs * files);
+#endif
+
+	struct timespec start, end;
+	char path[64];
+	long glob_us, find_us, count;
+	int i, j;
+	WILDCARD wc;
+	FILE *fp;
+
+	assert(mkdir("bench", 0755) == 0);
+	for (i = 0; i < dirs; i++)
+	{
+		snprintf(path, sizeof path, "bench/d%d", i % 16);
+		mkdir(path, 0755);
+		snprintf(path, sizeof path, "bench/d%d/s%d", i % 16, i);
+		assert(mkdir(path, 0755) == 0);
+		for (j = 0; j < files; j++)
+		{
+			snprintf(path, sizeof path, "bench/d%d/s%d/f%d.%s", i % 16, i, j, (j % 2) ? "log" : "dat");
+			touch(path);
+		}
+	}
+
+	memset(&wc, 0, sizeof wc);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	count = wildcard_glob("bench/**/*.log", &wc);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	glob_us = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+	assert(count == (long) dirs * (files / 2));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fp = popen("find bench -name '*.log' | LC_ALL=C sort", "r");
+	assert(fp != NULL);
+	for (i = 0; fgets(path, sizeof path, fp) != NULL; i++)
+	{
+		*strchr(path, '\n') = '\0';
+		assert(i < count && strcmp(path, wc.paths[i]) == 0);
+	}
+	pclose(fp);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	find_us = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+	assert(i == count);
+	wildcard_free(&wc);
+
+#ifdef DEBUG_TEST
+	printf("TEST: WILDCARD %ld matches: glob %ld us, find | sort %ld us\n", count, glob_us, find_us);
+#endif
+}
+
+
+/* Function: test_destroy
+   Remove the tree
+*/
+void test_destroy()
+{
+#ifdef DEBUG_TEST
+	printf("TEST: WILDCARD Destroy\n");
+#endif
+
+	char cmd[64];
+
+	assert(chdir("/") == 0);
+	snprintf(cmd, sizeof cmd, "rm -rf %s", tree);
+	assert(system(cmd) == 0);
+}
+
+
+int main()
+{
+#ifdef DEBUG_TEST
+	printf("Begin Unittest: WILDCARD Module\n");
+#endif
+
+	test_match();
+	test_glob();
+	test_expand();
+	test_bench(64, 100);
+	test_destroy();
+
+#ifdef DEBUG_TEST
+	printf("End Unittest: WILDCARD Module\n");
+#endif
+
+	return 0;
+}